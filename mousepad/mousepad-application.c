@@ -21,6 +21,7 @@
 #include "mousepad-plugin-provider.h"
 #include "mousepad-prefs-dialog.h"
 #include "mousepad-replace-dialog.h"
+#include "mousepad-search.h"
 #include "mousepad-settings.h"
 #include "mousepad-util.h"
 #include "mousepad-window.h"
@@ -664,6 +665,7 @@ mousepad_application_set_accels (MousepadApplication *application)
     { "win.search.find-next", "<Control>G" },
     { "win.search.find-previous", "<Control><Shift>G" },
     { "win.search.find-and-replace", "<Control>R" },
+    { "win.search.find-in-files", "<Control><Shift>F" },
     { "win.search.go-to", "<Control>L" },
 
     /* "View" menu */
@@ -1233,6 +1235,10 @@ mousepad_application_shutdown (GApplication *gapplication)
       g_free (filename);
     }
 
+  /* release the charset converters and the compiled regexes kept for reuse */
+  mousepad_encoding_clear_converters ();
+  mousepad_search_clear_regex_cache ();
+
   /* finalize mousepad settings */
   mousepad_settings_finalize ();
 
@@ -28,6 +28,7 @@ G_BEGIN_DECLS
 #define MOUSEPAD_MESSAGE_IO_ERROR_OPEN _("Failed to open the document")
 #define MOUSEPAD_MESSAGE_IO_ERROR_SAVE _("Failed to save the document")
 #define MOUSEPAD_MESSAGE_UNSUPPORTED_ENCODING _("Unsupported character set")
+#define MOUSEPAD_MESSAGE_SAVE_PENDING _("The document is already being saved")
 
 /* button labels */
 #define MOUSEPAD_LABEL_CANCEL _("_Cancel")
@@ -18,6 +18,7 @@
 #include "mousepad-close-button.h"
 #include "mousepad-document.h"
 #include "mousepad-marshal.h"
+#include "mousepad-search.h"
 #include "mousepad-settings.h"
 #include "mousepad-util.h"
 #include "mousepad-view.h"
@@ -25,6 +26,11 @@
 
 
 
+/* delay before counting the matches again after the buffer was modified */
+#define SEARCH_REFRESH_DELAY 250
+
+
+
 static void
 mousepad_document_finalize (GObject *object);
 static gboolean
@@ -48,6 +54,10 @@ static void
 mousepad_document_location_changed (MousepadDocument *document,
                                     GFile *file);
 static void
+mousepad_document_large_file_changed (MousepadDocument *document,
+                                      gboolean large,
+                                      MousepadFile *file);
+static void
 mousepad_document_style_label (MousepadDocument *document);
 static void
 mousepad_document_tab_button_clicked (GtkWidget *widget,
@@ -61,6 +71,31 @@ mousepad_document_emit_search_signal (MousepadDocument *document,
                                       GParamSpec *pspec,
                                       GtkSourceSearchContext *search_context);
 static void
+mousepad_document_highlight_matches (MousepadDocument *document);
+static void
+mousepad_document_style_match_tag (MousepadDocument *document);
+static void
+mousepad_document_raise_match_tag (MousepadDocument *document,
+                                   GtkTextTag *tag,
+                                   GtkTextTagTable *table);
+static void
+mousepad_document_apply_tag (MousepadDocument *document,
+                             GtkTextTag *tag,
+                             GtkTextIter *start,
+                             GtkTextIter *end,
+                             GtkTextBuffer *buffer);
+static void
+mousepad_document_insert_text (MousepadDocument *document,
+                               GtkTextIter *location,
+                               const gchar *text,
+                               gint len);
+static void
+mousepad_document_delete_range (MousepadDocument *document,
+                                GtkTextIter *start,
+                                GtkTextIter *end);
+static gboolean
+mousepad_document_get_highlight_all (MousepadDocument *document);
+static void
 mousepad_document_search_widget_visible (MousepadDocument *document,
                                          GParamSpec *pspec,
                                          MousepadWindow *window);
@@ -96,11 +131,34 @@ struct _MousepadDocumentPrivate
   gchar *utf8_basename;
 
   /* search related */
-  GtkSourceSearchContext *search_context, *selection_context;
-  GtkSourceBuffer *selection_buffer;
+  GtkSourceSearchContext *search_context;
+  GCancellable *search_cancellable;
   gint prev_search_state;
   guint search_id;
   gint cur_match;
+
+  /* searches in the whole document, run by the search engine on a snapshot of the buffer,
+   * and the resulting index of the matches, kept up to date as the buffer is modified */
+  GBytes *snapshot;
+  GCancellable *engine_cancellable;
+  gchar *engine_string;
+  MousepadSearchIndex *index;
+  guint refresh_id;
+
+  /* searches in the selection, also run by the search engine, only to count the matches */
+  GCancellable *selection_cancellable;
+
+  /* replace-all operations, the area being given as character offsets, and the number
+   * of buffer edits, to detect that the buffer was modified during an operation */
+  GCancellable *replace_cancellable;
+  gint replace_start, replace_end;
+  guint edit_stamp;
+
+  /* highlight of the indexed matches around the visible area */
+  GtkTextTag *match_tag;
+  GtkTextMark *highlight_start, *highlight_end;
+  guint highlight_id;
+  gboolean highlighting;
 };
 
 
@@ -232,6 +290,8 @@ mousepad_document_init (MousepadDocument *document)
 {
   GtkTargetList *target_list;
   GtkSourceSearchSettings *search_settings;
+  GtkAdjustment *vadjustment;
+  GtkTextIter iter;
 
   /* we will complete initialization when the document is anchored */
   g_signal_connect (document, "hierarchy-changed",
@@ -244,8 +304,6 @@ mousepad_document_init (MousepadDocument *document)
   document->priv->utf8_filename = NULL;
   document->priv->utf8_basename = NULL;
   document->priv->label = NULL;
-  document->priv->selection_context = NULL;
-  document->priv->selection_buffer = NULL;
   document->priv->prev_search_state = INIT;
 
   /* setup the scrolled window */
@@ -258,12 +316,38 @@ mousepad_document_init (MousepadDocument *document)
   /* create a textbuffer and associated search context */
   document->buffer = GTK_TEXT_BUFFER (gtk_source_buffer_new (NULL));
   document->priv->search_context = gtk_source_search_context_new (GTK_SOURCE_BUFFER (document->buffer), NULL);
+  document->priv->search_cancellable = NULL;
   document->priv->search_id = 0;
   document->priv->cur_match = 0;
+  document->priv->snapshot = NULL;
+  document->priv->engine_cancellable = NULL;
+  document->priv->engine_string = NULL;
+  document->priv->index = NULL;
+  document->priv->refresh_id = 0;
+  document->priv->replace_cancellable = NULL;
+  document->priv->edit_stamp = 0;
+  document->priv->highlight_id = 0;
+  document->priv->highlighting = FALSE;
+
+  /* matches are highlighted from the search engine index, not by the search context */
+  gtk_source_search_context_set_highlight (document->priv->search_context, FALSE);
+  document->priv->match_tag = gtk_text_buffer_create_tag (document->buffer, NULL, NULL);
+  gtk_text_buffer_get_start_iter (document->buffer, &iter);
+  document->priv->highlight_start = gtk_text_buffer_create_mark (document->buffer, NULL, &iter, TRUE);
+  document->priv->highlight_end = gtk_text_buffer_create_mark (document->buffer, NULL, &iter, FALSE);
+  mousepad_document_style_match_tag (document);
+  g_signal_connect_object (document->buffer, "notify::style-scheme",
+                           G_CALLBACK (mousepad_document_style_match_tag),
+                           document, G_CONNECT_SWAPPED);
+  g_signal_connect_object (gtk_text_buffer_get_tag_table (document->buffer), "tag-added",
+                           G_CALLBACK (mousepad_document_raise_match_tag),
+                           document, G_CONNECT_SWAPPED);
+  g_signal_connect_object (document->buffer, "apply-tag",
+                           G_CALLBACK (mousepad_document_apply_tag),
+                           document, G_CONNECT_SWAPPED);
 
-  /* bind search settings to Mousepad settings, except "regex-enabled" to prevent prohibitive
-   * computation times in some situations (see
-   * mousepad_document_prevent_endless_scanning() below) */
+  /* bind search settings to Mousepad settings, "regex-enabled" being bound only when the
+   * search widget is visible (see mousepad_document_search_widget_visible() below) */
   search_settings = gtk_source_search_context_get_settings (document->priv->search_context);
   MOUSEPAD_SETTING_BIND (SEARCH_WRAP_AROUND, search_settings,
                          "wrap-around", G_SETTINGS_BIND_GET);
@@ -276,16 +360,35 @@ mousepad_document_init (MousepadDocument *document)
   g_signal_connect_swapped (document->priv->search_context, "notify::occurrences-count",
                             G_CALLBACK (mousepad_document_emit_search_signal), document);
 
+  /* keep the search engine index up to date */
+  g_signal_connect_object (document->buffer, "insert-text",
+                           G_CALLBACK (mousepad_document_insert_text),
+                           document, G_CONNECT_SWAPPED | G_CONNECT_AFTER);
+  g_signal_connect_object (document->buffer, "delete-range",
+                           G_CALLBACK (mousepad_document_delete_range),
+                           document, G_CONNECT_SWAPPED | G_CONNECT_AFTER);
+
   /* initialize the file */
   document->file = mousepad_file_new (document->buffer);
   g_signal_connect_swapped (document->file, "location-changed",
                             G_CALLBACK (mousepad_document_location_changed), document);
+  g_signal_connect_swapped (document->file, "large-file-changed",
+                            G_CALLBACK (mousepad_document_large_file_changed), document);
 
   /* setup the textview */
   document->textview = g_object_new (MOUSEPAD_TYPE_VIEW, "buffer", document->buffer, NULL);
   gtk_container_add (GTK_CONTAINER (document), GTK_WIDGET (document->textview));
   gtk_widget_show (GTK_WIDGET (document->textview));
 
+  /* highlight the matches around the visible area as it changes */
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (document));
+  g_signal_connect_object (vadjustment, "value-changed",
+                           G_CALLBACK (mousepad_document_highlight_matches),
+                           document, G_CONNECT_SWAPPED);
+  g_signal_connect_object (vadjustment, "changed",
+                           G_CALLBACK (mousepad_document_highlight_matches),
+                           document, G_CONNECT_SWAPPED);
+
   /* also allow dropping of uris and tabs in the textview */
   target_list = gtk_drag_dest_get_target_list (GTK_WIDGET (document->textview));
   gtk_target_list_add_table (target_list, drop_targets, G_N_ELEMENTS (drop_targets));
@@ -326,14 +429,40 @@ mousepad_document_finalize (GObject *object)
   g_object_unref (document->file);
 
   /* search related */
-  g_object_unref (document->priv->search_context);
-  g_object_unref (document->buffer);
-  if (document->priv->selection_buffer != NULL)
+  if (document->priv->search_cancellable != NULL)
     {
-      g_object_unref (document->priv->selection_context);
-      g_object_unref (document->priv->selection_buffer);
+      g_cancellable_cancel (document->priv->search_cancellable);
+      g_object_unref (document->priv->search_cancellable);
     }
 
+  if (document->priv->engine_cancellable != NULL)
+    {
+      g_cancellable_cancel (document->priv->engine_cancellable);
+      g_object_unref (document->priv->engine_cancellable);
+    }
+
+  if (document->priv->selection_cancellable != NULL)
+    {
+      g_cancellable_cancel (document->priv->selection_cancellable);
+      g_object_unref (document->priv->selection_cancellable);
+    }
+
+  if (document->priv->replace_cancellable != NULL)
+    {
+      g_cancellable_cancel (document->priv->replace_cancellable);
+      g_object_unref (document->priv->replace_cancellable);
+    }
+
+  if (document->priv->snapshot != NULL)
+    g_bytes_unref (document->priv->snapshot);
+
+  if (document->priv->index != NULL)
+    mousepad_search_index_free (document->priv->index);
+
+  g_free (document->priv->engine_string);
+  g_object_unref (document->priv->search_context);
+  g_object_unref (document->buffer);
+
   G_OBJECT_CLASS (mousepad_document_parent_class)->finalize (object);
 }
 
@@ -510,6 +639,23 @@ mousepad_document_location_changed (MousepadDocument *document,
 
 
 
+static void
+mousepad_document_large_file_changed (MousepadDocument *document,
+                                      gboolean large,
+                                      MousepadFile *file)
+{
+  MousepadLargeFileFeatures features;
+
+  /* turn the view features off or on again */
+  features = mousepad_file_get_disabled_features (file);
+  mousepad_view_set_disabled_features (document->textview, features);
+
+  /* same for search highlight */
+  mousepad_document_highlight_matches (document);
+}
+
+
+
 static void
 mousepad_document_style_label (MousepadDocument *document)
 {
@@ -657,10 +803,8 @@ mousepad_document_search_completed_idle (gpointer data)
   MousepadSearchFlags flags;
   GtkSourceSearchContext *search_context;
   GtkSourceSearchSettings *search_settings;
-  GtkTextBuffer *selection_buffer;
   GtkTextIter *start, *end;
   GtkTextIter iter;
-  gchar *selected_text;
   const gchar *string, *replace;
   gboolean found;
 
@@ -680,8 +824,7 @@ mousepad_document_search_completed_idle (gpointer data)
     gtk_text_buffer_get_selection_bounds (document->buffer, NULL, &iter);
 
   /* handle the action */
-  if (found && (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT)
-      && !(flags & MOUSEPAD_SEARCH_FLAGS_AREA_SELECTION))
+  if (found && (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT))
     {
       gtk_text_buffer_select_range (document->buffer, start, end);
       document->priv->cur_match = gtk_source_search_context_get_occurrence_position (search_context, start, end);
@@ -704,29 +847,12 @@ mousepad_document_search_completed_idle (gpointer data)
         }
       else if (flags & MOUSEPAD_SEARCH_FLAGS_ENTIRE_AREA)
         {
-          /* replace all occurrences in the buffer in use */
+          /* replace all occurrences in the buffer */
           gtk_source_search_context_replace_all (search_context, replace, -1, NULL);
-
-          if (flags & MOUSEPAD_SEARCH_FLAGS_AREA_SELECTION)
-            {
-              /* get the text in the virtual selection buffer */
-              selection_buffer = GTK_TEXT_BUFFER (gtk_source_search_context_get_buffer (search_context));
-              gtk_text_buffer_get_bounds (selection_buffer, start, end);
-              selected_text = gtk_text_buffer_get_text (selection_buffer, start, end, FALSE);
-
-              /* replace selection in the real buffer by the text in the virtual selection buffer */
-              gtk_text_buffer_get_selection_bounds (document->buffer, start, end);
-              gtk_text_buffer_begin_user_action (document->buffer);
-              gtk_text_buffer_delete (document->buffer, start, end);
-              gtk_text_buffer_insert (document->buffer, start, selected_text, -1);
-              gtk_text_buffer_end_user_action (document->buffer);
-              g_free (selected_text);
-            }
         }
     }
   /* deselect previous result when the new search fails or the search field is reset */
-  else if (!(flags & MOUSEPAD_SEARCH_FLAGS_ACTION_NONE)
-           && !(flags & MOUSEPAD_SEARCH_FLAGS_AREA_SELECTION))
+  else if (!(flags & MOUSEPAD_SEARCH_FLAGS_ACTION_NONE))
     gtk_text_buffer_place_cursor (document->buffer, &iter);
   /* if e.g. a silent search fails by modifying the search entry this must be reset */
   else
@@ -826,6 +952,635 @@ mousepad_document_search_completed (GObject *object,
 
 
 
+/* returns the snapshot of the buffer, taken if needed and kept until the buffer is modified,
+ * and the byte range in it of the text between 'start' and 'end' */
+static GBytes *
+mousepad_document_get_snapshot (MousepadDocument *document,
+                                const GtkTextIter *start,
+                                const GtkTextIter *end,
+                                gsize *byte_start,
+                                gsize *byte_end)
+{
+  GtkTextIter iter, end_iter;
+  const gchar *text, *p;
+  gchar *slice;
+  gsize size;
+
+  if (document->priv->snapshot == NULL)
+    {
+      gtk_text_buffer_get_bounds (document->buffer, &iter, &end_iter);
+      slice = gtk_text_buffer_get_slice (document->buffer, &iter, &end_iter, TRUE);
+      document->priv->snapshot = g_bytes_new_take (slice, strlen (slice));
+    }
+
+  /* the snapshot contains a character per buffer offset, see gtk_text_buffer_get_slice() */
+  text = g_bytes_get_data (document->priv->snapshot, &size);
+  p = g_utf8_offset_to_pointer (text, gtk_text_iter_get_offset (start));
+  *byte_start = p - text;
+  if (gtk_text_iter_is_end (end))
+    *byte_end = size;
+  else
+    *byte_end = g_utf8_offset_to_pointer (p, gtk_text_iter_get_offset (end)
+                                             - gtk_text_iter_get_offset (start)) - text;
+
+  return document->priv->snapshot;
+}
+
+
+
+static void
+mousepad_document_engine_search_cancel (MousepadDocument *document)
+{
+  if (document->priv->engine_cancellable != NULL)
+    {
+      g_cancellable_cancel (document->priv->engine_cancellable);
+      g_clear_object (&document->priv->engine_cancellable);
+    }
+
+  g_clear_pointer (&document->priv->index, mousepad_search_index_free);
+}
+
+
+
+static gboolean
+mousepad_document_engine_search_refresh (gpointer data)
+{
+  MousepadDocument *document = data;
+  MousepadSearchFlags flags;
+  gchar *string;
+
+  /* count the matches again, without moving the selection */
+  flags = GPOINTER_TO_INT (mousepad_object_get_data (document->priv->search_context, "flags"));
+  flags = (flags & ~(MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT | MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE
+                     | MOUSEPAD_SEARCH_FLAGS_TOO_EXPENSIVE))
+          | MOUSEPAD_SEARCH_FLAGS_ACTION_NONE;
+  string = g_strdup (document->priv->engine_string);
+  mousepad_document_search (document, string, NULL, flags);
+  g_free (string);
+
+  document->priv->refresh_id = 0;
+
+  return FALSE;
+}
+
+
+
+static gboolean
+mousepad_document_highlight_matches_idle (gpointer data)
+{
+  MousepadDocument *document = data;
+  MousepadSearchMatch *match;
+  GtkTextIter start, end;
+  GdkRectangle rect;
+  GArray *matches;
+  gboolean highlight;
+  guint n;
+
+  document->priv->highlight_id = 0;
+  highlight = document->priv->prev_search_state == VISIBLE
+              && mousepad_document_get_highlight_all (document);
+
+  /* keep the current highlight until the search engine is done */
+  if (highlight && document->priv->engine_string != NULL && document->priv->index == NULL)
+    return FALSE;
+
+  /* clear the previous highlight */
+  gtk_text_buffer_get_iter_at_mark (document->buffer, &start, document->priv->highlight_start);
+  gtk_text_buffer_get_iter_at_mark (document->buffer, &end, document->priv->highlight_end);
+  gtk_text_buffer_remove_tag (document->buffer, document->priv->match_tag, &start, &end);
+  gtk_text_buffer_move_mark (document->buffer, document->priv->highlight_end, &start);
+
+  if (!highlight || document->priv->index == NULL)
+    return FALSE;
+
+  /* highlight the matches in the visible area, plus a page above and below */
+  gtk_text_view_get_visible_rect (GTK_TEXT_VIEW (document->textview), &rect);
+  gtk_text_view_get_line_at_y (GTK_TEXT_VIEW (document->textview), &start,
+                               rect.y - rect.height, NULL);
+  gtk_text_view_get_line_at_y (GTK_TEXT_VIEW (document->textview), &end,
+                               rect.y + 2 * rect.height, NULL);
+  if (!gtk_text_iter_ends_line (&end))
+    gtk_text_iter_forward_to_line_end (&end);
+
+  matches = mousepad_search_index_get_range (document->priv->index, gtk_text_iter_get_offset (&start),
+                                             gtk_text_iter_get_offset (&end));
+  if (matches->len > 0)
+    {
+      match = &g_array_index (matches, MousepadSearchMatch, 0);
+      gtk_text_buffer_get_iter_at_offset (document->buffer, &start,
+                                          MIN (match->start, gtk_text_iter_get_offset (&start)));
+      match = &g_array_index (matches, MousepadSearchMatch, matches->len - 1);
+      gtk_text_buffer_get_iter_at_offset (document->buffer, &end,
+                                          MAX (match->end, gtk_text_iter_get_offset (&end)));
+    }
+
+  gtk_text_buffer_move_mark (document->buffer, document->priv->highlight_start, &start);
+  gtk_text_buffer_move_mark (document->buffer, document->priv->highlight_end, &end);
+
+  document->priv->highlighting = TRUE;
+  for (n = 0; n < matches->len; n++)
+    {
+      match = &g_array_index (matches, MousepadSearchMatch, n);
+      gtk_text_buffer_get_iter_at_offset (document->buffer, &start, match->start);
+      gtk_text_buffer_get_iter_at_offset (document->buffer, &end, match->end);
+      gtk_text_buffer_apply_tag (document->buffer, document->priv->match_tag, &start, &end);
+    }
+
+  document->priv->highlighting = FALSE;
+
+  g_array_unref (matches);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_document_highlight_matches (MousepadDocument *document)
+{
+  if (document->priv->highlight_id == 0)
+    document->priv->highlight_id = g_idle_add (mousepad_document_highlight_matches_idle,
+                                               mousepad_util_source_autoremove (document));
+}
+
+
+
+static void
+mousepad_document_style_match_tag (MousepadDocument *document)
+{
+  GtkSourceStyleScheme *scheme;
+  GtkSourceStyle *style = NULL;
+
+  /* use the same style as the search context would */
+  scheme = gtk_source_buffer_get_style_scheme (GTK_SOURCE_BUFFER (document->buffer));
+  if (scheme != NULL)
+    style = gtk_source_style_scheme_get_style (scheme, "search-match");
+
+  gtk_source_style_apply (style, document->priv->match_tag);
+  if (style == NULL)
+    g_object_set (document->priv->match_tag, "background", "yellow", NULL);
+}
+
+
+
+static void
+mousepad_document_raise_match_tag (MousepadDocument *document,
+                                   GtkTextTag *tag,
+                                   GtkTextTagTable *table)
+{
+  /* keep the match tag above the syntax highlighting tags */
+  if (tag != document->priv->match_tag)
+    gtk_text_tag_set_priority (document->priv->match_tag, gtk_text_tag_table_get_size (table) - 1);
+}
+
+
+
+static void
+mousepad_document_apply_tag (MousepadDocument *document,
+                             GtkTextTag *tag,
+                             GtkTextIter *start,
+                             GtkTextIter *end,
+                             GtkTextBuffer *buffer)
+{
+  /* the match tag would be copied with text pasted or dropped from this buffer, outside of
+   * the highlighted area, and would never be removed */
+  if (tag == document->priv->match_tag && !document->priv->highlighting)
+    g_signal_stop_emission_by_name (buffer, "apply-tag");
+}
+
+
+
+static void
+mousepad_document_buffer_edited (MousepadDocument *document,
+                                 gint offset)
+{
+  gint delta;
+
+  /* the snapshot is outdated */
+  document->priv->edit_stamp++;
+  g_clear_pointer (&document->priv->snapshot, g_bytes_unref);
+  if (document->priv->engine_string == NULL)
+    return;
+
+  if (document->priv->prev_search_state == VISIBLE)
+    {
+      /* update the index by rescanning the lines around the edit, if possible */
+      if (document->priv->index != NULL && document->priv->refresh_id == 0)
+        {
+          delta = gtk_text_buffer_get_char_count (document->buffer)
+                  - mousepad_search_index_get_n_chars (document->priv->index);
+          if (mousepad_search_index_update (document->priv->index, document->buffer, offset,
+                                            MAX (-delta, 0), MAX (delta, 0)))
+            {
+              mousepad_document_emit_search_signal (document, NULL, document->priv->search_context);
+              mousepad_document_highlight_matches (document);
+              return;
+            }
+        }
+
+      /* otherwise search again when the user pauses */
+      mousepad_document_engine_search_cancel (document);
+      if (document->priv->refresh_id != 0)
+        g_source_remove (document->priv->refresh_id);
+
+      document->priv->refresh_id = g_timeout_add (SEARCH_REFRESH_DELAY,
+                                                  mousepad_document_engine_search_refresh,
+                                                  mousepad_util_source_autoremove (document));
+    }
+  /* forget the search otherwise */
+  else
+    {
+      mousepad_document_engine_search_cancel (document);
+      g_clear_pointer (&document->priv->engine_string, g_free);
+      if (document->priv->refresh_id != 0)
+        {
+          g_source_remove (document->priv->refresh_id);
+          document->priv->refresh_id = 0;
+        }
+    }
+}
+
+
+
+static void
+mousepad_document_insert_text (MousepadDocument *document,
+                               GtkTextIter *location,
+                               const gchar *text,
+                               gint len)
+{
+  /* 'location' has been moved to the end of the inserted text */
+  mousepad_document_buffer_edited (document, gtk_text_iter_get_offset (location)
+                                               - g_utf8_strlen (text, len));
+}
+
+
+
+static void
+mousepad_document_delete_range (MousepadDocument *document,
+                                GtkTextIter *start,
+                                GtkTextIter *end)
+{
+  mousepad_document_buffer_edited (document, gtk_text_iter_get_offset (start));
+}
+
+
+
+static void
+mousepad_document_engine_search_completed (GObject *object,
+                                           GAsyncResult *result,
+                                           gpointer data)
+{
+  MousepadDocument *document = data;
+  MousepadSearchIndex *index;
+  MousepadSearchFlags flags;
+  MousepadSearchMatch match;
+  GtkTextIter iter, start, end;
+  GError *error = NULL;
+  gboolean wrap_around;
+  gint n = -1;
+
+  /* exit if the operation was cancelled or the document removed during the search */
+  index = mousepad_search_finish (result, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)
+      || gtk_widget_get_parent (GTK_WIDGET (document)) == NULL)
+    {
+      if (index != NULL)
+        mousepad_search_index_free (index);
+      else
+        g_error_free (error);
+
+      g_object_unref (document);
+
+      return;
+    }
+
+  g_clear_object (&document->priv->engine_cancellable);
+  document->priv->index = index;
+
+  flags = GPOINTER_TO_INT (mousepad_object_get_data (document->priv->search_context, "flags"));
+  if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_SEL_START)
+    gtk_text_buffer_get_selection_bounds (document->buffer, &iter, NULL);
+  else
+    gtk_text_buffer_get_selection_bounds (document->buffer, NULL, &iter);
+
+  /* an invalid or too expensive regex has no matches */
+  if (index != NULL)
+    {
+      n = mousepad_search_index_find (index, gtk_text_iter_get_offset (&iter),
+                                      flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD);
+      wrap_around = (flags & MOUSEPAD_SEARCH_FLAGS_WRAP_AROUND)
+                    || MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_WRAP_AROUND);
+      if (n == -1 && wrap_around && mousepad_search_index_get_n_matches (index) > 0)
+        n = (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD)
+            ? (gint) mousepad_search_index_get_n_matches (index) - 1 : 0;
+    }
+  else
+    {
+      /* let the search bar tell why there is no match */
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+        mousepad_object_set_data (document->priv->search_context, "flags",
+                                  GINT_TO_POINTER (flags | MOUSEPAD_SEARCH_FLAGS_TOO_EXPENSIVE));
+
+      g_error_free (error);
+    }
+
+  /* handle the action, the same way as mousepad_document_search_completed_idle() */
+  if (n != -1 && (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT))
+    {
+      mousepad_search_index_get_match (index, n, &match);
+      gtk_text_buffer_get_iter_at_offset (document->buffer, &start, match.start);
+      gtk_text_buffer_get_iter_at_offset (document->buffer, &end, match.end);
+      gtk_text_buffer_select_range (document->buffer, &start, &end);
+      document->priv->cur_match = n + 1;
+    }
+  else if (!(flags & MOUSEPAD_SEARCH_FLAGS_ACTION_NONE))
+    gtk_text_buffer_place_cursor (document->buffer, &iter);
+  else
+    document->priv->cur_match = 0;
+
+  mousepad_document_emit_search_signal (document, NULL, document->priv->search_context);
+
+  /* there is nothing to keep up to date for an invalid or too expensive regex */
+  if (index == NULL)
+    g_clear_pointer (&document->priv->engine_string, g_free);
+
+  mousepad_document_highlight_matches (document);
+  g_object_unref (document);
+}
+
+
+
+static void
+mousepad_document_engine_search (MousepadDocument *document,
+                                 const gchar *string,
+                                 MousepadSearchFlags flags,
+                                 MousepadSearchOptions options,
+                                 MousepadSearchIndex *previous)
+{
+  GtkSourceSearchSettings *search_settings;
+  GtkTextIter start, end;
+  GBytes *snapshot;
+  gsize byte_start, byte_end;
+
+  document->priv->engine_string = g_strdup (string);
+  mousepad_object_set_data (document->priv->search_context, "flags", GINT_TO_POINTER (flags));
+
+  /* the search context is not used: don't let it scan the buffer for nothing */
+  search_settings = gtk_source_search_context_get_settings (document->priv->search_context);
+  gtk_source_search_settings_set_search_text (search_settings, NULL);
+
+  /* keep the document alive during the search process */
+  document->priv->engine_cancellable = g_cancellable_new ();
+
+  /* only check the previous matches if the string was extended, e.g. as the user types */
+  if (previous != NULL && mousepad_search_index_can_refine (previous, string, options))
+    {
+      mousepad_search_refine_async (previous, string, options, document->priv->engine_cancellable,
+                                    mousepad_document_engine_search_completed, g_object_ref (document));
+      return;
+    }
+
+  if (previous != NULL)
+    mousepad_search_index_free (previous);
+
+  gtk_text_buffer_get_bounds (document->buffer, &start, &end);
+  snapshot = mousepad_document_get_snapshot (document, &start, &end, &byte_start, &byte_end);
+  mousepad_search_async (snapshot, byte_start, byte_end, string, options,
+                         document->priv->engine_cancellable,
+                         mousepad_document_engine_search_completed, g_object_ref (document));
+}
+
+
+
+static void
+mousepad_document_engine_replace_completed (GObject *object,
+                                            GAsyncResult *result,
+                                            gpointer data)
+{
+  MousepadDocument *document = data;
+  MousepadSearchEdits *edits;
+  MousepadSearchFlags flags;
+  GtkTextIter start, end;
+  GError *error = NULL;
+  const gchar *string, *replace;
+  gint delta;
+
+  /* exit if the operation was superseded or the document was removed in the meantime */
+  edits = mousepad_search_replace_finish (result, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)
+      || gtk_widget_get_parent (GTK_WIDGET (document)) == NULL)
+    {
+      if (edits != NULL)
+        mousepad_search_edits_free (edits);
+      else
+        g_error_free (error);
+
+      g_object_unref (document);
+
+      return;
+    }
+
+  g_clear_object (&document->priv->replace_cancellable);
+
+  /* retrieve the operation data */
+  flags = GPOINTER_TO_INT (mousepad_object_get_data (document, "replace-flags"));
+  string = mousepad_object_get_data (document, "replace-string");
+  replace = mousepad_object_get_data (document, "replace-replacement");
+
+  /* start again if the buffer was modified in the meantime */
+  if (GPOINTER_TO_UINT (mousepad_object_get_data (document, "replace-stamp"))
+      != document->priv->edit_stamp)
+    {
+      if (edits != NULL)
+        mousepad_search_edits_free (edits);
+      else
+        g_error_free (error);
+
+      mousepad_document_search (document, string, replace, flags);
+      g_object_unref (document);
+
+      return;
+    }
+
+  /* a too expensive regex is reported when counting the matches below */
+  if (edits == NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+        g_warning ("%s", error->message);
+
+      g_error_free (error);
+    }
+  else if (edits->edits->len > 0)
+    {
+      /* apply the edits as a single undoable action */
+      gtk_text_buffer_begin_user_action (document->buffer);
+      delta = mousepad_search_edits_apply (edits, document->buffer, document->priv->replace_start);
+
+      /* keep the whole replaced area selected */
+      if (flags & MOUSEPAD_SEARCH_FLAGS_AREA_SELECTION)
+        {
+          gtk_text_buffer_get_iter_at_offset (document->buffer, &start, document->priv->replace_start);
+          gtk_text_buffer_get_iter_at_offset (document->buffer, &end,
+                                              document->priv->replace_end + delta);
+          gtk_text_buffer_select_range (document->buffer, &start, &end);
+        }
+
+      gtk_text_buffer_end_user_action (document->buffer);
+    }
+
+  if (edits != NULL)
+    mousepad_search_edits_free (edits);
+
+  /* count the remaining matches */
+  flags = (flags & ~(MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT | MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE))
+          | MOUSEPAD_SEARCH_FLAGS_ACTION_NONE;
+  document->priv->cur_match = 0;
+  mousepad_document_search (document, string, NULL, flags);
+
+  g_object_unref (document);
+}
+
+
+
+static void
+mousepad_document_engine_replace (MousepadDocument *document,
+                                  const gchar *string,
+                                  const gchar *replace,
+                                  MousepadSearchFlags flags,
+                                  MousepadSearchOptions options)
+{
+  GtkTextIter start, end;
+  GBytes *snapshot;
+  gsize byte_start, byte_end;
+
+  /* the buffer is about to be modified, and the previous replacement is superseded */
+  mousepad_document_engine_search_cancel (document);
+  g_clear_pointer (&document->priv->engine_string, g_free);
+  if (document->priv->replace_cancellable != NULL)
+    {
+      g_cancellable_cancel (document->priv->replace_cancellable);
+      g_clear_object (&document->priv->replace_cancellable);
+    }
+
+  /* attach some data for the second stage */
+  mousepad_object_set_data (document, "replace-flags", GINT_TO_POINTER (flags));
+  mousepad_object_set_data (document, "replace-stamp", GUINT_TO_POINTER (document->priv->edit_stamp));
+  mousepad_object_set_data_full (document, "replace-string", g_strdup (string), g_free);
+  mousepad_object_set_data_full (document, "replace-replacement", g_strdup (replace), g_free);
+
+  /* replace in the selection or in the whole buffer, using its snapshot */
+  if (flags & MOUSEPAD_SEARCH_FLAGS_AREA_SELECTION)
+    gtk_text_buffer_get_selection_bounds (document->buffer, &start, &end);
+  else
+    gtk_text_buffer_get_bounds (document->buffer, &start, &end);
+
+  snapshot = mousepad_document_get_snapshot (document, &start, &end, &byte_start, &byte_end);
+  document->priv->replace_start = gtk_text_iter_get_offset (&start);
+  document->priv->replace_end = gtk_text_iter_get_offset (&end);
+
+  /* keep the document alive during the operation */
+  document->priv->replace_cancellable = g_cancellable_new ();
+  mousepad_search_replace_async (snapshot, byte_start, byte_end, string, options, replace,
+                                 document->priv->replace_cancellable,
+                                 mousepad_document_engine_replace_completed, g_object_ref (document));
+}
+
+
+
+static void
+mousepad_document_selection_search_completed (GObject *object,
+                                              GAsyncResult *result,
+                                              gpointer data)
+{
+  MousepadDocument *document = data;
+  MousepadSearchIndex *index;
+  MousepadSearchFlags flags;
+  GError *error = NULL;
+  gint n_matches = 0;
+
+  /* exit if the operation was cancelled or the document removed during the search */
+  index = mousepad_search_finish (result, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)
+      || gtk_widget_get_parent (GTK_WIDGET (document)) == NULL)
+    {
+      if (index != NULL)
+        mousepad_search_index_free (index);
+      else
+        g_error_free (error);
+
+      g_object_unref (document);
+
+      return;
+    }
+
+  g_clear_object (&document->priv->selection_cancellable);
+
+  /* an invalid or too expensive regex has no matches */
+  flags = GPOINTER_TO_INT (mousepad_object_get_data (document, "selection-flags"));
+  if (index != NULL)
+    {
+      n_matches = mousepad_search_index_get_n_matches (index);
+      mousepad_search_index_free (index);
+    }
+  else
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+        flags |= MOUSEPAD_SEARCH_FLAGS_TOO_EXPENSIVE;
+
+      g_error_free (error);
+    }
+
+  /* matches are only counted in the selection */
+  document->priv->cur_match = 0;
+  g_signal_emit (document, document_signals[SEARCH_COMPLETED], 0, 0, n_matches,
+                 mousepad_object_get_data (document, "selection-string"), flags);
+
+  g_object_unref (document);
+}
+
+
+
+static void
+mousepad_document_selection_search (MousepadDocument *document,
+                                    const gchar *string,
+                                    MousepadSearchFlags flags,
+                                    MousepadSearchOptions options)
+{
+  GtkTextIter start, end;
+  GBytes *snapshot;
+  gsize byte_start, byte_end;
+
+  /* supersede the previous search */
+  if (document->priv->selection_cancellable != NULL)
+    {
+      g_cancellable_cancel (document->priv->selection_cancellable);
+      g_clear_object (&document->priv->selection_cancellable);
+    }
+
+  /* there is nothing to search for */
+  if (!mousepad_search_supports (string, options))
+    {
+      document->priv->cur_match = 0;
+      g_signal_emit (document, document_signals[SEARCH_COMPLETED], 0, 0, 0, string, flags);
+      return;
+    }
+
+  /* attach some data for the second stage */
+  mousepad_object_set_data (document, "selection-flags", GINT_TO_POINTER (flags));
+  mousepad_object_set_data_full (document, "selection-string", g_strdup (string), g_free);
+
+  gtk_text_buffer_get_selection_bounds (document->buffer, &start, &end);
+  snapshot = mousepad_document_get_snapshot (document, &start, &end, &byte_start, &byte_end);
+
+  /* keep the document alive during the search process */
+  document->priv->selection_cancellable = g_cancellable_new ();
+  mousepad_search_async (snapshot, byte_start, byte_end, string, options,
+                         document->priv->selection_cancellable,
+                         mousepad_document_selection_search_completed, g_object_ref (document));
+}
+
+
+
 void
 mousepad_document_search (MousepadDocument *document,
                           const gchar *string,
@@ -833,12 +1588,10 @@ mousepad_document_search (MousepadDocument *document,
                           MousepadSearchFlags flags)
 {
   GtkSourceSearchContext *search_context;
-  GtkSourceSearchSettings *search_settings, *search_settings_doc;
-  GtkTextIter iter, start, end;
-  GCancellable *cancellable;
-  gchar *selected_text;
-  const gchar *reference = "";
-  gboolean has_references;
+  GtkSourceSearchSettings *search_settings;
+  MousepadSearchIndex *previous;
+  MousepadSearchOptions options = 0;
+  GtkTextIter iter;
 
   /* get the search iter */
   if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_SEL_START)
@@ -846,45 +1599,57 @@ mousepad_document_search (MousepadDocument *document,
   else
     gtk_text_buffer_get_selection_bounds (document->buffer, NULL, &iter);
 
-  /* search in selected text only: substitute a virtual selection buffer to the real buffer
-   * and work inside */
+  /* get the search engine options */
+  search_settings = gtk_source_search_context_get_settings (document->priv->search_context);
+  if (gtk_source_search_settings_get_case_sensitive (search_settings))
+    options |= MOUSEPAD_SEARCH_CASE_SENSITIVE;
+  if (gtk_source_search_settings_get_at_word_boundaries (search_settings))
+    options |= MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES;
+  if (gtk_source_search_settings_get_regex_enabled (search_settings))
+    options |= MOUSEPAD_SEARCH_REGEX;
+
+  /* replace all matches in a single pass, in the selection or in the whole document */
+  if ((flags & MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE) && (flags & MOUSEPAD_SEARCH_FLAGS_ENTIRE_AREA)
+      && replace != NULL && mousepad_search_supports (string, options))
+    {
+      mousepad_document_engine_replace (document, string, replace, flags, options);
+      return;
+    }
+
+  /* search in selected text only, to count the matches */
   if (flags & MOUSEPAD_SEARCH_FLAGS_AREA_SELECTION)
     {
-      /* initialize selection buffer and search context if needed */
-      if (document->priv->selection_buffer == NULL)
-        {
-          document->priv->selection_buffer = gtk_source_buffer_new (NULL);
-          document->priv->selection_context = gtk_source_search_context_new (document->priv->selection_buffer, NULL);
-          g_signal_connect_swapped (document->priv->selection_context, "notify::occurrences-count",
-                                    G_CALLBACK (mousepad_document_emit_search_signal), document);
-          gtk_source_search_context_set_highlight (document->priv->selection_context, FALSE);
-        }
+      mousepad_document_selection_search (document, string, flags, options);
+      return;
+    }
 
-      /* get the text in the selection area */
-      gtk_text_buffer_get_selection_bounds (document->buffer, &start, &end);
-      selected_text = gtk_text_buffer_get_text (document->buffer, &start, &end, FALSE);
+  /* supersede the previous searches, keeping the index of the last one to refine it */
+  search_context = document->priv->search_context;
+  previous = g_steal_pointer (&document->priv->index);
+  mousepad_document_engine_search_cancel (document);
+  g_clear_pointer (&document->priv->engine_string, g_free);
+  if (document->priv->search_cancellable != NULL)
+    {
+      g_cancellable_cancel (document->priv->search_cancellable);
+      g_clear_object (&document->priv->search_cancellable);
+    }
 
-      /* put the text in the selection buffer */
-      gtk_text_buffer_set_text (GTK_TEXT_BUFFER (document->priv->selection_buffer),
-                                selected_text, -1);
-      gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (document->priv->selection_buffer), &iter);
-      g_free (selected_text);
+  if (document->priv->refresh_id != 0)
+    {
+      g_source_remove (document->priv->refresh_id);
+      document->priv->refresh_id = 0;
+    }
 
-      /* copy search settings from those of the document */
-      search_context = document->priv->selection_context;
-      search_settings = gtk_source_search_context_get_settings (search_context);
-      search_settings_doc = gtk_source_search_context_get_settings (document->priv->search_context);
-
-      gtk_source_search_settings_set_case_sensitive (
-        search_settings, gtk_source_search_settings_get_case_sensitive (search_settings_doc));
-      gtk_source_search_settings_set_at_word_boundaries (
-        search_settings, gtk_source_search_settings_get_at_word_boundaries (search_settings_doc));
-      gtk_source_search_settings_set_regex_enabled (
-        search_settings, gtk_source_search_settings_get_regex_enabled (search_settings_doc));
+  /* searches are run by the search engine, except for replacements */
+  if (!(flags & MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE)
+      && mousepad_search_supports (string, options))
+    {
+      mousepad_document_engine_search (document, string, flags, options, previous);
+      return;
     }
-  /* search in the whole document */
-  else
-    search_context = document->priv->search_context;
+
+  if (previous != NULL)
+    mousepad_search_index_free (previous);
 
   /* set the string to search for */
   search_settings = gtk_source_search_context_get_settings (search_context);
@@ -895,42 +1660,42 @@ mousepad_document_search (MousepadDocument *document,
                                               (flags & MOUSEPAD_SEARCH_FLAGS_WRAP_AROUND)
                                                 || MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_WRAP_AROUND));
 
-  /* special treatments if regex search is enabled */
-  if (gtk_source_search_settings_get_regex_enabled (search_settings))
-    {
-      /* disable highlight to prevent prohibitive computation times in some situations
-       * (see mousepad_document_prevent_endless_scanning() below) */
-      gtk_source_search_context_set_highlight (search_context, FALSE);
-
-      /* trick gtk_source_search_context_replace_all() into thinking its replacement text
-       * contains back references even if it does not, so that g_regex_replace() is always
-       * used to replace text in this function, which finally behaves the same as
-       * gtk_source_search_context_replace(): see
-       * https://gitlab.gnome.org/GNOME/gtksourceview/-/issues/172 */
-      if (replace != NULL && (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE)
-          && (flags & MOUSEPAD_SEARCH_FLAGS_ENTIRE_AREA)
-          && g_regex_check_replacement (replace, &has_references, NULL)
-          && !has_references)
-        reference = "\\g<MousepadReservedName>";
-    }
-
   /* attach some data for the second stage */
   mousepad_object_set_data (search_context, "flags", GINT_TO_POINTER (flags));
-  mousepad_object_set_data_full (search_context, "replace",
-                                 g_strconcat (reference, replace, NULL), g_free);
+  mousepad_object_set_data_full (search_context, "replace", g_strdup (replace), g_free);
 
   /* keep the document alive during the search process */
   g_object_ref (document);
 
   /* search the string */
-  cancellable = g_cancellable_new ();
+  document->priv->search_cancellable = g_cancellable_new ();
   if (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD)
-    gtk_source_search_context_backward_async (search_context, &iter, cancellable,
+    gtk_source_search_context_backward_async (search_context, &iter,
+                                              document->priv->search_cancellable,
                                               mousepad_document_search_completed, document);
   else
-    gtk_source_search_context_forward_async (search_context, &iter, cancellable,
+    gtk_source_search_context_forward_async (search_context, &iter,
+                                             document->priv->search_cancellable,
                                              mousepad_document_search_completed, document);
-  g_object_unref (cancellable);
+}
+
+
+
+void
+mousepad_document_cancel_search (MousepadDocument *document)
+{
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* forget the search in the whole document, as when the search widgets are hidden */
+  mousepad_document_engine_search_cancel (document);
+  g_clear_pointer (&document->priv->engine_string, g_free);
+  if (document->priv->refresh_id != 0)
+    {
+      g_source_remove (document->priv->refresh_id);
+      document->priv->refresh_id = 0;
+    }
+
+  mousepad_document_highlight_matches (document);
 }
 
 
@@ -945,11 +1710,26 @@ mousepad_document_emit_search_signal (MousepadDocument *document,
   gint n_matches;
   const gchar *string;
 
-  /* retrieve data */
+  /* retrieve data, from the search engine for a search in the whole document */
   flags = GPOINTER_TO_INT (mousepad_object_get_data (search_context, "flags"));
-  n_matches = gtk_source_search_context_get_occurrences_count (search_context);
-  search_settings = gtk_source_search_context_get_settings (search_context);
-  string = gtk_source_search_settings_get_search_text (search_settings);
+  if (search_context == document->priv->search_context && document->priv->engine_string != NULL)
+    {
+      /* wait for the search engine, there is no index for an invalid regex */
+      if (document->priv->index != NULL)
+        n_matches = mousepad_search_index_get_n_matches (document->priv->index);
+      else if (document->priv->engine_cancellable == NULL && document->priv->refresh_id == 0)
+        n_matches = 0;
+      else
+        return;
+
+      string = document->priv->engine_string;
+    }
+  else
+    {
+      n_matches = gtk_source_search_context_get_occurrences_count (search_context);
+      search_settings = gtk_source_search_context_get_settings (search_context);
+      string = gtk_source_search_settings_get_search_text (search_settings);
+    }
 
   /* emit the signal */
   g_signal_emit (document, document_signals[SEARCH_COMPLETED], 0, document->priv->cur_match,
@@ -958,54 +1738,11 @@ mousepad_document_emit_search_signal (MousepadDocument *document,
 
 
 
-static void
-mousepad_document_scanning_started (MousepadDocument *document)
-{
-  gtk_source_search_context_set_highlight (document->priv->search_context, FALSE);
-}
-
-
-
-static void
-mousepad_document_scanning_completed (MousepadDocument *document)
-{
-  gtk_source_search_context_set_highlight (document->priv->search_context, TRUE);
-}
-
-
-
-/*
- * Disable highlight during regex searches: a workaround to prevent prohibitive computation
- * times in some situations (see also mousepad_document_search() and mousepad_document_init()
- * above).
- * See https://gitlab.gnome.org/GNOME/gtksourceview/-/issues/164
- */
-static void
-mousepad_document_prevent_endless_scanning (MousepadDocument *document,
-                                            gboolean visible)
+static gboolean
+mousepad_document_get_highlight_all (MousepadDocument *document)
 {
-  if (visible && MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_HIGHLIGHT_ALL)
-      && MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_ENABLE_REGEX))
-    {
-      g_signal_connect_object (document->buffer, "insert-text",
-                               G_CALLBACK (mousepad_document_scanning_started),
-                               document, G_CONNECT_SWAPPED);
-      g_signal_connect_object (document->buffer, "delete-range",
-                               G_CALLBACK (mousepad_document_scanning_started),
-                               document, G_CONNECT_SWAPPED);
-      g_signal_connect_swapped (document->priv->search_context, "notify::occurrences-count",
-                                G_CALLBACK (mousepad_document_scanning_completed), document);
-    }
-  else
-    {
-      mousepad_disconnect_by_func (document->buffer, mousepad_document_scanning_started, document);
-      mousepad_disconnect_by_func (document->priv->search_context,
-                                   mousepad_document_scanning_completed, document);
-
-      /* re-enable highlighting if disconnection occurs between the two switches above */
-      gtk_source_search_context_set_highlight (document->priv->search_context,
-                                               MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_HIGHLIGHT_ALL));
-    }
+  return MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_HIGHLIGHT_ALL)
+         && !(mousepad_file_get_disabled_features (document->file) & MOUSEPAD_LARGE_FILE_HIGHLIGHT_ALL);
 }
 
 
@@ -1037,18 +1774,13 @@ mousepad_document_search_widget_visible (MousepadDocument *document,
                                          g_signal_lookup ("delete-range", GTK_TYPE_TEXT_BUFFER),
                                          0, NULL, NULL, document->priv->search_context);
 
-      /* activate the workaround to prevent endless buffer scanning */
-      mousepad_document_prevent_endless_scanning (document, visible);
+      /* highlight the matches, as long as the setting allows it */
+      mousepad_document_highlight_matches (document);
       MOUSEPAD_SETTING_CONNECT_OBJECT (SEARCH_HIGHLIGHT_ALL,
-                                       mousepad_document_prevent_endless_scanning,
-                                       document, G_CONNECT_SWAPPED);
-      MOUSEPAD_SETTING_CONNECT_OBJECT (SEARCH_ENABLE_REGEX,
-                                       mousepad_document_prevent_endless_scanning,
+                                       mousepad_document_highlight_matches,
                                        document, G_CONNECT_SWAPPED);
 
-      /* bind "highlight" and "regex-enabled" search settings to Mousepad settings */
-      MOUSEPAD_SETTING_BIND (SEARCH_HIGHLIGHT_ALL, document->priv->search_context,
-                             "highlight", G_SETTINGS_BIND_GET);
+      /* bind "regex-enabled" search setting to Mousepad setting */
       MOUSEPAD_SETTING_BIND (SEARCH_ENABLE_REGEX, search_settings,
                              "regex-enabled", G_SETTINGS_BIND_GET);
     }
@@ -1065,19 +1797,14 @@ mousepad_document_search_widget_visible (MousepadDocument *document,
                                        g_signal_lookup ("delete-range", GTK_TYPE_TEXT_BUFFER),
                                        0, NULL, NULL, document->priv->search_context);
 
-      /* deactivate the workaround to prevent endless buffer scanning */
-      mousepad_document_prevent_endless_scanning (document, visible);
+      /* remove the highlight */
+      mousepad_document_highlight_matches (document);
       MOUSEPAD_SETTING_DISCONNECT (SEARCH_HIGHLIGHT_ALL,
-                                   G_CALLBACK (mousepad_document_prevent_endless_scanning),
-                                   document);
-      MOUSEPAD_SETTING_DISCONNECT (SEARCH_ENABLE_REGEX,
-                                   G_CALLBACK (mousepad_document_prevent_endless_scanning),
+                                   G_CALLBACK (mousepad_document_highlight_matches),
                                    document);
 
-      /* unbind "highlight" and "regex-enabled" search settings and turn them off */
-      g_settings_unbind (document->priv->search_context, "highlight");
+      /* unbind "regex-enabled" search setting and turn it off */
       g_settings_unbind (search_settings, "regex-enabled");
-      gtk_source_search_context_set_highlight (document->priv->search_context, FALSE);
       gtk_source_search_settings_set_regex_enabled (search_settings, FALSE);
     }
 }
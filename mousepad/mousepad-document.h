@@ -49,6 +49,9 @@ typedef enum
   MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT = 1 << 8, /* select the match */
   MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE = 1 << 9, /* replace the match */
   MOUSEPAD_SEARCH_FLAGS_ACTION_NONE = 1 << 10, /* silent search */
+
+  /* result */
+  MOUSEPAD_SEARCH_FLAGS_TOO_EXPENSIVE = 1 << 11, /* the regex was too expensive to search for */
 } MousepadSearchFlags;
 
 GType
@@ -99,6 +102,9 @@ mousepad_document_search (MousepadDocument *document,
                           const gchar *replace,
                           MousepadSearchFlags flags);
 
+void
+mousepad_document_cancel_search (MousepadDocument *document);
+
 G_END_DECLS
 
 #endif /* !__MOUSEPAD_DOCUMENT_H__ */
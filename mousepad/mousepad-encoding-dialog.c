@@ -20,10 +20,19 @@
 #include "mousepad-encoding-dialog.h"
 #include "mousepad-encoding.h"
 #include "mousepad-history.h"
+#include "mousepad-settings.h"
 #include "mousepad-util.h"
 
 
 
+/* size of the output buffer used to probe an encoding */
+#define PROBE_BUFFER_SIZE (16 * 1024)
+
+/* the preview decodes the file by pages of this number of bytes, as the user scrolls down */
+#define PREVIEW_PAGE_SIZE (64 * 1024)
+
+
+
 static void
 mousepad_encoding_dialog_constructed (GObject *object);
 static void
@@ -38,9 +47,18 @@ mousepad_encoding_dialog_test_encodings_destroy (gpointer user_data);
 static void
 mousepad_encoding_dialog_test_encodings (MousepadEncodingDialog *dialog);
 static void
+mousepad_encoding_dialog_test_encodings_stop (MousepadEncodingDialog *dialog);
+static void
+mousepad_encoding_dialog_test_encodings_finish (MousepadEncodingDialog *dialog);
+static gboolean
+mousepad_encoding_dialog_probe_done (gpointer data);
+static void
 mousepad_encoding_dialog_cancel_encoding_test (GtkWidget *button,
                                                MousepadEncodingDialog *dialog);
 static void
+mousepad_encoding_dialog_preview_scrolled (GtkAdjustment *adjustment,
+                                           MousepadEncodingDialog *dialog);
+static void
 mousepad_encoding_dialog_read_file (MousepadEncodingDialog *dialog,
                                     MousepadEncoding encoding);
 static void
@@ -59,6 +77,47 @@ enum
   N_COLUMNS
 };
 
+/* result of an encoding probe, unknown if the test was cancelled before it was done */
+enum
+{
+  PROBE_UNKNOWN = -1,
+  PROBE_FAILED,
+  PROBE_PARTIAL,
+  PROBE_VALID
+};
+
+/* state of an encoding test, shared with the probing threads */
+typedef struct _MousepadEncodingTest
+{
+  gint ref_count;
+
+  /* the dialog, or NULL once the test is over */
+  MousepadEncodingDialog *dialog;
+
+  /* the contents to probe, possibly only the start of the file */
+  GBytes *bytes;
+  const gchar *contents;
+  gsize length;
+  gboolean sampled;
+  gint cancelled;
+
+  /* probe results, indexed by encoding, and number of probes still running */
+  gint results[MOUSEPAD_N_ENCODINGS];
+  guint n_probes, n_pending;
+
+  /* encodings shown as radio buttons rather than in the combo box */
+  MousepadEncoding default_encoding, system_encoding, history_encoding;
+  gboolean show_history;
+} MousepadEncodingTest;
+
+/* result of a probe, passed from a probing thread to the main thread */
+typedef struct _MousepadEncodingProbe
+{
+  MousepadEncodingTest *test;
+  MousepadEncoding encoding;
+  gint result;
+} MousepadEncodingProbe;
+
 struct _MousepadEncodingDialog
 {
   GtkDialog __parent__;
@@ -72,8 +131,20 @@ struct _MousepadEncodingDialog
   /* encoding test idle id */
   guint timer_id;
 
-  /* boolean to cancel the testing loop */
-  gboolean cancel_testing;
+  /* the encoding test in progress, if any */
+  MousepadEncodingTest *test;
+
+  /* the start of the file, read once to be probed, or the whole file if small enough */
+  GBytes *sample;
+  gboolean sampled;
+
+  /* the file opened for the preview, read page by page, the end of the last page read
+   * which could not be decoded yet, and the size of the code units of the previewed
+   * encoding */
+  GInputStream *stream;
+  GConverter *converter;
+  gchar *page;
+  gsize page_length, unit;
 
   /* dialog widgets */
   GtkWidget *button_ok, *button_cancel, *error_box, *error_label, *progress_bar;
@@ -113,6 +184,7 @@ mousepad_encoding_dialog_init (MousepadEncodingDialog *dialog)
 {
   GtkWidget *area, *vbox, *hbox, *icon;
   GtkCellRenderer *cell;
+  GtkAdjustment *adjustment;
 
   /* set some dialog properties */
   gtk_window_set_default_size (GTK_WINDOW (dialog), 550, 350);
@@ -225,6 +297,13 @@ mousepad_encoding_dialog_init (MousepadEncodingDialog *dialog)
   gtk_source_view_set_show_line_numbers (GTK_SOURCE_VIEW (dialog->document->textview), FALSE);
   gtk_text_view_set_wrap_mode (GTK_TEXT_VIEW (dialog->document->textview), GTK_WRAP_NONE);
   gtk_widget_show (GTK_WIDGET (dialog->document));
+
+  /* decode the next page of the preview when the end of the text is about to be shown */
+  adjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (dialog->document));
+  g_signal_connect_object (adjustment, "changed",
+                           G_CALLBACK (mousepad_encoding_dialog_preview_scrolled), dialog, 0);
+  g_signal_connect_object (adjustment, "value-changed",
+                           G_CALLBACK (mousepad_encoding_dialog_preview_scrolled), dialog, 0);
 }
 
 
@@ -247,10 +326,27 @@ mousepad_encoding_dialog_finalize (GObject *object)
 {
   MousepadEncodingDialog *dialog = MOUSEPAD_ENCODING_DIALOG (object);
 
-  /* stop running timeout */
+  /* stop running timeout and encoding test */
   if (G_UNLIKELY (dialog->timer_id))
     g_source_remove (dialog->timer_id);
 
+  mousepad_encoding_dialog_test_encodings_stop (dialog);
+
+  /* release the file contents */
+  if (dialog->converter != NULL)
+    mousepad_encoding_release_converter (dialog->converter);
+
+  if (dialog->sample != NULL)
+    g_bytes_unref (dialog->sample);
+
+  if (dialog->stream != NULL)
+    {
+      g_input_stream_close (dialog->stream, NULL, NULL);
+      g_object_unref (dialog->stream);
+    }
+
+  g_free (dialog->page);
+
   /* clear and release stores */
   g_free (dialog->title);
   gtk_list_store_clear (dialog->store);
@@ -268,7 +364,7 @@ mousepad_encoding_dialog_response (GtkDialog *dialog,
                                    gint response_id)
 {
   /* make sure we cancel encoding testing asap */
-  MOUSEPAD_ENCODING_DIALOG (dialog)->cancel_testing = TRUE;
+  mousepad_encoding_dialog_test_encodings_stop (MOUSEPAD_ENCODING_DIALOG (dialog));
 }
 
 
@@ -277,59 +373,258 @@ static gboolean
 mousepad_encoding_dialog_set_radio (GtkWidget *radio,
                                     const gchar *name,
                                     MousepadEncoding encoding,
-                                    const gchar *contents,
-                                    gsize length)
+                                    gint result)
 {
-  gchar *encoded, *label;
+  gchar *label;
   const gchar *charset;
-  gsize written;
-  gboolean valid = FALSE;
 
   /* attach encoding to the button for later use */
   mousepad_object_set_data (radio, "encoding", GINT_TO_POINTER (encoding));
 
-  /* try to convert the contents in the radio encoding */
+  /* set the radio label according to the probe result */
   charset = mousepad_encoding_get_charset (encoding);
-  encoded = g_convert (contents, length, "UTF-8", charset, NULL, &written, NULL);
-
-  /* set the radio label accordingly */
-  if (encoded == NULL)
+  if (result == PROBE_UNKNOWN)
+    label = g_strdup_printf (_("%s (%s, unknown)"), name, charset);
+  else if (result == PROBE_FAILED)
     label = g_strdup_printf (_("%s (%s, failed)"), name, charset);
-  else if (!g_utf8_validate (encoded, written, NULL))
+  else if (result == PROBE_PARTIAL)
     label = g_strdup_printf (_("%s (%s, partial)"), name, charset);
   else
-    {
-      valid = TRUE;
-      label = g_strdup_printf ("%s (%s)", name, charset);
-    }
+    label = g_strdup_printf ("%s (%s)", name, charset);
 
   gtk_button_set_label (GTK_BUTTON (radio), label);
 
   /* cleanup */
-  g_free (encoded);
   g_free (label);
 
-  return valid;
+  return result == PROBE_VALID;
+}
+
+
+
+static MousepadEncodingTest *
+mousepad_encoding_test_ref (MousepadEncodingTest *test)
+{
+  g_atomic_int_inc (&test->ref_count);
+
+  return test;
+}
+
+
+
+static void
+mousepad_encoding_test_unref (MousepadEncodingTest *test)
+{
+  if (g_atomic_int_dec_and_test (&test->ref_count))
+    {
+      g_bytes_unref (test->bytes);
+      g_free (test);
+    }
+}
+
+
+
+static gint
+mousepad_encoding_dialog_probe (MousepadEncodingTest *test,
+                                MousepadEncoding encoding)
+{
+  GConverter *converter;
+  GConverterResult converted;
+  GError *error = NULL;
+  const gchar *charset, *inbuf;
+  gchar buffer[PROBE_BUFFER_SIZE];
+  gsize inleft, n_read, n_written;
+  gint result = PROBE_VALID;
+
+  charset = mousepad_encoding_get_charset (encoding);
+  if (charset == NULL || (converter = mousepad_encoding_get_converter ("UTF-8", charset, NULL)) == NULL)
+    return PROBE_FAILED;
+
+  /* convert by blocks through a fixed size buffer, so that the conversion result is never
+   * stored, and stop at the first invalid sequence */
+  inbuf = test->contents;
+  inleft = test->length;
+  while (inleft > 0)
+    {
+      if (g_atomic_int_get (&test->cancelled))
+        {
+          result = PROBE_FAILED;
+          break;
+        }
+
+      converted = g_converter_convert (converter, inbuf, inleft, buffer, PROBE_BUFFER_SIZE,
+                                       G_CONVERTER_NO_FLAGS, &n_read, &n_written, &error);
+      if (converted == G_CONVERTER_ERROR)
+        {
+          /* a sample may end in the middle of a character */
+          if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT) || !test->sampled)
+            result = PROBE_FAILED;
+
+          g_error_free (error);
+          break;
+        }
+
+      /* nul characters make the conversion partially valid, as for g_utf8_validate() */
+      if (result == PROBE_VALID && memchr (buffer, '\0', n_written) != NULL)
+        result = PROBE_PARTIAL;
+
+      inbuf += n_read;
+      inleft -= n_read;
+    }
+
+  mousepad_encoding_release_converter (converter);
+
+  return result;
+}
+
+
+
+static void
+mousepad_encoding_dialog_probe_thread (gpointer data,
+                                       gpointer user_data)
+{
+  MousepadEncodingProbe *probe;
+
+  probe = g_new (MousepadEncodingProbe, 1);
+  probe->test = user_data;
+  probe->encoding = GPOINTER_TO_INT (data);
+  probe->result = mousepad_encoding_dialog_probe (probe->test, probe->encoding);
+
+  /* report the result to the main thread */
+  g_idle_add (mousepad_encoding_dialog_probe_done, probe);
+}
+
+
+
+static void
+mousepad_encoding_dialog_store_insert (GtkListStore *store,
+                                       MousepadEncoding encoding)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (store);
+  GtkTreeIter iter;
+  gint position, id;
+  gboolean valid;
+
+  /* results come in any order: keep the list sorted by encoding */
+  for (valid = gtk_tree_model_get_iter_first (model, &iter), position = 0; valid;
+       valid = gtk_tree_model_iter_next (model, &iter), position++)
+    {
+      gtk_tree_model_get (model, &iter, COLUMN_ID, &id, -1);
+      if (id > (gint) encoding)
+        break;
+    }
+
+  gtk_list_store_insert_with_values (store, NULL, position,
+                                     COLUMN_LABEL, mousepad_encoding_get_charset (encoding),
+                                     COLUMN_ID, encoding, -1);
+}
+
+
+
+static gboolean
+mousepad_encoding_dialog_probe_done (gpointer data)
+{
+  MousepadEncodingProbe *probe = data;
+  MousepadEncodingTest *test = probe->test;
+  MousepadEncodingDialog *dialog = test->dialog;
+
+  /* the test is over, drop late results */
+  if (dialog != NULL)
+    {
+      test->results[probe->encoding] = probe->result;
+      test->n_pending--;
+
+      /* set progress bar fraction */
+      gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (dialog->progress_bar),
+                                     1.0 - (gdouble) test->n_pending / test->n_probes);
+
+      /* insert other encodings in the stores as the results arrive */
+      if (probe->encoding != test->default_encoding && probe->encoding != test->system_encoding
+          && probe->encoding != test->history_encoding)
+        {
+          if (probe->result == PROBE_VALID)
+            mousepad_encoding_dialog_store_insert (dialog->store, probe->encoding);
+          else if (probe->result == PROBE_PARTIAL)
+            mousepad_encoding_dialog_store_insert (dialog->fallback_store, probe->encoding);
+        }
+
+      if (test->n_pending == 0)
+        mousepad_encoding_dialog_test_encodings_finish (dialog);
+    }
+
+  /* cleanup */
+  mousepad_encoding_test_unref (test);
+  g_free (probe);
+
+  return FALSE;
 }
 
 
 
+static gboolean
+mousepad_encoding_dialog_load_contents (MousepadEncodingDialog *dialog,
+                                        GError **error)
+{
+  GFileInputStream *stream;
+  GByteArray *sample;
+  gsize sample_size, length, size;
+  gssize n_read;
+
+  stream = g_file_read (mousepad_file_get_location (dialog->document->file), NULL, error);
+  if (stream == NULL)
+    return FALSE;
+
+  /* read only the start of the file to probe, or the whole file if it is not limited: one
+   * more byte tells whether the file is longer */
+  sample_size = (gsize) MOUSEPAD_SETTING_GET_UINT (ENCODING_TEST_SAMPLE_SIZE) * 1024 * 1024;
+  sample = g_byte_array_new ();
+  do
+    {
+      length = sample->len;
+      size = PREVIEW_PAGE_SIZE;
+      if (sample_size > 0)
+        size = MIN (size, sample_size + 1 - length);
+
+      g_byte_array_set_size (sample, length + size);
+      n_read = g_input_stream_read (G_INPUT_STREAM (stream), sample->data + length, size,
+                                    NULL, error);
+      g_byte_array_set_size (sample, length + MAX (n_read, 0));
+    }
+  while (n_read > 0 && (sample_size == 0 || sample->len <= sample_size));
+
+  if (n_read < 0)
+    {
+      g_byte_array_unref (sample);
+      g_object_unref (stream);
+      return FALSE;
+    }
+
+  dialog->sampled = (sample_size > 0 && sample->len > sample_size);
+  if (dialog->sampled)
+    g_byte_array_set_size (sample, sample_size);
+
+  dialog->sample = g_byte_array_free_to_bytes (sample);
+
+  /* the same stream is used for the preview, rewound for each encoding */
+  dialog->stream = G_INPUT_STREAM (stream);
+  dialog->page = g_malloc (PREVIEW_PAGE_SIZE);
+
+  return TRUE;
+}
+
+
 static gboolean
 mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
 {
   MousepadEncodingDialog *dialog = MOUSEPAD_ENCODING_DIALOG (user_data);
-  MousepadEncoding default_encoding, system_encoding, history_encoding = MOUSEPAD_ENCODING_NONE;
+  MousepadEncodingTest *test;
+  GThreadPool *pool;
   GError *error = NULL;
-  const gchar *charset, *subtitle;
-  gchar *contents, *label, *encoded;
-  gsize length, written;
+  MousepadEncoding radio_encodings[3];
   guint i, n;
-  gint result = 0;
-  gboolean default_valid, system_valid = FALSE, history_valid = FALSE, show_history;
 
   /* exit with a popup dialog in case of problem */
-  if (!g_file_load_contents (mousepad_file_get_location (dialog->document->file),
-                             NULL, &contents, &length, NULL, &error))
+  if (dialog->sample == NULL && !mousepad_encoding_dialog_load_contents (dialog, &error))
     {
       /* show the warning */
       mousepad_dialogs_show_error (GTK_WINDOW (dialog), error, MOUSEPAD_MESSAGE_IO_ERROR_OPEN);
@@ -343,87 +638,109 @@ mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
       return FALSE;
     }
 
-  /* see if default, system and history encodings are valid and set their button labels */
-  default_valid = g_utf8_validate (contents, length, NULL);
-  default_encoding = mousepad_encoding_get_default ();
-  charset = mousepad_encoding_get_charset (default_encoding);
-  if (default_valid)
-    label = g_strdup_printf ("%s (%s)", MOUSEPAD_ENCODING_LABEL_DEFAULT, charset);
-  else
-    label = g_strdup_printf (_("%s (%s, partial)"), MOUSEPAD_ENCODING_LABEL_DEFAULT, charset);
+  test = g_new0 (MousepadEncodingTest, 1);
+  test->ref_count = 1;
+  for (i = 0; i < MOUSEPAD_N_ENCODINGS; i++)
+    test->results[i] = PROBE_UNKNOWN;
 
-  gtk_button_set_label (GTK_BUTTON (dialog->radio_default), label);
-  mousepad_object_set_data (dialog->radio_default, "encoding", GINT_TO_POINTER (default_encoding));
-  g_free (label);
-
-  /* set the system radio button */
-  system_encoding = mousepad_encoding_get_system ();
-  if (dialog->radio_system != NULL)
-    system_valid = mousepad_encoding_dialog_set_radio (dialog->radio_system,
-                                                       MOUSEPAD_ENCODING_LABEL_SYSTEM,
-                                                       system_encoding, contents, length);
+  /* probe the whole contents, or only their start */
+  test->bytes = g_bytes_ref (dialog->sample);
+  test->contents = g_bytes_get_data (test->bytes, &test->length);
+  test->sampled = dialog->sampled;
 
-  /* set the history radio button */
+  /* default, system and history encodings are shown as radio buttons */
+  test->default_encoding = mousepad_encoding_get_default ();
+  test->system_encoding = mousepad_encoding_get_system ();
+  test->history_encoding = MOUSEPAD_ENCODING_NONE;
   mousepad_history_recent_get_encoding (mousepad_file_get_location (dialog->document->file),
-                                        &history_encoding);
-  show_history = (history_encoding != MOUSEPAD_ENCODING_NONE
-                  && history_encoding != default_encoding
-                  && history_encoding != system_encoding);
-  if (show_history)
-    history_valid = mousepad_encoding_dialog_set_radio (dialog->radio_history,
-                                                        MOUSEPAD_ENCODING_LABEL_HISTORY,
-                                                        history_encoding, contents, length);
+                                        &test->history_encoding);
+  test->show_history = (test->history_encoding != MOUSEPAD_ENCODING_NONE
+                        && test->history_encoding != test->default_encoding
+                        && test->history_encoding != test->system_encoding);
+
+  test->dialog = dialog;
+  dialog->test = test;
+
+  /* probe all encodings on a thread pool, each result being reported as it arrives: the
+   * encodings shown as radio buttons first, so that their results are known as soon as
+   * possible, even if the user cancels the test */
+  pool = g_thread_pool_new (mousepad_encoding_dialog_probe_thread, test,
+                            g_get_num_processors (), FALSE, NULL);
+  test->n_probes = test->n_pending = MOUSEPAD_N_ENCODINGS - 1;
+  radio_encodings[0] = test->default_encoding;
+  radio_encodings[1] = test->system_encoding;
+  radio_encodings[2] = test->history_encoding;
+  for (n = 0; n < G_N_ELEMENTS (radio_encodings); n++)
+    if (radio_encodings[n] != MOUSEPAD_ENCODING_NONE
+        && (n < 1 || radio_encodings[n] != radio_encodings[0])
+        && (n < 2 || radio_encodings[n] != radio_encodings[1]))
+      {
+        mousepad_encoding_test_ref (test);
+        g_thread_pool_push (pool, GINT_TO_POINTER (radio_encodings[n]), NULL);
+      }
+
+  for (i = 1; i < MOUSEPAD_N_ENCODINGS; i++)
+    if ((MousepadEncoding) i != test->default_encoding && (MousepadEncoding) i != test->system_encoding
+        && (MousepadEncoding) i != test->history_encoding)
+      {
+        mousepad_encoding_test_ref (test);
+        g_thread_pool_push (pool, GINT_TO_POINTER (i), NULL);
+      }
+
+  /* the pool is freed once all the probes are done */
+  g_thread_pool_free (pool, FALSE, FALSE);
 
-  /* test all other encodings */
-  for (i = 1, n = 0; i < MOUSEPAD_N_ENCODINGS && !dialog->cancel_testing; i++)
-    {
-      /* skip default, system and history encodings */
-      if (i == default_encoding || i == system_encoding || i == history_encoding)
-        continue;
-
-      /* set progress bar fraction */
-      gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (dialog->progress_bar),
-                                     (i + 1.00) / MOUSEPAD_N_ENCODINGS);
+  return FALSE;
+}
 
-      /* try to convert the content */
-      charset = mousepad_encoding_get_charset (i);
-      encoded = g_convert (contents, length, "UTF-8", charset, NULL, &written, NULL);
 
-      if (encoded != NULL)
-        {
-          /* insert in the store */
-          if (g_utf8_validate (encoded, written, NULL))
-            gtk_list_store_insert_with_values (dialog->store, NULL, n++,
-                                               COLUMN_LABEL, charset, COLUMN_ID, i, -1);
-          else
-            gtk_list_store_insert_with_values (dialog->fallback_store, NULL, n++,
-                                               COLUMN_LABEL, charset, COLUMN_ID, i, -1);
 
-          /* cleanup */
-          g_free (encoded);
-        }
-
-      /* iterate the main loop to update the gui */
-      while (gtk_events_pending ())
-        gtk_main_iteration ();
-    }
+static void
+mousepad_encoding_dialog_test_encodings_finish (MousepadEncodingDialog *dialog)
+{
+  MousepadEncodingTest *test = dialog->test;
+  GtkTreeModel *model;
+  const gchar *subtitle;
+  gint result = 0, probed, n;
+  gboolean default_valid, system_valid = FALSE, history_valid = FALSE;
 
-  /* cleanup */
-  g_free (contents);
+  /* detach the test from the dialog: probes still running are cancelled */
+  dialog->test = NULL;
+  test->dialog = NULL;
+  g_atomic_int_set (&test->cancelled, TRUE);
 
   /* hide progress bar and cancel button */
   gtk_widget_hide (dialog->progress_bar);
   gtk_widget_hide (dialog->button_cancel);
 
+  /* set the default, system and history radio buttons, the document being loaded at least
+   * partially in the default encoding */
+  probed = test->results[test->default_encoding];
+  default_valid = mousepad_encoding_dialog_set_radio (dialog->radio_default,
+                                                      MOUSEPAD_ENCODING_LABEL_DEFAULT,
+                                                      test->default_encoding,
+                                                      probed == PROBE_FAILED ? PROBE_PARTIAL : probed);
+  if (dialog->radio_system != NULL)
+    system_valid = mousepad_encoding_dialog_set_radio (dialog->radio_system,
+                                                       MOUSEPAD_ENCODING_LABEL_SYSTEM,
+                                                       test->system_encoding,
+                                                       test->results[test->system_encoding]);
+  if (test->show_history)
+    history_valid = mousepad_encoding_dialog_set_radio (dialog->radio_history,
+                                                        MOUSEPAD_ENCODING_LABEL_HISTORY,
+                                                        test->history_encoding,
+                                                        test->results[test->history_encoding]);
+
   /* check if we have something to propose to the user apart from the default encoding */
-  if (!gtk_tree_model_iter_n_children (GTK_TREE_MODEL (dialog->store), NULL))
+  model = GTK_TREE_MODEL (dialog->store);
+  if (!gtk_tree_model_iter_n_children (model, NULL))
     {
       /* fall back to partially valid conversions if possible */
-      if (G_LIKELY (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (dialog->fallback_store), NULL)))
+      model = GTK_TREE_MODEL (dialog->fallback_store);
+      if (G_LIKELY (gtk_tree_model_iter_n_children (model, NULL)))
         {
           result = 1 - (default_valid || system_valid || history_valid);
-          gtk_combo_box_set_model (GTK_COMBO_BOX (dialog->combo),
-                                   GTK_TREE_MODEL (dialog->fallback_store));
+          gtk_combo_box_set_model (GTK_COMBO_BOX (dialog->combo), model);
           gtk_button_set_label (GTK_BUTTON (dialog->radio_other), _("Other (partial):"));
         }
       else
@@ -446,7 +763,7 @@ mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
       gtk_widget_show (dialog->radio_default);
       if (dialog->radio_system != NULL)
         gtk_widget_show (dialog->radio_system);
-      if (show_history)
+      if (test->show_history)
         gtk_widget_show (dialog->radio_history);
 
       /* show the "Other" radio button and combo box */
@@ -457,6 +774,7 @@ mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
       gtk_combo_box_set_active (GTK_COMBO_BOX (dialog->combo), 0);
 
       /* spread the encoding list over several columns */
+      n = gtk_tree_model_iter_n_children (model, NULL);
       gtk_combo_box_set_wrap_width (GTK_COMBO_BOX (dialog->combo), n / 10 + (n % 10 != 0));
 
       /* activate history encoding if possible, or the first valid encoding */
@@ -484,7 +802,7 @@ mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
           gtk_widget_show (dialog->radio_system);
         }
 
-      if (show_history)
+      if (test->show_history)
         {
           gtk_widget_show (dialog->radio_default);
           gtk_widget_show (dialog->radio_history);
@@ -494,7 +812,22 @@ mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
       gtk_toggle_button_toggled (GTK_TOGGLE_BUTTON (dialog->radio_default));
     }
 
-  return FALSE;
+  /* cleanup */
+  mousepad_encoding_test_unref (test);
+}
+
+
+
+static void
+mousepad_encoding_dialog_test_encodings_stop (MousepadEncodingDialog *dialog)
+{
+  /* cancel the running probes and drop their results */
+  if (dialog->test != NULL)
+    {
+      g_atomic_int_set (&dialog->test->cancelled, TRUE);
+      dialog->test->dialog = NULL;
+      g_clear_pointer (&dialog->test, mousepad_encoding_test_unref);
+    }
 }
 
 
@@ -510,11 +843,8 @@ mousepad_encoding_dialog_test_encodings_destroy (gpointer user_data)
 static void
 mousepad_encoding_dialog_test_encodings (MousepadEncodingDialog *dialog)
 {
-  if (G_LIKELY (dialog->timer_id == 0))
+  if (G_LIKELY (dialog->timer_id == 0 && dialog->test == NULL))
     {
-      /* reset boolean */
-      dialog->cancel_testing = FALSE;
-
       /* start a new idle function */
       dialog->timer_id = g_idle_add_full (G_PRIORITY_LOW, mousepad_encoding_dialog_test_encodings_idle,
                                           dialog, mousepad_encoding_dialog_test_encodings_destroy);
@@ -527,8 +857,127 @@ static void
 mousepad_encoding_dialog_cancel_encoding_test (GtkWidget *button,
                                                MousepadEncodingDialog *dialog)
 {
-  /* cancel the testing loop */
-  dialog->cancel_testing = TRUE;
+  /* stop testing, and propose the encodings found so far */
+  if (dialog->test != NULL)
+    mousepad_encoding_dialog_test_encodings_finish (dialog);
+}
+
+
+
+static void
+mousepad_encoding_dialog_preview_insert (MousepadEncodingDialog *dialog,
+                                         const gchar *text,
+                                         gsize length)
+{
+  GtkTextIter iter;
+  const gchar *nul;
+
+  /* null characters can't be inserted in the buffer, replace them like invalid sequences */
+  gtk_text_buffer_get_end_iter (dialog->document->buffer, &iter);
+  for (; (nul = memchr (text, '\0', length)) != NULL; length -= nul + 1 - text, text = nul + 1)
+    {
+      gtk_text_buffer_insert (dialog->document->buffer, &iter, text, nul - text);
+      gtk_text_buffer_insert (dialog->document->buffer, &iter, "\357\277\275", 3);
+    }
+
+  gtk_text_buffer_insert (dialog->document->buffer, &iter, text, length);
+}
+
+
+
+static void
+mousepad_encoding_dialog_preview_page (MousepadEncodingDialog *dialog)
+{
+  GConverterResult result = G_CONVERTER_CONVERTED;
+  GError *error = NULL;
+  gchar buffer[PROBE_BUFFER_SIZE];
+  gsize offset = 0, limit, n_read, n_written;
+  gboolean at_end;
+
+  /* read one page after the end of the previous one, a read error ending the preview */
+  if (!g_input_stream_read_all (dialog->stream, dialog->page + dialog->page_length,
+                                PREVIEW_PAGE_SIZE - dialog->page_length, &n_read, NULL, &error))
+    g_clear_error (&error);
+
+  limit = dialog->page_length + n_read;
+  at_end = (limit < PREVIEW_PAGE_SIZE);
+
+  /* decode the page, replacing invalid sequences as the loading does when the user
+   * chooses the encoding */
+  while (offset < limit || (at_end && result != G_CONVERTER_FINISHED))
+    {
+      result = g_converter_convert (dialog->converter, dialog->page + offset, limit - offset,
+                                    buffer, sizeof (buffer),
+                                    at_end ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+                                    &n_read, &n_written, &error);
+      if (result != G_CONVERTER_ERROR)
+        {
+          mousepad_encoding_dialog_preview_insert (dialog, buffer, n_written);
+          offset += n_read;
+        }
+      /* the last character of the page is decoded with the next page */
+      else if (!at_end && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT))
+        {
+          g_error_free (error);
+          break;
+        }
+      /* skip one code unit, so that the rest of the page remains aligned on them */
+      else
+        {
+          g_clear_error (&error);
+          mousepad_encoding_dialog_preview_insert (dialog, "\357\277\275", 3);
+          g_converter_reset (dialog->converter);
+          offset = MIN (offset + dialog->unit, limit);
+        }
+    }
+
+  /* keep what could not be decoded for the next page */
+  dialog->page_length = limit - offset;
+  memmove (dialog->page, dialog->page + offset, dialog->page_length);
+
+  /* the whole file is shown */
+  if (at_end)
+    g_clear_pointer (&dialog->converter, mousepad_encoding_release_converter);
+}
+
+
+
+static gboolean
+mousepad_encoding_dialog_preview_rewind (MousepadEncodingDialog *dialog,
+                                         GError **error)
+{
+  GFileInputStream *stream;
+
+  dialog->page_length = 0;
+
+  if (G_IS_SEEKABLE (dialog->stream) && g_seekable_can_seek (G_SEEKABLE (dialog->stream)))
+    return g_seekable_seek (G_SEEKABLE (dialog->stream), 0, G_SEEK_SET, NULL, error);
+
+  /* open the file again if its stream can't be rewound */
+  stream = g_file_read (mousepad_file_get_location (dialog->document->file), NULL, error);
+  if (stream == NULL)
+    return FALSE;
+
+  g_input_stream_close (dialog->stream, NULL, NULL);
+  g_object_unref (dialog->stream);
+  dialog->stream = G_INPUT_STREAM (stream);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_encoding_dialog_preview_scrolled (GtkAdjustment *adjustment,
+                                           MousepadEncodingDialog *dialog)
+{
+  gdouble page_size;
+
+  /* decode pages until there is at least one screen of text below the visible one */
+  page_size = gtk_adjustment_get_page_size (adjustment);
+  if (dialog->converter != NULL
+      && gtk_adjustment_get_value (adjustment) + 2 * page_size >= gtk_adjustment_get_upper (adjustment))
+    mousepad_encoding_dialog_preview_page (dialog);
 }
 
 
@@ -540,19 +989,33 @@ mousepad_encoding_dialog_read_file (MousepadEncodingDialog *dialog,
   GtkTextIter start, end;
   GError *error = NULL;
   gchar *message;
-  gint result;
+  gint result = 0;
 
   /* clear buffer */
   gtk_text_buffer_get_bounds (dialog->document->buffer, &start, &end);
   gtk_text_buffer_delete (dialog->document->buffer, &start, &end);
+  g_clear_pointer (&dialog->converter, mousepad_encoding_release_converter);
 
   if (G_LIKELY (encoding))
     {
       /* set encoding */
       mousepad_file_set_encoding (dialog->document->file, encoding);
 
-      /* try to open the file */
-      result = mousepad_file_open (dialog->document->file, 0, 0, TRUE, TRUE, TRUE, &error);
+      /* only decode the first page of the file, the next ones being decoded on demand and
+       * the whole file once the encoding is confirmed */
+      if (dialog->stream != NULL)
+        {
+          if (!mousepad_encoding_dialog_preview_rewind (dialog, &error))
+            result = ERROR_READING_FAILED;
+          else if ((dialog->converter = mousepad_encoding_get_converter (
+                      "UTF-8", mousepad_encoding_get_charset (encoding), &error)) == NULL)
+            result = ERROR_CONVERTING_FAILED;
+          else
+            {
+              dialog->unit = mousepad_encoding_get_unit_size (encoding);
+              mousepad_encoding_dialog_preview_page (dialog);
+            }
+        }
     }
   /* unsupported system charset */
   else
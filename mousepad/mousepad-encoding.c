@@ -269,13 +269,48 @@ mousepad_encoding_read_bom (const gchar *contents,
 
 
 
-void
-mousepad_encoding_write_bom (MousepadEncoding *encoding,
-                             gsize *length,
-                             gchar **contents)
+gboolean
+mousepad_encoding_is_unicode (MousepadEncoding encoding)
+{
+  return encoding == MOUSEPAD_ENCODING_UTF_7
+         || encoding == MOUSEPAD_ENCODING_UTF_8
+         || encoding == MOUSEPAD_ENCODING_UTF_16BE
+         || encoding == MOUSEPAD_ENCODING_UTF_16LE
+         || encoding == MOUSEPAD_ENCODING_UTF_32BE
+         || encoding == MOUSEPAD_ENCODING_UTF_32LE;
+}
+
+
+
+/* size in bytes of the code units of an encoding, a null character being a null unit */
+gsize
+mousepad_encoding_get_unit_size (MousepadEncoding encoding)
 {
-  guchar bom[4];
-  gsize bytes = 0, n;
+  switch (encoding)
+    {
+    case MOUSEPAD_ENCODING_UTF_16LE:
+    case MOUSEPAD_ENCODING_UTF_16BE:
+    case MOUSEPAD_ENCODING_UCS_2LE:
+    case MOUSEPAD_ENCODING_UCS_2BE:
+      return 2;
+
+    case MOUSEPAD_ENCODING_UTF_32LE:
+    case MOUSEPAD_ENCODING_UTF_32BE:
+      return 4;
+
+    default:
+      return 1;
+    }
+}
+
+
+
+const gchar *
+mousepad_encoding_get_bom (MousepadEncoding *encoding,
+                           gsize *bom_length)
+{
+  const gchar *bom;
+  gsize bytes;
 
   switch (*encoding)
     {
@@ -283,58 +318,845 @@ mousepad_encoding_write_bom (MousepadEncoding *encoding,
     case MOUSEPAD_ENCODING_UTF_7:
     case MOUSEPAD_ENCODING_UTF_8:
       *encoding = MOUSEPAD_ENCODING_UTF_8;
-      bom[0] = 0xef;
-      bom[1] = 0xbb;
-      bom[2] = 0xbf;
+      bom = "\xef\xbb\xbf";
       bytes = 3;
       break;
 
     case MOUSEPAD_ENCODING_UTF_16BE:
-      bom[0] = 0xfe;
-      bom[1] = 0xff;
+      bom = "\xfe\xff";
       bytes = 2;
       break;
 
     case MOUSEPAD_ENCODING_UTF_16LE:
-      bom[0] = 0xff;
-      bom[1] = 0xfe;
+      bom = "\xff\xfe";
       bytes = 2;
       break;
 
     case MOUSEPAD_ENCODING_UTF_32BE:
-      bom[0] = 0x00;
-      bom[1] = 0x00;
-      bom[2] = 0xfe;
-      bom[3] = 0xff;
+      bom = "\x00\x00\xfe\xff";
       bytes = 4;
       break;
 
     case MOUSEPAD_ENCODING_UTF_32LE:
-      bom[0] = 0xff;
-      bom[1] = 0xfe;
-      bom[2] = 0x00;
-      bom[3] = 0x00;
+      bom = "\xff\xfe\x00\x00";
       bytes = 4;
       break;
 
     default:
-      return;
+      bom = NULL;
+      bytes = 0;
       break;
     }
 
-  if (G_LIKELY (bytes > 0))
+  if (bom_length != NULL)
+    *bom_length = bytes;
+
+  return bom;
+}
+
+
+
+/* number of idle converters kept for each charset pair */
+#define CONVERTER_CACHE_SIZE 4
+
+/* idle converters by charset pair, shared by all threads */
+static GMutex converter_cache_lock;
+static GHashTable *converter_cache = NULL;
+static guint converter_cache_hits = 0;
+static guint converter_cache_misses = 0;
+
+
+
+static GSList *
+mousepad_encoding_converter_cache_lookup (const gchar *key)
+{
+  if (converter_cache == NULL)
+    converter_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  return g_hash_table_lookup (converter_cache, key);
+}
+
+
+
+GConverter *
+mousepad_encoding_get_converter (const gchar *to_charset,
+                                 const gchar *from_charset,
+                                 GError **error)
+{
+  GConverter *converter = NULL;
+  GSList *idle;
+  gchar *key;
+
+  key = g_strconcat (to_charset, "\n", from_charset, NULL);
+
+  /* reuse an idle converter if any, ready for a new conversion */
+  g_mutex_lock (&converter_cache_lock);
+  if ((idle = mousepad_encoding_converter_cache_lookup (key)) != NULL)
+    {
+      converter = idle->data;
+      g_hash_table_insert (converter_cache, g_strdup (key), g_slist_delete_link (idle, idle));
+      converter_cache_hits++;
+    }
+  else
+    converter_cache_misses++;
+
+  g_mutex_unlock (&converter_cache_lock);
+  g_free (key);
+
+  if (converter == NULL)
+    converter = G_CONVERTER (g_charset_converter_new (to_charset, from_charset, error));
+
+  return converter;
+}
+
+
+
+void
+mousepad_encoding_release_converter (GConverter *converter)
+{
+  GSList *idle;
+  gchar *to_charset, *from_charset, *key;
+
+  g_return_if_fail (G_IS_CHARSET_CONVERTER (converter));
+
+  /* forget the state of the last conversion */
+  g_converter_reset (converter);
+
+  g_object_get (converter, "to-charset", &to_charset, "from-charset", &from_charset, NULL);
+  key = g_strconcat (to_charset, "\n", from_charset, NULL);
+  g_free (to_charset);
+  g_free (from_charset);
+
+  /* keep it for later use, unless there are enough idle converters for this pair */
+  g_mutex_lock (&converter_cache_lock);
+  idle = mousepad_encoding_converter_cache_lookup (key);
+  if (g_slist_length (idle) < CONVERTER_CACHE_SIZE)
+    {
+      g_hash_table_insert (converter_cache, g_strdup (key), g_slist_prepend (idle, converter));
+      converter = NULL;
+    }
+
+  g_mutex_unlock (&converter_cache_lock);
+  g_free (key);
+
+  if (converter != NULL)
+    g_object_unref (converter);
+}
+
+
+
+void
+mousepad_encoding_clear_converters (void)
+{
+  GHashTableIter iter;
+  gpointer idle;
+
+  g_mutex_lock (&converter_cache_lock);
+
+  /* shown with G_MESSAGES_DEBUG=Mousepad, to check that converters are reused */
+  g_debug ("Charset converters: %u reused, %u created",
+           converter_cache_hits, converter_cache_misses);
+
+  if (converter_cache != NULL)
+    {
+      g_hash_table_iter_init (&iter, converter_cache);
+      while (g_hash_table_iter_next (&iter, NULL, &idle))
+        g_slist_free_full (idle, g_object_unref);
+
+      g_clear_pointer (&converter_cache, g_hash_table_destroy);
+    }
+
+  g_mutex_unlock (&converter_cache_lock);
+}
+
+
+
+/* single-byte encodings ranked by the detector, most widespread first in each family,
+ * since the detector can hardly tell them apart when the contents are ambiguous */
+static const MousepadEncoding detector_single_byte_encodings[] = {
+  MOUSEPAD_ENCODING_WINDOWS_1252, MOUSEPAD_ENCODING_ISO_8859_15, MOUSEPAD_ENCODING_ISO_8859_1,
+  MOUSEPAD_ENCODING_IBM_850, MOUSEPAD_ENCODING_ISO_8859_14, MOUSEPAD_ENCODING_ISO_8859_10,
+  MOUSEPAD_ENCODING_ISO_8859_3, MOUSEPAD_ENCODING_ISO_8859_16,
+  MOUSEPAD_ENCODING_WINDOWS_1250, MOUSEPAD_ENCODING_ISO_8859_2, MOUSEPAD_ENCODING_IBM_852,
+  MOUSEPAD_ENCODING_WINDOWS_1254, MOUSEPAD_ENCODING_ISO_8859_9, MOUSEPAD_ENCODING_IBM_857,
+  MOUSEPAD_ENCODING_WINDOWS_1257, MOUSEPAD_ENCODING_ISO_8859_4, MOUSEPAD_ENCODING_ISO_8859_13,
+  MOUSEPAD_ENCODING_WINDOWS_1251, MOUSEPAD_ENCODING_KOI8_R, MOUSEPAD_ENCODING_KOI8_U,
+  MOUSEPAD_ENCODING_ISO_8859_5, MOUSEPAD_ENCODING_CP_866, MOUSEPAD_ENCODING_IBM_855,
+  MOUSEPAD_ENCODING_ISO_IR_111,
+  MOUSEPAD_ENCODING_WINDOWS_1253, MOUSEPAD_ENCODING_ISO_8859_7,
+  MOUSEPAD_ENCODING_WINDOWS_1255, MOUSEPAD_ENCODING_ISO_8859_8_I, MOUSEPAD_ENCODING_ISO_8859_8,
+  MOUSEPAD_ENCODING_IBM_862,
+  MOUSEPAD_ENCODING_WINDOWS_1256, MOUSEPAD_ENCODING_ISO_8859_6, MOUSEPAD_ENCODING_IBM_864,
+  MOUSEPAD_ENCODING_WINDOWS_1258, MOUSEPAD_ENCODING_TCVN, MOUSEPAD_ENCODING_VISCII,
+  MOUSEPAD_ENCODING_TIS_620, MOUSEPAD_ENCODING_ARMSCII_8, MOUSEPAD_ENCODING_GEOSTD8
+};
+
+/* multibyte encodings checked by a state machine, in the same order of preference */
+static const MousepadEncoding detector_multibyte_encodings[] = {
+  MOUSEPAD_ENCODING_UTF_8,
+  MOUSEPAD_ENCODING_GB18030, MOUSEPAD_ENCODING_GBK, MOUSEPAD_ENCODING_GB2312,
+  MOUSEPAD_ENCODING_BIG5, MOUSEPAD_ENCODING_BIG5_HKSCS,
+  MOUSEPAD_ENCODING_EUC_KR, MOUSEPAD_ENCODING_UHC,
+  MOUSEPAD_ENCODING_EUC_JP, MOUSEPAD_ENCODING_SHIFT_JIS
+};
+
+/* the most frequent lowercase letters in the languages covered by the single-byte
+ * encodings above, used to weight the byte frequencies of each of them */
+static const gchar detector_frequent_letters[] =
+  "éèàçêâôüöäßñóáíúãõøåæœłśćąęńżźšžčřěůýőűğış"
+  "оеаинтсрвлкм" "αοειτσνηρκ" "יוהלארמב" "الينمورت" "นอาเกรมงยว" "աեոնրիկսվտ" "აიესრმლნდვ"
+  "đơưạảếệịọồộờủứự";
+
+/* the most frequent characters in the languages covered by the multibyte encodings above,
+ * in the same order, used to weight the character frequencies of each of them */
+static const gchar *detector_frequent_chars[] = {
+  NULL,
+  "的一是不了在人有我他这个们中来上大为和国地到以说时要就出会可也你对生能而子那得于着下自之年过发后作里，。",
+  "的一是不了在人有我他这个们中来上大为和国地到以说时要就出会可也你对生能而子那得于着下自之年过发后作里，。",
+  "的一是不了在人有我他这个们中来上大为和国地到以说时要就出会可也你对生能而子那得于着下自之年过发后作里，。",
+  "的一是不了在人有我他這個們中來上大為和國地到以說時要就出會可也你對生能而子那得於著下自之年過發後作裡，。",
+  "的一是不了在人有我他這個們中來上大為和國地到以說時要就出會可也你對生能而子那得於著下自之年過發後作裡，。",
+  "이다는의에하고을가서지한로를기들니자사도리아으수해었나대정시인적",
+  "이다는의에하고을가서지한로를기들니자사도리아으수해었나대정시인적",
+  "のにはをたがでてしとなるいれかもすあうったこ、。",
+  "のにはをたがでてしとなるいれかもすあうったこ、。"
+};
+
+/* what a byte in the range 0x80-0xff stands for in a single-byte encoding */
+typedef struct _MousepadDetectorByte
+{
+  gfloat weight;
+  gboolean defined;
+  gboolean letter;
+  gboolean in_script;
+} MousepadDetectorByte;
+
+static MousepadDetectorByte detector_tables[G_N_ELEMENTS (detector_single_byte_encodings)][128];
+static gboolean detector_latin[G_N_ELEMENTS (detector_single_byte_encodings)];
+
+/* the frequent characters above encoded in each multibyte encoding */
+static guint32 detector_frequent_codes[G_N_ELEMENTS (detector_multibyte_encodings)][64];
+static guint detector_n_frequent_codes[G_N_ELEMENTS (detector_multibyte_encodings)];
+
+/* state machine checking the contents against a multibyte encoding */
+typedef struct _MousepadDetectorMachine
+{
+  MousepadEncoding encoding;
+  gboolean failed;
+
+  /* the character being read */
+  guchar bytes[4];
+  guint n_bytes, length;
+
+  /* index of the encoding in the multibyte encodings above */
+  guint index;
+
+  /* number of multibyte characters, and of frequent ones */
+  gsize n_chars, n_frequent;
+} MousepadDetectorMachine;
+
+/* statistics collected in a single pass over the contents */
+typedef struct _MousepadDetector
+{
+  /* byte frequencies, and high bytes following another high byte */
+  gsize counts[256];
+  gsize n_high_pairs;
+
+  /* multibyte state machines */
+  MousepadDetectorMachine machines[G_N_ELEMENTS (detector_multibyte_encodings)];
+
+  /* ISO-2022 escape sequences and HZ shift sequences */
+  gsize n_iso_2022_jp, n_iso_2022_kr, n_hz_open, n_hz_close;
+
+  /* UTF-16 code units in the most used blocks, and surrogate errors */
+  gsize n_plausible_le, n_plausible_be;
+  gboolean surrogate_le, surrogate_be, failed_16le, failed_16be;
+
+  /* UTF-32 validity and non-null code units */
+  gboolean failed_32le, failed_32be;
+  gsize n_nonzero_32;
+} MousepadDetector;
+
+
+
+static MousepadDetectorByte
+mousepad_encoding_detector_byte (gunichar c)
+{
+  MousepadDetectorByte byte = { 0.0, TRUE, FALSE, FALSE };
+
+  if (g_unichar_isalpha (c))
+    {
+      byte.letter = TRUE;
+      byte.weight = g_unichar_isupper (c) ? 0.6 : 1.0;
+      if (g_utf8_strchr (detector_frequent_letters, -1, g_unichar_tolower (c)) != NULL)
+        byte.weight += 1.0;
+    }
+  else if (g_unichar_ismark (c))
+    byte.weight = 0.6;
+  else if (g_unichar_iscntrl (c))
+    byte.weight = -1.0;
+  else if (g_unichar_type (c) == G_UNICODE_SPACE_SEPARATOR || g_unichar_ispunct (c)
+           || g_unichar_type (c) == G_UNICODE_CURRENCY_SYMBOL)
+    byte.weight = 0.5;
+  else
+    byte.weight = 0.1;
+
+  return byte;
+}
+
+
+
+static void
+mousepad_encoding_detector_init_tables (void)
+{
+  static gsize initialized = 0;
+  GIConv converter;
+  GUnicodeScript scripts[128], script;
+  gunichar chars[128];
+  gchar byte, *inbuf, *outbuf, buffer[16], *encoded;
+  gsize inleft, outleft, length;
+  guint i, n, m, count, max;
+
+  if (!g_once_init_enter (&initialized))
+    return;
+
+  for (i = 0; i < G_N_ELEMENTS (detector_single_byte_encodings); i++)
+    {
+      converter = g_iconv_open ("UTF-8", mousepad_encoding_get_charset (detector_single_byte_encodings[i]));
+
+      /* decode the high bytes one by one, flushing the converter each time, since some
+       * encodings wait for combining characters */
+      for (n = 0; n < 128; n++)
+        {
+          byte = (gchar) (n + 128);
+          inbuf = &byte;
+          inleft = 1;
+          outbuf = buffer;
+          outleft = sizeof (buffer) - 1;
+          chars[n] = (gunichar) -1;
+          if (converter != (GIConv) -1
+              && g_iconv (converter, &inbuf, &inleft, &outbuf, &outleft) != (gsize) -1
+              && g_iconv (converter, NULL, NULL, &outbuf, &outleft) != (gsize) -1
+              && outbuf > buffer)
+            {
+              *outbuf = '\0';
+              chars[n] = g_utf8_get_char_validated (buffer, outbuf - buffer);
+            }
+
+          if (converter != (GIConv) -1)
+            g_iconv (converter, NULL, NULL, NULL, NULL);
+
+          scripts[n] = G_UNICODE_SCRIPT_INVALID_CODE;
+          if (chars[n] == (gunichar) -1 || chars[n] == (gunichar) -2)
+            detector_tables[i][n].defined = FALSE;
+          else
+            {
+              detector_tables[i][n] = mousepad_encoding_detector_byte (chars[n]);
+              if (g_unichar_isalpha (chars[n]))
+                scripts[n] = g_unichar_get_script (chars[n]);
+            }
+        }
+
+      /* the script of the encoding is the one of most of its letters */
+      for (n = 0, max = 0, script = G_UNICODE_SCRIPT_LATIN; n < 128; n++)
+        {
+          if (scripts[n] == G_UNICODE_SCRIPT_INVALID_CODE)
+            continue;
+
+          for (m = 0, count = 0; m < 128; m++)
+            count += (scripts[m] == scripts[n]);
+
+          if (count > max)
+            {
+              max = count;
+              script = scripts[n];
+            }
+        }
+
+      for (n = 0; n < 128; n++)
+        detector_tables[i][n].in_script = (scripts[n] == script);
+
+      detector_latin[i] = (script == G_UNICODE_SCRIPT_LATIN);
+
+      if (converter != (GIConv) -1)
+        g_iconv_close (converter);
+    }
+
+  for (i = 1; i < G_N_ELEMENTS (detector_multibyte_encodings); i++)
+    {
+      encoded = g_convert (detector_frequent_chars[i], -1,
+                           mousepad_encoding_get_charset (detector_multibyte_encodings[i]),
+                           "UTF-8", NULL, &length, NULL);
+      if (encoded == NULL)
+        continue;
+
+      /* the frequent characters are all two bytes long */
+      for (n = 0; n + 1 < length && detector_n_frequent_codes[i] < 64; n += 2)
+        detector_frequent_codes[i][detector_n_frequent_codes[i]++] = ((guchar) encoded[n] << 8) | (guchar) encoded[n + 1];
+
+      g_free (encoded);
+    }
+
+  g_once_init_leave (&initialized, 1);
+}
+
+
+
+static guint
+mousepad_encoding_detector_lead (MousepadEncoding encoding,
+                                 guchar c)
+{
+  switch (encoding)
+    {
+    case MOUSEPAD_ENCODING_UTF_8:
+      return c < 0xc2 ? 0 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : c < 0xf5 ? 4 : 0;
+
+    case MOUSEPAD_ENCODING_SHIFT_JIS:
+      return (c >= 0xa1 && c <= 0xdf) ? 1 : ((c >= 0x81 && c <= 0x9f) || (c >= 0xe0 && c <= 0xef)) ? 2 : 0;
+
+    case MOUSEPAD_ENCODING_EUC_JP:
+      return c == 0x8e ? 2 : c == 0x8f ? 3 : (c >= 0xa1 && c <= 0xfe) ? 2 : 0;
+
+    case MOUSEPAD_ENCODING_EUC_KR:
+      return (c >= 0xa1 && c <= 0xfe) ? 2 : 0;
+
+    case MOUSEPAD_ENCODING_GB2312:
+      return (c >= 0xa1 && c <= 0xf7) ? 2 : 0;
+
+    case MOUSEPAD_ENCODING_BIG5:
+      return (c >= 0xa1 && c <= 0xf9) ? 2 : 0;
+
+    /* GB18030 characters are four bytes long if the second byte is a digit */
+    case MOUSEPAD_ENCODING_UHC:
+    case MOUSEPAD_ENCODING_GBK:
+    case MOUSEPAD_ENCODING_GB18030:
+    case MOUSEPAD_ENCODING_BIG5_HKSCS:
+      return (c >= 0x81 && c <= 0xfe) ? 2 : 0;
+
+    default:
+      return 0;
+    }
+}
+
+
+
+static gboolean
+mousepad_encoding_detector_trail (MousepadDetectorMachine *machine,
+                                  guchar c)
+{
+  guchar lead = machine->bytes[0];
+
+  switch (machine->encoding)
+    {
+    case MOUSEPAD_ENCODING_UTF_8:
+      if (machine->n_bytes == 1)
+        {
+          /* overlong forms, surrogates and code points beyond U+10FFFF */
+          if ((lead == 0xe0 && c < 0xa0) || (lead == 0xed && c >= 0xa0)
+              || (lead == 0xf0 && c < 0x90) || (lead == 0xf4 && c >= 0x90))
+            return FALSE;
+        }
+
+      return c >= 0x80 && c <= 0xbf;
+
+    case MOUSEPAD_ENCODING_SHIFT_JIS:
+      return (c >= 0x40 && c <= 0x7e) || (c >= 0x80 && c <= 0xfc);
+
+    case MOUSEPAD_ENCODING_EUC_JP:
+      return lead == 0x8e ? (c >= 0xa1 && c <= 0xdf) : (c >= 0xa1 && c <= 0xfe);
+
+    case MOUSEPAD_ENCODING_EUC_KR:
+    case MOUSEPAD_ENCODING_GB2312:
+      return c >= 0xa1 && c <= 0xfe;
+
+    case MOUSEPAD_ENCODING_UHC:
+      return (c >= 0x41 && c <= 0x5a) || (c >= 0x61 && c <= 0x7a) || (c >= 0x81 && c <= 0xfe);
+
+    case MOUSEPAD_ENCODING_GB18030:
+      if (machine->n_bytes == 1 && c >= 0x30 && c <= 0x39)
+        {
+          machine->length = 4;
+          return TRUE;
+        }
+      else if (machine->n_bytes == 2)
+        return c >= 0x81 && c <= 0xfe;
+      else if (machine->n_bytes == 3)
+        return c >= 0x30 && c <= 0x39;
+
+      /* fall through */
+
+    case MOUSEPAD_ENCODING_GBK:
+      return (c >= 0x40 && c <= 0x7e) || (c >= 0x80 && c <= 0xfe);
+
+    case MOUSEPAD_ENCODING_BIG5:
+    case MOUSEPAD_ENCODING_BIG5_HKSCS:
+      return (c >= 0x40 && c <= 0x7e) || (c >= 0xa1 && c <= 0xfe);
+
+    default:
+      return FALSE;
+    }
+}
+
+
+
+static void
+mousepad_encoding_detector_char (MousepadDetectorMachine *machine)
+{
+  guint32 code;
+  guint n;
+
+  machine->n_chars++;
+  if (machine->length != 2)
+    return;
+
+  code = (machine->bytes[0] << 8) | machine->bytes[1];
+  for (n = 0; n < detector_n_frequent_codes[machine->index]; n++)
+    if (detector_frequent_codes[machine->index][n] == code)
+      {
+        machine->n_frequent++;
+        break;
+      }
+}
+
+
+
+static inline void
+mousepad_encoding_detector_step (MousepadDetectorMachine *machine,
+                                 guchar c)
+{
+  if (machine->failed)
+    return;
+
+  /* ASCII characters are shared by all these encodings */
+  if (machine->n_bytes == 0)
     {
-      /* realloc the contents string */
-      *contents = g_renew (gchar, *contents, *length + bytes + 1);
+      if (c < 0x80)
+        return;
+
+      if ((machine->length = mousepad_encoding_detector_lead (machine->encoding, c)) == 0)
+        {
+          machine->failed = TRUE;
+          return;
+        }
+    }
+  else if (!mousepad_encoding_detector_trail (machine, c))
+    {
+      machine->failed = TRUE;
+      return;
+    }
+
+  machine->bytes[machine->n_bytes++] = c;
+  if (machine->n_bytes == machine->length)
+    {
+      mousepad_encoding_detector_char (machine);
+      machine->n_bytes = 0;
+    }
+}
 
-      /* move the existing contents */
-      memmove (*contents + bytes, *contents, *length + 1);
 
-      /* write the bom at the start of the contents */
-      for (n = 0; n < bytes; n++)
-        (*contents)[n] = bom[n];
 
-      /* increase the length */
-      *length += bytes;
+static inline gboolean
+mousepad_encoding_detector_plausible (guchar high,
+                                      guchar low)
+{
+  switch (high)
+    {
+    /* Latin-1 without controls, except for line endings and tabs */
+    case 0x00:
+      return (low >= 0x20 && low != 0x7f && (low < 0x80 || low >= 0xa0))
+             || low == '\n' || low == '\r' || low == '\t';
+
+    /* Latin extended, Greek, Cyrillic, Armenian, Hebrew, Arabic, Thai, Georgian,
+     * punctuation, CJK punctuation and kana, full width forms */
+    case 0x01: case 0x03: case 0x04: case 0x05: case 0x06: case 0x0e: case 0x10:
+    case 0x20: case 0x30: case 0xff:
+      return TRUE;
+
+    /* CJK ideographs and hangul */
+    default:
+      return (high >= 0x4e && high <= 0x9f) || (high >= 0xac && high <= 0xd7);
     }
 }
+
+
+
+static inline void
+mousepad_encoding_detector_utf_16 (gboolean *surrogate,
+                                   gboolean *failed,
+                                   guint unit)
+{
+  if (unit >= 0xd800 && unit <= 0xdbff)
+    {
+      *failed |= *surrogate;
+      *surrogate = TRUE;
+    }
+  else if (unit >= 0xdc00 && unit <= 0xdfff)
+    {
+      *failed |= !*surrogate;
+      *surrogate = FALSE;
+    }
+  else
+    {
+      *failed |= *surrogate;
+      *surrogate = FALSE;
+    }
+}
+
+
+
+static void
+mousepad_encoding_detector_scan (MousepadDetector *detector,
+                                 const guchar *contents,
+                                 gsize length)
+{
+  guint32 unit;
+  gsize i, n;
+  guchar c;
+
+  for (i = 0; i < length; i++)
+    {
+      c = contents[i];
+      detector->counts[c]++;
+
+      /* 8-bit encodings */
+      if (c >= 0x80 && i > 0 && contents[i - 1] >= 0x80)
+        detector->n_high_pairs++;
+
+      for (n = 0; n < G_N_ELEMENTS (detector->machines); n++)
+        mousepad_encoding_detector_step (detector->machines + n, c);
+
+      /* 7-bit encodings */
+      if (i >= 2 && contents[i - 2] == 0x1b && contents[i - 1] == '$' && (c == 'B' || c == '@'))
+        detector->n_iso_2022_jp++;
+      else if (i >= 3 && contents[i - 3] == 0x1b && contents[i - 2] == '$' && contents[i - 1] == ')'
+               && c == 'C')
+        detector->n_iso_2022_kr++;
+      else if (i >= 1 && contents[i - 1] == '~' && c == '{')
+        detector->n_hz_open++;
+      else if (i >= 1 && contents[i - 1] == '~' && c == '}')
+        detector->n_hz_close++;
+
+      /* UTF-16 code units */
+      if (i & 1)
+        {
+          detector->n_plausible_le += mousepad_encoding_detector_plausible (c, contents[i - 1]);
+          detector->n_plausible_be += mousepad_encoding_detector_plausible (contents[i - 1], c);
+
+          mousepad_encoding_detector_utf_16 (&detector->surrogate_le, &detector->failed_16le,
+                                             contents[i - 1] | (c << 8));
+          mousepad_encoding_detector_utf_16 (&detector->surrogate_be, &detector->failed_16be,
+                                             (contents[i - 1] << 8) | c);
+        }
+
+      /* UTF-32 code units */
+      if ((i & 3) == 3)
+        {
+          unit = contents[i - 3] | (contents[i - 2] << 8) | (contents[i - 1] << 16) | ((guint32) c << 24);
+          detector->failed_32le |= (unit > 0x10ffff || (unit >= 0xd800 && unit <= 0xdfff));
+          detector->n_nonzero_32 += (unit != 0);
+
+          unit = GUINT32_SWAP_LE_BE (unit);
+          detector->failed_32be |= (unit > 0x10ffff || (unit >= 0xd800 && unit <= 0xdfff));
+        }
+    }
+}
+
+
+
+static gdouble
+mousepad_encoding_detector_multibyte (MousepadDetectorMachine *machine)
+{
+  gdouble confidence;
+
+  if (machine->failed || machine->n_chars == 0)
+    return 0.0;
+
+  /* all the high bytes form valid UTF-8 sequences: this is hardly a coincidence */
+  if (machine->encoding == MOUSEPAD_ENCODING_UTF_8)
+    return 1.0;
+
+  /* text in the language of the encoding is made of frequent characters for a good
+   * part, unlike text in another encoding sharing the same byte ranges */
+  confidence = 0.3 + 0.65 * MIN (1.0, 4.0 * machine->n_frequent / machine->n_chars);
+
+  /* a few characters are not enough to be sure */
+  if (machine->n_chars < 8)
+    confidence *= 0.8;
+
+  return confidence;
+}
+
+
+
+static gdouble
+mousepad_encoding_detector_single_byte (MousepadDetector *detector,
+                                        guint index)
+{
+  const MousepadDetectorByte *table = detector_tables[index];
+  gdouble weight = 0.0, plausibility, confidence;
+  gsize n, total = 0, letters = 0, in_script = 0;
+
+  for (n = 0; n < 128; n++)
+    {
+      if (detector->counts[n + 128] == 0)
+        continue;
+
+      /* the contents can't be converted */
+      if (!table[n].defined)
+        return 0.0;
+
+      total += detector->counts[n + 128];
+      weight += table[n].weight * detector->counts[n + 128];
+      if (table[n].letter)
+        {
+          letters += detector->counts[n + 128];
+          in_script += table[n].in_script * detector->counts[n + 128];
+        }
+    }
+
+  if (total == 0)
+    return 0.0;
+
+  /* accented letters are surrounded by ASCII letters in texts written in a Latin script,
+   * but letters of other scripts follow each other */
+  plausibility = (gdouble) detector->n_high_pairs / total;
+  plausibility = detector_latin[index] ? 1.0 - 0.8 * plausibility : 0.2 + 0.8 * plausibility;
+
+  confidence = CLAMP (weight / (2.0 * total), 0.0, 1.0) * plausibility * 0.9;
+  if (letters > 0)
+    confidence *= (gdouble) in_script / letters;
+
+  return confidence;
+}
+
+
+
+static gint
+mousepad_encoding_compare_candidates (gconstpointer a,
+                                      gconstpointer b,
+                                      gpointer data)
+{
+  gdouble ca = ((const MousepadEncodingCandidate *) a)->confidence;
+  gdouble cb = ((const MousepadEncodingCandidate *) b)->confidence;
+
+  return (ca < cb) - (ca > cb);
+}
+
+
+
+guint
+mousepad_encoding_detect (const gchar *contents,
+                          gsize length,
+                          MousepadEncodingCandidate *candidates,
+                          guint n_candidates)
+{
+  MousepadEncodingCandidate ranking[MOUSEPAD_N_ENCODINGS];
+  MousepadDetector *detector;
+  MousepadEncoding system;
+  gsize n, n_units, n_high, n_nul;
+  guint n_ranked = 0;
+
+  g_return_val_if_fail (contents != NULL || length == 0, 0);
+  g_return_val_if_fail (candidates != NULL || n_candidates == 0, 0);
+
+  if (length == 0 || n_candidates == 0)
+    return 0;
+
+  mousepad_encoding_detector_init_tables ();
+
+  /* collect all the statistics in a single pass */
+  detector = g_new0 (MousepadDetector, 1);
+  for (n = 0; n < G_N_ELEMENTS (detector_multibyte_encodings); n++)
+    {
+      detector->machines[n].encoding = detector_multibyte_encodings[n];
+      detector->machines[n].index = n;
+    }
+
+  mousepad_encoding_detector_scan (detector, (const guchar *) contents, length);
+
+  for (n = 0x80, n_high = 0; n < 0x100; n++)
+    n_high += detector->counts[n];
+
+  n_nul = detector->counts[0];
+
+#define RANK(enc, conf) \
+  G_STMT_START \
+  { \
+    ranking[n_ranked].encoding = (enc); \
+    ranking[n_ranked].confidence = (conf); \
+    if (ranking[n_ranked].confidence > 0.0) \
+      n_ranked++; \
+  } \
+  G_STMT_END
+
+  /* BOM-less UTF-32: all code units valid, but null bytes within them */
+  n_units = length / 4;
+  if (n_nul > 0 && n_units > 0 && detector->n_nonzero_32 * 10 >= n_units * 9)
+    {
+      if (!detector->failed_32le)
+        RANK (MOUSEPAD_ENCODING_UTF_32LE, detector->failed_32be ? 0.97 : 0.9);
+      if (!detector->failed_32be)
+        RANK (MOUSEPAD_ENCODING_UTF_32BE, detector->failed_32le ? 0.97 : 0.9);
+    }
+
+  /* BOM-less UTF-16: most code units in the most used blocks, and in fewer ones with the
+   * other byte order */
+  n_units = length / 2;
+  if (n_nul > 0 && n_units > 0)
+    {
+      if (!detector->failed_16le && detector->n_plausible_le * 10 >= n_units * 9
+          && detector->n_plausible_le > detector->n_plausible_be)
+        RANK (MOUSEPAD_ENCODING_UTF_16LE, 0.5 + 0.45 * detector->n_plausible_le / n_units);
+      if (!detector->failed_16be && detector->n_plausible_be * 10 >= n_units * 9
+          && detector->n_plausible_be > detector->n_plausible_le)
+        RANK (MOUSEPAD_ENCODING_UTF_16BE, 0.5 + 0.45 * detector->n_plausible_be / n_units);
+    }
+
+  /* null bytes don't appear in text encoded in 8-bit or 7-bit encodings */
+  if (n_nul == 0)
+    {
+      /* 7-bit encodings */
+      if (n_high == 0)
+        {
+          /* designation sequences are not found in plain text: such contents are valid
+           * in UTF-8, but only make sense in the stateful encoding */
+          if (detector->n_iso_2022_jp > 0)
+            RANK (MOUSEPAD_ENCODING_ISO_2022_JP, 1.0);
+          if (detector->n_iso_2022_kr > 0)
+            RANK (MOUSEPAD_ENCODING_ISO_2022_KR, 1.0);
+
+          RANK (MOUSEPAD_ENCODING_UTF_8, 1.0);
+          RANK (MOUSEPAD_ENCODING_ASCII, 0.95);
+
+          if (detector->n_hz_open > 0 && detector->n_hz_close > 0)
+            RANK (MOUSEPAD_ENCODING_HZ, 0.9);
+        }
+      /* multibyte and single-byte encodings */
+      else
+        {
+          for (n = 0; n < G_N_ELEMENTS (detector->machines); n++)
+            RANK (detector->machines[n].encoding,
+                  mousepad_encoding_detector_multibyte (detector->machines + n));
+
+          /* slightly favor the system encoding among single-byte encodings */
+          system = mousepad_encoding_get_system ();
+          for (n = 0; n < G_N_ELEMENTS (detector_single_byte_encodings); n++)
+            RANK (detector_single_byte_encodings[n],
+                  mousepad_encoding_detector_single_byte (detector, n)
+                    * (detector_single_byte_encodings[n] == system ? 1.05 : 1.0));
+        }
+    }
+
+#undef RANK
+
+  /* rank the candidates, keeping the order of preference for equal confidences */
+  g_qsort_with_data (ranking, n_ranked, sizeof (MousepadEncodingCandidate),
+                     mousepad_encoding_compare_candidates, NULL);
+
+  n_ranked = MIN (n_ranked, n_candidates);
+  memcpy (candidates, ranking, n_ranked * sizeof (MousepadEncodingCandidate));
+
+  g_free (detector);
+
+  return n_ranked;
+}
@@ -103,6 +103,13 @@ typedef enum
   MOUSEPAD_N_ENCODINGS
 } MousepadEncoding;
 
+/* an encoding guessed from the contents, with a confidence between 0 and 1 */
+typedef struct _MousepadEncodingCandidate
+{
+  MousepadEncoding encoding;
+  gdouble confidence;
+} MousepadEncodingCandidate;
+
 
 
 const gchar *
@@ -125,10 +132,32 @@ mousepad_encoding_read_bom (const gchar *contents,
                             gsize length,
                             gsize *bom_length);
 
+gboolean
+mousepad_encoding_is_unicode (MousepadEncoding encoding);
+
+gsize
+mousepad_encoding_get_unit_size (MousepadEncoding encoding);
+
+const gchar *
+mousepad_encoding_get_bom (MousepadEncoding *encoding,
+                           gsize *bom_length);
+
+GConverter *
+mousepad_encoding_get_converter (const gchar *to_charset,
+                                 const gchar *from_charset,
+                                 GError **error);
+
 void
-mousepad_encoding_write_bom (MousepadEncoding *encoding,
-                             gsize *length,
-                             gchar **contents);
+mousepad_encoding_release_converter (GConverter *converter);
+
+void
+mousepad_encoding_clear_converters (void);
+
+guint
+mousepad_encoding_detect (const gchar *contents,
+                          gsize length,
+                          MousepadEncodingCandidate *candidates,
+                          guint n_candidates);
 
 G_END_DECLS
 
@@ -18,6 +18,8 @@
 #include "mousepad-dialogs.h"
 #include "mousepad-file.h"
 #include "mousepad-history.h"
+#include "mousepad-journal.h"
+#include "mousepad-scan.h"
 #include "mousepad-settings.h"
 #include "mousepad-util.h"
 
@@ -31,12 +33,47 @@
 #define realpath(path, resolved_path) NULL
 #endif
 
+/* files larger than this are read in chunks by a worker thread and inserted in the buffer
+ * in time slices, when someone is listening to the loading progress */
+#define LOAD_INTERACTIVE_SIZE (8 * 1024 * 1024)
+#define LOAD_CHUNK_SIZE (1024 * 1024)
+#define LOAD_TIME_SLICE (50 * G_TIME_SPAN_MILLISECOND)
+#define LOAD_PROGRESS_INTERVAL 100
+
+/* the buffer is serialized by slices of this number of characters when saving, and
+ * converted to the file encoding through an output buffer of this number of bytes */
+#define SAVE_CHUNK_SIZE (256 * 1024)
+#define SAVE_BUFFER_SIZE (64 * 1024)
+#define SAVE_PROGRESS_INTERVAL 100
+
+/* the autosave journal is compacted into a new base once it exceeds this size, or a
+ * quarter of the base size */
+#define AUTOSAVE_JOURNAL_MIN_LIMIT (1024 * 1024)
+
+/* the encoding of the contents is guessed from this number of bytes at their start, when they
+ * are not valid in the expected encoding, and used if the guess is confident enough */
+#define ENCODING_DETECTION_SAMPLE_SIZE (64 * 1024)
+#define ENCODING_DETECTION_CONFIDENCE 0.5
+
+/* the positions of the invalid sequences replaced at loading are remembered up to this
+ * number, each of them costing a text mark */
+#define INVALID_SEQUENCES_MAX 1000
+
+/* the saved state is tracked by digests of chunks of this number of characters */
+#define SAVED_STATE_CHUNK_SIZE (64 * 1024)
+#define SAVED_STATE_DIGEST_TYPE G_CHECKSUM_MD5
+#define SAVED_STATE_DIGEST_SIZE 16
+
 enum
 {
   ENCODING_CHANGED,
   EXTERNALLY_MODIFIED,
+  INVALID_SEQUENCES_CHANGED,
+  LARGE_FILE_CHANGED,
+  LOAD_PROGRESS,
   LOCATION_CHANGED,
   READONLY_CHANGED,
+  SAVE_PROGRESS,
   LAST_SIGNAL
 };
 
@@ -58,6 +95,108 @@ mousepad_file_monitor_changed (GFileMonitor *monitor,
 static void
 mousepad_file_set_read_only (MousepadFile *file,
                              gboolean readonly);
+static void
+mousepad_file_autosave_journal_reset (MousepadFile *file);
+
+
+
+/* state of a file loading */
+typedef struct _MousepadFileLoader
+{
+  MousepadFile *file;
+  GFile *location;
+
+  /* whether the file is read in chunks and inserted in time slices, reporting progress */
+  gboolean interactive;
+
+  /* whether invalid sequences have to be replaced when inserting the contents, the file
+   * offsets of those to remember, and how many were replaced */
+  gboolean make_valid;
+  GArray *invalid_offsets;
+  guint n_invalid_offsets;
+
+  /* file offset of the contents start */
+  gsize offset;
+
+  /* file contents, stored in a single allocated buffer, and a view on them */
+  gchar *data;
+  gchar *contents;
+  gsize length, size;
+  gchar *etag;
+
+  /* reading progress from a worker thread */
+  gint read_progress;
+
+  /* insertion in the buffer, from the main thread, before the previous contents which are
+   * kept until the new ones are complete, to be restored if the loading fails */
+  GtkTextMark *boundary;
+  gsize n_inserted, n_total;
+  gint64 last_yield;
+
+  /* contents bytes converted so far, the progress being based on them rather than on the
+   * inserted bytes when the contents are converted, whose size changes */
+  gboolean converting;
+  gsize n_converted;
+
+  /* line lengths of the contents converted chunk by chunk, to switch to large file mode
+   * as soon as the limit is exceeded */
+  gsize line_limit, line_length;
+  gboolean has_eol;
+
+  /* line ending mode set beforehand, not to be detected from the contents */
+  gboolean keep_line_ending;
+} MousepadFileLoader;
+
+/* invalid sequence replaced at loading */
+typedef struct _MousepadInvalidSequence
+{
+  goffset offset;
+  GtkTextMark *mark;
+} MousepadInvalidSequence;
+
+/* state of a file saving */
+typedef struct _MousepadFileWriter
+{
+  /* destination stream, NULL to only check that the contents can be converted */
+  GOutputStream *stream;
+
+  /* converter to the file encoding, NULL for UTF-8 */
+  GConverter *converter;
+  gchar *buffer;
+
+  /* whether the contents must be converted once without being written, to check that
+   * they can be represented in the file encoding */
+  gboolean check_first;
+
+  /* line ending translation */
+  MousepadLineEnding line_ending;
+  GString *translated;
+
+  /* bom written at the start of the file and line ending added at its end, if any */
+  const gchar *bom;
+  gsize bom_length;
+  const gchar *eol;
+} MousepadFileWriter;
+
+/* state of an asynchronous file saving */
+typedef struct _MousepadFileSaver
+{
+  MousepadFile *file;
+  MousepadFileWriter writer;
+
+  /* buffer snapshot, split into slices of SAVE_CHUNK_SIZE characters */
+  GPtrArray *slices;
+  guint revision;
+
+  /* destination */
+  GFile *location;
+  gchar *etag, *new_etag;
+  gboolean make_backup;
+
+  /* saving progress from a worker thread */
+  gint progress;
+  guint progress_id;
+} MousepadFileSaver;
 
 
 
@@ -79,8 +218,8 @@ struct _MousepadFile
   gboolean readonly, symlink;
   guint deleted_id, modified_id;
 
-  /* encoding of the file */
-  MousepadEncoding encoding;
+  /* encoding of the file, and the one it was not valid in if it was detected at loading */
+  MousepadEncoding encoding, rejected_encoding;
 
   /* line ending of the file */
   MousepadLineEnding line_ending;
@@ -91,15 +230,44 @@ struct _MousepadFile
   /* whether the filetype has been set by user or we should guess it */
   gboolean user_set_language;
 
+  /* features turned off in large file mode, none if the file is not large */
+  MousepadLargeFileFeatures disabled_features;
+
+  /* invalid sequences replaced at loading, the first ones only being remembered */
+  GArray *invalid_sequences;
+  guint n_invalid_sequences;
+
   /* autosave */
   GFile *autosave_location;
   gboolean autosave_scheduled;
 
-  /* saved state on disk */
+  /* autosave journal: edits recorded since the last base, journal header to write if it
+   * was not created yet, and how the base was written */
+  struct
+  {
+    MousepadJournal *edits;
+    GBytes *header;
+    gsize size, limit;
+    MousepadEncoding encoding;
+    MousepadLineEnding line_ending;
+    gboolean write_bom;
+    gboolean busy;
+  } journal;
+
+  /* to cancel an interactive loading */
+  GCancellable *cancellable;
+
+  /* buffer revision, and whether an asynchronous saving is in progress */
+  guint revision;
+  gboolean saving;
+
+  /* saved state on disk: the buffer is known to be identical to it except between 'head'
+   * and 'char_count - tail', in saved text coordinates, and the chunks of this region
+   * have been digested before being modified */
   struct
   {
-    gchar *text;
-    gint char_count;
+    guint8 *digests;
+    gint char_count, head, tail;
     MousepadLineEnding line_ending;
     gboolean write_bom;
     guint id;
@@ -138,6 +306,27 @@ mousepad_file_class_init (MousepadFileClass *klass)
                                                     g_cclosure_marshal_VOID__VOID,
                                                     G_TYPE_NONE, 0);
 
+  file_signals[INVALID_SEQUENCES_CHANGED] = g_signal_new (I_ ("invalid-sequences-changed"),
+                                                          G_TYPE_FROM_CLASS (gobject_class),
+                                                          G_SIGNAL_RUN_LAST,
+                                                          0, NULL, NULL,
+                                                          g_cclosure_marshal_VOID__UINT,
+                                                          G_TYPE_NONE, 1, G_TYPE_UINT);
+
+  file_signals[LARGE_FILE_CHANGED] = g_signal_new (I_ ("large-file-changed"),
+                                                   G_TYPE_FROM_CLASS (gobject_class),
+                                                   G_SIGNAL_RUN_LAST,
+                                                   0, NULL, NULL,
+                                                   g_cclosure_marshal_VOID__BOOLEAN,
+                                                   G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+
+  file_signals[LOAD_PROGRESS] = g_signal_new (I_ ("load-progress"),
+                                              G_TYPE_FROM_CLASS (gobject_class),
+                                              G_SIGNAL_RUN_LAST,
+                                              0, NULL, NULL,
+                                              g_cclosure_marshal_VOID__DOUBLE,
+                                              G_TYPE_NONE, 1, G_TYPE_DOUBLE);
+
   file_signals[READONLY_CHANGED] = g_signal_new (I_ ("readonly-changed"),
                                                  G_TYPE_FROM_CLASS (gobject_class),
                                                  G_SIGNAL_RUN_LAST,
@@ -151,6 +340,13 @@ mousepad_file_class_init (MousepadFileClass *klass)
                                                  0, NULL, NULL,
                                                  g_cclosure_marshal_VOID__OBJECT,
                                                  G_TYPE_NONE, 1, G_TYPE_FILE);
+
+  file_signals[SAVE_PROGRESS] = g_signal_new (I_ ("save-progress"),
+                                              G_TYPE_FROM_CLASS (gobject_class),
+                                              G_SIGNAL_RUN_LAST,
+                                              0, NULL, NULL,
+                                              g_cclosure_marshal_VOID__DOUBLE,
+                                              G_TYPE_NONE, 1, G_TYPE_DOUBLE);
 }
 
 
@@ -168,6 +364,7 @@ mousepad_file_init (MousepadFile *file)
   file->deleted_id = 0;
   file->modified_id = 0;
   file->encoding = mousepad_encoding_get_default ();
+  file->rejected_encoding = MOUSEPAD_ENCODING_NONE;
 #ifdef G_OS_WIN32
   file->line_ending = MOUSEPAD_EOL_DOS;
 #else
@@ -176,10 +373,21 @@ mousepad_file_init (MousepadFile *file)
   file->etag = NULL;
   file->write_bom = FALSE;
   file->user_set_language = FALSE;
+  file->disabled_features = 0;
+  file->invalid_sequences = g_array_new (FALSE, FALSE, sizeof (MousepadInvalidSequence));
+  file->n_invalid_sequences = 0;
   file->autosave_location = NULL;
   file->autosave_scheduled = FALSE;
-  file->saved_state.text = g_strdup ("");
+  file->journal.edits = NULL;
+  file->journal.header = NULL;
+  file->journal.busy = FALSE;
+  file->cancellable = g_cancellable_new ();
+  file->revision = 0;
+  file->saving = FALSE;
+  file->saved_state.digests = g_malloc (SAVED_STATE_DIGEST_SIZE);
   file->saved_state.char_count = 0;
+  file->saved_state.head = 0;
+  file->saved_state.tail = 0;
   file->saved_state.line_ending = file->line_ending;
   file->saved_state.write_bom = file->write_bom;
   file->saved_state.id = 0;
@@ -211,26 +419,165 @@ mousepad_file_finalize (GObject *object)
   if (file->autosave_location != NULL)
     g_object_unref (file->autosave_location);
 
-  g_free (file->saved_state.text);
+  if (file->journal.edits != NULL)
+    mousepad_journal_free (file->journal.edits);
+
+  if (file->journal.header != NULL)
+    g_bytes_unref (file->journal.header);
+
+  g_object_unref (file->cancellable);
+  g_free (file->saved_state.digests);
+  g_array_free (file->invalid_sequences, TRUE);
 
   (*G_OBJECT_CLASS (mousepad_file_parent_class)->finalize) (object);
 }
 
 
 
+static void
+mousepad_file_saved_state_update (MousepadFile *file,
+                                  GChecksum *checksum,
+                                  gint start,
+                                  gint end)
+{
+  GtkTextIter start_iter, end_iter;
+  gchar *text;
+
+  if (start >= end)
+    return;
+
+  gtk_text_buffer_get_iter_at_offset (file->buffer, &start_iter, start);
+  gtk_text_buffer_get_iter_at_offset (file->buffer, &end_iter, end);
+  text = gtk_text_buffer_get_slice (file->buffer, &start_iter, &end_iter, TRUE);
+  g_checksum_update (checksum, (const guchar *) text, -1);
+  g_free (text);
+}
+
+
+
+static void
+mousepad_file_saved_state_digest (MousepadFile *file,
+                                  gint chunk,
+                                  gboolean unmodified,
+                                  guint8 *digest)
+{
+  GChecksum *checksum;
+  gsize length = SAVED_STATE_DIGEST_SIZE;
+  gint start, end, shift;
+
+  start = chunk * SAVED_STATE_CHUNK_SIZE;
+  end = MIN (start + SAVED_STATE_CHUNK_SIZE, file->saved_state.char_count);
+  checksum = g_checksum_new (SAVED_STATE_DIGEST_TYPE);
+
+  /* an unmodified chunk is read from the buffer head and/or tail */
+  if (unmodified)
+    {
+      shift = gtk_text_buffer_get_char_count (file->buffer) - file->saved_state.char_count;
+      mousepad_file_saved_state_update (file, checksum, start, MIN (end, file->saved_state.head));
+      mousepad_file_saved_state_update (file, checksum, MAX (start, file->saved_state.head) + shift,
+                                        end + shift);
+    }
+  /* the buffer has the same length as the saved text otherwise */
+  else
+    mousepad_file_saved_state_update (file, checksum, start, end);
+
+  g_checksum_get_digest (checksum, digest, &length);
+  g_checksum_free (checksum);
+}
+
+
+
+static void
+mousepad_file_saved_state_modify (MousepadFile *file,
+                                  gint head,
+                                  gint tail)
+{
+  gint chunk, first, last, old_first = 0, old_last = -1, count = file->saved_state.char_count;
+
+  head = MIN (head, file->saved_state.head);
+  tail = MIN (tail, file->saved_state.tail);
+
+  /* digest the chunks which are about to be modified for the first time */
+  if (head < count - tail)
+    {
+      if (file->saved_state.head < count - file->saved_state.tail)
+        {
+          old_first = file->saved_state.head / SAVED_STATE_CHUNK_SIZE;
+          old_last = (count - file->saved_state.tail - 1) / SAVED_STATE_CHUNK_SIZE;
+        }
+
+      first = head / SAVED_STATE_CHUNK_SIZE;
+      last = (count - tail - 1) / SAVED_STATE_CHUNK_SIZE;
+      for (chunk = first; chunk <= last; chunk++)
+        if (chunk < old_first || chunk > old_last)
+          mousepad_file_saved_state_digest (file, chunk, TRUE,
+                                            file->saved_state.digests + chunk * SAVED_STATE_DIGEST_SIZE);
+    }
+
+  file->saved_state.head = head;
+  file->saved_state.tail = tail;
+}
+
+
+
+static void
+mousepad_file_buffer_insert_text (GtkTextBuffer *buffer,
+                                  GtkTextIter *location,
+                                  gchar *text,
+                                  gint len,
+                                  MousepadFile *file)
+{
+  gint offset;
+
+  offset = gtk_text_iter_get_offset (location);
+  if (file->journal.edits != NULL)
+    mousepad_journal_insert (file->journal.edits, offset, text, len);
+
+  if (file->saved_state.digests != NULL)
+    mousepad_file_saved_state_modify (file, offset, gtk_text_buffer_get_char_count (buffer) - offset);
+}
+
+
+
+static void
+mousepad_file_buffer_delete_range (GtkTextBuffer *buffer,
+                                   GtkTextIter *start,
+                                   GtkTextIter *end,
+                                   MousepadFile *file)
+{
+  if (file->journal.edits != NULL)
+    mousepad_journal_delete (file->journal.edits, gtk_text_iter_get_offset (start),
+                             gtk_text_iter_get_offset (end));
+
+  if (file->saved_state.digests != NULL)
+    mousepad_file_saved_state_modify (file, gtk_text_iter_get_offset (start),
+                                      gtk_text_buffer_get_char_count (buffer)
+                                        - gtk_text_iter_get_offset (end));
+}
+
+
+
 static gboolean
 mousepad_file_buffer_changed_idle (gpointer data)
 {
   MousepadFile *file = data;
-  GtkTextIter start, end;
-  gchar *text;
+  guint8 digest[SAVED_STATE_DIGEST_SIZE];
+  gint chunk, last, count = file->saved_state.char_count;
 
-  gtk_text_buffer_get_bounds (file->buffer, &start, &end);
-  text = gtk_text_buffer_get_slice (file->buffer, &start, &end, TRUE);
-  if (g_strcmp0 (text, file->saved_state.text) == 0)
+  /* compare the modified region with the saved one, chunk by chunk */
+  last = (count - file->saved_state.tail - 1) / SAVED_STATE_CHUNK_SIZE;
+  for (chunk = file->saved_state.head / SAVED_STATE_CHUNK_SIZE;
+       file->saved_state.head < count - file->saved_state.tail && chunk <= last; chunk++)
+    {
+      mousepad_file_saved_state_digest (file, chunk, FALSE, digest);
+      if (memcmp (digest, file->saved_state.digests + chunk * SAVED_STATE_DIGEST_SIZE,
+                  SAVED_STATE_DIGEST_SIZE) != 0)
+        break;
+    }
+
+  if (file->saved_state.head >= count - file->saved_state.tail || chunk > last)
     gtk_text_buffer_set_modified (file->buffer, FALSE);
 
-  g_free (text);
   file->saved_state.id = 0;
 
   return FALSE;
@@ -243,25 +590,26 @@ mousepad_file_buffer_changed (MousepadFile *file)
 {
   g_return_if_fail (MOUSEPAD_IS_FILE (file));
 
+  file->revision++;
   g_clear_handle_id (&file->saved_state.id, g_source_remove);
 
-  if (file->saved_state.text == NULL
+  if (file->saved_state.digests == NULL
       || file->line_ending != file->saved_state.line_ending
       || file->write_bom != file->saved_state.write_bom
       || gtk_text_buffer_get_char_count (file->buffer) != file->saved_state.char_count)
     return;
 
   /*
-   * In addition to being avoided as much as possible by the above tests, the string
-   * comparison is delayed for performance reasons:
+   * In addition to being avoided as much as possible by the above tests, and limited to
+   * the modified region, the comparison is delayed for performance reasons:
    * G_PRIORITY_HIGH_IDLE allows sequences of operations such as replace-all or its undo
    * to be fully completed before it is performed.
-   * This priority level does, however, allow the string comparison to be performed
+   * This priority level does, however, allow the comparison to be performed
    * before graphical operations (resizing, redrawing), or other operations which are
    * performed at G_PRIORITY_HIGH_IDLE + N, so that it does take place for large files,
    * where these operations can take a long time.
    * The small timeout allows other sequences of operations to be performed before the
-   * string comparison while preserving the above priority level, such as typically a
+   * comparison while preserving the above priority level, such as typically a
    * sequence of undos by holding down Ctrl+Z.
    */
   file->saved_state.id = g_timeout_add_full (G_PRIORITY_HIGH_IDLE, 100,
@@ -274,8 +622,7 @@ mousepad_file_buffer_changed (MousepadFile *file)
 static void
 mousepad_file_buffer_modified_changed (MousepadFile *file)
 {
-  GtkTextIter start, end;
-  gchar *text;
+  gint count;
 
   g_return_if_fail (MOUSEPAD_IS_FILE (file));
 
@@ -284,12 +631,14 @@ mousepad_file_buffer_modified_changed (MousepadFile *file)
       || gtk_text_buffer_get_modified (file->buffer))
     return;
 
-  /* buffer was set to unmodified for a named document: update saved state */
-  gtk_text_buffer_get_bounds (file->buffer, &start, &end);
-  text = gtk_text_buffer_get_slice (file->buffer, &start, &end, TRUE);
-  g_free (file->saved_state.text);
-  file->saved_state.text = text;
-  file->saved_state.char_count = gtk_text_buffer_get_char_count (file->buffer);
+  /* buffer was set to unmodified for a named document: update saved state, whose chunks
+   * will be digested when modified */
+  count = gtk_text_buffer_get_char_count (file->buffer);
+  g_free (file->saved_state.digests);
+  file->saved_state.digests = g_malloc ((count / SAVED_STATE_CHUNK_SIZE + 1) * SAVED_STATE_DIGEST_SIZE);
+  file->saved_state.char_count = count;
+  file->saved_state.head = count;
+  file->saved_state.tail = count;
   file->saved_state.line_ending = file->line_ending;
   file->saved_state.write_bom = file->write_bom;
 }
@@ -313,6 +662,10 @@ mousepad_file_new (GtkTextBuffer *buffer)
   g_signal_connect_object (file->buffer, "modified-changed",
                            G_CALLBACK (mousepad_file_buffer_modified_changed),
                            file, G_CONNECT_SWAPPED);
+  g_signal_connect_object (file->buffer, "insert-text",
+                           G_CALLBACK (mousepad_file_buffer_insert_text), file, 0);
+  g_signal_connect_object (file->buffer, "delete-range",
+                           G_CALLBACK (mousepad_file_buffer_delete_range), file, 0);
 
   return file;
 }
@@ -647,7 +1000,7 @@ mousepad_file_invalidate_saved_state (MousepadFile *file)
 {
   g_return_if_fail (MOUSEPAD_IS_FILE (file));
 
-  g_clear_pointer (&file->saved_state.text, g_free);
+  g_clear_pointer (&file->saved_state.digests, g_free);
   gtk_text_buffer_set_modified (file->buffer, TRUE);
 }
 
@@ -663,17 +1016,17 @@ mousepad_file_is_savable (MousepadFile *file)
 
 
 
-void
-mousepad_file_set_encoding (MousepadFile *file,
-                            MousepadEncoding encoding)
+static void
+mousepad_file_set_encoding_real (MousepadFile *file,
+                                 MousepadEncoding encoding,
+                                 MousepadEncoding rejected_encoding)
 {
-  g_return_if_fail (MOUSEPAD_IS_FILE (file));
-
-  if (file->encoding == encoding)
+  if (file->encoding == encoding && file->rejected_encoding == rejected_encoding)
     return;
 
   /* set new encoding */
   file->encoding = encoding;
+  file->rejected_encoding = rejected_encoding;
 
   /* send a signal that the encoding has been changed */
   g_signal_emit (file, file_signals[ENCODING_CHANGED], 0, file->encoding);
@@ -681,6 +1034,28 @@ mousepad_file_set_encoding (MousepadFile *file,
 
 
 
+void
+mousepad_file_set_encoding (MousepadFile *file,
+                            MousepadEncoding encoding)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* the encoding is no longer the detected one */
+  mousepad_file_set_encoding_real (file, encoding, MOUSEPAD_ENCODING_NONE);
+}
+
+
+
+MousepadEncoding
+mousepad_file_get_rejected_encoding (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), MOUSEPAD_ENCODING_NONE);
+
+  return file->rejected_encoding;
+}
+
+
+
 MousepadEncoding
 mousepad_file_get_encoding (MousepadFile *file)
 {
@@ -720,12 +1095,7 @@ mousepad_file_set_write_bom (MousepadFile *file,
   file->write_bom = write_bom;
 
   /* set the encoding to UTF-8 if not already compatible */
-  if (file->encoding != MOUSEPAD_ENCODING_UTF_7
-      && file->encoding != MOUSEPAD_ENCODING_UTF_8
-      && file->encoding != MOUSEPAD_ENCODING_UTF_16BE
-      && file->encoding != MOUSEPAD_ENCODING_UTF_16LE
-      && file->encoding != MOUSEPAD_ENCODING_UTF_32BE
-      && file->encoding != MOUSEPAD_ENCODING_UTF_32LE)
+  if (!mousepad_encoding_is_unicode (file->encoding))
     mousepad_file_set_encoding (file, MOUSEPAD_ENCODING_UTF_8);
 
   mousepad_file_set_modified_unbuffered (file);
@@ -812,6 +1182,13 @@ mousepad_file_set_language (MousepadFile *file,
       return;
     }
 
+  /* don't guess language in large file mode */
+  if (file->disabled_features & MOUSEPAD_LARGE_FILE_LANGUAGE_GUESSING)
+    {
+      gtk_source_buffer_set_language (GTK_SOURCE_BUFFER (file->buffer), NULL);
+      return;
+    }
+
   /* guess language */
   gtk_text_buffer_get_start_iter (file->buffer, &start);
   end = start;
@@ -854,496 +1231,1861 @@ mousepad_file_get_user_set_language (MousepadFile *file)
 
 
 
-gint
-mousepad_file_open (MousepadFile *file,
-                    gint line,
-                    gint column,
-                    gboolean must_exist,
-                    gboolean ignore_bom,
-                    gboolean make_valid,
-                    GError **error)
+static void
+mousepad_file_set_large (MousepadFile *file,
+                         gboolean large)
 {
-  MousepadEncoding bom_encoding;
-  GtkTextIter start, end;
-  GFile *location;
-  GFileInfo *fileinfo;
-  const gchar *charset, *bom_charset, *endc, *n, *m;
-  gchar *contents = NULL, *etag, *temp, *autosave_uri;
-  gsize file_size, written, bom_length;
-  gint retval = ERROR_READING_FAILED;
-
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
-  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (file->buffer), FALSE);
-  g_return_val_if_fail (file->location != NULL, FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  MousepadLargeFileFeatures features;
 
-  /* autosave restore */
-  if ((autosave_uri = mousepad_object_get_data (file->location, "autosave-uri")) != NULL)
-    {
-      location = g_file_new_for_uri (autosave_uri);
+  features = large ? MOUSEPAD_SETTING_GET_FLAGS (LARGE_FILE_DISABLED_FEATURES) : 0;
+  if (features == file->disabled_features)
+    return;
 
-      /* if autosaved file has a reference file on disk, load it first to init 'saved_state' */
-      if (!g_file_equal (location, file->location))
-        {
-          autosave_uri = g_strdup (autosave_uri);
-          mousepad_object_set_data (file->location, "autosave-uri", NULL);
-          mousepad_file_open (file, line, column, must_exist, ignore_bom, make_valid, NULL);
-          mousepad_object_set_data (file->location, "autosave-uri", autosave_uri);
-        }
-    }
-  else
-    {
-      location = g_object_ref (file->location);
+  file->disabled_features = features;
+  g_signal_emit (file, file_signals[LARGE_FILE_CHANGED], 0, large);
+}
 
-      /* update monitor location in case of a symlink (really useful only on reload,
-       * but not very costly) */
-      if (file->monitor != NULL
-          && (file->symlink || (file->symlink = mousepad_util_is_symlink (file->location))))
-        mousepad_file_set_monitor (file);
-    }
 
-  /* if the file does not exist and this is allowed, no problem */
-  if (!g_file_load_contents (location, NULL, &contents, &file_size, &etag, error)
-      && (error == NULL || g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-      && !must_exist)
-    {
-      g_clear_error (error);
-      g_object_unref (location);
 
-      return 0;
-    }
-  /* the file was sucessfully loaded */
-  else if (G_LIKELY (error == NULL || *error == NULL))
-    {
-      /* update etag */
-      g_free (file->etag);
-      file->etag = etag;
+gboolean
+mousepad_file_is_large (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
 
-      /* make sure the buffer is empty, in particular for reloading */
-      gtk_text_buffer_get_bounds (file->buffer, &start, &end);
-      gtk_text_buffer_delete (file->buffer, &start, &end);
+  return file->disabled_features != 0;
+}
 
-      if (G_LIKELY (file_size > 0))
-        {
-          /* get the encoding charset */
-          charset = mousepad_encoding_get_charset (file->encoding);
 
-          /* detect if there is a bom with the encoding type */
-          if (!ignore_bom)
-            {
-              bom_encoding = mousepad_encoding_read_bom (contents, file_size, &bom_length);
-              if (G_UNLIKELY (bom_encoding != MOUSEPAD_ENCODING_NONE))
-                {
-                  /* ask the user what to do if he has set an encoding different from default
-                   * (including with respect to GSettings, i.e. UTF-8 only) */
-                  bom_charset = mousepad_encoding_get_charset (bom_encoding);
-                  if (file->encoding == MOUSEPAD_ENCODING_UTF_8 || file->encoding == bom_encoding
-                      || mousepad_dialogs_confirm_encoding (bom_charset, charset) != GTK_RESPONSE_YES)
-                    {
-                      /* we've found a valid bom at the start of the contents */
-                      file->write_bom = TRUE;
 
-                      /* advance the contents offset and decrease size: don't use GLib string
-                       * functions here, there may be null bytes */
-                      file_size -= bom_length;
-                      temp = g_memdup (contents + bom_length, file_size);
-                      g_free (contents);
-                      contents = temp;
+MousepadLargeFileFeatures
+mousepad_file_get_disabled_features (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), 0);
 
-                      /* set the detected encoding */
-                      file->encoding = bom_encoding;
-                      charset = bom_charset;
-                    }
-                }
-            }
+  return file->disabled_features;
+}
 
-          /* try to convert the contents if needed */
-          if (file->encoding != MOUSEPAD_ENCODING_UTF_8)
-            {
-              temp = g_convert (contents, file_size, "UTF-8", charset, NULL, &written, error);
 
-              /* check if the conversion succeed at least partially */
-              if (temp == NULL)
-                {
-                  /* set return value */
-                  retval = ERROR_CONVERTING_FAILED;
 
-                  goto failed;
-                }
-              /* set new values */
-              else
-                {
-                  file_size = written;
-                  g_free (contents);
-                  contents = temp;
-                }
-            }
+static void
+mousepad_file_clear_invalid_sequences (MousepadFile *file)
+{
+  MousepadInvalidSequence *sequence;
+  guint n;
 
-          if (!g_utf8_validate (contents, file_size, &endc))
-            {
-              /* leave when the encoding is not valid... */
-              if (!make_valid)
-                {
-                  /* set return value */
-                  retval = ERROR_ENCODING_NOT_VALID;
+  for (n = 0; n < file->invalid_sequences->len; n++)
+    {
+      sequence = &g_array_index (file->invalid_sequences, MousepadInvalidSequence, n);
+      gtk_text_buffer_delete_mark (file->buffer, sequence->mark);
+    }
 
-                  /* set an error */
-                  g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
-                               _("Invalid byte sequence in conversion input"));
+  g_array_set_size (file->invalid_sequences, 0);
+  file->n_invalid_sequences = 0;
+}
 
-                  goto failed;
-                }
-              /* ... or make it valid and update location for end of valid data */
-              else
-                {
-                  temp = g_utf8_make_valid (contents, file_size);
-                  g_free (contents);
-                  contents = temp;
-                  g_utf8_validate (contents, -1, &endc);
-                }
-            }
 
-          /* detect the line ending, based on the first eol we match */
-          for (n = contents; n < endc; n = g_utf8_next_char (n))
-            {
-              if (G_LIKELY (*n == '\n'))
-                {
-                  /* set unix line ending */
-                  file->line_ending = MOUSEPAD_EOL_UNIX;
 
-                  break;
-                }
-              else if (*n == '\r')
-                {
-                  /* get next character */
-                  n = g_utf8_next_char (n);
+guint
+mousepad_file_get_n_invalid_sequences (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), 0);
 
-                  /* set dos or mac line ending */
-                  file->line_ending = (*n == '\n') ? MOUSEPAD_EOL_DOS : MOUSEPAD_EOL_MAC;
+  return file->n_invalid_sequences;
+}
 
-                  break;
-                }
-            }
 
-          /* get the iter at the beginning of the document */
-          gtk_text_buffer_get_start_iter (file->buffer, &start);
 
-          /* insert the file contents in the buffer */
-          if (file->line_ending == MOUSEPAD_EOL_UNIX)
+gboolean
+mousepad_file_get_invalid_sequence (MousepadFile *file,
+                                    guint n,
+                                    goffset *offset,
+                                    GtkTextIter *iter)
+{
+  MousepadInvalidSequence *sequence;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  /* only the first sequences are remembered */
+  if (n >= file->invalid_sequences->len)
+    return FALSE;
+
+  sequence = &g_array_index (file->invalid_sequences, MousepadInvalidSequence, n);
+  if (offset != NULL)
+    *offset = sequence->offset;
+  if (iter != NULL)
+    gtk_text_buffer_get_iter_at_mark (file->buffer, iter, sequence->mark);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_file_loader_read_thread (GTask *task,
+                                  gpointer source_object,
+                                  gpointer task_data,
+                                  GCancellable *cancellable)
+{
+  MousepadFileLoader *loader = task_data;
+  GFileInputStream *stream;
+  GFileInfo *fileinfo;
+  GError *error = NULL;
+  gchar *contents;
+  gsize length = 0, allocated;
+  gssize n_read;
+
+  stream = g_file_read (loader->location, cancellable, &error);
+  if (stream == NULL)
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  /* read the file in chunks, allowing for it to have grown since we queried its size */
+  allocated = loader->size + LOAD_CHUNK_SIZE + 1;
+  contents = g_malloc (allocated);
+  while ((n_read = g_input_stream_read (G_INPUT_STREAM (stream), contents + length,
+                                        LOAD_CHUNK_SIZE, cancellable, &error)) > 0)
+    {
+      length += n_read;
+      g_atomic_int_set (&loader->read_progress, 1000 * MIN (length, loader->size) / loader->size);
+
+      if (length + LOAD_CHUNK_SIZE + 1 > allocated)
+        {
+          allocated *= 2;
+          contents = g_realloc (contents, allocated);
+        }
+    }
+
+  if (n_read < 0)
+    {
+      g_free (contents);
+      g_object_unref (stream);
+      g_task_return_error (task, error);
+      return;
+    }
+
+  /* get the etag, as g_file_load_contents() does */
+  fileinfo = g_file_input_stream_query_info (stream, G_FILE_ATTRIBUTE_ETAG_VALUE, cancellable, NULL);
+  if (fileinfo != NULL)
+    {
+      loader->etag = g_strdup (g_file_info_get_etag (fileinfo));
+      g_object_unref (fileinfo);
+    }
+
+  g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+  g_object_unref (stream);
+
+  /* nul-terminate the contents, as g_file_load_contents() does */
+  contents[length] = '\0';
+  loader->data = contents;
+  loader->contents = contents;
+  loader->length = length;
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+
+static gboolean
+mousepad_file_loader_read_progress (gpointer data)
+{
+  MousepadFileLoader *loader = data;
+
+  /* reading is the first half of the loading */
+  g_signal_emit (loader->file, file_signals[LOAD_PROGRESS], 0,
+                 g_atomic_int_get (&loader->read_progress) / 2000.0);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_file_loader_set_data (MousepadFileLoader *loader,
+                               gchar *data,
+                               gsize length)
+{
+  /* release the previous contents as soon as possible, to keep only one working buffer */
+  g_free (loader->data);
+
+  loader->data = data;
+  loader->contents = data;
+  loader->length = length;
+}
+
+
+
+static void
+mousepad_file_loader_clear (MousepadFileLoader *loader)
+{
+  mousepad_file_loader_set_data (loader, NULL, 0);
+  g_clear_pointer (&loader->etag, g_free);
+  g_clear_pointer (&loader->invalid_offsets, g_array_unref);
+
+  if (loader->boundary != NULL)
+    {
+      gtk_text_buffer_delete_mark (loader->file->buffer, loader->boundary);
+      loader->boundary = NULL;
+    }
+}
+
+
+
+static gboolean
+mousepad_file_loader_read (MousepadFileLoader *loader,
+                           GError **error)
+{
+  GFileInfo *fileinfo;
+  GTask *task;
+  gchar *data;
+  gsize length;
+  guint id;
+  gboolean succeed;
+
+  /* get the file size, to decide how to read it (special files like those in /proc
+   * report a null size) */
+  fileinfo = g_file_query_info (loader->location, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  if (fileinfo != NULL)
+    {
+      loader->size = g_file_info_get_size (fileinfo);
+      g_object_unref (fileinfo);
+    }
+
+  /* only large files are worth being read in chunks and inserted in time slices */
+  loader->interactive = loader->interactive && loader->size >= LOAD_INTERACTIVE_SIZE;
+
+  /* read the file at once */
+  if (!loader->interactive)
+    {
+      if (!g_file_load_contents (loader->location, loader->file->cancellable, &data,
+                                 &length, &loader->etag, error))
+        return FALSE;
+
+      mousepad_file_loader_set_data (loader, data, length);
+
+      return TRUE;
+    }
+
+  /* read the file in chunks from a worker thread, keeping the GUI responsive meanwhile */
+  task = g_task_new (loader->file, loader->file->cancellable, NULL, NULL);
+  g_task_set_task_data (task, loader, NULL);
+  g_task_run_in_thread (task, mousepad_file_loader_read_thread);
+
+  mousepad_file_loader_read_progress (loader);
+  id = g_timeout_add (LOAD_PROGRESS_INTERVAL, mousepad_file_loader_read_progress, loader);
+  while (!g_task_get_completed (task))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_source_remove (id);
+  succeed = g_task_propagate_boolean (task, error);
+  g_object_unref (task);
+
+  return succeed;
+}
+
+
+
+static void
+mousepad_file_loader_replace_invalid (MousepadFileLoader *loader,
+                                      GtkTextIter *iter,
+                                      goffset offset)
+{
+  MousepadFile *file = loader->file;
+  MousepadInvalidSequence sequence;
+
+  /* remember where the sequence was, so that the user can go there */
+  if (file->invalid_sequences->len < INVALID_SEQUENCES_MAX)
+    {
+      sequence.offset = offset;
+      sequence.mark = gtk_text_buffer_create_mark (file->buffer, NULL, iter, TRUE);
+      g_array_append_val (file->invalid_sequences, sequence);
+    }
+
+  file->n_invalid_sequences++;
+  gtk_text_buffer_insert (file->buffer, iter, "\357\277\275", 3);
+}
+
+
+
+static gboolean
+mousepad_file_loader_insert (MousepadFileLoader *loader,
+                             GtkTextIter *iter,
+                             const gchar *text,
+                             gsize length,
+                             GError **error)
+{
+  GtkTextBuffer *buffer = loader->file->buffer;
+  const gchar *p, *end, *valid;
+  goffset offset;
+
+  while (length > 0)
+    {
+      end = text + length;
+
+      /* insert at most one chunk at a time when interactive, without splitting a character */
+      if (loader->interactive && length > LOAD_CHUNK_SIZE)
+        {
+          p = text + LOAD_CHUNK_SIZE;
+          while (p > text && (*(const guchar *) p & 0xC0) == 0x80)
+            p--;
+
+          end = (p > text) ? p : text + LOAD_CHUNK_SIZE;
+        }
+
+      /* replace invalid sequences on the fly, as g_utf8_make_valid() would do, so that
+       * we don't have to make a valid copy of the contents first */
+      p = text;
+      if (loader->make_valid)
+        for (; !g_utf8_validate (p, end - p, &valid); p = valid + 1)
+          {
+            gtk_text_buffer_insert (buffer, iter, p, valid - p);
+
+            /* file offset of the sequence, collected before line endings were normalized */
+            offset = -1;
+            if (loader->invalid_offsets != NULL
+                && loader->n_invalid_offsets < loader->invalid_offsets->len)
+              offset = g_array_index (loader->invalid_offsets, goffset, loader->n_invalid_offsets++);
+
+            mousepad_file_loader_replace_invalid (loader, iter, offset);
+          }
+
+      gtk_text_buffer_insert (buffer, iter, p, end - p);
+      loader->n_inserted += end - text;
+      length -= end - text;
+      text = end;
+
+      /* the time slice has elapsed: update the GUI */
+      if (loader->interactive && g_get_monotonic_time () - loader->last_yield > LOAD_TIME_SLICE)
+        {
+          /* insertion is the second half of the loading */
+          g_signal_emit (loader->file, file_signals[LOAD_PROGRESS], 0,
+                         0.5 + 0.5 * (loader->converting ? loader->n_converted : loader->n_inserted)
+                                   / loader->n_total);
+
+          while (gtk_events_pending ())
+            gtk_main_iteration ();
+
+          if (g_cancellable_set_error_if_cancelled (loader->file->cancellable, error))
+            return FALSE;
+
+          /* we always insert before the previous contents: make sure our iter is still valid */
+          gtk_text_buffer_get_iter_at_mark (buffer, iter, loader->boundary);
+          loader->last_yield = g_get_monotonic_time ();
+        }
+    }
+
+  return TRUE;
+}
+
+
+
+/* replace CRLF and lone CR line endings with LF in place, in a single pass, and return
+ * the new length of the contents */
+static gsize
+mousepad_file_normalize_line_endings (gchar *contents,
+                                      gsize length)
+{
+  gchar *src, *dest, *end = contents + length, *cr;
+
+  if ((dest = memchr (contents, '\r', length)) == NULL)
+    return length;
+
+  for (src = dest; (cr = memchr (src, '\r', end - src)) != NULL; src = cr + 1)
+    {
+      memmove (dest, src, cr - src);
+      dest += cr - src;
+      *dest++ = '\n';
+
+      /* skip the LF of a CRLF */
+      if (cr + 1 < end && *(cr + 1) == '\n')
+        cr++;
+    }
+
+  memmove (dest, src, end - src);
+  dest += end - src;
+
+  return dest - contents;
+}
+
+
+
+/* return the offset of the first null unit from 'start', or 'length' if there is none */
+static gsize
+mousepad_file_find_nul (const gchar *contents,
+                        gsize start,
+                        gsize length,
+                        gsize unit)
+{
+  const gchar *p;
+  gsize n, offset;
+
+  for (p = contents + start; (p = memchr (p, '\0', contents + length - p)) != NULL; p++)
+    {
+      /* the null byte must belong to a null unit */
+      offset = (p - contents) - (p - contents) % unit;
+      for (n = 0; n < unit && offset + n < length && contents[offset + n] == '\0'; n++);
+      if (n == unit)
+        return offset;
+    }
+
+  return length;
+}
+
+
+
+/* insert a chunk of converted contents, keeping track of the line ending and of the line
+ * lengths on the way */
+static gboolean
+mousepad_file_loader_flush (MousepadFileLoader *loader,
+                            GtkTextIter *iter,
+                            gchar *text,
+                            gsize length,
+                            GError **error)
+{
+  MousepadFile *file = loader->file;
+  MousepadScanResult scan;
+  gchar *p, *end = text + length;
+
+  if (length == 0)
+    return TRUE;
+
+  /* set the line ending, based on the first eol we match */
+  mousepad_scan_contents (text, length, &scan);
+  if (scan.has_eol && !loader->has_eol && !loader->keep_line_ending)
+    {
+      file->line_ending = scan.first_eol;
+      loader->has_eol = TRUE;
+    }
+
+  /* the first line of the chunk continues the last one of the previous chunk */
+  for (p = text; p < end && *p != '\n' && *p != '\r'; p++);
+  loader->line_length += p - text;
+  if (p < end)
+    {
+      scan.max_line_length = MAX (scan.max_line_length, loader->line_length);
+      for (p = end; *(p - 1) != '\n' && *(p - 1) != '\r'; p--);
+      loader->line_length = end - p;
+    }
+
+  /* switch to large file mode as soon as a line is too long */
+  if (loader->line_limit > 0
+      && MAX (scan.max_line_length, loader->line_length) > loader->line_limit)
+    mousepad_file_set_large (file, TRUE);
+
+  if (file->line_ending != MOUSEPAD_EOL_UNIX)
+    length = mousepad_file_normalize_line_endings (text, length);
+
+  return mousepad_file_loader_insert (loader, iter, text, length, error);
+}
+
+
+
+/* decode the contents chunk by chunk, inserting each of them as soon as it is converted so
+ * that no converted copy of the whole contents is needed, and replace invalid sequences
+ * if asked to, or fail at the first one */
+static gint
+mousepad_file_loader_convert (MousepadFileLoader *loader,
+                              GtkTextIter *iter,
+                              const gchar *contents,
+                              gsize length,
+                              gboolean make_valid,
+                              GError **error)
+{
+  MousepadFile *file = loader->file;
+  GConverter *converter;
+  GConverterResult result = G_CONVERTER_CONVERTED;
+  GError *local_error = NULL;
+  gchar *buffer, *offset;
+  gsize unit, in = 0, nul, n_read, n_written, n_kept = 0;
+  gboolean cr;
+  gint retval = 0;
+
+  converter = mousepad_encoding_get_converter ("UTF-8",
+                                               mousepad_encoding_get_charset (file->encoding),
+                                               error);
+  if (converter == NULL)
+    return ERROR_CONVERTING_FAILED;
+
+  buffer = g_malloc (LOAD_CHUNK_SIZE);
+  unit = mousepad_encoding_get_unit_size (file->encoding);
+  nul = mousepad_file_find_nul (contents, 0, length, unit);
+  loader->line_length = 0;
+  loader->has_eol = FALSE;
+  loader->converting = TRUE;
+  loader->n_converted = 0;
+
+  while (result != G_CONVERTER_FINISHED)
+    {
+      /* convert up to the next null character, which is not valid text */
+      if (in < nul || nul == length)
+        result = g_converter_convert (converter, contents + in, nul - in,
+                                      buffer + n_kept, LOAD_CHUNK_SIZE - n_kept,
+                                      nul == length ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+                                      &n_read, &n_written, &local_error);
+      else
+        result = G_CONVERTER_ERROR;
+
+      if (result != G_CONVERTER_ERROR)
+        {
+          in += n_read;
+          n_kept += n_written;
+
+          /* keep a final CR for the next chunk, it may be followed by a LF */
+          cr = (result != G_CONVERTER_FINISHED && n_kept > 0 && buffer[n_kept - 1] == '\r');
+          loader->n_converted = in;
+          if (!mousepad_file_loader_flush (loader, iter, buffer, n_kept - cr, error))
             {
-              gtk_text_buffer_insert (file->buffer, &start, contents, file_size);
+              retval = ERROR_READING_FAILED;
+              break;
             }
-          else
+
+          n_kept = cr;
+          if (cr)
+            buffer[0] = '\r';
+        }
+      /* conversion failure, unrelated to the contents */
+      else if (local_error != NULL
+               && !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA)
+               && !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT))
+        {
+          g_propagate_error (error, local_error);
+          retval = ERROR_CONVERTING_FAILED;
+          break;
+        }
+      /* invalid sequence or null character: tell the user where it is */
+      else if (!make_valid)
+        {
+          g_clear_error (&local_error);
+          offset = g_strdup_printf ("%" G_GOFFSET_FORMAT, (goffset) (loader->offset + in));
+          g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                       _("Invalid byte sequence at offset %s"), offset);
+          g_free (offset);
+          retval = ERROR_ENCODING_NOT_VALID;
+          break;
+        }
+      /* insert what was converted so far, replace one unit and start over after it */
+      else
+        {
+          g_clear_error (&local_error);
+          if (!mousepad_file_loader_flush (loader, iter, buffer, n_kept, error))
             {
-              for (n = m = contents; n < endc; n = g_utf8_next_char (n))
-                {
-                  if (G_UNLIKELY (*n == '\r'))
-                    {
-                      /* insert the text in the buffer */
-                      if (G_LIKELY (n - m > 0))
-                        gtk_text_buffer_insert (file->buffer, &start, m, n - m);
+              retval = ERROR_READING_FAILED;
+              break;
+            }
+
+          n_kept = 0;
+          mousepad_file_loader_replace_invalid (loader, iter, loader->offset + in);
+          in = MIN (in + unit, length);
+          if (in > nul)
+            nul = mousepad_file_find_nul (contents, in, length, unit);
+
+          g_converter_reset (converter);
+        }
+    }
+
+  mousepad_encoding_release_converter (converter);
+  g_free (buffer);
+
+  return retval;
+}
+
+
+
+/* whether the whole contents are valid in an encoding, converted through a fixed size
+ * buffer so that the result is never stored, and updating the GUI as during insertion */
+static gboolean
+mousepad_file_loader_validate (MousepadFileLoader *loader,
+                               const gchar *contents,
+                               gsize length,
+                               MousepadEncoding encoding)
+{
+  GConverter *converter;
+  GConverterResult result = G_CONVERTER_CONVERTED;
+  MousepadScanResult scan;
+  gchar *buffer;
+  gsize in = 0, n_read, n_written;
+  gboolean valid = TRUE;
+
+  if (encoding == MOUSEPAD_ENCODING_UTF_8)
+    {
+      mousepad_scan_contents (contents, length, &scan);
+      return scan.valid_length == length;
+    }
+
+  converter = mousepad_encoding_get_converter ("UTF-8", mousepad_encoding_get_charset (encoding), NULL);
+  if (converter == NULL)
+    return FALSE;
+
+  buffer = g_malloc (LOAD_CHUNK_SIZE);
+  while (valid && result != G_CONVERTER_FINISHED)
+    {
+      result = g_converter_convert (converter, contents + in, length - in, buffer, LOAD_CHUNK_SIZE,
+                                    G_CONVERTER_INPUT_AT_END, &n_read, &n_written, NULL);
+      in += n_read;
+
+      /* null characters are not valid text */
+      valid = (result != G_CONVERTER_ERROR && memchr (buffer, '\0', n_written) == NULL);
+
+      if (valid && loader->interactive
+          && g_get_monotonic_time () - loader->last_yield > LOAD_TIME_SLICE)
+        {
+          while (gtk_events_pending ())
+            gtk_main_iteration ();
+
+          valid = !g_cancellable_is_cancelled (loader->file->cancellable);
+          loader->last_yield = g_get_monotonic_time ();
+        }
+    }
+
+  mousepad_encoding_release_converter (converter);
+  g_free (buffer);
+
+  return valid;
+}
+
+
+
+static gboolean
+mousepad_file_detect_encoding (MousepadFile *file,
+                               MousepadFileLoader *loader,
+                               const gchar *contents,
+                               gsize length)
+{
+  MousepadEncodingCandidate candidates[2];
+  guint n, n_candidates;
+
+  /* take the most likely encoding the whole contents are valid in, the detection being
+   * based on their start only */
+  n_candidates = mousepad_encoding_detect (contents, MIN (length, ENCODING_DETECTION_SAMPLE_SIZE),
+                                           candidates, G_N_ELEMENTS (candidates));
+  for (n = 0; n < n_candidates && candidates[n].confidence >= ENCODING_DETECTION_CONFIDENCE; n++)
+    if (candidates[n].encoding != file->encoding
+        && mousepad_file_loader_validate (loader, contents, length, candidates[n].encoding))
+      {
+        /* remember the encoding the contents were not valid in, to tell the user */
+        mousepad_file_set_encoding_real (file, candidates[n].encoding, file->encoding);
+
+        return TRUE;
+      }
+
+  return FALSE;
+}
+
+
+
+gint
+mousepad_file_open (MousepadFile *file,
+                    gint line,
+                    gint column,
+                    gboolean must_exist,
+                    gboolean ignore_bom,
+                    gboolean make_valid,
+                    GError **error)
+{
+  MousepadFileLoader loader = { 0 };
+  MousepadScanResult scan;
+  MousepadEncoding bom_encoding, previous_encoding, previous_rejected_encoding;
+  MousepadLineEnding previous_line_ending;
+  GtkTextIter start, end;
+  GFile *location, *journal = NULL;
+  GFileInfo *fileinfo;
+  const gchar *charset, *bom_charset, *p, *valid;
+  gchar *contents, *temp, *autosave_uri, *digest = NULL;
+  gsize file_size, bom_length, size_limit, line_limit;
+  goffset offset;
+  gint retval = ERROR_READING_FAILED;
+  gboolean detect, previous_write_bom, previous_large, restored = FALSE;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (file->buffer), FALSE);
+  g_return_val_if_fail (file->location != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  /* autosave restore */
+  if ((autosave_uri = mousepad_object_get_data (file->location, "autosave-uri")) != NULL)
+    {
+      location = g_file_new_for_uri (autosave_uri);
+
+      /* if autosaved file has a reference file on disk, load it first to init 'saved_state' */
+      if (!g_file_equal (location, file->location))
+        {
+          autosave_uri = g_strdup (autosave_uri);
+          mousepad_object_set_data (file->location, "autosave-uri", NULL);
+          mousepad_file_open (file, line, column, must_exist, ignore_bom, make_valid, NULL);
+          mousepad_object_set_data (file->location, "autosave-uri", autosave_uri);
+        }
+    }
+  else
+    {
+      location = g_object_ref (file->location);
+
+      /* update monitor location in case of a symlink (really useful only on reload,
+       * but not very costly) */
+      if (file->monitor != NULL
+          && (file->symlink || (file->symlink = mousepad_util_is_symlink (file->location))))
+        mousepad_file_set_monitor (file);
+    }
+
+  /* load the file in chunks, reporting progress, if someone is waiting for it */
+  loader.file = file;
+  loader.location = location;
+  loader.interactive = g_signal_has_handler_pending (file, file_signals[LOAD_PROGRESS], 0, FALSE);
+  g_cancellable_reset (file->cancellable);
+
+  /* if the file does not exist and this is allowed, no problem */
+  if (!mousepad_file_loader_read (&loader, error)
+      && (error == NULL || g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+      && !must_exist)
+    {
+      g_clear_error (error);
+      g_object_unref (location);
+
+      return 0;
+    }
+  /* the file was sucessfully loaded */
+  else if (G_LIKELY (error == NULL || *error == NULL))
+    {
+      /* get a view on the contents */
+      contents = loader.contents;
+      file_size = loader.length;
+
+      /* the saved state is reset once the file is loaded, no need to digest the buffer
+       * before it is cleared */
+      if (autosave_uri == NULL)
+        g_clear_pointer (&file->saved_state.digests, g_free);
+
+      /* the loading is not journaled, a new autosave base will be written if needed */
+      mousepad_file_autosave_journal_reset (file);
+
+      /* autosave restore: identify the base of a journal before the contents are modified */
+      if (autosave_uri != NULL)
+        {
+          journal = mousepad_journal_get_location (location);
+          if (mousepad_util_query_exists (journal, FALSE))
+            digest = mousepad_journal_get_digest (contents, file_size);
+        }
+
+      /* insert the contents before those of the buffer, when reloading: the latter are
+       * removed only once the loading succeeded, and restored with the file properties
+       * otherwise, e.g. if the user cancelled the loading */
+      gtk_text_buffer_get_start_iter (file->buffer, &start);
+      loader.boundary = gtk_text_buffer_create_mark (file->buffer, NULL, &start, FALSE);
+      mousepad_file_clear_invalid_sequences (file);
+      previous_encoding = file->encoding;
+      previous_rejected_encoding = file->rejected_encoding;
+      previous_line_ending = file->line_ending;
+      previous_write_bom = file->write_bom;
+      previous_large = mousepad_file_is_large (file);
+
+      /* autosave restore: load the base with the line ending mode it was written in, for
+       * the journal records to apply to the same characters */
+      if (digest != NULL && mousepad_journal_get_line_ending (journal, digest, &file->line_ending))
+        loader.keep_line_ending = TRUE;
+
+      if (G_LIKELY (file_size > 0))
+        {
+          /* get the encoding charset */
+          charset = mousepad_encoding_get_charset (file->encoding);
+
+          /* guess the encoding from the contents if they are not valid in this one, unless
+           * it was chosen by the user */
+          detect = !make_valid && MOUSEPAD_SETTING_GET_BOOLEAN (DETECT_ENCODING);
+
+          /* detect if there is a bom with the encoding type */
+          if (!ignore_bom)
+            {
+              bom_encoding = mousepad_encoding_read_bom (contents, file_size, &bom_length);
+              if (G_UNLIKELY (bom_encoding != MOUSEPAD_ENCODING_NONE))
+                {
+                  detect = FALSE;
+
+                  /* ask the user what to do if he has set an encoding different from default
+                   * (including with respect to GSettings, i.e. UTF-8 only) */
+                  bom_charset = mousepad_encoding_get_charset (bom_encoding);
+                  if (file->encoding == MOUSEPAD_ENCODING_UTF_8 || file->encoding == bom_encoding
+                      || mousepad_dialogs_confirm_encoding (bom_charset, charset) != GTK_RESPONSE_YES)
+                    {
+                      /* we've found a valid bom at the start of the contents */
+                      file->write_bom = TRUE;
+
+                      /* advance the contents offset and decrease size: don't use GLib string
+                       * functions here, there may be null bytes */
+                      contents += bom_length;
+                      file_size -= bom_length;
+                      loader.offset = bom_length;
+
+                      /* set the detected encoding */
+                      file->encoding = bom_encoding;
+                    }
+                }
+            }
+
+          /* limits above which the file is opened in large file mode */
+          size_limit = (gsize) MOUSEPAD_SETTING_GET_UINT (LARGE_FILE_SIZE) * 1024 * 1024;
+          line_limit = MOUSEPAD_SETTING_GET_UINT (LARGE_FILE_LINE_LENGTH);
+
+convert:
+
+          /* convert the contents if needed, while inserting them in the buffer */
+          if (file->encoding != MOUSEPAD_ENCODING_UTF_8)
+            {
+              /* detect the encoding before anything is converted and inserted, if the
+               * contents are not valid in this one: the check stops at the first invalid
+               * sequence, and stores nothing */
+              loader.last_yield = g_get_monotonic_time ();
+              if (detect)
+                {
+                  detect = FALSE;
+                  if (!mousepad_file_loader_validate (&loader, contents, file_size, file->encoding)
+                      && mousepad_file_detect_encoding (file, &loader, contents, file_size))
+                    goto convert;
+                }
+
+              /* switch to large file mode before insertion if needed, so that expensive
+               * features don't process the contents, or during insertion for long lines */
+              mousepad_file_set_large (file, size_limit > 0 && file_size > size_limit);
+              loader.line_limit = line_limit;
+
+              gtk_text_buffer_get_start_iter (file->buffer, &start);
+              loader.n_total = file_size;
+              loader.last_yield = g_get_monotonic_time ();
+              retval = mousepad_file_loader_convert (&loader, &start, contents, file_size,
+                                                     make_valid, error);
+              if (retval != 0)
+                goto failed;
+            }
+          else
+            {
+              /* validate the contents and detect the line ending in a single pass */
+              mousepad_scan_contents (contents, file_size, &scan);
+
+              /* leave when the encoding is not valid, or make it valid during insertion,
+               * unless another encoding can be detected */
+              loader.make_valid = (scan.valid_length < file_size);
+              if (loader.make_valid && detect
+                  && mousepad_file_detect_encoding (file, &loader, contents, file_size))
+                {
+                  loader.make_valid = FALSE;
+                  detect = FALSE;
+
+                  goto convert;
+                }
+              else if (loader.make_valid && !make_valid)
+                {
+                  /* set return value */
+                  retval = ERROR_ENCODING_NOT_VALID;
+
+                  /* set an error */
+                  offset = loader.offset + scan.valid_length;
+                  temp = g_strdup_printf ("%" G_GOFFSET_FORMAT, offset);
+                  g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                               _("Invalid byte sequence at offset %s"), temp);
+                  g_free (temp);
+
+                  goto failed;
+                }
+              /* collect the file offsets of the invalid sequences before line endings are
+               * normalized, the replacement being done during insertion */
+              else if (loader.make_valid)
+                {
+                  loader.invalid_offsets = g_array_new (FALSE, FALSE, sizeof (goffset));
+                  for (p = contents + scan.valid_length;
+                       loader.invalid_offsets->len < INVALID_SEQUENCES_MAX; p = valid)
+                    {
+                      offset = loader.offset + (p - contents);
+                      g_array_append_val (loader.invalid_offsets, offset);
+                      if (g_utf8_validate (p + 1, contents + file_size - p - 1, &valid))
+                        break;
+                    }
+                }
+
+              /* set the line ending, based on the first eol we match */
+              if (scan.has_eol && !loader.keep_line_ending)
+                file->line_ending = scan.first_eol;
+
+              /* switch to large file mode before insertion if needed, so that expensive
+               * features don't process the contents */
+              mousepad_file_set_large (file, (size_limit > 0 && file_size > size_limit)
+                                               || (line_limit > 0 && scan.max_line_length > line_limit));
+
+              /* for dos and mac files, normalize line endings once and for all, instead of
+               * inserting the contents line by line */
+              if (file->line_ending != MOUSEPAD_EOL_UNIX)
+                file_size = mousepad_file_normalize_line_endings (contents, file_size);
+
+              /* insert the file contents in the buffer (failure here means cancellation) */
+              gtk_text_buffer_get_start_iter (file->buffer, &start);
+              loader.n_total = file_size;
+              loader.last_yield = g_get_monotonic_time ();
+              if (!mousepad_file_loader_insert (&loader, &start, contents, file_size, error))
+                goto failed;
+            }
+        }
+      /* an empty file is never large */
+      else
+        mousepad_file_set_large (file, FALSE);
+
+      /* the new contents are complete: drop the previous ones */
+      gtk_text_buffer_get_iter_at_mark (file->buffer, &start, loader.boundary);
+      gtk_text_buffer_get_end_iter (file->buffer, &end);
+      gtk_text_buffer_delete (file->buffer, &start, &end);
+
+      /* place cursor at (line, column) */
+      mousepad_util_place_cursor (file->buffer, line, column);
+
+      /* autosave restore: replay the edits journaled since the base was written */
+      if (digest != NULL)
+        mousepad_journal_replay (file->buffer, journal, digest, NULL);
+
+      /* assume everything when file */
+      retval = 0;
+
+      /* update etag */
+      g_free (file->etag);
+      file->etag = g_steal_pointer (&loader.etag);
+
+      /* store the file status */
+      if (G_LIKELY (!file->temporary))
+        if (G_LIKELY (fileinfo = g_file_query_info (location, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
+                                                    G_FILE_QUERY_INFO_NONE, NULL, error)))
+          {
+            mousepad_file_set_read_only (
+              file, !g_file_info_get_attribute_boolean (fileinfo, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE));
+            g_object_unref (fileinfo);
+          }
+        /* set return value */
+        else
+          retval = ERROR_FILE_STATUS_FAILED;
+      /* this is a new document with content from a template */
+      else
+        {
+          g_clear_pointer (&file->etag, g_free);
+        }
+
+failed:
+
+      /* remove what was inserted if we did not succeed, leaving the previous contents */
+      if (G_UNLIKELY (retval != 0))
+        {
+          gtk_text_buffer_get_start_iter (file->buffer, &start);
+          gtk_text_buffer_get_iter_at_mark (file->buffer, &end, loader.boundary);
+          gtk_text_buffer_delete (file->buffer, &start, &end);
+          mousepad_file_clear_invalid_sequences (file);
+
+          restored = (gtk_text_buffer_get_char_count (file->buffer) > 0);
+          if (restored)
+            {
+              mousepad_file_set_encoding_real (file, previous_encoding, previous_rejected_encoding);
+              file->line_ending = previous_line_ending;
+              file->write_bom = previous_write_bom;
+              mousepad_file_set_large (file, previous_large);
+            }
+        }
+
+      /* tell the user how many invalid sequences were replaced */
+      g_signal_emit (file, file_signals[INVALID_SEQUENCES_CHANGED], 0, file->n_invalid_sequences);
+
+      /* cleanup */
+      g_object_unref (location);
+      mousepad_file_loader_clear (&loader);
+      if (journal != NULL)
+        g_object_unref (journal);
+
+      g_free (digest);
+
+      /* guess and set the file's filetype/language */
+      mousepad_file_set_language (file, NULL);
+
+      /* the previous contents may not be those of the file anymore: they must not be
+       * considered as saved */
+      if (restored && autosave_uri == NULL)
+        mousepad_file_invalidate_saved_state (file);
+      /* this does not count as a modified buffer */
+      else if (autosave_uri == NULL)
+        {
+          gtk_text_buffer_set_modified (file->buffer, FALSE);
+
+          /* make sure the saved state is reset, even if the buffer was not modified */
+          if (file->saved_state.digests == NULL)
+            mousepad_file_buffer_modified_changed (file);
+        }
+    }
+
+  return retval;
+}
+
+
+
+void
+mousepad_file_cancel_loading (MousepadFile *file)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  g_cancellable_cancel (file->cancellable);
+}
+
+
+
+static gboolean
+mousepad_file_monitor_unblock (gpointer data)
+{
+  MousepadFile *file = data;
+
+  g_signal_handlers_unblock_by_func (file->monitor, mousepad_file_monitor_changed, data);
+
+  return FALSE;
+}
+
+
+
+static gboolean
+mousepad_file_writer_init (MousepadFileWriter *writer,
+                           MousepadFile *file,
+                           GError **error)
+{
+  MousepadEncoding encoding = file->encoding;
+  GtkTextIter iter;
+  const gchar *charset;
+  gunichar c;
+
+  /* get the bom to write at the start of the contents, which may switch the encoding */
+  if (file->write_bom)
+    {
+      writer->bom = mousepad_encoding_get_bom (&encoding, &writer->bom_length);
+      if (encoding != file->encoding)
+        mousepad_file_set_encoding (file, encoding);
+    }
+
+  /* convert to the encoding if different from UTF-8 */
+  if (encoding != MOUSEPAD_ENCODING_UTF_8)
+    {
+      /* get the charset */
+      charset = mousepad_encoding_get_charset (encoding);
+      if (G_UNLIKELY (charset == NULL))
+        {
+          g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_NO_CONVERSION,
+                       MOUSEPAD_MESSAGE_UNSUPPORTED_ENCODING);
+          return FALSE;
+        }
+
+      writer->converter = mousepad_encoding_get_converter (charset, "UTF-8", error);
+      if (G_UNLIKELY (writer->converter == NULL))
+        return FALSE;
+
+      writer->buffer = g_malloc (SAVE_BUFFER_SIZE);
+
+      /* the destination may be overwritten in place, so make sure first that the contents
+       * can be represented in an encoding that doesn't cover all of Unicode */
+      writer->check_first = !mousepad_encoding_is_unicode (encoding);
+    }
+
+  writer->line_ending = file->line_ending;
+  if (writer->line_ending == MOUSEPAD_EOL_DOS)
+    writer->translated = g_string_sized_new (SAVE_CHUNK_SIZE + SAVE_CHUNK_SIZE / 8);
+
+  /* add line ending at end of last line if not present */
+  gtk_text_buffer_get_end_iter (file->buffer, &iter);
+  if (gtk_text_iter_backward_char (&iter) && MOUSEPAD_SETTING_GET_BOOLEAN (ADD_LAST_EOL))
+    {
+      c = gtk_text_iter_get_char (&iter);
+      if (c != '\n' && (c != '\r' || writer->line_ending != MOUSEPAD_EOL_MAC))
+        writer->eol = writer->line_ending == MOUSEPAD_EOL_MAC ? "\r"
+                      : writer->line_ending == MOUSEPAD_EOL_DOS ? "\r\n" : "\n";
+    }
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_file_writer_clear (MousepadFileWriter *writer)
+{
+  if (writer->converter != NULL)
+    mousepad_encoding_release_converter (writer->converter);
+
+  if (writer->translated != NULL)
+    g_string_free (writer->translated, TRUE);
+
+  g_free (writer->buffer);
+}
+
+
+
+static gboolean
+mousepad_file_writer_convert (MousepadFileWriter *writer,
+                              const gchar *text,
+                              gsize length,
+                              gboolean flush,
+                              GCancellable *cancellable,
+                              GError **error)
+{
+  GConverterResult result = G_CONVERTER_CONVERTED;
+  gsize n_read, n_written;
+
+  /* UTF-8 is written as is */
+  if (writer->converter == NULL)
+    return writer->stream == NULL || length == 0
+           || g_output_stream_write_all (writer->stream, text, length, NULL, cancellable, error);
+
+  /* convert through the output buffer until all the input has been consumed, and
+   * until the converter has nothing left to output when flushing */
+  while (length > 0 || (flush && result != G_CONVERTER_FINISHED))
+    {
+      result = g_converter_convert (writer->converter, text, length,
+                                    writer->buffer, SAVE_BUFFER_SIZE,
+                                    flush ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+                                    &n_read, &n_written, error);
+      if (result == G_CONVERTER_ERROR)
+        return FALSE;
+
+      text += n_read;
+      length -= n_read;
+
+      if (writer->stream != NULL && n_written > 0
+          && !g_output_stream_write_all (writer->stream, writer->buffer, n_written,
+                                         NULL, cancellable, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_file_writer_start (MousepadFileWriter *writer,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+  /* the bom is written as is, ahead of the converted contents */
+  if (writer->converter != NULL)
+    g_converter_reset (writer->converter);
+
+  return writer->stream == NULL || writer->bom == NULL
+         || g_output_stream_write_all (writer->stream, writer->bom, writer->bom_length,
+                                       NULL, cancellable, error);
+}
+
+
+
+static gboolean
+mousepad_file_writer_write (MousepadFileWriter *writer,
+                            gchar *text,
+                            gsize length,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+  gchar *p, *end, *eol;
+
+  /* handle line endings: text from the buffer only contains unix line endings */
+  if (writer->line_ending == MOUSEPAD_EOL_MAC)
+    {
+      /* replace the unix with a mac line ending */
+      for (p = text, end = text + length; (p = memchr (p, '\n', end - p)) != NULL; p++)
+        *p = '\r';
+    }
+  else if (writer->line_ending == MOUSEPAD_EOL_DOS)
+    {
+      /* copy the text with dos line endings in between lines */
+      g_string_truncate (writer->translated, 0);
+      for (p = text, end = text + length; (eol = memchr (p, '\n', end - p)) != NULL; p = eol + 1)
+        {
+          g_string_append_len (writer->translated, p, eol - p);
+          g_string_append_len (writer->translated, "\r\n", 2);
+        }
+
+      g_string_append_len (writer->translated, p, end - p);
+      text = writer->translated->str;
+      length = writer->translated->len;
+    }
+
+  return mousepad_file_writer_convert (writer, text, length, FALSE, cancellable, error);
+}
+
+
+
+static gboolean
+mousepad_file_writer_finish (MousepadFileWriter *writer,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+  /* add the last line ending, already in the right format, and flush the converter */
+  return (writer->eol == NULL
+          || mousepad_file_writer_convert (writer, writer->eol, strlen (writer->eol),
+                                           FALSE, cancellable, error))
+         && mousepad_file_writer_convert (writer, NULL, 0, TRUE, cancellable, error);
+}
+
+
+
+static gboolean
+mousepad_file_writer_write_buffer (MousepadFileWriter *writer,
+                                   GtkTextBuffer *buffer,
+                                   GCancellable *cancellable,
+                                   GError **error)
+{
+  GtkTextIter start, end;
+  gchar *text;
+  gboolean succeed;
+
+  succeed = mousepad_file_writer_start (writer, cancellable, error);
+
+  /* walk the buffer by slices of a fixed number of characters, so that the document
+   * is never copied as a whole */
+  gtk_text_buffer_get_start_iter (buffer, &start);
+  end = start;
+  while (succeed && !gtk_text_iter_is_end (&start))
+    {
+      gtk_text_iter_forward_chars (&end, SAVE_CHUNK_SIZE);
+      text = gtk_text_buffer_get_slice (buffer, &start, &end, TRUE);
+      succeed = mousepad_file_writer_write (writer, text, strlen (text), cancellable, error);
+      g_free (text);
+      start = end;
+    }
+
+  return succeed && mousepad_file_writer_finish (writer, cancellable, error);
+}
+
+
+
+static GPtrArray *
+mousepad_file_get_slices (MousepadFile *file)
+{
+  GtkTextIter start, end;
+  GPtrArray *slices;
+
+  /* take a snapshot of the buffer by slices, which can then be serialized on a worker
+   * thread while the buffer is being modified */
+  slices = g_ptr_array_new_with_free_func (g_free);
+  gtk_text_buffer_get_start_iter (file->buffer, &start);
+  end = start;
+  while (!gtk_text_iter_is_end (&start))
+    {
+      gtk_text_iter_forward_chars (&end, SAVE_CHUNK_SIZE);
+      g_ptr_array_add (slices, gtk_text_buffer_get_slice (file->buffer, &start, &end, TRUE));
+      start = end;
+    }
+
+  return slices;
+}
+
+
+
+static gboolean
+mousepad_file_writer_write_slices (MousepadFileWriter *writer,
+                                   GPtrArray *slices,
+                                   gboolean release,
+                                   gint *progress,
+                                   GCancellable *cancellable,
+                                   GError **error)
+{
+  gchar *text;
+  guint n;
+
+  if (!mousepad_file_writer_start (writer, cancellable, error))
+    return FALSE;
+
+  for (n = 0; n < slices->len; n++)
+    {
+      text = g_ptr_array_index (slices, n);
+      if (!mousepad_file_writer_write (writer, text, strlen (text), cancellable, error))
+        return FALSE;
+
+      /* release the snapshot as it is written */
+      if (release)
+        {
+          g_free (text);
+          g_ptr_array_index (slices, n) = NULL;
+        }
+
+      if (progress != NULL)
+        g_atomic_int_set (progress, n + 1);
+    }
+
+  return mousepad_file_writer_finish (writer, cancellable, error);
+}
+
+
+
+static gboolean
+mousepad_file_write_contents (MousepadFile *file,
+                              GOutputStream *stream,
+                              GCancellable *cancellable,
+                              GError **error)
+{
+  MousepadFileWriter writer = { NULL };
+  gboolean succeed;
+
+  writer.stream = stream;
+  succeed = mousepad_file_writer_init (&writer, file, error)
+            && mousepad_file_writer_write_buffer (&writer, file->buffer, cancellable, error);
+  mousepad_file_writer_clear (&writer);
+
+  return succeed;
+}
+
+
+
+static void
+mousepad_file_output_stream_abort (GOutputStream *stream)
+{
+  GCancellable *cancellable;
+
+  /* a cancelled close keeps the original file, unless it was overwritten in place */
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  g_output_stream_close (stream, cancellable, NULL);
+  g_object_unref (cancellable);
+}
+
+
+
+static const gchar *
+mousepad_file_replace_begin (MousepadFile *file,
+                             const gchar *etag)
+{
+  /* suspend file monitoring */
+  if (file->monitor != NULL)
+    g_signal_handlers_block_by_func (file->monitor, mousepad_file_monitor_changed, file);
+
+  /*
+   * Prevent g_file_replace() from returning G_IO_ERROR_WRONG_ETAG when the
+   * link target has been removed.
+   * See https://gitlab.gnome.org/GNOME/glib/-/issues/2466
+   */
+  if (mousepad_util_is_symlink (file->location)
+      && !mousepad_util_query_exists (file->location, TRUE))
+    etag = NULL;
+
+  return etag;
+}
+
+
+
+static void
+mousepad_file_replace_end (MousepadFile *file,
+                           gboolean succeed)
+{
+  if (file->monitor == NULL)
+    return;
+
+  /* update monitor location in case of a symlink */
+  if (succeed && (file->symlink || (file->symlink = mousepad_util_is_symlink (file->location))))
+    g_timeout_add (MOUSEPAD_SETTING_GET_UINT (MONITOR_DISABLING_TIMER),
+                   mousepad_file_set_monitor, mousepad_util_source_autoremove (file));
+  /* reactivate file monitoring with a delay, to not consider our own saving as
+   * external modification */
+  else
+    g_timeout_add (MOUSEPAD_SETTING_GET_UINT (MONITOR_DISABLING_TIMER),
+                   mousepad_file_monitor_unblock, mousepad_util_source_autoremove (file));
+}
+
+
+
+static gboolean
+mousepad_file_replace_contents (MousepadFile *m_file,
+                                GFile *file,
+                                const char *etag,
+                                gboolean make_backup,
+                                GFileCreateFlags flags,
+                                char **out_eol,
+                                char **new_etag,
+                                GCancellable *cancellable,
+                                GError **error)
+{
+  MousepadFileWriter writer = { NULL };
+  GFileOutputStream *stream;
+  gboolean succeed = FALSE;
+
+  if (!mousepad_file_writer_init (&writer, m_file, error)
+      || (writer.check_first
+          && !mousepad_file_writer_write_buffer (&writer, m_file->buffer, cancellable, error)))
+    {
+      mousepad_file_writer_clear (&writer);
+      return FALSE;
+    }
+
+  /* stream the buffer contents to the file */
+  etag = mousepad_file_replace_begin (m_file, etag);
+  stream = g_file_replace (file, etag, make_backup, flags, cancellable, error);
+  if (stream != NULL)
+    {
+      writer.stream = G_OUTPUT_STREAM (stream);
+      if (mousepad_file_writer_write_buffer (&writer, m_file->buffer, cancellable, error))
+        succeed = g_output_stream_close (writer.stream, cancellable, error);
+      else
+        mousepad_file_output_stream_abort (writer.stream);
+
+      if (succeed && new_etag != NULL)
+        *new_etag = g_file_output_stream_get_etag (stream);
+
+      g_object_unref (stream);
+    }
+
+  mousepad_file_replace_end (m_file, succeed);
+
+  if (succeed && out_eol != NULL && writer.eol != NULL)
+    *out_eol = g_strdup (writer.eol);
+
+  mousepad_file_writer_clear (&writer);
+
+  return succeed;
+}
+
+
+
+static void
+mousepad_file_saved (MousepadFile *file,
+                     const gchar *eol,
+                     gchar *etag,
+                     gboolean up_to_date)
+{
+  GtkTextIter iter;
+
+  /* update etag */
+  g_free (file->etag);
+  file->etag = etag;
+
+  /* the buffer was modified during an asynchronous saving: its current revision is
+   * not the one on disk */
+  if (up_to_date)
+    {
+      /* add last eol if needed */
+      if (eol != NULL)
+        {
+          gtk_text_buffer_get_end_iter (file->buffer, &iter);
+          gtk_text_buffer_insert (file->buffer, &iter, eol, -1);
+        }
+
+      /* everything has been saved */
+      gtk_text_buffer_set_modified (file->buffer, FALSE);
+    }
+  /* the saved state and the save point of the undo manager still describe the previous
+   * saving: make the current revision the save point, then drop it, so that undoing back
+   * to the previous saving doesn't make the document look saved, the disk holding the
+   * snapshot now */
+  else
+    {
+      gtk_text_buffer_set_modified (file->buffer, FALSE);
+      mousepad_file_invalidate_saved_state (file);
+    }
+
+  /* re-guess the filetype which could have changed */
+  mousepad_file_set_language (file, NULL);
+}
+
+
+
+gboolean
+mousepad_file_save (MousepadFile *file,
+                    gboolean forced,
+                    GError **error)
+{
+  gchar *eol = NULL, *etag = NULL;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  /* an asynchronous saving is in progress */
+  if (G_UNLIKELY (file->saving))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_PENDING, MOUSEPAD_MESSAGE_SAVE_PENDING);
+      return FALSE;
+    }
 
-                      /* advance the offset */
-                      m = g_utf8_next_char (n);
+  /* write the buffer to the file */
+  if (!mousepad_file_replace_contents (file, file->location,
+                                       (file->temporary || forced) ? NULL : file->etag,
+                                       MOUSEPAD_SETTING_GET_BOOLEAN (MAKE_BACKUP),
+                                       G_FILE_CREATE_NONE, &eol, &etag, NULL, error))
+    return FALSE;
 
-                      /* insert a new line when the document is not cr+lf */
-                      if (*m != '\n')
-                        gtk_text_buffer_insert (file->buffer, &start, "\n", 1);
-                    }
-                }
+  mousepad_file_saved (file, eol, etag, TRUE);
+  g_free (eol);
 
-              /* insert the remaining part */
-              if (G_LIKELY (n - m > 0))
-                gtk_text_buffer_insert (file->buffer, &start, m, n - m);
-            }
+  return TRUE;
+}
 
-          /* place cursor at (line, column) */
-          mousepad_util_place_cursor (file->buffer, line, column);
-        }
 
-      /* assume everything when file */
-      retval = 0;
 
-      /* store the file status */
-      if (G_LIKELY (!file->temporary))
-        if (G_LIKELY (fileinfo = g_file_query_info (location, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
-                                                    G_FILE_QUERY_INFO_NONE, NULL, error)))
-          {
-            mousepad_file_set_read_only (
-              file, !g_file_info_get_attribute_boolean (fileinfo, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE));
-            g_object_unref (fileinfo);
-          }
-        /* set return value */
-        else
-          retval = ERROR_FILE_STATUS_FAILED;
-      /* this is a new document with content from a template */
-      else
-        {
-          g_clear_pointer (&file->etag, g_free);
-        }
+static void
+mousepad_file_saver_free (gpointer data)
+{
+  MousepadFileSaver *saver = data;
+
+  mousepad_file_writer_clear (&saver->writer);
+  g_ptr_array_unref (saver->slices);
+  g_object_unref (saver->location);
+  g_free (saver->etag);
+  g_free (saver->new_etag);
+  g_free (saver);
+}
 
-failed:
 
-      /* make sure the buffer is empty if we did not succeed */
-      if (G_UNLIKELY (retval != 0))
-        {
-          gtk_text_buffer_get_bounds (file->buffer, &start, &end);
-          gtk_text_buffer_delete (file->buffer, &start, &end);
-        }
 
-      /* cleanup */
-      g_object_unref (location);
-      g_free (contents);
+static void
+mousepad_file_save_thread (GTask *task,
+                           gpointer source_object,
+                           gpointer task_data,
+                           GCancellable *cancellable)
+{
+  MousepadFileSaver *saver = task_data;
+  GFileOutputStream *stream;
+  GError *error = NULL;
+  gboolean succeed = FALSE;
 
-      /* guess and set the file's filetype/language */
-      mousepad_file_set_language (file, NULL);
+  if (!saver->writer.check_first
+      || mousepad_file_writer_write_slices (&saver->writer, saver->slices, FALSE, NULL,
+                                            cancellable, &error))
+    {
+      stream = g_file_replace (saver->location, saver->etag, saver->make_backup,
+                               G_FILE_CREATE_NONE, cancellable, &error);
+      if (stream != NULL)
+        {
+          saver->writer.stream = G_OUTPUT_STREAM (stream);
+          if (mousepad_file_writer_write_slices (&saver->writer, saver->slices, TRUE,
+                                                 &saver->progress, cancellable, &error))
+            succeed = g_output_stream_close (saver->writer.stream, cancellable, &error);
+          else
+            mousepad_file_output_stream_abort (saver->writer.stream);
 
-      /* this does not count as a modified buffer */
-      if (autosave_uri == NULL)
-        gtk_text_buffer_set_modified (file->buffer, FALSE);
+          if (succeed)
+            saver->new_etag = g_file_output_stream_get_etag (stream);
+
+          saver->writer.stream = NULL;
+          g_object_unref (stream);
+        }
     }
 
-  return retval;
+  if (succeed)
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
 }
 
 
 
 static gboolean
-mousepad_file_monitor_unblock (gpointer data)
+mousepad_file_save_progress (gpointer data)
 {
-  MousepadFile *file = data;
+  MousepadFileSaver *saver = data;
 
-  g_signal_handlers_unblock_by_func (file->monitor, mousepad_file_monitor_changed, data);
+  g_signal_emit (saver->file, file_signals[SAVE_PROGRESS], 0,
+                 (gdouble) g_atomic_int_get (&saver->progress) / MAX (saver->slices->len, 1));
 
-  return FALSE;
+  return TRUE;
 }
 
 
 
-static gboolean
-mousepad_file_replace_contents (MousepadFile *m_file,
-                                GFile *file,
-                                const char *contents,
-                                gsize length,
-                                const char *etag,
-                                gboolean make_backup,
-                                GFileCreateFlags flags,
-                                char **new_etag,
-                                GCancellable *cancellable,
-                                GError **error)
+static void
+mousepad_file_save_ready (GObject *object,
+                          GAsyncResult *result,
+                          gpointer data)
 {
-  gboolean succeed;
-
-  /* suspend file monitoring */
-  if (m_file->monitor != NULL)
-    g_signal_handlers_block_by_func (m_file->monitor, mousepad_file_monitor_changed, m_file);
-
-  /*
-   * Prevent g_file_replace_contents() from returning G_IO_ERROR_WRONG_ETAG when the
-   * link target has been removed.
-   * See https://gitlab.gnome.org/GNOME/glib/-/issues/2466
-   */
-  if (mousepad_util_is_symlink (m_file->location)
-      && !mousepad_util_query_exists (m_file->location, TRUE))
-    etag = NULL;
+  MousepadFile *file = MOUSEPAD_FILE (object);
+  MousepadFileSaver *saver = g_task_get_task_data (G_TASK (result));
+  GTask *task = data;
+  GError *error = NULL;
 
-  /* replace contents */
-  succeed = g_file_replace_contents (file, contents, length, etag, make_backup,
-                                     flags, new_etag, cancellable, error);
+  g_source_remove (saver->progress_id);
+  file->saving = FALSE;
 
-  if (m_file->monitor != NULL)
+  if (g_task_propagate_boolean (G_TASK (result), &error))
     {
-      /* update monitor location in case of a symlink */
-      if (succeed && (m_file->symlink || (m_file->symlink = mousepad_util_is_symlink (m_file->location))))
-        g_timeout_add (MOUSEPAD_SETTING_GET_UINT (MONITOR_DISABLING_TIMER),
-                       mousepad_file_set_monitor, mousepad_util_source_autoremove (m_file));
-      /* reactivate file monitoring with a delay, to not consider our own saving as
-       * external modification */
-      else
-        g_timeout_add (MOUSEPAD_SETTING_GET_UINT (MONITOR_DISABLING_TIMER),
-                       mousepad_file_monitor_unblock, mousepad_util_source_autoremove (m_file));
+      mousepad_file_replace_end (file, TRUE);
+      mousepad_file_saved (file, saver->writer.eol, g_steal_pointer (&saver->new_etag),
+                           saver->revision == file->revision);
+      g_task_return_boolean (task, TRUE);
+    }
+  else
+    {
+      mousepad_file_replace_end (file, FALSE);
+      g_task_return_error (task, error);
     }
 
-  return succeed;
+  /* decrease application use count */
+  g_application_release (g_application_get_default ());
+
+  g_object_unref (task);
 }
 
 
 
-static gboolean
-mousepad_file_prepare_save_contents (MousepadFile *file,
-                                     gchar **out_contents,
-                                     gsize *out_length,
-                                     gchar **out_eol,
-                                     GError **error)
+void
+mousepad_file_save_async (MousepadFile *file,
+                          gboolean forced,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data)
 {
-  GtkTextIter start, end;
-  gchar **chunks;
-  gchar *contents, *p, *encoded;
-  const gchar *charset, *eol = NULL;
-  gsize length, written;
+  MousepadFileSaver *saver;
+  GError *error = NULL;
+  GTask *task, *thread_task;
+
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
 
-  /* get buffer contents */
-  gtk_text_buffer_get_bounds (file->buffer, &start, &end);
-  contents = gtk_text_buffer_get_slice (file->buffer, &start, &end, TRUE);
-  length = strlen (contents);
+  task = g_task_new (file, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mousepad_file_save_async);
 
-  /* handle line endings */
-  if (file->line_ending == MOUSEPAD_EOL_MAC)
+  /* only one saving at a time */
+  if (G_UNLIKELY (file->saving))
     {
-      /* replace the unix with a mac line ending */
-      for (p = contents; *p != '\0'; p++)
-        if (G_UNLIKELY (*p == '\n'))
-          *p = '\r';
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_PENDING, MOUSEPAD_MESSAGE_SAVE_PENDING);
+      g_object_unref (task);
+
+      return;
     }
-  else if (file->line_ending == MOUSEPAD_EOL_DOS)
-    {
-      /* split the contents into chunks */
-      chunks = g_strsplit (contents, "\n", -1);
-      g_free (contents);
 
-      /* join the chunks with dos line endings in between */
-      contents = g_strjoinv ("\r\n", chunks);
-      g_strfreev (chunks);
+  saver = g_new0 (MousepadFileSaver, 1);
+  if (!mousepad_file_writer_init (&saver->writer, file, &error))
+    {
+      mousepad_file_writer_clear (&saver->writer);
+      g_free (saver);
+      g_task_return_error (task, error);
+      g_object_unref (task);
 
-      /* new contents length */
-      length = strlen (contents);
+      return;
     }
 
-  /* add line ending at end of last line if not present */
-  if (length > 0 && MOUSEPAD_SETTING_GET_BOOLEAN (ADD_LAST_EOL))
-    {
-      switch (file->line_ending)
-        {
-        case MOUSEPAD_EOL_UNIX:
-          if (contents[length - 1] != '\n')
-            {
-              contents = g_renew (gchar, contents, length + 2);
-              contents[length] = '\n';
-              length++;
-              eol = "\n";
-            }
-          break;
+  /* the worker releases the snapshot as it writes it */
+  saver->slices = mousepad_file_get_slices (file);
 
-        case MOUSEPAD_EOL_MAC:
-          if (contents[length - 1] != '\r')
-            {
-              contents = g_renew (gchar, contents, length + 2);
-              contents[length] = '\r';
-              length++;
-              eol = "\r";
-            }
-          break;
+  saver->file = file;
+  saver->revision = file->revision;
+  saver->location = g_object_ref (file->location);
+  saver->make_backup = MOUSEPAD_SETTING_GET_BOOLEAN (MAKE_BACKUP);
+  saver->etag = g_strdup (mousepad_file_replace_begin (file, (file->temporary || forced) ? NULL : file->etag));
+  file->saving = TRUE;
 
-        case MOUSEPAD_EOL_DOS:
-          if (contents[length - 1] != '\n' || (length > 1 && contents[length - 2] != '\r'))
-            {
-              contents = g_renew (gchar, contents, length + 3);
-              contents[length] = '\r';
-              contents[length + 1] = '\n';
-              length += 2;
-              eol = "\r\n";
-            }
-          break;
-        }
+  /* increase application use count during async saving */
+  g_application_hold (g_application_get_default ());
 
-      contents[length] = '\0';
-    }
+  /* report the saving progress from the main thread */
+  saver->progress_id = g_timeout_add (SAVE_PROGRESS_INTERVAL, mousepad_file_save_progress, saver);
 
-  /* convert to the encoding if different from UTF-8: must be done after the above */
-  if (file->encoding != MOUSEPAD_ENCODING_UTF_8)
-    {
-      /* get the charset */
-      charset = mousepad_encoding_get_charset (file->encoding);
-      if (G_UNLIKELY (charset == NULL))
-        {
-          g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_NO_CONVERSION,
-                       MOUSEPAD_MESSAGE_UNSUPPORTED_ENCODING);
-          g_free (contents);
+  /* serialize and write the snapshot on a worker thread */
+  thread_task = g_task_new (file, cancellable, mousepad_file_save_ready, task);
+  g_task_set_task_data (thread_task, saver, mousepad_file_saver_free);
+  g_task_run_in_thread (thread_task, mousepad_file_save_thread);
+  g_object_unref (thread_task);
+}
 
-          return FALSE;
-        }
 
-      /* convert the content to the user encoding */
-      encoded = g_convert (contents, length, charset, "UTF-8", NULL, &written, error);
 
-      /* return if nothing was encoded */
-      if (G_UNLIKELY (encoded == NULL))
+gboolean
+mousepad_file_save_finish (MousepadFile *file,
+                           GAsyncResult *result,
+                           GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, file), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+
+
+/* autosave serialization and writing, performed on a worker thread */
+typedef struct _MousepadFileAutosaveJob
+{
+  GFile *location, *journal_location;
+
+  /* buffer snapshot to serialize into a new base, and the resulting journal header */
+  MousepadFileWriter writer;
+  GPtrArray *slices;
+  GBytes *header;
+  gsize base_size;
+
+  /* or records to append to the journal, which is created if there is a header */
+  GBytes *records;
+} MousepadFileAutosaveJob;
+
+
+
+static void
+mousepad_file_autosave_job_free (gpointer data)
+{
+  MousepadFileAutosaveJob *job = data;
+
+  g_object_unref (job->location);
+  g_object_unref (job->journal_location);
+  mousepad_file_writer_clear (&job->writer);
+  if (job->slices != NULL)
+    g_ptr_array_unref (job->slices);
+
+  if (job->header != NULL)
+    g_bytes_unref (job->header);
+
+  if (job->records != NULL)
+    g_bytes_unref (job->records);
+
+  g_free (job);
+}
+
+
+
+static gboolean
+mousepad_file_autosave_job_run (MousepadFileAutosaveJob *job,
+                                GError **error)
+{
+  GFileOutputStream *stream;
+  GOutputStream *memory;
+  GBytes *base;
+  gchar *digest;
+  gboolean succeed;
+
+  /* write a new base, which makes the journal obsolete */
+  if (job->slices != NULL)
+    {
+      /* serialize the snapshot */
+      memory = g_memory_output_stream_new_resizable ();
+      job->writer.stream = memory;
+      succeed = mousepad_file_writer_write_slices (&job->writer, job->slices, TRUE, NULL,
+                                                   NULL, error)
+                && g_output_stream_close (memory, NULL, error);
+      job->writer.stream = NULL;
+      if (!succeed)
         {
-          g_free (contents);
+          g_object_unref (memory);
           return FALSE;
         }
 
-      /* set the new contents */
-      g_free (contents);
-      contents = encoded;
-      length = written;
+      base = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (memory));
+      g_object_unref (memory);
+
+      /* prepare the header of the journal based on it */
+      digest = mousepad_journal_get_digest (g_bytes_get_data (base, NULL), g_bytes_get_size (base));
+      job->header = mousepad_journal_new_header (digest, job->writer.eol != NULL,
+                                                 job->writer.line_ending);
+      job->base_size = g_bytes_get_size (base);
+      g_free (digest);
+
+      succeed = g_file_replace_contents (job->location, g_bytes_get_data (base, NULL),
+                                         g_bytes_get_size (base), NULL, FALSE,
+                                         G_FILE_CREATE_NONE, NULL, NULL, error);
+      g_bytes_unref (base);
+
+      /* an obsolete journal would be ignored anyway, since it doesn't match the new base */
+      if (succeed)
+        g_file_delete (job->journal_location, NULL, NULL);
+
+      return succeed;
     }
 
-  /* add a bom at the start of the contents if needed */
-  if (file->write_bom)
-    mousepad_encoding_write_bom (&(file->encoding), &length, &contents);
+  /* create the journal or append records to it */
+  if (job->header != NULL)
+    stream = g_file_replace (job->journal_location, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+  else
+    stream = g_file_append_to (job->journal_location, G_FILE_CREATE_NONE, NULL, error);
 
-  /* assign output variables */
-  *out_contents = contents;
-  *out_length = length;
-  if (out_eol != NULL && eol != NULL)
-    *out_eol = g_strdup (eol);
+  if (stream == NULL)
+    return FALSE;
 
-  return TRUE;
+  succeed = (job->header == NULL
+             || g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+                                           g_bytes_get_data (job->header, NULL),
+                                           g_bytes_get_size (job->header), NULL, NULL, error))
+            && g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+                                          g_bytes_get_data (job->records, NULL),
+                                          g_bytes_get_size (job->records), NULL, NULL, error)
+            && g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, error);
+
+  g_object_unref (stream);
+
+  return succeed;
 }
 
 
 
-gboolean
-mousepad_file_save (MousepadFile *file,
-                    gboolean forced,
-                    GError **error)
+static void
+mousepad_file_autosave_thread (GTask *task,
+                               gpointer source_object,
+                               gpointer task_data,
+                               GCancellable *cancellable)
 {
-  GtkTextIter iter;
-  gchar *contents, *eol = NULL, *etag = NULL;
-  gsize length;
+  GError *error = NULL;
 
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  if (mousepad_file_autosave_job_run (task_data, &error))
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
 
-  /* prepare save contents */
-  if (!mousepad_file_prepare_save_contents (file, &contents, &length, &eol, error))
-    return FALSE;
 
-  /* write the buffer to the file */
-  if (!mousepad_file_replace_contents (file, file->location, contents, length,
-                                       (file->temporary || forced) ? NULL : file->etag,
-                                       MOUSEPAD_SETTING_GET_BOOLEAN (MAKE_BACKUP),
-                                       G_FILE_CREATE_NONE, &etag, NULL, error))
-    {
-      g_free (contents);
-      g_free (eol);
 
-      return FALSE;
-    }
+static void
+mousepad_file_autosave_journal_reset (MousepadFile *file)
+{
+  g_clear_pointer (&file->journal.edits, mousepad_journal_free);
+  g_clear_pointer (&file->journal.header, g_bytes_unref);
+}
+
+
+
+static void
+mousepad_file_autosave_journal_start (MousepadFile *file)
+{
+  /* record the edits from now on, for a journal based on the new base being written,
+   * the header of which is known once it is written */
+  mousepad_file_autosave_journal_reset (file);
+  file->journal.edits = mousepad_journal_new ();
+  file->journal.size = 0;
+  file->journal.limit = AUTOSAVE_JOURNAL_MIN_LIMIT;
+  file->journal.encoding = file->encoding;
+  file->journal.line_ending = file->line_ending;
+  file->journal.write_bom = file->write_bom;
+}
+
+
+
+static gboolean
+mousepad_file_autosave_journal_usable (MousepadFile *file)
+{
+  /* the base must be serialized in the same way, and the journal not grow too large */
+  return file->journal.edits != NULL
+         && file->journal.size < file->journal.limit
+         && file->journal.encoding == file->encoding
+         && file->journal.line_ending == file->line_ending
+         && file->journal.write_bom == file->write_bom;
+}
 
-  /* update etag */
-  g_free (file->etag);
-  file->etag = etag;
 
-  /* add last eol if needed */
-  if (eol != NULL)
+
+static MousepadFileAutosaveJob *
+mousepad_file_autosave_job_new (MousepadFile *file,
+                                GError **error)
+{
+  MousepadFileAutosaveJob *job;
+
+  job = g_new0 (MousepadFileAutosaveJob, 1);
+  job->location = g_object_ref (file->autosave_location);
+  job->journal_location = mousepad_journal_get_location (file->autosave_location);
+
+  /* append the last edits to the journal */
+  if (mousepad_file_autosave_journal_usable (file))
     {
-      gtk_text_buffer_get_end_iter (file->buffer, &iter);
-      gtk_text_buffer_insert (file->buffer, &iter, eol, -1);
-      g_free (eol);
-    }
+      job->records = mousepad_journal_steal_records (file->journal.edits);
+      job->header = g_steal_pointer (&file->journal.header);
+      file->journal.size += g_bytes_get_size (job->records);
 
-  /* everything has been saved */
-  gtk_text_buffer_set_modified (file->buffer, FALSE);
+      return job;
+    }
 
-  /* re-guess the filetype which could have changed */
-  mousepad_file_set_language (file, NULL);
+  /* write a new base otherwise, i.e. compact the journal: only take a snapshot of the
+   * buffer here, serialization is done by the worker */
+  if (!mousepad_file_writer_init (&job->writer, file, error))
+    {
+      mousepad_file_autosave_job_free (job);
+      return NULL;
+    }
 
-  /* cleanup */
-  g_free (contents);
+  job->slices = mousepad_file_get_slices (file);
+  mousepad_file_autosave_journal_start (file);
 
-  return TRUE;
+  return job;
 }
 
 
@@ -1353,12 +3095,24 @@ mousepad_file_autosave_save_finish (GObject *source_object,
                                     GAsyncResult *res,
                                     gpointer user_data)
 {
+  MousepadFile *file = MOUSEPAD_FILE (source_object);
+  MousepadFileAutosaveJob *job = g_task_get_task_data (G_TASK (res));
   GError *error = NULL;
 
-  if (!g_file_replace_contents_finish (G_FILE (source_object), res, NULL, &error))
+  file->journal.busy = FALSE;
+  if (!g_task_propagate_boolean (G_TASK (res), &error))
     {
       g_warning ("Autosave failed: %s", error->message);
       g_error_free (error);
+
+      /* the journal doesn't apply anymore, a new base will have to be written */
+      mousepad_file_autosave_journal_reset (file);
+    }
+  /* a new base was written: the journal can be created, if still recording */
+  else if (job->slices != NULL && file->journal.edits != NULL)
+    {
+      file->journal.header = g_steal_pointer (&job->header);
+      file->journal.limit = MAX (AUTOSAVE_JOURNAL_MIN_LIMIT, job->base_size / 4);
     }
 
   /* decrease application use count in all cases */
@@ -1371,20 +3125,23 @@ static gboolean
 mousepad_file_autosave_save (gpointer data)
 {
   MousepadFile *file = data;
+  MousepadFileAutosaveJob *job;
   GError *error = NULL;
-  GBytes *contents;
-  gchar *strcont;
-  gsize length;
+  GTask *task;
 
   /* autosave cancelled */
   if (!file->autosave_scheduled)
     return FALSE;
 
+  /* the previous autosave is still in progress: try again later */
+  if (file->journal.busy)
+    return TRUE;
+
   /* update autosave state right now, in particular to prevent any concurrent sync saving */
   file->autosave_scheduled = FALSE;
 
   /* prepare save contents */
-  if (!mousepad_file_prepare_save_contents (file, &strcont, &length, NULL, &error))
+  if ((job = mousepad_file_autosave_job_new (file, &error)) == NULL)
     {
       g_warning ("Autosave failed: %s", error->message);
       g_error_free (error);
@@ -1396,13 +3153,11 @@ mousepad_file_autosave_save (gpointer data)
   g_application_hold (g_application_get_default ());
 
   /* save contents */
-  contents = g_bytes_new_take (strcont, length);
-  g_file_replace_contents_bytes_async (file->autosave_location, contents, NULL, FALSE,
-                                       G_FILE_CREATE_NONE, NULL,
-                                       mousepad_file_autosave_save_finish, file);
-
-  /* cleanup */
-  g_bytes_unref (contents);
+  file->journal.busy = TRUE;
+  task = g_task_new (file, NULL, mousepad_file_autosave_save_finish, NULL);
+  g_task_set_task_data (task, job, mousepad_file_autosave_job_free);
+  g_task_run_in_thread (task, mousepad_file_autosave_thread);
+  g_object_unref (task);
 
   return FALSE;
 }
@@ -1459,17 +3214,29 @@ static void
 mousepad_file_autosave_delete (GtkTextBuffer *buffer,
                                MousepadFile *file)
 {
+  GFile *journal;
+
   /* we are only interested in a switch to the "unmodified" state, i.e. when the file
    * was regularly saved, or changes were reverted by some means */
   if (gtk_text_buffer_get_modified (file->buffer))
     return;
 
+  /* stop journaling until the next autosave */
+  mousepad_file_autosave_journal_reset (file);
+  journal = mousepad_journal_get_location (file->autosave_location);
+
   /* increase application use count during async delete */
   g_application_hold (g_application_get_default ());
+  g_application_hold (g_application_get_default ());
 
-  /* delete file */
+  /* delete files */
   g_file_delete_async (file->autosave_location, G_PRIORITY_DEFAULT, NULL,
                        mousepad_file_autosave_delete_finish, NULL);
+  g_file_delete_async (journal, G_PRIORITY_DEFAULT, NULL,
+                       mousepad_file_autosave_delete_finish, NULL);
+
+  /* cleanup */
+  g_object_unref (journal);
 }
 
 
@@ -1508,6 +3275,7 @@ mousepad_file_autosave_timer_changed (MousepadFile *file)
     {
       /* reset autosave location */
       g_clear_object (&file->autosave_location);
+      mousepad_file_autosave_journal_reset (file);
 
       /* disconnect handlers */
       mousepad_disconnect_by_func (file->buffer, mousepad_file_autosave_schedule, file);
@@ -1548,11 +3316,13 @@ mousepad_file_autosave_get_uri (MousepadFile *file)
 gboolean
 mousepad_file_autosave_save_sync (MousepadFile *file)
 {
+  MousepadFileAutosaveJob *job;
   GtkWindow *window;
+  GFileOutputStream *stream;
+  GFile *journal;
   GError **perror = NULL;
   GError *error = NULL;
-  gchar *contents = NULL;
-  gsize length;
+  gboolean succeed = FALSE;
 
   /* file already saved */
   if (!file->autosave_scheduled)
@@ -1565,33 +3335,52 @@ mousepad_file_autosave_save_sync (MousepadFile *file)
   if (mousepad_history_session_get_quitting () == MOUSEPAD_SESSION_QUITTING_INTERACTIVE)
     perror = &error;
 
-  /* prepare save contents */
-  if (!mousepad_file_prepare_save_contents (file, &contents, &length, NULL, perror)
-      && perror != NULL)
+  /* wait for the async saving in progress, if any */
+  while (file->journal.busy)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* append the last edits to the journal */
+  if (mousepad_file_autosave_journal_usable (file))
     {
-      window = gtk_application_get_active_window (GTK_APPLICATION (g_application_get_default ()));
-      mousepad_dialogs_show_error (window, error, MOUSEPAD_MESSAGE_IO_ERROR_SAVE);
-      g_error_free (error);
+      job = mousepad_file_autosave_job_new (file, NULL);
+      succeed = mousepad_file_autosave_job_run (job, perror);
+      mousepad_file_autosave_job_free (job);
+    }
+  /* stream contents to a new base otherwise */
+  else
+    {
+      stream = g_file_replace (file->autosave_location, NULL, FALSE, G_FILE_CREATE_NONE, NULL, perror);
+      if (stream != NULL)
+        {
+          if (mousepad_file_write_contents (file, G_OUTPUT_STREAM (stream), NULL, perror))
+            succeed = g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, perror);
+          else
+            mousepad_file_output_stream_abort (G_OUTPUT_STREAM (stream));
 
-      return FALSE;
+          g_object_unref (stream);
+        }
+
+      /* the journal is obsolete */
+      if (succeed)
+        {
+          journal = mousepad_journal_get_location (file->autosave_location);
+          g_file_delete (journal, NULL, NULL);
+          g_object_unref (journal);
+        }
     }
 
-  /* save contents */
-  if (contents != NULL
-      && !g_file_replace_contents (file->autosave_location, contents, length, NULL, FALSE,
-                                   G_FILE_CREATE_NONE, NULL, NULL, perror)
-      && perror != NULL)
+  /* stop journaling in case of error, a new base will have to be written */
+  if (!succeed)
+    mousepad_file_autosave_journal_reset (file);
+
+  if (!succeed && perror != NULL)
     {
       window = gtk_application_get_active_window (GTK_APPLICATION (g_application_get_default ()));
       mousepad_dialogs_show_error (window, error, MOUSEPAD_MESSAGE_IO_ERROR_SAVE);
       g_error_free (error);
-      g_free (contents);
 
       return FALSE;
     }
 
-  /* cleanup */
-  g_free (contents);
-
   return TRUE;
 }
@@ -45,6 +45,18 @@ typedef enum
   MOUSEPAD_EOL_DOS
 } MousepadLineEnding;
 
+/* features which can be turned off in large file mode, see the
+ * "large-file-disabled-features" setting */
+typedef enum
+{
+  MOUSEPAD_LARGE_FILE_SYNTAX_HIGHLIGHTING = 1 << 0,
+  MOUSEPAD_LARGE_FILE_MATCH_BRACES = 1 << 1,
+  MOUSEPAD_LARGE_FILE_HIGHLIGHT_ALL = 1 << 2,
+  MOUSEPAD_LARGE_FILE_SPELL_CHECKING = 1 << 3,
+  MOUSEPAD_LARGE_FILE_WORD_WRAP = 1 << 4,
+  MOUSEPAD_LARGE_FILE_LANGUAGE_GUESSING = 1 << 5
+} MousepadLargeFileFeatures;
+
 /* location type */
 enum
 {
@@ -89,6 +101,9 @@ mousepad_file_set_encoding (MousepadFile *file,
 MousepadEncoding
 mousepad_file_get_encoding (MousepadFile *file);
 
+MousepadEncoding
+mousepad_file_get_rejected_encoding (MousepadFile *file);
+
 void
 mousepad_file_set_write_bom (MousepadFile *file,
                              gboolean write_bom);
@@ -116,6 +131,21 @@ mousepad_file_get_language (MousepadFile *file);
 gboolean
 mousepad_file_get_user_set_language (MousepadFile *file);
 
+gboolean
+mousepad_file_is_large (MousepadFile *file);
+
+MousepadLargeFileFeatures
+mousepad_file_get_disabled_features (MousepadFile *file);
+
+guint
+mousepad_file_get_n_invalid_sequences (MousepadFile *file);
+
+gboolean
+mousepad_file_get_invalid_sequence (MousepadFile *file,
+                                    guint n,
+                                    goffset *offset,
+                                    GtkTextIter *iter);
+
 gint
 mousepad_file_open (MousepadFile *file,
                     gint line,
@@ -125,11 +155,26 @@ mousepad_file_open (MousepadFile *file,
                     gboolean make_valid,
                     GError **error);
 
+void
+mousepad_file_cancel_loading (MousepadFile *file);
+
 gboolean
 mousepad_file_save (MousepadFile *file,
                     gboolean forced,
                     GError **error);
 
+void
+mousepad_file_save_async (MousepadFile *file,
+                          gboolean forced,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data);
+
+gboolean
+mousepad_file_save_finish (MousepadFile *file,
+                           GAsyncResult *result,
+                           GError **error);
+
 void
 mousepad_file_autosave_init (MousepadFile *file);
 
@@ -0,0 +1,1042 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mousepad-private.h"
+#include "mousepad-find-in-files.h"
+#include "mousepad-marshal.h"
+#include "mousepad-scan.h"
+#include "mousepad-search.h"
+#include "mousepad-settings.h"
+#include "mousepad-util.h"
+
+#include <glib/gstdio.h>
+
+
+
+/* beyond this number of matches, matches are only counted */
+#define RESULTS_MAX 10000
+
+/* the line shown for a match starts at most this number of bytes before it, and is cut
+ * after this number of bytes */
+#define LINE_CONTEXT 40
+#define LINE_LENGTH_MAX 200
+
+/* delay between two updates of the results list, in milliseconds */
+#define FLUSH_DELAY 100
+
+/* files are read in blocks of this size, binary files being skipped after the first one */
+#define READ_BLOCK_SIZE (64 * 1024)
+
+
+
+/*
+ * A search is a job shared by the pane and the worker threads: a directory walk runs on
+ * a GTask thread and pushes the files to search to a pool of one thread per processor,
+ * skipping the files above the large file size, which are only counted. Each file is read,
+ * skipped if it is not valid UTF-8 (which includes binary files, as nul bytes are invalid
+ * here), and searched with the search engine pattern, within the regex time budget for
+ * each file. The matches are queued under a mutex and added to the results list in the
+ * main thread every FLUSH_DELAY milliseconds, so that a large search never blocks the UI.
+ */
+typedef struct _MousepadFindMatch
+{
+  /* path relative to the searched folder, line and column as character offsets */
+  gchar *path;
+  gint line, column, length;
+
+  /* the line containing the match start, possibly cut */
+  gchar *text;
+} MousepadFindMatch;
+
+typedef struct _MousepadFindJob
+{
+  gint ref_count;
+  GCancellable *cancellable;
+
+  /* search parameters, and the length of the folder path prefix in the file paths */
+  gchar *folder;
+  gsize prefix_length;
+  MousepadSearchPattern *pattern;
+  GPatternSpec **globs;
+
+  /* files above this size in bytes are not read, if not zero */
+  goffset size_max;
+
+  /* matches not yet added to the results list, and totals, protected by the mutex */
+  GMutex mutex;
+  GPtrArray *matches;
+  guint n_listed, n_matches;
+  guint n_too_expensive, n_too_large;
+  guint flush_id;
+
+  /* the pane, or NULL if the search was stopped, only used in the main thread */
+  MousepadFindInFiles *pane;
+} MousepadFindJob;
+
+
+
+static void
+mousepad_find_in_files_finalize (GObject *object);
+static void
+mousepad_find_in_files_hide_clicked (MousepadFindInFiles *pane);
+static void
+mousepad_find_in_files_search (MousepadFindInFiles *pane);
+static void
+mousepad_find_in_files_search_clicked (MousepadFindInFiles *pane);
+static void
+mousepad_find_in_files_row_activated (MousepadFindInFiles *pane,
+                                      GtkTreePath *path,
+                                      GtkTreeViewColumn *column);
+
+
+
+enum
+{
+  HIDE_PANE,
+  OPEN_MATCH,
+  LAST_SIGNAL
+};
+
+enum
+{
+  COLUMN_LOCATION,
+  COLUMN_TEXT,
+  COLUMN_PATH,
+  COLUMN_LINE,
+  COLUMN_COLUMN,
+  COLUMN_LENGTH,
+  N_COLUMNS
+};
+
+struct _MousepadFindInFiles
+{
+  GtkBox __parent__;
+
+  /* pane widgets */
+  GtkWidget *entry;
+  GtkWidget *folder_button;
+  GtkWidget *files_entry;
+  GtkWidget *search_button;
+  GtkWidget *spinner;
+  GtkWidget *hits_label;
+  GtkListStore *store;
+
+  /* the running search, if any */
+  MousepadFindJob *job;
+};
+
+
+
+static guint find_in_files_signals[LAST_SIGNAL];
+
+
+
+static MousepadFindJob *
+mousepad_find_job_ref (MousepadFindJob *job)
+{
+  g_atomic_int_inc (&job->ref_count);
+
+  return job;
+}
+
+
+
+static void
+mousepad_find_match_free (gpointer data)
+{
+  MousepadFindMatch *match = data;
+
+  g_free (match->path);
+  g_free (match->text);
+  g_free (match);
+}
+
+
+
+static void
+mousepad_find_job_unref (gpointer data)
+{
+  MousepadFindJob *job = data;
+  guint n;
+
+  if (!g_atomic_int_dec_and_test (&job->ref_count))
+    return;
+
+  if (job->globs != NULL)
+    {
+      for (n = 0; job->globs[n] != NULL; n++)
+        g_pattern_spec_free (job->globs[n]);
+
+      g_free (job->globs);
+    }
+
+  g_object_unref (job->cancellable);
+  mousepad_search_pattern_free (job->pattern);
+  g_ptr_array_unref (job->matches);
+  g_mutex_clear (&job->mutex);
+  g_free (job->folder);
+  g_free (job);
+}
+
+
+
+/* counts the line breaks in [p, end), as they are once normalized in a text buffer, and
+ * moves 'line_start' after the last one */
+static gint
+mousepad_find_job_count_lines (const gchar *p,
+                               const gchar *end,
+                               const gchar *text_end,
+                               gboolean lone_crs,
+                               const gchar **line_start)
+{
+  gint n = 0;
+
+  if (!lone_crs)
+    {
+      for (; (p = memchr (p, '\n', end - p)) != NULL; n++)
+        *line_start = ++p;
+
+      return n;
+    }
+
+  for (; p < end; p++)
+    if (*p == '\n' || (*p == '\r' && (p + 1 == text_end || p[1] != '\n')))
+      {
+        *line_start = p + 1;
+        n++;
+      }
+
+  return n;
+}
+
+
+
+static gchar *
+mousepad_find_job_line_text (const gchar *line_start,
+                             const gchar *match,
+                             const gchar *text_end)
+{
+  const gchar *start = line_start, *end;
+  gboolean cut_start = FALSE, cut_end = FALSE;
+
+  /* keep the context of a match far from the line start */
+  if (match - start > LINE_CONTEXT)
+    {
+      start = match - LINE_CONTEXT;
+      while (((guchar) *start & 0xC0) == 0x80)
+        start++;
+
+      cut_start = TRUE;
+    }
+  else
+    while (start < match && (*start == ' ' || *start == '\t'))
+      start++;
+
+  for (end = start; end < text_end && *end != '\n' && *end != '\r'; end++)
+    if (end - start == LINE_LENGTH_MAX)
+      {
+        while (end > start && ((guchar) *end & 0xC0) == 0x80)
+          end--;
+
+        cut_end = TRUE;
+        break;
+      }
+
+  return g_strdup_printf ("%s%.*s%s", cut_start ? "…" : "", (gint) (end - start), start,
+                          cut_end ? "…" : "");
+}
+
+
+
+static gboolean
+mousepad_find_job_flush (gpointer data)
+{
+  MousepadFindJob *job = data;
+  MousepadFindInFiles *pane = job->pane;
+  MousepadFindMatch *match;
+  GPtrArray *matches;
+  gchar *location, *message;
+  guint n, n_matches, n_listed, n_too_expensive, n_too_large;
+
+  /* take the queued matches */
+  g_mutex_lock (&job->mutex);
+  matches = job->matches;
+  job->matches = g_ptr_array_new_with_free_func (mousepad_find_match_free);
+  n_matches = job->n_matches;
+  n_listed = job->n_listed;
+  n_too_expensive = job->n_too_expensive;
+  n_too_large = job->n_too_large;
+  job->flush_id = 0;
+  g_mutex_unlock (&job->mutex);
+
+  /* the search was stopped */
+  if (pane == NULL)
+    {
+      g_ptr_array_unref (matches);
+      return FALSE;
+    }
+
+  for (n = 0; n < matches->len; n++)
+    {
+      match = g_ptr_array_index (matches, n);
+      location = g_strdup_printf ("%s:%d", match->path, match->line + 1);
+      gtk_list_store_insert_with_values (pane->store, NULL, -1,
+                                         COLUMN_LOCATION, location,
+                                         COLUMN_TEXT, match->text,
+                                         COLUMN_PATH, match->path,
+                                         COLUMN_LINE, match->line,
+                                         COLUMN_COLUMN, match->column,
+                                         COLUMN_LENGTH, match->length,
+                                         -1);
+      g_free (location);
+    }
+
+  g_ptr_array_unref (matches);
+
+  /* update the counter */
+  message = g_strdup_printf (ngettext ("%d match", "%d matches", n_matches), n_matches);
+  if (n_listed < n_matches)
+    {
+      location = message;
+      message = g_strdup_printf (_("%s (first %d listed)"), location, n_listed);
+      g_free (location);
+    }
+
+  /* the files where the search was given up */
+  if (n_too_expensive > 0)
+    {
+      location = message;
+      message = g_strdup_printf (ngettext ("%s, pattern too expensive in %d file",
+                                           "%s, pattern too expensive in %d files", n_too_expensive),
+                                 location, n_too_expensive);
+      g_free (location);
+    }
+
+  /* the files not read at all */
+  if (n_too_large > 0)
+    {
+      location = message;
+      message = g_strdup_printf (ngettext ("%s, %d large file skipped",
+                                           "%s, %d large files skipped", n_too_large),
+                                 location, n_too_large);
+      g_free (location);
+    }
+
+  gtk_label_set_text (GTK_LABEL (pane->hits_label), message);
+  g_free (message);
+
+  return FALSE;
+}
+
+
+
+/* schedules an update of the results list if needed, the job mutex being held */
+static void
+mousepad_find_job_schedule_flush (MousepadFindJob *job)
+{
+  if (job->flush_id == 0)
+    job->flush_id = g_timeout_add_full (G_PRIORITY_DEFAULT, FLUSH_DELAY, mousepad_find_job_flush,
+                                        mousepad_find_job_ref (job), mousepad_find_job_unref);
+}
+
+
+
+/* reads a whole file in blocks, as long as the search is not cancelled, the file does not
+ * look binary and it remains below the size limit: returns the nul-terminated contents,
+ * or NULL */
+static gchar *
+mousepad_find_job_read_file (MousepadFindJob *job,
+                             const gchar *path,
+                             gsize *text_length)
+{
+  GFile *file;
+  GFileInputStream *stream;
+  GByteArray *contents;
+  gsize length;
+  gssize n_read;
+
+  file = g_file_new_for_path (path);
+  stream = g_file_read (file, job->cancellable, NULL);
+  g_object_unref (file);
+  if (stream == NULL)
+    return NULL;
+
+  contents = g_byte_array_new ();
+  do
+    {
+      length = contents->len;
+      g_byte_array_set_size (contents, length + READ_BLOCK_SIZE);
+      n_read = g_input_stream_read (G_INPUT_STREAM (stream), contents->data + length,
+                                    READ_BLOCK_SIZE, job->cancellable, NULL);
+      g_byte_array_set_size (contents, length + MAX (n_read, 0));
+
+      /* nul bytes are invalid anyway, don't read the rest of a binary file */
+      if (n_read > 0 && contents->len <= READ_BLOCK_SIZE
+          && memchr (contents->data, '\0', contents->len) != NULL)
+        n_read = -1;
+
+      /* the file grew beyond the size limit since it was listed */
+      if (job->size_max > 0 && contents->len > (gsize) job->size_max)
+        n_read = -1;
+    }
+  while (n_read > 0);
+
+  g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+  g_object_unref (stream);
+
+  if (n_read < 0)
+    {
+      g_byte_array_unref (contents);
+      return NULL;
+    }
+
+  *text_length = contents->len;
+  g_byte_array_append (contents, (const guint8 *) "", 1);
+
+  return (gchar *) g_byte_array_free (contents, FALSE);
+}
+
+
+
+static void
+mousepad_find_job_search_file (gpointer data,
+                               gpointer user_data)
+{
+  MousepadFindJob *job = user_data;
+  MousepadFindMatch *match;
+  MousepadScanResult scan;
+  GPtrArray *matches;
+  GError *error = NULL;
+  const gchar *text_end, *p, *start, *end, *line_start;
+  gchar *text, *path = data;
+  gint64 deadline;
+  gsize length;
+  gint line = 0;
+  guint n = 0, i;
+  gboolean too_expensive;
+
+  if (g_cancellable_is_cancelled (job->cancellable)
+      || (text = mousepad_find_job_read_file (job, path, &length)) == NULL)
+    {
+      g_free (path);
+      return;
+    }
+
+  text_end = text + length;
+  line_start = text;
+
+  /* skip binary files and files in other encodings */
+  if (length > 0)
+    mousepad_scan_contents (text, length, &scan);
+
+  if (length == 0 || scan.valid_length < length)
+    {
+      g_free (text);
+      g_free (path);
+      return;
+    }
+
+  /* each file has its own time budget */
+  matches = g_ptr_array_new ();
+  deadline = g_get_monotonic_time () + MOUSEPAD_SEARCH_REGEX_TIME_BUDGET;
+  for (p = text;
+       (start = mousepad_search_pattern_find (job->pattern, text, length, p, deadline,
+                                              job->cancellable, &end, &error)) != NULL;
+       p = end)
+    {
+      n++;
+      line += mousepad_find_job_count_lines (p, start, text_end, scan.n_cr > 0, &line_start);
+
+      /* beyond the matches to list, only count them */
+      if (matches->len < RESULTS_MAX)
+        {
+          match = g_new (MousepadFindMatch, 1);
+          match->path = g_strdup (path + job->prefix_length);
+          match->line = line;
+          match->column = g_utf8_strlen (line_start, start - line_start);
+          match->length = g_utf8_strlen (start, end - start);
+          match->text = mousepad_find_job_line_text (line_start, start, text_end);
+          g_ptr_array_add (matches, match);
+        }
+
+      /* the match may contain line breaks */
+      line += mousepad_find_job_count_lines (start, end, text_end, scan.n_cr > 0, &line_start);
+    }
+
+  /* the matches found before a too expensive regex was given up are kept */
+  too_expensive = g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+  if (error != NULL)
+    g_error_free (error);
+
+  /* queue the matches, and schedule an update of the results list if needed */
+  if (n > 0 || too_expensive)
+    {
+      g_mutex_lock (&job->mutex);
+
+      for (i = 0; i < matches->len && job->n_listed < RESULTS_MAX; i++, job->n_listed++)
+        g_ptr_array_add (job->matches, g_ptr_array_index (matches, i));
+      for (; i < matches->len; i++)
+        mousepad_find_match_free (g_ptr_array_index (matches, i));
+
+      job->n_matches += n;
+      if (too_expensive)
+        job->n_too_expensive++;
+
+      mousepad_find_job_schedule_flush (job);
+      g_mutex_unlock (&job->mutex);
+    }
+
+  g_ptr_array_unref (matches);
+  g_free (text);
+  g_free (path);
+}
+
+
+
+static gboolean
+mousepad_find_job_match_name (MousepadFindJob *job,
+                              const gchar *name)
+{
+  guint n;
+
+  if (job->globs == NULL)
+    return TRUE;
+
+  for (n = 0; job->globs[n] != NULL; n++)
+    if (g_pattern_match_string (job->globs[n], name))
+      return TRUE;
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_find_job_walk (MousepadFindJob *job,
+                        GThreadPool *pool,
+                        const gchar *folder)
+{
+  GDir *dir;
+  GStatBuf statbuf;
+  const gchar *name;
+  gchar *path;
+
+  if ((dir = g_dir_open (folder, 0, NULL)) == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL && !g_cancellable_is_cancelled (job->cancellable))
+    {
+      /* skip hidden files and folders, such as version control data */
+      if (*name == '.')
+        continue;
+
+      /* skip symbolic links, which could loop or lead out of the folder */
+      path = g_build_filename (folder, name, NULL);
+      if (g_lstat (path, &statbuf) != 0)
+        {
+          g_free (path);
+          continue;
+        }
+
+      if (S_ISDIR (statbuf.st_mode))
+        {
+          mousepad_find_job_walk (job, pool, path);
+          g_free (path);
+          continue;
+        }
+
+      if (!S_ISREG (statbuf.st_mode) || !mousepad_find_job_match_name (job, name))
+        {
+          g_free (path);
+          continue;
+        }
+
+      /* don't read whole files that are too large to be searched in memory, but report them */
+      if (job->size_max > 0 && statbuf.st_size > job->size_max)
+        {
+          g_mutex_lock (&job->mutex);
+          job->n_too_large++;
+          mousepad_find_job_schedule_flush (job);
+          g_mutex_unlock (&job->mutex);
+          g_free (path);
+          continue;
+        }
+
+      /* the pool takes ownership of the path */
+      g_thread_pool_push (pool, path, NULL);
+    }
+
+  g_dir_close (dir);
+}
+
+
+
+static void
+mousepad_find_job_thread (GTask *task,
+                          gpointer source_object,
+                          gpointer task_data,
+                          GCancellable *cancellable)
+{
+  MousepadFindJob *job = task_data;
+  GThreadPool *pool;
+
+  pool = g_thread_pool_new (mousepad_find_job_search_file, job, g_get_num_processors (),
+                            FALSE, NULL);
+
+  mousepad_find_job_walk (job, pool, job->folder);
+
+  /* wait for the files in the queue to be searched, which is quick once cancelled */
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+
+static void
+mousepad_find_job_completed (GObject *object,
+                             GAsyncResult *result,
+                             gpointer data)
+{
+  MousepadFindJob *job = data;
+  MousepadFindInFiles *pane = job->pane;
+
+  /* add the last matches */
+  g_mutex_lock (&job->mutex);
+  if (job->flush_id != 0)
+    {
+      g_source_remove (job->flush_id);
+      job->flush_id = 0;
+    }
+
+  g_mutex_unlock (&job->mutex);
+  mousepad_find_job_flush (job);
+
+  /* the search was not stopped meanwhile, drop the reference of the pane */
+  if (pane != NULL)
+    {
+      mousepad_util_entry_error (pane->entry, job->n_matches == 0);
+      gtk_spinner_stop (GTK_SPINNER (pane->spinner));
+      gtk_button_set_label (GTK_BUTTON (pane->search_button), _("_Search"));
+
+      pane->job = NULL;
+      job->pane = NULL;
+      mousepad_find_job_unref (job);
+    }
+
+  /* drop the reference of the task */
+  mousepad_find_job_unref (job);
+}
+
+
+
+G_DEFINE_TYPE (MousepadFindInFiles, mousepad_find_in_files, GTK_TYPE_BOX)
+
+
+
+static void
+mousepad_find_in_files_class_init (MousepadFindInFilesClass *klass)
+{
+  GObjectClass *gobject_class;
+  GtkBindingSet *binding_set;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = mousepad_find_in_files_finalize;
+
+  /* signals */
+  find_in_files_signals[HIDE_PANE] = g_signal_new (I_ ("hide-pane"),
+                                                   G_TYPE_FROM_CLASS (gobject_class),
+                                                   G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                                                   0, NULL, NULL,
+                                                   g_cclosure_marshal_VOID__VOID,
+                                                   G_TYPE_NONE, 0);
+
+  find_in_files_signals[OPEN_MATCH] = g_signal_new (I_ ("open-match"),
+                                                    G_TYPE_FROM_CLASS (gobject_class),
+                                                    G_SIGNAL_RUN_LAST,
+                                                    0, NULL, NULL,
+                                                    _mousepad_marshal_VOID__OBJECT_INT_INT_INT,
+                                                    G_TYPE_NONE, 4, G_TYPE_FILE,
+                                                    G_TYPE_INT, G_TYPE_INT, G_TYPE_INT);
+
+  /* setup key bindings for the pane */
+  binding_set = gtk_binding_set_by_class (klass);
+  gtk_binding_entry_add_signal (binding_set, GDK_KEY_Escape, 0, "hide-pane", 0);
+}
+
+
+
+static void
+mousepad_find_in_files_init (MousepadFindInFiles *pane)
+{
+  GtkWidget *hbox, *widget, *tree_view, *scrolled;
+  GtkCellRenderer *renderer;
+  GtkTreeViewColumn *column;
+
+  pane->job = NULL;
+
+  gtk_orientable_set_orientation (GTK_ORIENTABLE (pane), GTK_ORIENTATION_VERTICAL);
+  gtk_box_set_spacing (GTK_BOX (pane), 4);
+
+  /* search parameters */
+  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+  gtk_widget_set_margin_start (hbox, 6);
+  gtk_widget_set_margin_end (hbox, 6);
+  gtk_widget_set_margin_top (hbox, 4);
+  gtk_box_pack_start (GTK_BOX (pane), hbox, FALSE, FALSE, 0);
+
+  /* the close button */
+  widget = gtk_button_new_from_icon_name ("window-close-symbolic", GTK_ICON_SIZE_MENU);
+  gtk_button_set_relief (GTK_BUTTON (widget), GTK_RELIEF_NONE);
+  g_signal_connect_swapped (widget, "clicked", G_CALLBACK (mousepad_find_in_files_hide_clicked), pane);
+  gtk_box_pack_start (GTK_BOX (hbox), widget, FALSE, FALSE, 0);
+
+  /* the search entry */
+  pane->entry = gtk_search_entry_new ();
+  gtk_entry_set_placeholder_text (GTK_ENTRY (pane->entry), _("Find in files"));
+  g_signal_connect_swapped (pane->entry, "activate",
+                            G_CALLBACK (mousepad_find_in_files_search), pane);
+  gtk_box_pack_start (GTK_BOX (hbox), pane->entry, TRUE, TRUE, 0);
+
+  /* warn about a too expensive regex as it is typed or the search options change */
+  g_signal_connect (pane->entry, "changed", G_CALLBACK (mousepad_util_entry_check_pattern), NULL);
+  mousepad_setting_connect_object (MOUSEPAD_SETTING_SEARCH_MATCH_CASE,
+                                   G_CALLBACK (mousepad_util_entry_check_pattern),
+                                   pane->entry, G_CONNECT_SWAPPED);
+  mousepad_setting_connect_object (MOUSEPAD_SETTING_SEARCH_ENABLE_REGEX,
+                                   G_CALLBACK (mousepad_util_entry_check_pattern),
+                                   pane->entry, G_CONNECT_SWAPPED);
+
+  /* the folder to search */
+  widget = gtk_label_new_with_mnemonic (_("_In:"));
+  gtk_box_pack_start (GTK_BOX (hbox), widget, FALSE, FALSE, 0);
+
+  pane->folder_button = gtk_file_chooser_button_new (_("Select a Folder"),
+                                                     GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER);
+  gtk_label_set_mnemonic_widget (GTK_LABEL (widget), pane->folder_button);
+  gtk_box_pack_start (GTK_BOX (hbox), pane->folder_button, FALSE, FALSE, 0);
+
+  /* the files to search */
+  widget = gtk_label_new_with_mnemonic (_("_Files:"));
+  gtk_box_pack_start (GTK_BOX (hbox), widget, FALSE, FALSE, 0);
+
+  pane->files_entry = gtk_entry_new ();
+  gtk_entry_set_width_chars (GTK_ENTRY (pane->files_entry), 12);
+  gtk_entry_set_placeholder_text (GTK_ENTRY (pane->files_entry), "*.c, *.h");
+  gtk_widget_set_tooltip_text (pane->files_entry,
+                               _("Patterns of the names of the files to search, all files if empty"));
+  gtk_label_set_mnemonic_widget (GTK_LABEL (widget), pane->files_entry);
+  g_signal_connect_swapped (pane->files_entry, "activate",
+                            G_CALLBACK (mousepad_find_in_files_search), pane);
+  gtk_box_pack_start (GTK_BOX (hbox), pane->files_entry, FALSE, FALSE, 0);
+
+  /* search options, shared with the search bar and the replace dialog */
+  widget = gtk_check_button_new_with_mnemonic (_("Match _case"));
+  MOUSEPAD_SETTING_BIND (SEARCH_MATCH_CASE, widget, "active", G_SETTINGS_BIND_DEFAULT);
+  gtk_box_pack_start (GTK_BOX (hbox), widget, FALSE, FALSE, 0);
+
+  widget = gtk_check_button_new_with_mnemonic (_("_Match whole word"));
+  MOUSEPAD_SETTING_BIND (SEARCH_MATCH_WHOLE_WORD, widget, "active", G_SETTINGS_BIND_DEFAULT);
+  gtk_box_pack_start (GTK_BOX (hbox), widget, FALSE, FALSE, 0);
+
+  widget = gtk_check_button_new_with_mnemonic (_("Regular e_xpression"));
+  MOUSEPAD_SETTING_BIND (SEARCH_ENABLE_REGEX, widget, "active", G_SETTINGS_BIND_DEFAULT);
+  gtk_box_pack_start (GTK_BOX (hbox), widget, FALSE, FALSE, 0);
+
+  /* the search/stop button */
+  pane->search_button = gtk_button_new_with_mnemonic (_("_Search"));
+  g_signal_connect_swapped (pane->search_button, "clicked",
+                            G_CALLBACK (mousepad_find_in_files_search_clicked), pane);
+  gtk_box_pack_start (GTK_BOX (hbox), pane->search_button, FALSE, FALSE, 0);
+
+  /* the spinner and the occurrences label */
+  pane->spinner = gtk_spinner_new ();
+  gtk_box_pack_start (GTK_BOX (hbox), pane->spinner, FALSE, FALSE, 0);
+
+  pane->hits_label = gtk_label_new (NULL);
+  gtk_style_context_add_class (gtk_widget_get_style_context (pane->hits_label),
+                               GTK_STYLE_CLASS_DIM_LABEL);
+  gtk_box_pack_start (GTK_BOX (hbox), pane->hits_label, FALSE, FALSE, 0);
+
+  /* the results list */
+  pane->store = gtk_list_store_new (N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+                                    G_TYPE_INT, G_TYPE_INT, G_TYPE_INT);
+
+  tree_view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (pane->store));
+  gtk_tree_view_set_headers_visible (GTK_TREE_VIEW (tree_view), FALSE);
+  gtk_tree_view_set_enable_search (GTK_TREE_VIEW (tree_view), FALSE);
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (tree_view), TRUE);
+  g_signal_connect_swapped (tree_view, "row-activated",
+                            G_CALLBACK (mousepad_find_in_files_row_activated), pane);
+  g_object_unref (pane->store);
+
+  renderer = gtk_cell_renderer_text_new ();
+  column = gtk_tree_view_column_new_with_attributes (NULL, renderer, "text", COLUMN_LOCATION, NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, 250);
+  gtk_tree_view_column_set_resizable (column, TRUE);
+  gtk_tree_view_append_column (GTK_TREE_VIEW (tree_view), column);
+
+  renderer = gtk_cell_renderer_text_new ();
+  g_object_set (renderer, "family", "Monospace", "family-set", TRUE, NULL);
+  column = gtk_tree_view_column_new_with_attributes (NULL, renderer, "text", COLUMN_TEXT, NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_append_column (GTK_TREE_VIEW (tree_view), column);
+
+  scrolled = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (scrolled), GTK_SHADOW_IN);
+  gtk_widget_set_size_request (scrolled, -1, 160);
+  gtk_container_add (GTK_CONTAINER (scrolled), tree_view);
+  gtk_box_pack_start (GTK_BOX (pane), scrolled, TRUE, TRUE, 0);
+
+  /* show all widgets but the pane */
+  gtk_widget_show_all (GTK_WIDGET (pane));
+  gtk_widget_hide (GTK_WIDGET (pane));
+}
+
+
+
+static void
+mousepad_find_in_files_finalize (GObject *object)
+{
+  MousepadFindInFiles *pane = MOUSEPAD_FIND_IN_FILES (object);
+
+  /* stop the running search, whose results will be dropped */
+  if (pane->job != NULL)
+    {
+      g_cancellable_cancel (pane->job->cancellable);
+      pane->job->pane = NULL;
+      mousepad_find_job_unref (pane->job);
+    }
+
+  (*G_OBJECT_CLASS (mousepad_find_in_files_parent_class)->finalize) (object);
+}
+
+
+
+static void
+mousepad_find_in_files_hide_clicked (MousepadFindInFiles *pane)
+{
+  g_signal_emit (pane, find_in_files_signals[HIDE_PANE], 0);
+}
+
+
+
+static GPatternSpec **
+mousepad_find_in_files_get_globs (MousepadFindInFiles *pane)
+{
+  GPtrArray *globs;
+  gchar **strings;
+  guint n;
+
+  strings = g_strsplit_set (gtk_entry_get_text (GTK_ENTRY (pane->files_entry)), " ,;", -1);
+  globs = g_ptr_array_new ();
+  for (n = 0; strings[n] != NULL; n++)
+    if (*strings[n] != '\0')
+      g_ptr_array_add (globs, g_pattern_spec_new (strings[n]));
+
+  g_strfreev (strings);
+
+  /* search all files */
+  if (globs->len == 0)
+    {
+      g_ptr_array_free (globs, TRUE);
+      return NULL;
+    }
+
+  g_ptr_array_add (globs, NULL);
+
+  return (GPatternSpec **) g_ptr_array_free (globs, FALSE);
+}
+
+
+
+static void
+mousepad_find_in_files_search (MousepadFindInFiles *pane)
+{
+  MousepadFindJob *job;
+  MousepadSearchPattern *pattern;
+  MousepadSearchOptions options = 0;
+  GTask *task;
+  GError *error = NULL;
+  const gchar *string;
+  gchar *folder;
+
+  mousepad_find_in_files_stop (pane);
+  gtk_list_store_clear (pane->store);
+  gtk_label_set_text (GTK_LABEL (pane->hits_label), NULL);
+  mousepad_util_entry_error (pane->entry, FALSE);
+
+  string = gtk_entry_get_text (GTK_ENTRY (pane->entry));
+  folder = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (pane->folder_button));
+  if (*string == '\0' || folder == NULL)
+    {
+      g_free (folder);
+      return;
+    }
+
+  if (MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_MATCH_CASE))
+    options |= MOUSEPAD_SEARCH_CASE_SENSITIVE;
+  if (MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_MATCH_WHOLE_WORD))
+    options |= MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES;
+  if (MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_ENABLE_REGEX))
+    options |= MOUSEPAD_SEARCH_REGEX;
+
+  /* an invalid regex */
+  if ((pattern = mousepad_search_pattern_new (string, options, &error)) == NULL)
+    {
+      mousepad_util_entry_error (pane->entry, TRUE);
+      gtk_label_set_text (GTK_LABEL (pane->hits_label), error->message);
+      g_error_free (error);
+      g_free (folder);
+
+      return;
+    }
+
+  job = g_new0 (MousepadFindJob, 1);
+  job->ref_count = 1;
+  job->cancellable = g_cancellable_new ();
+  job->folder = folder;
+  job->prefix_length = strlen (folder) + (g_str_has_suffix (folder, G_DIR_SEPARATOR_S) ? 0 : 1);
+  job->pattern = pattern;
+  job->globs = mousepad_find_in_files_get_globs (pane);
+  job->size_max = (goffset) MOUSEPAD_SETTING_GET_UINT (LARGE_FILE_SIZE) * 1024 * 1024;
+  job->matches = g_ptr_array_new_with_free_func (mousepad_find_match_free);
+  g_mutex_init (&job->mutex);
+  job->pane = pane;
+  pane->job = job;
+
+  gtk_spinner_start (GTK_SPINNER (pane->spinner));
+  gtk_button_set_label (GTK_BUTTON (pane->search_button), _("_Stop"));
+
+  /* the task keeps its own reference on the job */
+  task = g_task_new (NULL, job->cancellable, mousepad_find_job_completed, mousepad_find_job_ref (job));
+  g_task_set_task_data (task, job, NULL);
+  g_task_run_in_thread (task, mousepad_find_job_thread);
+  g_object_unref (task);
+}
+
+
+
+static void
+mousepad_find_in_files_search_clicked (MousepadFindInFiles *pane)
+{
+  /* the button stops the running search */
+  if (pane->job != NULL)
+    mousepad_find_in_files_stop (pane);
+  else
+    mousepad_find_in_files_search (pane);
+}
+
+
+
+static void
+mousepad_find_in_files_row_activated (MousepadFindInFiles *pane,
+                                      GtkTreePath *path,
+                                      GtkTreeViewColumn *column)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (pane->store);
+  GtkTreeIter iter;
+  GFile *folder, *file;
+  gchar *relpath;
+  gint line, col, length;
+
+  if (!gtk_tree_model_get_iter (model, &iter, path))
+    return;
+
+  gtk_tree_model_get (model, &iter, COLUMN_PATH, &relpath, COLUMN_LINE, &line,
+                      COLUMN_COLUMN, &col, COLUMN_LENGTH, &length, -1);
+
+  folder = gtk_file_chooser_get_file (GTK_FILE_CHOOSER (pane->folder_button));
+  if (folder != NULL)
+    {
+      file = g_file_resolve_relative_path (folder, relpath);
+      g_signal_emit (pane, find_in_files_signals[OPEN_MATCH], 0, file, line, col, length);
+      g_object_unref (file);
+      g_object_unref (folder);
+    }
+
+  g_free (relpath);
+}
+
+
+
+/**
+ * mousepad_find_in_files_new:
+ *
+ * Creates a pane to search for a string in the files of a folder. The results are listed
+ * as they come, and activating one of them emits the "open-match" signal, with the file,
+ * the line, the column and the length of the match, as character offsets.
+ *
+ * Return value: the newly created #MousepadFindInFiles.
+ **/
+GtkWidget *
+mousepad_find_in_files_new (void)
+{
+  return g_object_new (MOUSEPAD_TYPE_FIND_IN_FILES, NULL);
+}
+
+
+
+void
+mousepad_find_in_files_focus (MousepadFindInFiles *pane)
+{
+  gtk_widget_grab_focus (pane->entry);
+  gtk_editable_select_region (GTK_EDITABLE (pane->entry), 0, -1);
+}
+
+
+
+void
+mousepad_find_in_files_set_folder (MousepadFindInFiles *pane,
+                                   GFile *folder)
+{
+  /* keep the folder of a previous search */
+  if (pane->job == NULL && gtk_tree_model_iter_n_children (GTK_TREE_MODEL (pane->store), NULL) == 0)
+    gtk_file_chooser_set_file (GTK_FILE_CHOOSER (pane->folder_button), folder, NULL);
+}
+
+
+
+void
+mousepad_find_in_files_set_text (MousepadFindInFiles *pane,
+                                 const gchar *text)
+{
+  gtk_entry_set_text (GTK_ENTRY (pane->entry), text);
+}
+
+
+
+/**
+ * mousepad_find_in_files_stop:
+ * @pane: a #MousepadFindInFiles.
+ *
+ * Stops the running search, if any. The matches already found stay listed.
+ **/
+void
+mousepad_find_in_files_stop (MousepadFindInFiles *pane)
+{
+  if (pane->job == NULL)
+    return;
+
+  g_cancellable_cancel (pane->job->cancellable);
+  pane->job->pane = NULL;
+  mousepad_find_job_unref (pane->job);
+  pane->job = NULL;
+
+  gtk_spinner_stop (GTK_SPINNER (pane->spinner));
+  gtk_button_set_label (GTK_BUTTON (pane->search_button), _("_Search"));
+}
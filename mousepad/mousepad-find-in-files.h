@@ -0,0 +1,46 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_FIND_IN_FILES_H__
+#define __MOUSEPAD_FIND_IN_FILES_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define MOUSEPAD_TYPE_FIND_IN_FILES (mousepad_find_in_files_get_type ())
+G_DECLARE_FINAL_TYPE (MousepadFindInFiles, mousepad_find_in_files, MOUSEPAD, FIND_IN_FILES, GtkBox)
+
+GtkWidget *
+mousepad_find_in_files_new (void);
+
+void
+mousepad_find_in_files_focus (MousepadFindInFiles *pane);
+
+void
+mousepad_find_in_files_set_folder (MousepadFindInFiles *pane,
+                                   GFile *folder);
+
+void
+mousepad_find_in_files_set_text (MousepadFindInFiles *pane,
+                                 const gchar *text);
+
+void
+mousepad_find_in_files_stop (MousepadFindInFiles *pane);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_FIND_IN_FILES_H__ */
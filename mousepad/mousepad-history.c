@@ -18,6 +18,7 @@
 #include "mousepad-dialogs.h"
 #include "mousepad-document.h"
 #include "mousepad-history.h"
+#include "mousepad-journal.h"
 #include "mousepad-settings.h"
 #include "mousepad-util.h"
 #include "mousepad-window.h"
@@ -801,7 +802,9 @@ mousepad_history_autosave_check_basename (const gchar *basename)
     {
       strid = basename + AUTOSAVE_PREFIX_LEN;
       id = g_ascii_strtoll (strid, &end, 10);
-      if (*(strid) != '\0' && *end == '\0')
+
+      /* the autosave journal of a file has the same id */
+      if (*(strid) != '\0' && (*end == '\0' || g_strcmp0 (end, MOUSEPAD_JOURNAL_SUFFIX) == 0))
         return id;
     }
 
@@ -917,7 +920,8 @@ mousepad_history_autosave_enable (void)
 
   /* get current file list, store taken ids */
   for (basename = g_dir_read_name (dir); basename != NULL; basename = g_dir_read_name (dir))
-    if ((id = mousepad_history_autosave_check_basename (basename)) != (guint) -1)
+    if ((id = mousepad_history_autosave_check_basename (basename)) != (guint) -1
+        && g_list_find (autosave_ids, GUINT_TO_POINTER (id)) == NULL)
       autosave_ids = g_list_prepend (autosave_ids, GUINT_TO_POINTER (id));
 
   /* cleanup */
@@ -0,0 +1,471 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "mousepad-private.h"
+#include "mousepad-journal.h"
+
+
+
+/*
+ * A journal records the edits made to a buffer since its last autosave, which is then
+ * called the base. It starts with a header identifying this base by its digest, followed
+ * by records which are only appended to the file:
+ *
+ *   MOUSEPAD-JOURNAL <version> <base digest> <eol appended> <line ending>\n
+ *   i <char offset> <byte length> <checksum>\n<text>\n
+ *   d <start char offset> <end char offset> <checksum>\n
+ *
+ * The base may end with a line ending which is not in the buffer, when the ADD_LAST_EOL
+ * setting is enabled. Its line endings are those of the buffer, translated according to
+ * the line ending mode of the file, which must be used again to load it: detecting it
+ * from the contents could change the character offsets the records refer to, e.g. for a
+ * file in Unix mode containing CRLF sequences. Version 1 journals don't record it.
+ *
+ * A journal which doesn't match its base is obsolete: this is the case when the
+ * application stops after a new base was written, but before the journal was deleted.
+ * Replaying stops at the first incomplete or corrupted record, that is when the
+ * application stops while appending records, so that the buffer is always restored to a
+ * state it actually had.
+ */
+#define JOURNAL_MAGIC "MOUSEPAD-JOURNAL"
+#define JOURNAL_VERSION 2
+#define JOURNAL_DIGEST_TYPE G_CHECKSUM_MD5
+#define JOURNAL_CHECKSUM_LENGTH 8
+
+struct _MousepadJournal
+{
+  /* serialized records */
+  GString *records;
+
+  /* last insertion, kept apart to be extended or shortened by the next edit */
+  GString *text;
+  gint offset, n_chars;
+};
+
+
+
+MousepadJournal *
+mousepad_journal_new (void)
+{
+  MousepadJournal *journal;
+
+  journal = g_new (MousepadJournal, 1);
+  journal->records = g_string_new (NULL);
+  journal->text = g_string_new (NULL);
+  journal->offset = 0;
+  journal->n_chars = 0;
+
+  return journal;
+}
+
+
+
+void
+mousepad_journal_free (MousepadJournal *journal)
+{
+  g_string_free (journal->records, TRUE);
+  g_string_free (journal->text, TRUE);
+  g_free (journal);
+}
+
+
+
+static gchar *
+mousepad_journal_checksum (const gchar *record,
+                           const gchar *text,
+                           gsize length)
+{
+  GChecksum *checksum;
+  gchar *string;
+
+  checksum = g_checksum_new (JOURNAL_DIGEST_TYPE);
+  g_checksum_update (checksum, (const guchar *) record, -1);
+  if (text != NULL)
+    g_checksum_update (checksum, (const guchar *) text, length);
+
+  string = g_strndup (g_checksum_get_string (checksum), JOURNAL_CHECKSUM_LENGTH);
+  g_checksum_free (checksum);
+
+  return string;
+}
+
+
+
+static void
+mousepad_journal_append_record (MousepadJournal *journal,
+                                gchar op,
+                                gint a,
+                                gint b,
+                                const gchar *text)
+{
+  gchar *record, *checksum;
+
+  record = g_strdup_printf ("%c %d %d", op, a, b);
+  checksum = mousepad_journal_checksum (record, text, b);
+  g_string_append_printf (journal->records, "%s %s\n", record, checksum);
+  if (text != NULL)
+    {
+      g_string_append_len (journal->records, text, b);
+      g_string_append_c (journal->records, '\n');
+    }
+
+  g_free (record);
+  g_free (checksum);
+}
+
+
+
+static void
+mousepad_journal_flush (MousepadJournal *journal)
+{
+  if (journal->n_chars == 0)
+    return;
+
+  mousepad_journal_append_record (journal, 'i', journal->offset, journal->text->len,
+                                  journal->text->str);
+  g_string_truncate (journal->text, 0);
+  journal->n_chars = 0;
+}
+
+
+
+void
+mousepad_journal_insert (MousepadJournal *journal,
+                         gint offset,
+                         const gchar *text,
+                         gint length)
+{
+  if (length < 0)
+    length = strlen (text);
+
+  if (length == 0)
+    return;
+
+  /* typing: extend the last insertion */
+  if (journal->n_chars == 0 || offset != journal->offset + journal->n_chars)
+    {
+      mousepad_journal_flush (journal);
+      journal->offset = offset;
+    }
+
+  g_string_append_len (journal->text, text, length);
+  journal->n_chars += g_utf8_strlen (text, length);
+}
+
+
+
+void
+mousepad_journal_delete (MousepadJournal *journal,
+                         gint start,
+                         gint end)
+{
+  const gchar *p;
+
+  if (start >= end)
+    return;
+
+  /* backspacing: shorten the last insertion */
+  if (journal->n_chars > 0 && start >= journal->offset
+      && end == journal->offset + journal->n_chars)
+    {
+      journal->n_chars -= end - start;
+      p = g_utf8_offset_to_pointer (journal->text->str, journal->n_chars);
+      g_string_truncate (journal->text, p - journal->text->str);
+
+      return;
+    }
+
+  mousepad_journal_flush (journal);
+  mousepad_journal_append_record (journal, 'd', start, end, NULL);
+}
+
+
+
+gboolean
+mousepad_journal_is_empty (MousepadJournal *journal)
+{
+  return journal->n_chars == 0 && journal->records->len == 0;
+}
+
+
+
+GBytes *
+mousepad_journal_steal_records (MousepadJournal *journal)
+{
+  GBytes *bytes;
+
+  mousepad_journal_flush (journal);
+  bytes = g_string_free_to_bytes (journal->records);
+  journal->records = g_string_new (NULL);
+
+  return bytes;
+}
+
+
+
+gchar *
+mousepad_journal_get_digest (const gchar *base,
+                             gsize length)
+{
+  return g_compute_checksum_for_data (JOURNAL_DIGEST_TYPE, (const guchar *) base, length);
+}
+
+
+
+GBytes *
+mousepad_journal_new_header (const gchar *digest,
+                             gboolean eol_appended,
+                             MousepadLineEnding line_ending)
+{
+  gchar *header;
+
+  header = g_strdup_printf (JOURNAL_MAGIC " %d %s %d %d\n", JOURNAL_VERSION, digest,
+                            !!eol_appended, line_ending);
+
+  return g_bytes_new_take (header, strlen (header));
+}
+
+
+
+GFile *
+mousepad_journal_get_location (GFile *autosave_location)
+{
+  GFile *location;
+  gchar *path;
+
+  path = g_strconcat (g_file_peek_path (autosave_location), MOUSEPAD_JOURNAL_SUFFIX, NULL);
+  location = g_file_new_for_path (path);
+  g_free (path);
+
+  return location;
+}
+
+
+
+static gboolean
+mousepad_journal_parse_line (const gchar **p,
+                             const gchar *end,
+                             gchar ***fields)
+{
+  const gchar *eol;
+  gchar *line;
+
+  if ((eol = memchr (*p, '\n', end - *p)) == NULL)
+    return FALSE;
+
+  line = g_strndup (*p, eol - *p);
+  *fields = g_strsplit (line, " ", -1);
+  *p = eol + 1;
+  g_free (line);
+
+  return TRUE;
+}
+
+
+
+/* check that the journal matches its base, and get the way the latter was written */
+static gboolean
+mousepad_journal_parse_header (const gchar **p,
+                               const gchar *end,
+                               const gchar *digest,
+                               gboolean *eol_appended,
+                               gint *line_ending)
+{
+  gchar **fields;
+  guint64 version = 0, eol = 0, mode = 0;
+  gboolean valid;
+
+  if (!mousepad_journal_parse_line (p, end, &fields))
+    return FALSE;
+
+  valid = g_strv_length (fields) >= 4
+          && g_strcmp0 (fields[0], JOURNAL_MAGIC) == 0
+          && g_ascii_string_to_unsigned (fields[1], 10, 1, JOURNAL_VERSION, &version, NULL)
+          && g_strv_length (fields) == (version == 1 ? 4 : 5)
+          && g_strcmp0 (fields[2], digest) == 0
+          && g_ascii_string_to_unsigned (fields[3], 10, 0, 1, &eol, NULL)
+          && (version == 1
+              || g_ascii_string_to_unsigned (fields[4], 10, MOUSEPAD_EOL_UNIX, MOUSEPAD_EOL_DOS,
+                                             &mode, NULL));
+
+  *eol_appended = eol;
+  *line_ending = (valid && version > 1) ? (gint) mode : -1;
+  g_strfreev (fields);
+
+  return valid;
+}
+
+
+
+gboolean
+mousepad_journal_get_line_ending (GFile *location,
+                                  const gchar *digest,
+                                  MousepadLineEnding *line_ending)
+{
+  GFileInputStream *stream;
+  gchar header[256];
+  const gchar *p = header;
+  gsize length;
+  gboolean eol_appended;
+  gint mode = -1;
+
+  g_return_val_if_fail (G_IS_FILE (location), FALSE);
+
+  /* only the header is needed, the records are read when replayed */
+  if ((stream = g_file_read (location, NULL, NULL)) == NULL)
+    return FALSE;
+
+  if (g_input_stream_read_all (G_INPUT_STREAM (stream), header, sizeof (header), &length,
+                               NULL, NULL))
+    mousepad_journal_parse_header (&p, header + length, digest, &eol_appended, &mode);
+
+  g_object_unref (stream);
+
+  if (mode < 0)
+    return FALSE;
+
+  *line_ending = mode;
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_journal_replay_record (GtkTextBuffer *buffer,
+                                gchar **fields,
+                                const gchar **p,
+                                const gchar *end)
+{
+  GtkTextIter start_iter, end_iter;
+  const gchar *text = NULL;
+  gchar *record, *checksum;
+  guint64 a, b, n_chars;
+  gboolean valid;
+
+  /* check the record format */
+  if (g_strv_length (fields) != 4 || fields[0][0] == '\0' || fields[0][1] != '\0'
+      || (fields[0][0] != 'i' && fields[0][0] != 'd')
+      || !g_ascii_string_to_unsigned (fields[1], 10, 0, G_MAXINT, &a, NULL)
+      || !g_ascii_string_to_unsigned (fields[2], 10, 0, G_MAXINT, &b, NULL))
+    return FALSE;
+
+  /* get the inserted text */
+  if (fields[0][0] == 'i')
+    {
+      if ((gsize) (end - *p) < b + 1 || (*p)[b] != '\n')
+        return FALSE;
+
+      text = *p;
+      *p += b + 1;
+    }
+
+  /* check the record integrity */
+  record = g_strdup_printf ("%s %s %s", fields[0], fields[1], fields[2]);
+  checksum = mousepad_journal_checksum (record, text, b);
+  valid = (g_strcmp0 (checksum, fields[3]) == 0);
+  g_free (record);
+  g_free (checksum);
+
+  if (!valid)
+    return FALSE;
+
+  /* apply it, if it applies */
+  n_chars = gtk_text_buffer_get_char_count (buffer);
+  if (text != NULL)
+    {
+      if (a > n_chars || !g_utf8_validate (text, b, NULL))
+        return FALSE;
+
+      gtk_text_buffer_get_iter_at_offset (buffer, &start_iter, a);
+      gtk_text_buffer_insert (buffer, &start_iter, text, b);
+    }
+  else
+    {
+      if (a > b || b > n_chars)
+        return FALSE;
+
+      gtk_text_buffer_get_iter_at_offset (buffer, &start_iter, a);
+      gtk_text_buffer_get_iter_at_offset (buffer, &end_iter, b);
+      gtk_text_buffer_delete (buffer, &start_iter, &end_iter);
+    }
+
+  return TRUE;
+}
+
+
+
+gint
+mousepad_journal_replay (GtkTextBuffer *buffer,
+                         GFile *location,
+                         const gchar *digest,
+                         GError **error)
+{
+  GtkTextIter start_iter, end_iter;
+  GError *err = NULL;
+  gchar **fields = NULL;
+  gchar *contents;
+  const gchar *p, *end;
+  gsize length;
+  gboolean eol_appended;
+  gint line_ending, n_records = 0;
+
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), -1);
+  g_return_val_if_fail (G_IS_FILE (location), -1);
+
+  /* no journal, nothing to do */
+  if (!g_file_load_contents (location, NULL, &contents, &length, NULL, &err))
+    {
+      if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        {
+          g_error_free (err);
+          return 0;
+        }
+
+      g_propagate_error (error, err);
+
+      return -1;
+    }
+
+  /* check that the journal matches its base */
+  p = contents;
+  end = contents + length;
+  if (mousepad_journal_parse_header (&p, end, digest, &eol_appended, &line_ending))
+    {
+      /* remove the line ending added to the base when it was written */
+      gtk_text_buffer_get_end_iter (buffer, &end_iter);
+      start_iter = end_iter;
+      if (eol_appended && gtk_text_iter_backward_char (&start_iter)
+          && gtk_text_iter_get_char (&start_iter) == '\n')
+        gtk_text_buffer_delete (buffer, &start_iter, &end_iter);
+
+      /* replay the records up to the first invalid one */
+      while (mousepad_journal_parse_line (&p, end, &fields)
+             && mousepad_journal_replay_record (buffer, fields, &p, end))
+        {
+          g_strfreev (fields);
+          fields = NULL;
+          n_records++;
+        }
+    }
+
+  /* cleanup */
+  g_strfreev (fields);
+  g_free (contents);
+
+  return n_records;
+}
@@ -0,0 +1,79 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __MOUSEPAD_JOURNAL_H__
+#define __MOUSEPAD_JOURNAL_H__
+
+#include "mousepad-file.h"
+
+G_BEGIN_DECLS
+
+/* suffix of the journal file next to an autosave file */
+#define MOUSEPAD_JOURNAL_SUFFIX ".journal"
+
+/* edits made to a buffer since its last autosave, not written yet */
+typedef struct _MousepadJournal MousepadJournal;
+
+MousepadJournal *
+mousepad_journal_new (void);
+
+void
+mousepad_journal_free (MousepadJournal *journal);
+
+void
+mousepad_journal_insert (MousepadJournal *journal,
+                         gint offset,
+                         const gchar *text,
+                         gint length);
+
+void
+mousepad_journal_delete (MousepadJournal *journal,
+                         gint start,
+                         gint end);
+
+gboolean
+mousepad_journal_is_empty (MousepadJournal *journal);
+
+GBytes *
+mousepad_journal_steal_records (MousepadJournal *journal);
+
+gchar *
+mousepad_journal_get_digest (const gchar *base,
+                             gsize length);
+
+GBytes *
+mousepad_journal_new_header (const gchar *digest,
+                             gboolean eol_appended,
+                             MousepadLineEnding line_ending);
+
+GFile *
+mousepad_journal_get_location (GFile *autosave_location);
+
+gboolean
+mousepad_journal_get_line_ending (GFile *location,
+                                  const gchar *digest,
+                                  MousepadLineEnding *line_ending);
+
+gint
+mousepad_journal_replay (GtkTextBuffer *buffer,
+                         GFile *location,
+                         const gchar *digest,
+                         GError **error);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_JOURNAL_H__ */
@@ -610,8 +610,10 @@ mousepad_replace_dialog_search_completed (MousepadReplaceDialog *dialog,
       /* update entry color */
       mousepad_util_entry_error (dialog->search_entry, n_matches == 0);
 
-      /* update counter */
-      if (cur_match != 0)
+      /* update counter, unless the search was given up */
+      if (flags & MOUSEPAD_SEARCH_FLAGS_TOO_EXPENSIVE)
+        message = g_strdup (_("Pattern too expensive"));
+      else if (cur_match != 0)
         message = g_strdup_printf (ngettext ("%d of %d match", "%d of %d matches", n_matches),
                                    cur_match, n_matches);
       else
@@ -627,6 +629,9 @@ mousepad_replace_dialog_search_completed (MousepadReplaceDialog *dialog,
 static void
 mousepad_replace_dialog_entry_changed (MousepadReplaceDialog *dialog)
 {
+  /* check the pattern before searching it, also when the search options change */
+  mousepad_util_entry_check_pattern (dialog->search_entry);
+
   gtk_dialog_response (GTK_DIALOG (dialog), MOUSEPAD_RESPONSE_ENTRY_CHANGED);
 }
 
@@ -0,0 +1,288 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "mousepad-private.h"
+#include "mousepad-scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define MOUSEPAD_SCAN_SIMD 1
+#include <immintrin.h>
+#endif
+
+
+
+/*
+ * The contents are scanned once, in blocks of 16 or 32 bytes when SIMD instructions are
+ * available: for each block, we build bit masks of CRs, LFs, and bytes which are either
+ * non-ASCII or nul. Line endings are counted from the first two masks, and UTF-8 validation
+ * only falls back to a byte-wise decoding for blocks where the third mask is not empty,
+ * which is rare in practice.
+ */
+typedef struct _MousepadScanState
+{
+  MousepadScanResult *result;
+  const guchar *start, *end;
+
+  /* validation */
+  const guchar *valid_end;
+  gboolean valid;
+
+  /* line endings: total number of CRs and LFs, whether the last scanned byte is a CR */
+  gsize n_cr, n_lf;
+  gboolean prev_cr;
+
+  /* start of the current line */
+  const guchar *line_start;
+} MousepadScanState;
+
+
+
+/* returns the length of the valid UTF-8 character at 'p', or 0 if it is invalid
+ * (nul characters are invalid too, as for g_utf8_validate() with a given length) */
+static inline gsize
+mousepad_scan_utf8_char (const guchar *p,
+                         const guchar *end)
+{
+  gsize n, len;
+
+  if (p[0] < 0x80)
+    return p[0] != 0;
+  else if (p[0] < 0xC2)
+    return 0;
+  else if (p[0] < 0xE0)
+    len = 2;
+  else if (p[0] < 0xF0)
+    len = 3;
+  else if (p[0] < 0xF5)
+    len = 4;
+  else
+    return 0;
+
+  if ((gsize) (end - p) < len)
+    return 0;
+
+  for (n = 1; n < len; n++)
+    if ((p[n] & 0xC0) != 0x80)
+      return 0;
+
+  /* overlong forms, surrogates and code points beyond U+10FFFF */
+  if ((p[0] == 0xE0 && p[1] < 0xA0) || (p[0] == 0xED && p[1] >= 0xA0)
+      || (p[0] == 0xF0 && p[1] < 0x90) || (p[0] == 0xF4 && p[1] >= 0x90))
+    return 0;
+
+  return len;
+}
+
+
+
+static void
+mousepad_scan_validate (MousepadScanState *state,
+                        const guchar *limit)
+{
+  gsize len;
+
+  while (state->valid_end < limit)
+    {
+      len = mousepad_scan_utf8_char (state->valid_end, state->end);
+      if (len == 0)
+        {
+          state->valid = FALSE;
+          state->result->valid_length = state->valid_end - state->start;
+
+          return;
+        }
+
+      state->valid_end += len;
+    }
+}
+
+
+
+static inline void
+mousepad_scan_first_eol (MousepadScanState *state,
+                         const guchar *p)
+{
+  state->result->has_eol = TRUE;
+  if (*p == '\n')
+    state->result->first_eol = MOUSEPAD_EOL_UNIX;
+  else if (p + 1 < state->end && *(p + 1) == '\n')
+    state->result->first_eol = MOUSEPAD_EOL_DOS;
+  else
+    state->result->first_eol = MOUSEPAD_EOL_MAC;
+}
+
+
+
+static inline void
+mousepad_scan_line_end (MousepadScanState *state,
+                        const guchar *p)
+{
+  if ((gsize) (p - state->line_start) > state->result->max_line_length)
+    state->result->max_line_length = p - state->line_start;
+
+  state->line_start = p + 1;
+}
+
+
+
+#ifdef MOUSEPAD_SCAN_SIMD
+
+static inline void
+mousepad_scan_block (MousepadScanState *state,
+                     const guchar *p,
+                     guint width,
+                     guint64 cr,
+                     guint64 lf,
+                     guint64 special)
+{
+  guint64 eols;
+
+  if (!state->result->has_eol && (cr | lf) != 0)
+    mousepad_scan_first_eol (state, p + __builtin_ctzll (cr | lf));
+
+  for (eols = cr | lf; eols != 0; eols &= eols - 1)
+    mousepad_scan_line_end (state, p + __builtin_ctzll (eols));
+
+  state->n_cr += __builtin_popcountll (cr);
+  state->n_lf += __builtin_popcountll (lf);
+  state->result->n_crlf += __builtin_popcountll (cr & (lf >> 1)) + (state->prev_cr && (lf & 1));
+  state->prev_cr = (cr >> (width - 1)) & 1;
+
+  /* pure ASCII block, possibly after the end of a multibyte character started in the
+   * previous block (which is then necessarily followed by a non-ASCII byte in this one) */
+  if (state->valid)
+    {
+      if (special == 0)
+        state->valid_end = MAX (state->valid_end, p + width);
+      else
+        mousepad_scan_validate (state, p + width);
+    }
+}
+
+
+
+static const guchar *
+mousepad_scan_sse2 (MousepadScanState *state,
+                    const guchar *p)
+{
+  __m128i block, cr = _mm_set1_epi8 ('\r'), lf = _mm_set1_epi8 ('\n'), zero = _mm_setzero_si128 ();
+
+  for (; state->end - p >= 16; p += 16)
+    {
+      block = _mm_loadu_si128 ((const __m128i *) p);
+      mousepad_scan_block (state, p, 16,
+                           (guint16) _mm_movemask_epi8 (_mm_cmpeq_epi8 (block, cr)),
+                           (guint16) _mm_movemask_epi8 (_mm_cmpeq_epi8 (block, lf)),
+                           (guint16) (_mm_movemask_epi8 (block)
+                                      | _mm_movemask_epi8 (_mm_cmpeq_epi8 (block, zero))));
+    }
+
+  return p;
+}
+
+
+
+__attribute__ ((target ("avx2"))) static const guchar *
+mousepad_scan_avx2 (MousepadScanState *state,
+                    const guchar *p)
+{
+  __m256i block, cr = _mm256_set1_epi8 ('\r'), lf = _mm256_set1_epi8 ('\n'),
+                  zero = _mm256_setzero_si256 ();
+
+  for (; state->end - p >= 32; p += 32)
+    {
+      block = _mm256_loadu_si256 ((const __m256i *) p);
+      mousepad_scan_block (state, p, 32,
+                           (guint32) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (block, cr)),
+                           (guint32) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (block, lf)),
+                           (guint32) (_mm256_movemask_epi8 (block)
+                                      | _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (block, zero))));
+    }
+
+  return p;
+}
+
+#endif /* MOUSEPAD_SCAN_SIMD */
+
+
+
+void
+mousepad_scan_contents (const gchar *contents,
+                        gsize length,
+                        MousepadScanResult *result)
+{
+  MousepadScanState state = { 0 };
+  const guchar *p;
+
+  g_return_if_fail (contents != NULL || length == 0);
+  g_return_if_fail (result != NULL);
+
+  memset (result, 0, sizeof (MousepadScanResult));
+  state.result = result;
+  state.start = state.valid_end = state.line_start = p = (const guchar *) contents;
+  state.end = state.start + length;
+  state.valid = TRUE;
+
+#ifdef MOUSEPAD_SCAN_SIMD
+  if (__builtin_cpu_supports ("avx2"))
+    p = mousepad_scan_avx2 (&state, p);
+
+  p = mousepad_scan_sse2 (&state, p);
+#endif
+
+  /* scalar scan of the remaining bytes */
+  for (; p < state.end; p++)
+    {
+      if (*p == '\r')
+        {
+          if (!result->has_eol)
+            mousepad_scan_first_eol (&state, p);
+
+          mousepad_scan_line_end (&state, p);
+          state.n_cr++;
+          state.prev_cr = TRUE;
+        }
+      else
+        {
+          if (*p == '\n')
+            {
+              if (!result->has_eol)
+                mousepad_scan_first_eol (&state, p);
+
+              mousepad_scan_line_end (&state, p);
+              state.n_lf++;
+              result->n_crlf += state.prev_cr;
+            }
+
+          state.prev_cr = FALSE;
+        }
+    }
+
+  /* the last line has no line ending */
+  mousepad_scan_line_end (&state, state.end);
+
+  if (state.valid)
+    mousepad_scan_validate (&state, state.end);
+
+  if (state.valid)
+    result->valid_length = length;
+
+  /* lone line endings, and number of lines */
+  result->n_cr = state.n_cr - result->n_crlf;
+  result->n_lf = state.n_lf - result->n_crlf;
+  result->n_lines = result->n_cr + result->n_lf + result->n_crlf + 1;
+}
@@ -0,0 +1,52 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __MOUSEPAD_SCAN_H__
+#define __MOUSEPAD_SCAN_H__
+
+#include "mousepad-file.h"
+
+G_BEGIN_DECLS
+
+/* result of a pre-scan of file contents */
+typedef struct _MousepadScanResult
+{
+  /* length of the longest valid UTF-8 prefix, as g_utf8_validate() would find it */
+  gsize valid_length;
+
+  /* kind of the first line ending, if any */
+  gboolean has_eol;
+  MousepadLineEnding first_eol;
+
+  /* number of lone CRs, lone LFs and CRLF pairs */
+  gsize n_cr, n_lf, n_crlf;
+
+  /* number of lines, as a GtkTextBuffer would count them once the line endings normalized */
+  gsize n_lines;
+
+  /* length in bytes of the longest line, line ending excluded */
+  gsize max_line_length;
+} MousepadScanResult;
+
+void
+mousepad_scan_contents (const gchar *contents,
+                        gsize length,
+                        MousepadScanResult *result);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_SCAN_H__ */
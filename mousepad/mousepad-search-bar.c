@@ -465,8 +465,10 @@ mousepad_search_bar_search_completed (MousepadSearchBar *bar,
       /* update entry color */
       mousepad_util_entry_error (bar->entry, n_matches == 0);
 
-      /* update counter */
-      if (cur_match != 0)
+      /* update counter, unless the search was given up */
+      if (flags & MOUSEPAD_SEARCH_FLAGS_TOO_EXPENSIVE)
+        message = g_strdup (_("Pattern too expensive"));
+      else if (cur_match != 0)
         message = g_strdup_printf (ngettext ("%d of %d match", "%d of %d matches", n_matches),
                                    cur_match, n_matches);
       else
@@ -511,6 +513,9 @@ mousepad_search_bar_entry_changed (MousepadSearchBar *bar)
 {
   MousepadSearchFlags flags;
 
+  /* check the pattern before searching it, also when the search options change */
+  mousepad_util_entry_check_pattern (bar->entry);
+
   /* set the search flags */
   flags = MOUSEPAD_SEARCH_FLAGS_ITER_SEL_START
           | MOUSEPAD_SEARCH_FLAGS_DIR_FORWARD;
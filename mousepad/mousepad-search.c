@@ -0,0 +1,2647 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "mousepad-private.h"
+#include "mousepad-search.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define MOUSEPAD_SEARCH_SIMD 1
+#include <immintrin.h>
+#endif
+
+
+
+/* below twice this size, the text is searched in a single chunk */
+#define CHUNK_SIZE_MIN (1024 * 1024)
+
+/* cancellation is checked at least once per window */
+#define WINDOW_SIZE (4 * 1024 * 1024)
+
+/* number of lines after a chunk or an edit where a regex match is allowed to end */
+#define REGEX_CONTEXT_LINES 16
+
+/* regexes are matched in windows of this size, the time budget being checked in between,
+ * and a match may not extend beyond this number of bytes after its window on long lines */
+#define REGEX_WINDOW_SIZE (64 * 1024)
+#define REGEX_CONTEXT_SIZE (1024 * 1024)
+
+/* beyond this time, an index update is given up in favour of a new search on a worker
+ * thread, see also MOUSEPAD_SEARCH_REGEX_TIME_BUDGET: it runs in the main thread at each
+ * keystroke, so this must stay well below a frame for typing not to lag */
+#define REGEX_UPDATE_TIME_BUDGET (8 * G_TIME_SPAN_MILLISECOND)
+
+/* target number of characters per index block */
+#define INDEX_BLOCK_SIZE (64 * 1024)
+
+/* beyond this number of characters to rescan after an edit, the index must be rebuilt */
+#define INDEX_RESCAN_MAX (1024 * 1024)
+
+/* number of compiled regexes kept for later searches */
+#define REGEX_CACHE_SIZE 16
+
+
+
+/*
+ * The text is split into one chunk per processor, whose bounds are aligned on characters, and
+ * each chunk is searched on its own thread for matches starting inside it: a match may end in
+ * the next chunk, hence an overlap of the pattern length minus one byte. Character offsets are
+ * counted along the way, relatively to the chunk start.
+ *
+ * Merging chunk results is then a matter of adding the number of characters in the previous
+ * chunks, except that the first matches of a chunk may overlap the last match of the previous
+ * one, e.g. when searching "aa" in "aaaa". In that case, the scan is resumed sequentially after
+ * the previous match, until it meets a match found by the chunk thread, so that the result is
+ * always the same as for a sequential search.
+ *
+ * Regex chunks are aligned on lines, so that anchors behave as in a sequential search, and a
+ * match may extend over REGEX_CONTEXT_LINES lines after the end of its chunk. They are matched
+ * in windows of REGEX_WINDOW_SIZE bytes with the same context, limited to REGEX_CONTEXT_SIZE
+ * bytes so that long lines are not scanned again for each window, and a regex which backtracks
+ * too much is given up between windows, or as soon as PCRE reaches its backtracking limit.
+ */
+struct _MousepadSearchPattern
+{
+  /* the pattern, in lower case for case insensitive literal searches */
+  gchar *string;
+  gsize length;
+  gint n_chars;
+  MousepadSearchOptions options;
+
+  /* bits to set in text bytes before comparing them to the first and last pattern bytes,
+   * i.e. 0x20 for letters in case insensitive searches */
+  gchar first_fold, last_fold;
+
+  /* regex searches only */
+  GRegex *regex;
+
+  /* number of lines after a match start where it may end */
+  guint context_lines;
+};
+
+typedef struct _MousepadSearchHit
+{
+  /* byte range in the text, character offset relatively to the chunk start and length */
+  gsize start, end;
+  gint char_start, char_length;
+} MousepadSearchHit;
+
+typedef struct _MousepadSearch MousepadSearch;
+
+typedef struct _MousepadSearchChunk
+{
+  MousepadSearch *search;
+
+  /* byte range where matches may start */
+  gsize start, end;
+
+  /* matches found, and number of characters in the chunk, counted up to 'counted' */
+  GArray *hits;
+  gint n_chars;
+  const gchar *counted;
+} MousepadSearchChunk;
+
+/*
+ * The index keeps the matches in blocks of about INDEX_BLOCK_SIZE characters, with offsets
+ * relative to the block start, so that an edit only changes the blocks around it: the lines
+ * around the edit are rescanned, with the same context as above for multi-line matches, and
+ * these blocks are split again.
+ */
+typedef struct _MousepadSearchBlock
+{
+  gint n_chars;
+  GArray *matches;
+} MousepadSearchBlock;
+
+struct _MousepadSearchIndex
+{
+  MousepadSearchPattern *pattern;
+  GArray *blocks;
+  gint n_chars;
+  guint n_matches;
+
+  /* the last block looked up, its start offset and the number of matches before it */
+  guint cursor;
+  gint cursor_start;
+  guint cursor_n_before;
+
+  /* the searched text, its range and the byte offsets of the matches in it, kept until the
+   * first update of the index, to refine it with mousepad_search_refine_async() */
+  GBytes *bytes;
+  gsize start, end;
+  GArray *byte_starts;
+};
+
+struct _MousepadSearch
+{
+  /* the searched text, and the byte range where matches are searched, which is handled as
+   * if it were the whole text */
+  GBytes *bytes;
+  const gchar *text;
+  gsize length, start, end;
+
+  MousepadSearchPattern *pattern;
+  GCancellable *cancellable;
+
+  MousepadSearchChunk *chunks;
+  guint n_chunks;
+
+  /* regex searches are given up past this monotonic time, if not zero, or when the regex
+   * reaches the backtracking limit, which sets 'too_expensive' */
+  gint64 deadline;
+  gint too_expensive;
+
+  /* replacement text, for replace operations only */
+  gchar *replacement;
+};
+
+/* a compiled regex kept for later searches, and its key in the cache */
+typedef struct _MousepadSearchCachedRegex
+{
+  gchar *key;
+  GRegex *regex;
+} MousepadSearchCachedRegex;
+
+/* state of a replace operation */
+typedef struct _MousepadSearchReplace
+{
+  MousepadSearchEdits *edits;
+
+  /* the end of the last match, and the character offset of 'counted' */
+  const gchar *copied, *counted;
+  gint n_chars;
+
+  /* for regex searches, the replacement and its last expansion */
+  const gchar *replacement;
+  gboolean has_references;
+  gchar *expanded;
+} MousepadSearchReplace;
+
+/* state of a refine operation: the previous index and the new pattern */
+typedef struct _MousepadSearchRefine
+{
+  MousepadSearchIndex *index;
+  MousepadSearchPattern *pattern;
+} MousepadSearchRefine;
+
+/* called for each non-empty match of mousepad_search_regex_foreach() */
+typedef void (*MousepadSearchRegexFunc) (GMatchInfo *info,
+                                         const gchar *match,
+                                         const gchar *match_end,
+                                         gpointer data);
+
+/* a regex item, for the analysis of mousepad_search_is_pathological() */
+typedef struct _MousepadSearchAtom
+{
+  const gchar *text;
+  gsize length;
+} MousepadSearchAtom;
+
+/* a regex group being analysed: whether it is atomic, i.e. never backtracked into, whether it
+ * has a repeated part and the first atom of each of its alternatives */
+typedef struct _MousepadSearchGroup
+{
+  gboolean atomic, repeats;
+  GArray *firsts;
+  gboolean first_pending;
+} MousepadSearchGroup;
+
+
+
+/* compiled regexes by compile flags and pattern, shared by all threads: the queue holds the
+ * cached regexes, most recently used first, and the table their links in the queue */
+static GMutex regex_cache_lock;
+static GHashTable *regex_cache = NULL;
+static GQueue regex_cache_queue = G_QUEUE_INIT;
+static guint regex_cache_hits = 0;
+static guint regex_cache_misses = 0;
+
+
+
+static void
+mousepad_search_cached_regex_free (MousepadSearchCachedRegex *cached)
+{
+  g_regex_unref (cached->regex);
+  g_free (cached->key);
+  g_free (cached);
+}
+
+
+
+/* same as g_regex_new(), but the compiled regexes are shared, so that the pattern is compiled
+ * once for every keystroke, whatever the number of documents searched */
+static GRegex *
+mousepad_search_regex_new (const gchar *string,
+                           GRegexCompileFlags flags,
+                           GError **error)
+{
+  MousepadSearchCachedRegex *cached;
+  GRegex *regex = NULL;
+  GList *link;
+  gchar *key;
+
+  key = g_strdup_printf ("%x\n%s", (guint) flags, string);
+
+  /* move a cached regex to the queue head */
+  g_mutex_lock (&regex_cache_lock);
+  if (regex_cache == NULL)
+    regex_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+  if ((link = g_hash_table_lookup (regex_cache, key)) != NULL)
+    {
+      g_queue_unlink (&regex_cache_queue, link);
+      g_queue_push_head_link (&regex_cache_queue, link);
+      regex = g_regex_ref (((MousepadSearchCachedRegex *) link->data)->regex);
+      regex_cache_hits++;
+    }
+  else
+    regex_cache_misses++;
+
+  g_mutex_unlock (&regex_cache_lock);
+
+  if (regex != NULL)
+    {
+      g_free (key);
+      return regex;
+    }
+
+  /* compile the regex out of the lock, G_REGEX_OPTIMIZE enabling JIT compilation */
+  regex = g_regex_new (string, flags | G_REGEX_OPTIMIZE, 0, error);
+  if (regex == NULL)
+    {
+      g_free (key);
+      return NULL;
+    }
+
+  /* cache it, unless another thread did meanwhile, and drop the least recently used one */
+  g_mutex_lock (&regex_cache_lock);
+  if (regex_cache != NULL && !g_hash_table_contains (regex_cache, key))
+    {
+      cached = g_new (MousepadSearchCachedRegex, 1);
+      cached->key = key;
+      cached->regex = g_regex_ref (regex);
+      g_queue_push_head (&regex_cache_queue, cached);
+      g_hash_table_insert (regex_cache, key, regex_cache_queue.head);
+      key = NULL;
+
+      if (regex_cache_queue.length > REGEX_CACHE_SIZE)
+        {
+          cached = g_queue_pop_tail (&regex_cache_queue);
+          g_hash_table_remove (regex_cache, cached->key);
+          mousepad_search_cached_regex_free (cached);
+        }
+    }
+
+  g_mutex_unlock (&regex_cache_lock);
+  g_free (key);
+
+  return regex;
+}
+
+
+
+/**
+ * mousepad_search_pattern_new:
+ * @string: the text or regex to search for, see mousepad_search_supports().
+ * @options: the search options.
+ * @error: return location for a #GError, or %NULL.
+ *
+ * Compiles @string for searches with @options, e.g. to search many texts with
+ * mousepad_search_pattern_find(), possibly from several threads.
+ *
+ * Return value: the new pattern, to be freed with mousepad_search_pattern_free(), or %NULL
+ *               if the regex is invalid.
+ **/
+MousepadSearchPattern *
+mousepad_search_pattern_new (const gchar *string,
+                             MousepadSearchOptions options,
+                             GError **error)
+{
+  MousepadSearchPattern *pattern;
+  GRegexCompileFlags flags = G_REGEX_MULTILINE;
+  const gchar *p;
+  gchar *word_string, *escaped;
+
+  /* case folding beyond ASCII is left to GRegex, with word boundaries checked as in
+   * mousepad_search_at_word_boundaries() rather than with '\b' */
+  if (!(options & (MOUSEPAD_SEARCH_CASE_SENSITIVE | MOUSEPAD_SEARCH_REGEX)))
+    for (p = string; *p != '\0'; p++)
+      if ((guchar) *p >= 0x80)
+        {
+          escaped = g_regex_escape_string (string, -1);
+          if (options & MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES)
+            {
+              word_string = g_strdup_printf ("(?<![\\pL\\pN_])(?=[\\pL\\pN_])%s"
+                                             "(?<=[\\pL\\pN_])(?![\\pL\\pN_])", escaped);
+              g_free (escaped);
+              escaped = word_string;
+            }
+
+          pattern = mousepad_search_pattern_new (escaped, (options & ~MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES)
+                                                          | MOUSEPAD_SEARCH_REGEX, error);
+          g_free (escaped);
+
+          return pattern;
+        }
+
+  pattern = g_new0 (MousepadSearchPattern, 1);
+  pattern->options = options;
+
+  /* same compile flags as GtkSourceView */
+  if (options & MOUSEPAD_SEARCH_REGEX)
+    {
+      if (!(options & MOUSEPAD_SEARCH_CASE_SENSITIVE))
+        flags |= G_REGEX_CASELESS;
+
+      if (options & MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES)
+        {
+          word_string = g_strdup_printf ("\\b(?:%s)\\b", string);
+          pattern->regex = mousepad_search_regex_new (word_string, flags, error);
+          g_free (word_string);
+        }
+      else
+        pattern->regex = mousepad_search_regex_new (string, flags, error);
+
+      if (pattern->regex == NULL)
+        {
+          g_free (pattern);
+          return NULL;
+        }
+
+      pattern->string = g_strdup (string);
+      pattern->context_lines = REGEX_CONTEXT_LINES;
+    }
+  else
+    {
+      pattern->string = (options & MOUSEPAD_SEARCH_CASE_SENSITIVE) ? g_strdup (string)
+                                                                   : g_ascii_strdown (string, -1);
+      pattern->length = strlen (pattern->string);
+      pattern->n_chars = g_utf8_strlen (pattern->string, -1);
+      if (!(options & MOUSEPAD_SEARCH_CASE_SENSITIVE))
+        {
+          pattern->first_fold = g_ascii_isalpha (pattern->string[0]) ? 0x20 : 0;
+          pattern->last_fold = g_ascii_isalpha (pattern->string[pattern->length - 1]) ? 0x20 : 0;
+        }
+
+      for (p = pattern->string; (p = strchr (p, '\n')) != NULL; p++)
+        pattern->context_lines++;
+    }
+
+  return pattern;
+}
+
+
+
+void
+mousepad_search_pattern_free (MousepadSearchPattern *pattern)
+{
+  if (pattern->regex != NULL)
+    g_regex_unref (pattern->regex);
+
+  g_free (pattern->string);
+  g_free (pattern);
+}
+
+
+
+static void
+mousepad_search_free (gpointer data)
+{
+  MousepadSearch *search = data;
+  guint n;
+
+  for (n = 0; n < search->n_chunks; n++)
+    if (search->chunks[n].hits != NULL)
+      g_array_unref (search->chunks[n].hits);
+
+  if (search->cancellable != NULL)
+    g_object_unref (search->cancellable);
+
+  if (search->pattern != NULL)
+    mousepad_search_pattern_free (search->pattern);
+
+  g_free (search->replacement);
+  g_free (search->chunks);
+  g_bytes_unref (search->bytes);
+  g_free (search);
+}
+
+
+
+/*
+ * Candidate positions are those where both the first and the last bytes of the pattern match,
+ * which are tested for 16 or 32 positions at once when SIMD instructions are available, and
+ * only candidates are fully compared to the pattern. Case folding, for ASCII letters only,
+ * is a matter of setting the 0x20 bit of text bytes when the pattern byte is a letter, the
+ * pattern being in lower case.
+ */
+static inline gboolean
+mousepad_search_verify (MousepadSearch *search,
+                        const gchar *p)
+{
+  if (search->pattern->options & MOUSEPAD_SEARCH_CASE_SENSITIVE)
+    return memcmp (p + 1, search->pattern->string + 1, search->pattern->length - 1) == 0;
+  else
+    return g_ascii_strncasecmp (p + 1, search->pattern->string + 1, search->pattern->length - 1) == 0;
+}
+
+
+
+#ifdef MOUSEPAD_SEARCH_SIMD
+
+/* scans [*p, end) as long as full blocks can be loaded, and returns the first match if any,
+ * otherwise updates 'p' to the first position to scan */
+static const gchar *
+mousepad_search_find_sse2 (MousepadSearch *search,
+                           const gchar **p,
+                           const gchar *end)
+{
+  __m128i first = _mm_set1_epi8 (search->pattern->string[0]),
+          last = _mm_set1_epi8 (search->pattern->string[search->pattern->length - 1]),
+          first_fold = _mm_set1_epi8 (search->pattern->first_fold), last_fold = _mm_set1_epi8 (search->pattern->last_fold);
+  const gchar *q;
+  guint mask;
+
+  for (q = *p; (gsize) (end - q) >= search->pattern->length + 15; q += 16)
+    {
+      mask = _mm_movemask_epi8 (_mm_and_si128 (
+        _mm_cmpeq_epi8 (_mm_or_si128 (_mm_loadu_si128 ((const __m128i *) q), first_fold), first),
+        _mm_cmpeq_epi8 (_mm_or_si128 (_mm_loadu_si128 ((const __m128i *) (q + search->pattern->length - 1)),
+                                      last_fold),
+                        last)));
+
+      for (; mask != 0; mask &= mask - 1)
+        if (mousepad_search_verify (search, q + __builtin_ctz (mask)))
+          return q + __builtin_ctz (mask);
+    }
+
+  *p = q;
+
+  return NULL;
+}
+
+
+
+__attribute__ ((target ("avx2"))) static const gchar *
+mousepad_search_find_avx2 (MousepadSearch *search,
+                           const gchar **p,
+                           const gchar *end)
+{
+  __m256i first = _mm256_set1_epi8 (search->pattern->string[0]),
+          last = _mm256_set1_epi8 (search->pattern->string[search->pattern->length - 1]),
+          first_fold = _mm256_set1_epi8 (search->pattern->first_fold),
+          last_fold = _mm256_set1_epi8 (search->pattern->last_fold);
+  const gchar *q;
+  guint mask;
+
+  for (q = *p; (gsize) (end - q) >= search->pattern->length + 31; q += 32)
+    {
+      mask = _mm256_movemask_epi8 (_mm256_and_si256 (
+        _mm256_cmpeq_epi8 (_mm256_or_si256 (_mm256_loadu_si256 ((const __m256i *) q), first_fold), first),
+        _mm256_cmpeq_epi8 (_mm256_or_si256 (_mm256_loadu_si256 ((const __m256i *) (q + search->pattern->length - 1)),
+                                            last_fold),
+                           last)));
+
+      for (; mask != 0; mask &= mask - 1)
+        if (mousepad_search_verify (search, q + __builtin_ctz (mask)))
+          return q + __builtin_ctz (mask);
+    }
+
+  *p = q;
+
+  return NULL;
+}
+
+#endif /* MOUSEPAD_SEARCH_SIMD */
+
+
+
+/* returns the first occurrence of the pattern in [p, end), not checking word boundaries */
+static const gchar *
+mousepad_search_find (MousepadSearch *search,
+                      const gchar *p,
+                      const gchar *end)
+{
+  const gchar *last, *match;
+  gchar first;
+
+  if (p >= end || (gsize) (end - p) < search->pattern->length)
+    return NULL;
+
+#ifdef MOUSEPAD_SEARCH_SIMD
+  if (__builtin_cpu_supports ("avx2") && (match = mousepad_search_find_avx2 (search, &p, end)) != NULL)
+    return match;
+
+  if ((match = mousepad_search_find_sse2 (search, &p, end)) != NULL)
+    return match;
+#endif
+
+  /* scalar search of the remaining positions */
+  last = end - search->pattern->length;
+  first = search->pattern->string[0];
+  if (search->pattern->options & MOUSEPAD_SEARCH_CASE_SENSITIVE)
+    {
+      while (p <= last && (match = memchr (p, first, last - p + 1)) != NULL)
+        {
+          if (mousepad_search_verify (search, match))
+            return match;
+
+          p = match + 1;
+        }
+    }
+  else
+    {
+      for (; p <= last; p++)
+        if ((*p | search->pattern->first_fold) == first && mousepad_search_verify (search, p))
+          return p;
+    }
+
+  return NULL;
+}
+
+
+
+/* same as _gtk_source_iter_starts/ends_extra_natural_word(), more or less */
+static inline gboolean
+mousepad_search_is_word_char (gunichar c)
+{
+  return c == '_' || g_unichar_isalnum (c);
+}
+
+
+
+static gboolean
+mousepad_search_at_word_boundaries (MousepadSearch *search,
+                                    const gchar *start,
+                                    const gchar *end)
+{
+  const gchar *text_start = search->text + search->start, *text_end = search->text + search->end;
+
+  /* the match must start a word */
+  if (!mousepad_search_is_word_char (g_utf8_get_char (start))
+      || (start > text_start
+          && mousepad_search_is_word_char (g_utf8_get_char (g_utf8_prev_char (start)))))
+    return FALSE;
+
+  /* and end one */
+  if (!mousepad_search_is_word_char (g_utf8_get_char (g_utf8_prev_char (end)))
+      || (end < text_end && mousepad_search_is_word_char (g_utf8_get_char (end))))
+    return FALSE;
+
+  return TRUE;
+}
+
+
+
+static inline gint
+mousepad_search_count_chars (const gchar *p,
+                             const gchar *end)
+{
+  gint n_chars = 0;
+
+#ifdef MOUSEPAD_SEARCH_SIMD
+  /* count bytes which are not continuation bytes, i.e. greater than 0xBF as signed bytes */
+  __m128i continuation = _mm_set1_epi8 ((gchar) 0xBF);
+
+  for (; end - p >= 16; p += 16)
+    n_chars += __builtin_popcount (
+      _mm_movemask_epi8 (_mm_cmpgt_epi8 (_mm_loadu_si128 ((const __m128i *) p), continuation)));
+#endif
+
+  for (; p < end; p++)
+    n_chars += ((guchar) *p & 0xC0) != 0x80;
+
+  return n_chars;
+}
+
+
+
+/* returns the end of the line 'context_lines' lines after the one containing 'offset',
+ * or the range end */
+static gsize
+mousepad_search_context_end (MousepadSearch *search,
+                             gsize offset)
+{
+  const gchar *p = search->text + offset, *end = search->text + search->end;
+  guint n;
+
+  for (n = 0; (p = memchr (p, '\n', end - p)) != NULL; n++, p++)
+    if (n == search->pattern->context_lines)
+      return p - search->text;
+
+  return search->end;
+}
+
+
+
+/* returns the start of the line containing 'p' */
+static const gchar *
+mousepad_search_line_start (MousepadSearch *search,
+                            const gchar *p)
+{
+  const gchar *start = search->text + search->start;
+
+  while (p > start && p[-1] != '\n')
+    p--;
+
+  return p;
+}
+
+
+
+/* whether to give up the search, because it was cancelled or is too expensive */
+static gboolean
+mousepad_search_interrupted (MousepadSearch *search)
+{
+  if (g_cancellable_is_cancelled (search->cancellable) || g_atomic_int_get (&search->too_expensive))
+    return TRUE;
+
+  if (search->deadline != 0 && g_get_monotonic_time () > search->deadline)
+    {
+      g_atomic_int_set (&search->too_expensive, TRUE);
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+
+
+/* matches the regex from 'p' up to 'end', on whole lines from 'line' so that anchors and
+ * lookbehinds behave as in a sequential search: match positions are relative to 'line' */
+static void
+mousepad_search_regex_match (MousepadSearch *search,
+                             const gchar *line,
+                             const gchar *p,
+                             gsize end,
+                             GMatchInfo **info,
+                             GError **error)
+{
+  GRegexMatchFlags flags = 0;
+
+  /* 'end' may also be in the middle of a line */
+  if (end < search->end && search->text[end] != '\n')
+    flags |= G_REGEX_MATCH_NOTEOL;
+
+  g_regex_match_full (search->pattern->regex, line, search->text + end - line, p - line,
+                      flags, info, error);
+}
+
+
+
+/* a matching error means that the backtracking limit was reached */
+static void
+mousepad_search_regex_error (MousepadSearch *search,
+                             GError *error)
+{
+  g_atomic_int_set (&search->too_expensive, TRUE);
+  g_error_free (error);
+}
+
+
+
+static const gchar *
+mousepad_search_regex_next (MousepadSearch *search,
+                            const gchar *p,
+                            const gchar *limit,
+                            const gchar **match_end)
+{
+  GMatchInfo *info;
+  GError *error = NULL;
+  const gchar *line, *match = NULL;
+  gsize end;
+  gint start_pos, end_pos;
+
+  /* the match may not extend too far on long lines, as in mousepad_search_regex_foreach() */
+  end = mousepad_search_context_end (search, limit - search->text);
+  if (end > (gsize) (limit - search->text) + REGEX_CONTEXT_SIZE)
+    {
+      end = limit - search->text + REGEX_CONTEXT_SIZE;
+      while (((guchar) search->text[end] & 0xC0) == 0x80)
+        end++;
+    }
+
+  line = mousepad_search_line_start (search, p);
+  mousepad_search_regex_match (search, line, p, end, &info, &error);
+  for (; g_match_info_matches (info); g_match_info_next (info, &error))
+    {
+      g_match_info_fetch_pos (info, 0, &start_pos, &end_pos);
+      if (line + start_pos >= limit)
+        break;
+
+      /* empty matches are ignored */
+      if (end_pos > start_pos)
+        {
+          match = line + start_pos;
+          *match_end = line + end_pos;
+          break;
+        }
+    }
+
+  g_match_info_free (info);
+
+  if (error != NULL)
+    {
+      mousepad_search_regex_error (search, error);
+      return NULL;
+    }
+
+  return match;
+}
+
+
+
+/* calls 'func' for each non-empty match starting in [start, end), as a single sequential
+ * match operation would find them, unless the search is interrupted */
+static void
+mousepad_search_regex_foreach (MousepadSearch *search,
+                               gsize start,
+                               gsize end,
+                               MousepadSearchRegexFunc func,
+                               gpointer data)
+{
+  GMatchInfo *info;
+  GError *error = NULL;
+  const gchar *p, *q, *line, *window, *subject_end, *next, *limit = search->text + end;
+  gsize context = 0, context_from = 0;
+  gint start_pos, end_pos;
+  guint n = 0;
+  gboolean interrupted = FALSE;
+
+  p = search->text + start;
+  line = mousepad_search_line_start (search, p);
+  while (p < limit && !interrupted)
+    {
+      if (mousepad_search_interrupted (search))
+        return;
+
+      /* a window aligned on characters, matches starting in it being allowed to extend
+       * beyond it as in the chunk case */
+      window = p + MIN (REGEX_WINDOW_SIZE, limit - p);
+      while (window < limit && ((guchar) *window & 0xC0) == 0x80)
+        window++;
+
+      /* the context end only changes with the window line, which matters for long lines */
+      if (context_from == 0 || memchr (search->text + context_from, '\n',
+                                       window - search->text - context_from) != NULL)
+        context = mousepad_search_context_end (search, window - search->text);
+
+      context_from = window - search->text;
+      subject_end = search->text + context;
+      if (subject_end > window + REGEX_CONTEXT_SIZE)
+        {
+          subject_end = window + REGEX_CONTEXT_SIZE;
+          while (((guchar) *subject_end & 0xC0) == 0x80)
+            subject_end++;
+        }
+
+      next = window;
+      mousepad_search_regex_match (search, line, p, subject_end - search->text, &info, &error);
+      for (; g_match_info_matches (info); g_match_info_next (info, &error))
+        {
+          g_match_info_fetch_pos (info, 0, &start_pos, &end_pos);
+          if (line + start_pos >= window
+              || (interrupted = (++n % 1024 == 0 && mousepad_search_interrupted (search))))
+            break;
+
+          /* empty matches are ignored */
+          if (end_pos > start_pos)
+            {
+              func (info, line + start_pos, line + end_pos, data);
+              next = MAX (window, line + end_pos);
+            }
+        }
+
+      g_match_info_free (info);
+
+      if (error != NULL)
+        {
+          mousepad_search_regex_error (search, error);
+          return;
+        }
+
+      /* the next window starts after the last match, on the last line start before it */
+      for (q = next; q > p && q[-1] != '\n'; q--);
+      if (q > p)
+        line = q;
+
+      p = next;
+    }
+}
+
+
+
+/* returns the first match starting in [p, limit), possibly ending beyond 'limit' */
+static const gchar *
+mousepad_search_next (MousepadSearch *search,
+                      const gchar *p,
+                      const gchar *limit,
+                      const gchar **match_end)
+{
+  const gchar *end;
+
+  if (p >= limit)
+    return NULL;
+
+  if (search->pattern->regex != NULL)
+    return mousepad_search_regex_next (search, p, limit, match_end);
+
+  end = search->text + MIN ((gsize) (limit - search->text) + search->pattern->length - 1,
+                            search->end);
+
+  while ((p = mousepad_search_find (search, p, end)) != NULL && p < limit)
+    {
+      if (!(search->pattern->options & MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES)
+          || mousepad_search_at_word_boundaries (search, p, p + search->pattern->length))
+        {
+          *match_end = p + search->pattern->length;
+          return p;
+        }
+
+      p = g_utf8_next_char (p);
+    }
+
+  return NULL;
+}
+
+
+
+static void
+mousepad_search_chunk_literal (MousepadSearchChunk *chunk)
+{
+  MousepadSearch *search = chunk->search;
+  MousepadSearchHit hit;
+  const gchar *p, *match, *match_end, *counted, *window, *chunk_end;
+
+  p = counted = search->text + chunk->start;
+  chunk_end = search->text + chunk->end;
+  hit.char_length = search->pattern->n_chars;
+
+  while (p < chunk_end)
+    {
+      if (g_cancellable_is_cancelled (search->cancellable))
+        return;
+
+      window = p + MIN (WINDOW_SIZE, chunk_end - p);
+      while ((match = mousepad_search_next (search, p, window, &match_end)) != NULL)
+        {
+          chunk->n_chars += mousepad_search_count_chars (counted, match);
+          counted = match;
+
+          hit.start = match - search->text;
+          hit.end = match_end - search->text;
+          hit.char_start = chunk->n_chars;
+          g_array_append_val (chunk->hits, hit);
+
+          p = match_end;
+        }
+
+      p = MAX (p, window);
+    }
+
+  chunk->n_chars += mousepad_search_count_chars (counted, chunk_end);
+}
+
+
+
+static void
+mousepad_search_chunk_regex_hit (GMatchInfo *info,
+                                 const gchar *match,
+                                 const gchar *match_end,
+                                 gpointer data)
+{
+  MousepadSearchChunk *chunk = data;
+  MousepadSearchHit hit;
+
+  chunk->n_chars += mousepad_search_count_chars (chunk->counted, match);
+  chunk->counted = match;
+
+  hit.start = match - chunk->search->text;
+  hit.end = match_end - chunk->search->text;
+  hit.char_start = chunk->n_chars;
+  hit.char_length = mousepad_search_count_chars (match, match_end);
+  g_array_append_val (chunk->hits, hit);
+}
+
+
+
+static void
+mousepad_search_chunk_regex (MousepadSearchChunk *chunk)
+{
+  MousepadSearch *search = chunk->search;
+
+  chunk->counted = search->text + chunk->start;
+  mousepad_search_regex_foreach (search, chunk->start, chunk->end,
+                                 mousepad_search_chunk_regex_hit, chunk);
+  chunk->n_chars += mousepad_search_count_chars (chunk->counted, search->text + chunk->end);
+}
+
+
+
+static void
+mousepad_search_chunk (gpointer data,
+                       gpointer user_data)
+{
+  MousepadSearchChunk *chunk = data;
+
+  chunk->hits = g_array_new (FALSE, FALSE, sizeof (MousepadSearchHit));
+
+  if (chunk->search->pattern->regex != NULL)
+    mousepad_search_chunk_regex (chunk);
+  else
+    mousepad_search_chunk_literal (chunk);
+}
+
+
+
+/* returns the matches of the chunks, and their byte offsets in 'byte_starts' if not NULL */
+static GArray *
+mousepad_search_merge (MousepadSearch *search,
+                       GArray *byte_starts)
+{
+  MousepadSearchChunk *chunk;
+  MousepadSearchHit *hits;
+  MousepadSearchMatch match;
+  GArray *matches;
+  const gchar *next, *next_end;
+  gsize p, byte_start, last_end = 0;
+  gint base = 0;
+  guint n, i, n_matches = 0;
+
+  for (n = 0; n < search->n_chunks; n++)
+    n_matches += search->chunks[n].hits->len;
+
+  matches = g_array_sized_new (FALSE, FALSE, sizeof (MousepadSearchMatch), n_matches);
+
+  for (n = 0; n < search->n_chunks; base += chunk->n_chars, n++)
+    {
+      chunk = search->chunks + n;
+      hits = (MousepadSearchHit *) (gpointer) chunk->hits->data;
+      i = 0;
+
+      /* resume the scan after the last match of the previous chunk, dropping chunk matches
+       * overlapping it, until meeting one of them */
+      for (p = last_end; p > chunk->start; p = last_end)
+        {
+          while (i < chunk->hits->len && hits[i].start < p)
+            i++;
+
+          next = mousepad_search_next (search, search->text + p, search->text + chunk->end, &next_end);
+          if (next == NULL || (i < chunk->hits->len && (gsize) (next - search->text) == hits[i].start))
+            break;
+
+          match.start = base + mousepad_search_count_chars (search->text + chunk->start, next);
+          match.end = match.start + mousepad_search_count_chars (next, next_end);
+          g_array_append_val (matches, match);
+
+          byte_start = next - search->text;
+          if (byte_starts != NULL)
+            g_array_append_val (byte_starts, byte_start);
+
+          last_end = next_end - search->text;
+        }
+
+      for (; i < chunk->hits->len; i++)
+        {
+          match.start = base + hits[i].char_start;
+          match.end = match.start + hits[i].char_length;
+          g_array_append_val (matches, match);
+
+          if (byte_starts != NULL)
+            g_array_append_val (byte_starts, hits[i].start);
+
+          last_end = hits[i].end;
+        }
+    }
+
+  return matches;
+}
+
+
+
+/* searches the whole text in the current thread */
+static GArray *
+mousepad_search_scan (MousepadSearch *search)
+{
+  MousepadSearchChunk chunk = { search, search->start, search->end, NULL, 0 };
+  GArray *matches;
+
+  search->chunks = &chunk;
+  search->n_chunks = 1;
+
+  mousepad_search_chunk (&chunk, NULL);
+  matches = mousepad_search_merge (search, NULL);
+  g_array_unref (chunk.hits);
+
+  search->chunks = NULL;
+  search->n_chunks = 0;
+
+  return matches;
+}
+
+
+
+static void
+mousepad_search_block_clear (gpointer data)
+{
+  MousepadSearchBlock *block = data;
+
+  g_array_unref (block->matches);
+}
+
+
+
+/* replaces 'n_removed' blocks at 'first' by blocks covering 'n_chars' characters from 'start',
+ * containing 'matches', with absolute offsets */
+static void
+mousepad_search_index_split (MousepadSearchIndex *index,
+                             guint first,
+                             guint n_removed,
+                             GArray *matches,
+                             gint start,
+                             gint n_chars,
+                             guint n_before)
+{
+  MousepadSearchBlock block;
+  MousepadSearchMatch *match, relative;
+  GArray *blocks;
+  gint block_start = start, block_end;
+  guint n, n_blocks, i = 0;
+
+  n_blocks = MAX (n_chars / INDEX_BLOCK_SIZE, 1);
+  blocks = g_array_sized_new (FALSE, FALSE, sizeof (MousepadSearchBlock), n_blocks);
+  for (n = 0; n < n_blocks; n++)
+    {
+      block_end = start + (gint) ((gint64) n_chars * (n + 1) / n_blocks);
+      block.n_chars = block_end - block_start;
+      block.matches = g_array_new (FALSE, FALSE, sizeof (MousepadSearchMatch));
+
+      for (; i < matches->len; i++)
+        {
+          match = &g_array_index (matches, MousepadSearchMatch, i);
+          if (match->start >= block_end && n < n_blocks - 1)
+            break;
+
+          relative.start = match->start - block_start;
+          relative.end = match->end - block_start;
+          g_array_append_val (block.matches, relative);
+        }
+
+      g_array_append_val (blocks, block);
+      block_start = block_end;
+    }
+
+  g_array_remove_range (index->blocks, first, n_removed);
+  g_array_insert_vals (index->blocks, first, blocks->data, blocks->len);
+  g_array_free (blocks, TRUE);
+
+  index->cursor = first;
+  index->cursor_start = start;
+  index->cursor_n_before = n_before;
+}
+
+
+
+static MousepadSearchIndex *
+mousepad_search_index_new (MousepadSearchPattern *pattern,
+                           GArray *matches,
+                           gint n_chars)
+{
+  MousepadSearchIndex *index;
+
+  index = g_new0 (MousepadSearchIndex, 1);
+  index->pattern = pattern;
+  index->blocks = g_array_new (FALSE, FALSE, sizeof (MousepadSearchBlock));
+  g_array_set_clear_func (index->blocks, mousepad_search_block_clear);
+  index->n_chars = n_chars;
+  index->n_matches = matches->len;
+  mousepad_search_index_split (index, 0, 0, matches, 0, n_chars, 0);
+
+  return index;
+}
+
+
+
+static inline MousepadSearchBlock *
+mousepad_search_index_get_cursor (MousepadSearchIndex *index)
+{
+  return &g_array_index (index->blocks, MousepadSearchBlock, index->cursor);
+}
+
+
+
+static void
+mousepad_search_index_backward (MousepadSearchIndex *index)
+{
+  MousepadSearchBlock *block;
+
+  index->cursor--;
+  block = mousepad_search_index_get_cursor (index);
+  index->cursor_start -= block->n_chars;
+  index->cursor_n_before -= block->matches->len;
+}
+
+
+
+static void
+mousepad_search_index_forward (MousepadSearchIndex *index)
+{
+  MousepadSearchBlock *block;
+
+  block = mousepad_search_index_get_cursor (index);
+  index->cursor_start += block->n_chars;
+  index->cursor_n_before += block->matches->len;
+  index->cursor++;
+}
+
+
+
+/* moves the cursor to the block containing 'offset', or to the last block */
+static void
+mousepad_search_index_seek (MousepadSearchIndex *index,
+                            gint offset)
+{
+  while (index->cursor > 0 && offset < index->cursor_start)
+    mousepad_search_index_backward (index);
+
+  while (index->cursor < index->blocks->len - 1
+         && offset >= index->cursor_start + mousepad_search_index_get_cursor (index)->n_chars)
+    mousepad_search_index_forward (index);
+}
+
+
+
+/* moves the cursor to the block containing the match 'n' */
+static void
+mousepad_search_index_seek_match (MousepadSearchIndex *index,
+                                  guint n)
+{
+  while (index->cursor > 0 && n < index->cursor_n_before)
+    mousepad_search_index_backward (index);
+
+  while (index->cursor < index->blocks->len - 1
+         && n >= index->cursor_n_before + mousepad_search_index_get_cursor (index)->matches->len)
+    mousepad_search_index_forward (index);
+}
+
+
+
+/* returns the number of matches starting before 'offset', or ending before it if 'by_end' */
+static guint
+mousepad_search_index_count_before (MousepadSearchIndex *index,
+                                    gint offset,
+                                    gboolean by_end)
+{
+  MousepadSearchBlock *block;
+  MousepadSearchMatch *matches;
+  guint n_before, lower, upper, middle;
+
+  /* matches of the previous blocks may end in the block containing 'offset' */
+  mousepad_search_index_seek (index, offset);
+  while (by_end && index->cursor > 0)
+    {
+      block = &g_array_index (index->blocks, MousepadSearchBlock, index->cursor - 1);
+      if (block->matches->len > 0
+          && g_array_index (block->matches, MousepadSearchMatch, block->matches->len - 1).end
+             <= offset - index->cursor_start + block->n_chars)
+        break;
+
+      mousepad_search_index_backward (index);
+    }
+
+  for (n_before = index->cursor_n_before;; mousepad_search_index_forward (index))
+    {
+      block = mousepad_search_index_get_cursor (index);
+      matches = (MousepadSearchMatch *) (gpointer) block->matches->data;
+      lower = 0;
+      upper = block->matches->len;
+      while (lower < upper)
+        {
+          middle = (lower + upper) / 2;
+          if ((by_end ? matches[middle].end : matches[middle].start + 1) <= offset - index->cursor_start)
+            lower = middle + 1;
+          else
+            upper = middle;
+        }
+
+      n_before += lower;
+
+      /* matches are sorted both by start and end, and the next block starts after 'offset' */
+      if (lower < block->matches->len || index->cursor == index->blocks->len - 1
+          || offset < index->cursor_start + block->n_chars)
+        break;
+    }
+
+  return n_before;
+}
+
+
+
+static void
+mousepad_search_return_too_expensive (GTask *task)
+{
+  g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                           "The pattern is too expensive to search for");
+}
+
+
+
+static void
+mousepad_search_thread (GTask *task,
+                        gpointer source_object,
+                        gpointer task_data,
+                        GCancellable *cancellable)
+{
+  MousepadSearch *search = task_data;
+  MousepadSearchChunk *chunk;
+  MousepadSearchIndex *index;
+  GThreadPool *pool = NULL;
+  GArray *matches, *byte_starts;
+  const gchar *eol;
+  gsize end;
+  gint n_chars = 0;
+  guint n;
+
+  /* the time budget is shared by all the chunks */
+  if (search->pattern->regex != NULL)
+    search->deadline = g_get_monotonic_time () + MOUSEPAD_SEARCH_REGEX_TIME_BUDGET;
+
+  /* split the text into chunks aligned on characters, or on lines for regex searches */
+  search->n_chunks = CLAMP ((search->end - search->start) / CHUNK_SIZE_MIN, 1, g_get_num_processors ());
+  search->chunks = g_new0 (MousepadSearchChunk, search->n_chunks);
+  for (n = 0; n < search->n_chunks; n++)
+    {
+      chunk = search->chunks + n;
+      chunk->search = search;
+      chunk->start = (n == 0) ? search->start : search->chunks[n - 1].end;
+
+      if (n == search->n_chunks - 1)
+        chunk->end = search->end;
+      else
+        {
+          end = search->start + (search->end - search->start) / search->n_chunks * (n + 1);
+          end = MAX (end, chunk->start);
+          if (search->pattern->regex != NULL)
+            {
+              eol = memchr (search->text + end, '\n', search->end - end);
+              end = (eol != NULL) ? (gsize) (eol - search->text) + 1 : search->end;
+            }
+          else
+            while (end < search->end && ((guchar) search->text[end] & 0xC0) == 0x80)
+              end++;
+
+          chunk->end = end;
+        }
+    }
+
+  /* search the chunks in parallel, the first one in this thread */
+  if (search->n_chunks > 1)
+    {
+      pool = g_thread_pool_new (mousepad_search_chunk, NULL, search->n_chunks - 1, FALSE, NULL);
+      for (n = 1; n < search->n_chunks; n++)
+        g_thread_pool_push (pool, search->chunks + n, NULL);
+    }
+
+  mousepad_search_chunk (search->chunks, NULL);
+
+  /* wait for the other chunks */
+  if (pool != NULL)
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  /* build the index, which takes over the pattern */
+  for (n = 0; n < search->n_chunks; n++)
+    n_chars += search->chunks[n].n_chars;
+
+  byte_starts = g_array_new (FALSE, FALSE, sizeof (gsize));
+  matches = mousepad_search_merge (search, byte_starts);
+
+  /* some matches may be missing */
+  if (search->too_expensive)
+    {
+      g_array_unref (matches);
+      g_array_unref (byte_starts);
+      mousepad_search_return_too_expensive (task);
+      return;
+    }
+
+  index = mousepad_search_index_new (search->pattern, matches, n_chars);
+  search->pattern = NULL;
+  g_array_unref (matches);
+
+  /* keep what is needed to refine the index */
+  index->bytes = g_bytes_ref (search->bytes);
+  index->start = search->start;
+  index->end = search->end;
+  index->byte_starts = byte_starts;
+
+  g_task_return_pointer (task, index, (GDestroyNotify) mousepad_search_index_free);
+}
+
+
+
+/**
+ * mousepad_search_pattern_find:
+ * @pattern: a #MousepadSearchPattern.
+ * @text: the valid UTF-8 text to search in.
+ * @length: the length of @text in bytes.
+ * @from: the position in @text where to start searching.
+ * @deadline: the monotonic time past which a regex search is given up, or 0 for no limit,
+ *            see MOUSEPAD_SEARCH_REGEX_TIME_BUDGET.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @match_end: (out): return location for the end of the match.
+ * @error: return location for a #GError, or %NULL.
+ *
+ * Finds the next match of @pattern in @text from @from, in the current thread: calling this
+ * function again from the end of each match finds all the matches, as mousepad_search_async()
+ * would. The text is searched in windows, the search being given up in between if @cancellable
+ * is cancelled, or if @deadline is reached, in which case the pattern is too expensive to search
+ * for, as when the regex reaches the backtracking limit.
+ *
+ * Return value: the start of the match, or %NULL if there is none or the search was given up,
+ *               with @error set to %G_IO_ERROR_CANCELLED or %G_IO_ERROR_TIMED_OUT.
+ **/
+const gchar *
+mousepad_search_pattern_find (MousepadSearchPattern *pattern,
+                              const gchar *text,
+                              gsize length,
+                              const gchar *from,
+                              gint64 deadline,
+                              GCancellable *cancellable,
+                              const gchar **match_end,
+                              GError **error)
+{
+  MousepadSearch search = { 0 };
+  const gchar *match, *window, *end = text + length;
+  gsize window_size;
+
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  search.pattern = pattern;
+  search.text = text;
+  search.length = search.end = length;
+  search.cancellable = cancellable;
+  search.deadline = (pattern->regex != NULL) ? deadline : 0;
+  window_size = (pattern->regex != NULL) ? REGEX_WINDOW_SIZE : WINDOW_SIZE;
+
+  for (; from < end && !mousepad_search_interrupted (&search); from = window)
+    {
+      window = from + MIN (window_size, (gsize) (end - from));
+      while (window < end && ((guchar) *window & 0xC0) == 0x80)
+        window++;
+
+      if ((match = mousepad_search_next (&search, from, window, match_end)) != NULL)
+        return match;
+    }
+
+  if (!g_cancellable_set_error_if_cancelled (cancellable, error) && search.too_expensive)
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                         "The pattern is too expensive to search for");
+
+  return NULL;
+}
+
+
+
+/**
+ * mousepad_search_supports:
+ * @pattern: the text to search for.
+ * @options: the search options.
+ *
+ * Whether the search engine can handle a search for @pattern with @options, i.e. whether
+ * the pattern is not empty: case folding beyond ASCII is done through a regex.
+ *
+ * Return value: %TRUE if the search engine can be used, %FALSE otherwise.
+ **/
+gboolean
+mousepad_search_supports (const gchar *pattern,
+                          MousepadSearchOptions options)
+{
+  return pattern != NULL && *pattern != '\0';
+}
+
+
+
+/* whether a regex atom may match 'c', only for single characters and the most common
+ * character classes, other atoms being considered as matching nothing */
+static gboolean
+mousepad_search_atom_matches (const MousepadSearchAtom *atom,
+                              gunichar c,
+                              gboolean caseless)
+{
+  gunichar a;
+
+  if (atom->text[0] == '.' && atom->length == 1)
+    return c != '\n';
+
+  if (atom->text[0] != '\\')
+    {
+      if ((gsize) g_utf8_skip[(guchar) atom->text[0]] != atom->length)
+        return FALSE;
+
+      a = g_utf8_get_char (atom->text);
+      return a == c || (caseless && g_unichar_tolower (a) == g_unichar_tolower (c));
+    }
+
+  if (atom->length != 2)
+    return FALSE;
+
+  switch (atom->text[1])
+    {
+    case 'w': return c == '_' || g_unichar_isalnum (c);
+    case 'W': return c != '_' && !g_unichar_isalnum (c);
+    case 'd': return g_unichar_isdigit (c);
+    case 'D': return !g_unichar_isdigit (c);
+    case 's': return g_unichar_isspace (c);
+    case 'S': return !g_unichar_isspace (c);
+    case 'n': return c == '\n';
+    case 't': return c == '\t';
+    default: return !g_ascii_isalnum (atom->text[1]) && (guchar) atom->text[1] == c;
+    }
+}
+
+
+
+/* the character an atom stands for, if it is a single character */
+static gunichar
+mousepad_search_atom_char (const MousepadSearchAtom *atom)
+{
+  if (atom->text[0] != '\\')
+    return ((gsize) g_utf8_skip[(guchar) atom->text[0]] == atom->length) ? g_utf8_get_char (atom->text) : 0;
+
+  if (atom->length != 2)
+    return 0;
+  else if (atom->text[1] == 'n')
+    return '\n';
+  else if (atom->text[1] == 't')
+    return '\t';
+
+  return g_ascii_isalnum (atom->text[1]) ? 0 : (guchar) atom->text[1];
+}
+
+
+
+/* whether two atoms may match the same character, tested on a few samples */
+static gboolean
+mousepad_search_atoms_overlap (const MousepadSearchAtom *a,
+                               const MousepadSearchAtom *b,
+                               gboolean caseless)
+{
+  gunichar samples[] = { 'a', '0', '_', ' ', '-', '\t', '\n', 0, 0 };
+  guint n;
+
+  if (a->length == b->length && memcmp (a->text, b->text, a->length) == 0)
+    return TRUE;
+
+  samples[G_N_ELEMENTS (samples) - 2] = mousepad_search_atom_char (a);
+  samples[G_N_ELEMENTS (samples) - 1] = mousepad_search_atom_char (b);
+  for (n = 0; n < G_N_ELEMENTS (samples); n++)
+    if (samples[n] != 0 && mousepad_search_atom_matches (a, samples[n], caseless)
+        && mousepad_search_atom_matches (b, samples[n], caseless))
+      return TRUE;
+
+  return FALSE;
+}
+
+
+
+/* whether some alternatives of a group may start with the same character, possibly
+ * up to case */
+static gboolean
+mousepad_search_group_overlaps (MousepadSearchGroup *group,
+                                gboolean caseless)
+{
+  MousepadSearchAtom *firsts = (MousepadSearchAtom *) (gpointer) group->firsts->data;
+  guint i, j;
+
+  for (i = 0; i < group->firsts->len; i++)
+    for (j = i + 1; j < group->firsts->len; j++)
+      if (mousepad_search_atoms_overlap (firsts + i, firsts + j, caseless))
+        return TRUE;
+
+  return FALSE;
+}
+
+
+
+/* returns the end of the quantifier at 'p', if any, telling whether it is unbounded */
+static const gchar *
+mousepad_search_skip_quantifier (const gchar *p,
+                                 gboolean *unbounded)
+{
+  const gchar *q;
+
+  *unbounded = (*p == '*' || *p == '+');
+  if (*p == '*' || *p == '+' || *p == '?')
+    return p + 1;
+
+  /* {n}, {n,} or {n,m}, otherwise a literal brace */
+  if (*p != '{' || !g_ascii_isdigit (p[1]))
+    return NULL;
+
+  for (q = p + 1; g_ascii_isdigit (*q); q++);
+  if (*q == ',')
+    {
+      *unbounded = !g_ascii_isdigit (q[1]);
+      for (q++; g_ascii_isdigit (*q); q++);
+    }
+
+  return (*q == '}') ? q + 1 : NULL;
+}
+
+
+
+/* returns the end of the escape sequence at 'p' */
+static const gchar *
+mousepad_search_skip_escape (const gchar *p)
+{
+  const gchar *q;
+
+  if (p[1] == '\0')
+    return p + 1;
+
+  /* \x{...}, \p{...}, \g{...}, etc. */
+  if (g_ascii_isalpha (p[1]) && p[2] == '{' && (q = strchr (p + 3, '}')) != NULL)
+    return q + 1;
+
+  return g_utf8_next_char (p + 1);
+}
+
+
+
+/* returns the end of the character class at 'p' */
+static const gchar *
+mousepad_search_skip_class (const gchar *p)
+{
+  const gchar *q;
+
+  p++;
+  if (*p == '^')
+    p++;
+
+  /* a leading ']' is a literal */
+  if (*p == ']')
+    p++;
+
+  while (*p != '\0' && *p != ']')
+    {
+      if (*p == '\\')
+        p = mousepad_search_skip_escape (p);
+      else if (p[0] == '[' && p[1] == ':' && (q = strstr (p + 2, ":]")) != NULL)
+        p = q + 2;
+      else
+        p++;
+    }
+
+  return (*p == ']') ? p + 1 : p;
+}
+
+
+
+/**
+ * mousepad_search_is_pathological:
+ * @pattern: the text to search for.
+ * @options: the search options.
+ *
+ * Analyses a regex for the constructs which are known to make PCRE backtrack exponentially:
+ * a group repeated without bound which itself repeats something, e.g. "(a+)+" or "(\w+\s?)*",
+ * or whose alternatives may start with the same character, e.g. "(a|ab)*", or "(a|A)*" without
+ * %MOUSEPAD_SEARCH_CASE_SENSITIVE in @options. Searches with such a regex are likely to be
+ * given up as too expensive, see mousepad_search_async().
+ *
+ * Return value: %TRUE if @pattern is a regex with a pathological construct, %FALSE otherwise.
+ **/
+gboolean
+mousepad_search_is_pathological (const gchar *pattern,
+                                 MousepadSearchOptions options)
+{
+  MousepadSearchGroup *group, closed = { 0 }, new_group = { FALSE, FALSE, NULL, TRUE };
+  MousepadSearchAtom atom;
+  GArray *groups;
+  const gchar *p, *q;
+  gboolean is_closed, unbounded, overlaps = FALSE, pathological = FALSE;
+  gboolean caseless = !(options & MOUSEPAD_SEARCH_CASE_SENSITIVE);
+  guint n;
+
+  if (!(options & MOUSEPAD_SEARCH_REGEX) || pattern == NULL)
+    return FALSE;
+
+  /* the whole pattern is the first group */
+  groups = g_array_new (FALSE, FALSE, sizeof (MousepadSearchGroup));
+  new_group.firsts = g_array_new (FALSE, FALSE, sizeof (MousepadSearchAtom));
+  g_array_append_val (groups, new_group);
+
+  for (p = pattern; *p != '\0' && !pathological; )
+    {
+      group = &g_array_index (groups, MousepadSearchGroup, groups->len - 1);
+      atom.text = p;
+      is_closed = FALSE;
+
+      switch (*p)
+        {
+        case '\\':
+          /* quoted text: only its first character may matter */
+          if (p[1] == 'Q')
+            {
+              p += 2;
+              atom.text = p;
+              q = strstr (p, "\\E");
+              p = (q != NULL) ? q + 2 : p + strlen (p);
+              if (q == atom.text)
+                continue;
+
+              atom.length = g_utf8_skip[(guchar) *atom.text];
+            }
+          else
+            {
+              p = mousepad_search_skip_escape (p);
+              atom.length = p - atom.text;
+            }
+          break;
+
+        case '[':
+          p = mousepad_search_skip_class (p);
+          atom.length = p - atom.text;
+          break;
+
+        case '(':
+          /* comments, verbs and option settings are not groups */
+          if ((p[1] == '?' && p[2] == '#') || p[1] == '*')
+            {
+              p = strchr (p, ')');
+              p = (p != NULL) ? p + 1 : atom.text + strlen (atom.text);
+              continue;
+            }
+
+          for (q = p + 2; p[1] == '?' && (g_ascii_isalpha (*q) || *q == '-'); q++);
+          if (p[1] == '?' && q > p + 2 && *q == ')')
+            {
+              p = q + 1;
+              continue;
+            }
+
+          /* a group starts the current alternative, which is not compared to the others */
+          group->first_pending = FALSE;
+
+          /* atomic groups and lookarounds are not backtracked into */
+          new_group.atomic = (p[1] == '?' && (p[2] == '>' || p[2] == '=' || p[2] == '!'
+                                               || (p[2] == '<' && (p[3] == '=' || p[3] == '!'))));
+          new_group.firsts = g_array_new (FALSE, FALSE, sizeof (MousepadSearchAtom));
+
+          /* skip the group kind and name, if any */
+          if (p[1] != '?')
+            p++;
+          else
+            {
+              p += 2;
+              if (*p == 'P')
+                p++;
+
+              if ((*p == '<' && p[1] != '=' && p[1] != '!') || *p == '\'')
+                {
+                  q = strchr (p + 1, (*p == '<') ? '>' : '\'');
+                  p = (q != NULL) ? q + 1 : p + strlen (p);
+                }
+              else
+                {
+                  while (g_ascii_isalpha (*p) || *p == '-')
+                    p++;
+                  if (*p == '<')
+                    p++;
+                  if (*p != '\0')
+                    p++;
+                }
+            }
+
+          g_array_append_val (groups, new_group);
+          continue;
+
+        case ')':
+          p++;
+          if (groups->len == 1)
+            continue;
+
+          closed = *group;
+          overlaps = !closed.atomic && mousepad_search_group_overlaps (&closed, caseless);
+          closed.repeats = closed.repeats && !closed.atomic;
+          g_array_unref (closed.firsts);
+          g_array_set_size (groups, groups->len - 1);
+          group = &g_array_index (groups, MousepadSearchGroup, groups->len - 1);
+          is_closed = TRUE;
+          break;
+
+        case '|':
+          p++;
+          group->first_pending = TRUE;
+          continue;
+
+        case '^':
+        case '$':
+          p++;
+          continue;
+
+        default:
+          p = g_utf8_next_char (p);
+          atom.length = p - atom.text;
+          break;
+        }
+
+      /* the first atom of an alternative */
+      if (group->first_pending && !is_closed)
+        {
+          g_array_append_val (group->firsts, atom);
+          group->first_pending = FALSE;
+        }
+
+      /* a repeated atom, unless the quantifier is possessive */
+      q = mousepad_search_skip_quantifier (p, &unbounded);
+      if (q != NULL)
+        {
+          p = q;
+          if (*p == '+')
+            unbounded = FALSE;
+          if (*p == '+' || *p == '?')
+            p++;
+
+          if (unbounded && is_closed && (closed.repeats || overlaps))
+            pathological = TRUE;
+          else if (unbounded)
+            group->repeats = TRUE;
+        }
+
+      if (is_closed && closed.repeats)
+        group->repeats = TRUE;
+    }
+
+  for (n = 0; n < groups->len; n++)
+    g_array_unref (g_array_index (groups, MousepadSearchGroup, n).firsts);
+
+  g_array_unref (groups);
+
+  return pathological;
+}
+
+
+
+static MousepadSearch *
+mousepad_search_new (GBytes *text,
+                     gsize start,
+                     gssize end,
+                     GCancellable *cancellable)
+{
+  MousepadSearch *search;
+
+  search = g_new0 (MousepadSearch, 1);
+  search->bytes = g_bytes_ref (text);
+  search->text = g_bytes_get_data (text, &search->length);
+  if (search->text == NULL)
+    search->text = "";
+
+  search->end = (end < 0) ? search->length : MIN ((gsize) end, search->length);
+  search->start = MIN (start, search->end);
+
+  if (cancellable != NULL)
+    search->cancellable = g_object_ref (cancellable);
+
+  return search;
+}
+
+
+
+/**
+ * mousepad_search_async:
+ * @text: the valid UTF-8 text to search in, which must not be modified during the search.
+ * @start: the byte offset in @text where to start searching, on a character boundary.
+ * @end: the byte offset in @text where to stop searching, on a character boundary, or -1
+ *       for the end of @text.
+ * @pattern: the text or regex to search for, see mousepad_search_supports().
+ * @options: the search options.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: a #GAsyncReadyCallback to call when the search is complete.
+ * @user_data: the data to pass to @callback.
+ *
+ * Searches all the non-overlapping occurrences of @pattern in @text between @start and @end,
+ * as gtk_source_search_context_forward_async() would find them in sequence, using a thread
+ * per processor for large ranges. The range is searched as if it were the whole text, and
+ * the character offsets of the resulting index are relative to @start.
+ *
+ * A regex search which takes more than a few seconds, or reaches the backtracking limit of
+ * PCRE, is given up with a %G_IO_ERROR_TIMED_OUT error: see also
+ * mousepad_search_is_pathological().
+ **/
+void
+mousepad_search_async (GBytes *text,
+                       gsize start,
+                       gssize end,
+                       const gchar *pattern,
+                       MousepadSearchOptions options,
+                       GCancellable *cancellable,
+                       GAsyncReadyCallback callback,
+                       gpointer user_data)
+{
+  MousepadSearch *search;
+  GTask *task;
+  GError *error = NULL;
+
+  g_return_if_fail (text != NULL);
+  g_return_if_fail (mousepad_search_supports (pattern, options));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  search = mousepad_search_new (text, start, end, cancellable);
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mousepad_search_async);
+  g_task_set_task_data (task, search, mousepad_search_free);
+
+  /* invalid regexes are reported right away */
+  search->pattern = mousepad_search_pattern_new (pattern, options, &error);
+  if (search->pattern == NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_run_in_thread (task, mousepad_search_thread);
+
+  g_object_unref (task);
+}
+
+
+
+/**
+ * mousepad_search_finish:
+ * @result: a #GAsyncResult.
+ * @error: return location for a #GError, or %NULL.
+ *
+ * Finishes a search started with mousepad_search_async() or mousepad_search_refine_async().
+ *
+ * Return value: (transfer full): the index of the matches, to be freed with
+ *               mousepad_search_index_free(), or %NULL if the search was cancelled or
+ *               the regex is invalid or too expensive.
+ **/
+MousepadSearchIndex *
+mousepad_search_finish (GAsyncResult *result,
+                        GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+
+
+/**
+ * mousepad_search_index_can_refine:
+ * @index: a #MousepadSearchIndex.
+ * @pattern: the text to search for.
+ * @options: the search options.
+ *
+ * Tells whether the matches of @pattern are among those of @index, so that
+ * mousepad_search_refine_async() can find them without searching the whole text again.
+ * This is the case if @index was not updated since the search, and @pattern extends its
+ * literal pattern with the same options, e.g. as the user types in the search bar.
+ *
+ * Return value: %TRUE if @index can be refined with @pattern, %FALSE otherwise.
+ **/
+gboolean
+mousepad_search_index_can_refine (MousepadSearchIndex *index,
+                                  const gchar *pattern,
+                                  MousepadSearchOptions options)
+{
+  MousepadSearchPattern *old = index->pattern;
+  const gchar *p;
+  gsize n;
+
+  if (index->bytes == NULL || old->regex != NULL || options != old->options
+      || (options & (MOUSEPAD_SEARCH_REGEX | MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES))
+      || strlen (pattern) < old->length)
+    return FALSE;
+
+  if (options & MOUSEPAD_SEARCH_CASE_SENSITIVE)
+    {
+      if (strncmp (pattern, old->string, old->length) != 0)
+        return FALSE;
+    }
+  else
+    {
+      /* case insensitive searches beyond ASCII are regex searches */
+      for (p = pattern; *p != '\0'; p++)
+        if ((guchar) *p >= 0x80)
+          return FALSE;
+
+      if (g_ascii_strncasecmp (pattern, old->string, old->length) != 0)
+        return FALSE;
+    }
+
+  /* the previous matches are all the occurrences of the previous pattern, unless occurrences
+   * may overlap, i.e. unless a prefix of the pattern is also a suffix of it */
+  if (pattern[old->length] != '\0')
+    for (n = 1; n < old->length; n++)
+      if (memcmp (old->string, old->string + old->length - n, n) == 0)
+        return FALSE;
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_search_refine_free (gpointer data)
+{
+  MousepadSearchRefine *refine = data;
+
+  mousepad_search_index_free (refine->index);
+  if (refine->pattern != NULL)
+    mousepad_search_pattern_free (refine->pattern);
+
+  g_free (refine);
+}
+
+
+
+static void
+mousepad_search_refine_thread (GTask *task,
+                               gpointer source_object,
+                               gpointer task_data,
+                               GCancellable *cancellable)
+{
+  MousepadSearchRefine *refine = task_data;
+  MousepadSearchIndex *old = refine->index, *index;
+  MousepadSearchPattern *pattern = refine->pattern;
+  MousepadSearchBlock *block = NULL;
+  MousepadSearchMatch *match, new_match;
+  GArray *matches, *byte_starts;
+  const gchar *text, *suffix;
+  gsize byte_start, suffix_length, last_end = old->start;
+  gint block_start = 0, n_extra_chars;
+  guint n, i, j = 0;
+
+  text = g_bytes_get_data (old->bytes, NULL);
+  suffix = pattern->string + old->pattern->length;
+  suffix_length = pattern->length - old->pattern->length;
+  n_extra_chars = pattern->n_chars - old->pattern->n_chars;
+
+  /* check the text following each previous match, skipping matches overlapping the last
+   * new one, as a sequential search would */
+  matches = g_array_new (FALSE, FALSE, sizeof (MousepadSearchMatch));
+  byte_starts = g_array_new (FALSE, FALSE, sizeof (gsize));
+  for (n = 0; n < old->blocks->len && !g_cancellable_is_cancelled (cancellable);
+       block_start += block->n_chars, n++)
+    {
+      block = &g_array_index (old->blocks, MousepadSearchBlock, n);
+      for (i = 0; i < block->matches->len; i++, j++)
+        {
+          byte_start = g_array_index (old->byte_starts, gsize, j);
+          if (byte_start < last_end || byte_start + pattern->length > old->end)
+            continue;
+
+          if ((pattern->options & MOUSEPAD_SEARCH_CASE_SENSITIVE)
+                ? memcmp (text + byte_start + old->pattern->length, suffix, suffix_length) != 0
+                : g_ascii_strncasecmp (text + byte_start + old->pattern->length, suffix, suffix_length) != 0)
+            continue;
+
+          match = &g_array_index (block->matches, MousepadSearchMatch, i);
+          new_match.start = block_start + match->start;
+          new_match.end = block_start + match->end + n_extra_chars;
+          g_array_append_val (matches, new_match);
+          g_array_append_val (byte_starts, byte_start);
+
+          last_end = byte_start + pattern->length;
+        }
+    }
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_array_unref (matches);
+      g_array_unref (byte_starts);
+      return;
+    }
+
+  /* build the new index, which takes over the pattern */
+  index = mousepad_search_index_new (pattern, matches, old->n_chars);
+  refine->pattern = NULL;
+  g_array_unref (matches);
+
+  index->bytes = g_bytes_ref (old->bytes);
+  index->start = old->start;
+  index->end = old->end;
+  index->byte_starts = byte_starts;
+
+  g_task_return_pointer (task, index, (GDestroyNotify) mousepad_search_index_free);
+}
+
+
+
+/**
+ * mousepad_search_refine_async:
+ * @index: (transfer full): a #MousepadSearchIndex.
+ * @pattern: the text to search for, see mousepad_search_index_can_refine().
+ * @options: the search options.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: a #GAsyncReadyCallback to call when the search is complete.
+ * @user_data: the data to pass to @callback.
+ *
+ * Searches @pattern in the text @index was built from, only checking the previous matches.
+ * The result is the same as for mousepad_search_async(), and is obtained the same way, with
+ * mousepad_search_finish(). @index is freed afterwards.
+ **/
+void
+mousepad_search_refine_async (MousepadSearchIndex *index,
+                              const gchar *pattern,
+                              MousepadSearchOptions options,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data)
+{
+  MousepadSearchRefine *refine;
+  GTask *task;
+
+  g_return_if_fail (index != NULL);
+  g_return_if_fail (mousepad_search_index_can_refine (index, pattern, options));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  refine = g_new (MousepadSearchRefine, 1);
+  refine->index = index;
+  refine->pattern = mousepad_search_pattern_new (pattern, options, NULL);
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mousepad_search_refine_async);
+  g_task_set_task_data (task, refine, mousepad_search_refine_free);
+  g_task_run_in_thread (task, mousepad_search_refine_thread);
+  g_object_unref (task);
+}
+
+
+
+static void
+mousepad_search_index_forget_text (MousepadSearchIndex *index)
+{
+  g_clear_pointer (&index->bytes, g_bytes_unref);
+  g_clear_pointer (&index->byte_starts, g_array_unref);
+}
+
+
+
+void
+mousepad_search_index_free (MousepadSearchIndex *index)
+{
+  mousepad_search_index_forget_text (index);
+  g_array_unref (index->blocks);
+  mousepad_search_pattern_free (index->pattern);
+  g_free (index);
+}
+
+
+
+gint
+mousepad_search_index_get_n_chars (MousepadSearchIndex *index)
+{
+  return index->n_chars;
+}
+
+
+
+guint
+mousepad_search_index_get_n_matches (MousepadSearchIndex *index)
+{
+  return index->n_matches;
+}
+
+
+
+void
+mousepad_search_index_get_match (MousepadSearchIndex *index,
+                                 guint n,
+                                 MousepadSearchMatch *match)
+{
+  g_return_if_fail (n < index->n_matches);
+
+  mousepad_search_index_seek_match (index, n);
+  *match = g_array_index (mousepad_search_index_get_cursor (index)->matches,
+                          MousepadSearchMatch, n - index->cursor_n_before);
+  match->start += index->cursor_start;
+  match->end += index->cursor_start;
+}
+
+
+
+/**
+ * mousepad_search_index_find:
+ * @index: a #MousepadSearchIndex.
+ * @offset: a character offset.
+ * @backward: the search direction.
+ *
+ * Return value: the number of the first match starting at or after @offset, or of the last
+ *               match ending at or before @offset if @backward is %TRUE, or -1 if there is
+ *               no such match.
+ **/
+gint
+mousepad_search_index_find (MousepadSearchIndex *index,
+                            gint offset,
+                            gboolean backward)
+{
+  guint n;
+
+  if (backward)
+    {
+      n = mousepad_search_index_count_before (index, offset, TRUE);
+      return (gint) n - 1;
+    }
+
+  n = mousepad_search_index_count_before (index, offset, FALSE);
+
+  return n < index->n_matches ? (gint) n : -1;
+}
+
+
+
+/**
+ * mousepad_search_index_get_range:
+ * @index: a #MousepadSearchIndex.
+ * @start: a character offset.
+ * @end: a character offset.
+ *
+ * Return value: (transfer full): the array of #MousepadSearchMatch intersecting [@start, @end).
+ **/
+GArray *
+mousepad_search_index_get_range (MousepadSearchIndex *index,
+                                 gint start,
+                                 gint end)
+{
+  MousepadSearchMatch match;
+  GArray *matches;
+  guint n;
+
+  matches = g_array_new (FALSE, FALSE, sizeof (MousepadSearchMatch));
+  for (n = mousepad_search_index_count_before (index, start, TRUE); n < index->n_matches; n++)
+    {
+      mousepad_search_index_get_match (index, n, &match);
+      if (match.start >= end)
+        break;
+
+      g_array_append_val (matches, match);
+    }
+
+  return matches;
+}
+
+
+
+/**
+ * mousepad_search_index_update:
+ * @index: a #MousepadSearchIndex.
+ * @buffer: the #GtkTextBuffer the index is about, once modified.
+ * @offset: the character offset of the modification.
+ * @n_removed: the number of characters removed at @offset.
+ * @n_inserted: the number of characters inserted at @offset.
+ *
+ * Updates @index after a modification of @buffer, by rescanning the lines around it. This
+ * is done in the calling thread, within a few milliseconds for a regex.
+ *
+ * Return value: %FALSE if the region to rescan is too large or too expensive to search, in
+ *               which case @index is left unchanged and a new search should be started,
+ *               %TRUE otherwise.
+ **/
+gboolean
+mousepad_search_index_update (MousepadSearchIndex *index,
+                              GtkTextBuffer *buffer,
+                              gint offset,
+                              gint n_removed,
+                              gint n_inserted)
+{
+  MousepadSearchBlock *block;
+  MousepadSearchMatch *match, new_match;
+  MousepadSearch search = { 0 };
+  GtkTextIter start_iter, end_iter;
+  GArray *matches, *new_matches, *found;
+  gchar *text;
+  gint start, old_end, first_start, n_chars = 0, delta = n_inserted - n_removed;
+  guint first, last, n_before, n, i;
+  gboolean extended;
+
+  /* the searched text is outdated */
+  mousepad_search_index_forget_text (index);
+
+  /* the lines around the edit, in new coordinates, with some context for multi-line matches */
+  gtk_text_buffer_get_iter_at_offset (buffer, &start_iter, offset);
+  gtk_text_iter_set_line_offset (&start_iter, 0);
+  gtk_text_iter_backward_lines (&start_iter, index->pattern->context_lines);
+  gtk_text_buffer_get_iter_at_offset (buffer, &end_iter, offset + n_inserted);
+  gtk_text_iter_forward_lines (&end_iter, index->pattern->context_lines);
+  if (!gtk_text_iter_ends_line (&end_iter))
+    gtk_text_iter_forward_to_line_end (&end_iter);
+
+  start = gtk_text_iter_get_offset (&start_iter);
+  old_end = gtk_text_iter_get_offset (&end_iter) - delta;
+
+  /* the blocks concerned, with one more block on each side for matches spanning blocks */
+  mousepad_search_index_seek (index, start);
+  if (index->cursor > 0)
+    mousepad_search_index_backward (index);
+
+  first = index->cursor;
+  first_start = index->cursor_start;
+  n_before = index->cursor_n_before;
+  mousepad_search_index_seek (index, old_end);
+  last = MIN (index->cursor + 1, index->blocks->len - 1);
+
+  /* gather their matches, in old coordinates */
+  matches = g_array_new (FALSE, FALSE, sizeof (MousepadSearchMatch));
+  for (n = first; n <= last; n++)
+    {
+      block = &g_array_index (index->blocks, MousepadSearchBlock, n);
+      for (i = 0; i < block->matches->len; i++)
+        {
+          new_match = g_array_index (block->matches, MousepadSearchMatch, i);
+          new_match.start += first_start + n_chars;
+          new_match.end += first_start + n_chars;
+          g_array_append_val (matches, new_match);
+        }
+
+      n_chars += block->n_chars;
+    }
+
+  /* extend the region to the matches it intersects, on whole lines */
+  do
+    {
+      extended = FALSE;
+      for (i = 0; i < matches->len; i++)
+        {
+          match = &g_array_index (matches, MousepadSearchMatch, i);
+          if (match->start < old_end && match->end > start
+              && (match->start < start || match->end > old_end))
+            {
+              start = MIN (start, match->start);
+              old_end = MAX (old_end, match->end);
+              extended = TRUE;
+            }
+        }
+
+      if (extended)
+        {
+          gtk_text_buffer_get_iter_at_offset (buffer, &start_iter, start);
+          gtk_text_iter_set_line_offset (&start_iter, 0);
+          gtk_text_buffer_get_iter_at_offset (buffer, &end_iter, old_end + delta);
+          if (!gtk_text_iter_ends_line (&end_iter))
+            gtk_text_iter_forward_to_line_end (&end_iter);
+
+          start = gtk_text_iter_get_offset (&start_iter);
+          old_end = gtk_text_iter_get_offset (&end_iter) - delta;
+        }
+    }
+  while (extended);
+
+  if (old_end + delta - start > INDEX_RESCAN_MAX)
+    {
+      g_array_unref (matches);
+      return FALSE;
+    }
+
+  /* rescan the region, in the main thread but in a limited time */
+  text = gtk_text_buffer_get_slice (buffer, &start_iter, &end_iter, TRUE);
+  search.pattern = index->pattern;
+  search.text = text;
+  search.length = search.end = strlen (text);
+  if (index->pattern->regex != NULL)
+    search.deadline = g_get_monotonic_time () + REGEX_UPDATE_TIME_BUDGET;
+
+  found = mousepad_search_scan (&search);
+  g_free (text);
+
+  if (search.too_expensive)
+    {
+      g_array_unref (matches);
+      g_array_unref (found);
+      return FALSE;
+    }
+
+  /* replace the matches intersecting the region, and shift those after it */
+  new_matches = g_array_sized_new (FALSE, FALSE, sizeof (MousepadSearchMatch), matches->len + found->len);
+  for (i = 0; i < matches->len && (match = &g_array_index (matches, MousepadSearchMatch, i))->end <= start; i++)
+    g_array_append_val (new_matches, *match);
+
+  for (n = 0; n < found->len; n++)
+    {
+      new_match = g_array_index (found, MousepadSearchMatch, n);
+      new_match.start += start;
+      new_match.end += start;
+      g_array_append_val (new_matches, new_match);
+    }
+
+  for (; i < matches->len; i++)
+    {
+      new_match = g_array_index (matches, MousepadSearchMatch, i);
+      if (new_match.start >= old_end)
+        {
+          new_match.start += delta;
+          new_match.end += delta;
+          g_array_append_val (new_matches, new_match);
+        }
+    }
+
+  /* split the blocks again */
+  index->n_chars += delta;
+  index->n_matches = index->n_matches - matches->len + new_matches->len;
+  mousepad_search_index_split (index, first, last - first + 1, new_matches, first_start,
+                               n_chars + delta, n_before);
+
+  g_array_unref (matches);
+  g_array_unref (new_matches);
+  g_array_unref (found);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_search_replace_add (MousepadSearchReplace *replace,
+                             const gchar *match,
+                             const gchar *match_end,
+                             const gchar *text,
+                             gssize length)
+{
+  MousepadSearchEdits *edits = replace->edits;
+  MousepadSearchEdit *edit, new_edit;
+
+  replace->n_chars += mousepad_search_count_chars (replace->counted, match);
+  replace->counted = match;
+
+  /* extend the last edit if this match follows it immediately, otherwise start a new one:
+   * the text between two matches is never replaced, so as not to touch marks and tags there */
+  if (edits->edits->len > 0 && match == replace->copied)
+    edit = &g_array_index (edits->edits, MousepadSearchEdit, edits->edits->len - 1);
+  else
+    {
+      new_edit.start = replace->n_chars;
+      new_edit.offset = edits->text->len;
+      g_array_append_val (edits->edits, new_edit);
+      edit = &g_array_index (edits->edits, MousepadSearchEdit, edits->edits->len - 1);
+    }
+
+  g_string_append_len (edits->text, text, length);
+
+  replace->n_chars += mousepad_search_count_chars (match, match_end);
+  replace->counted = replace->copied = match_end;
+  edit->end = replace->n_chars;
+  edit->length = edits->text->len - edit->offset;
+  edits->n_replaced++;
+}
+
+
+
+static void
+mousepad_search_replace_regex (GMatchInfo *info,
+                               const gchar *match,
+                               const gchar *match_end,
+                               gpointer data)
+{
+  MousepadSearchReplace *replace = data;
+
+  /* without references, the replacement only needs to be expanded once (for escapes) */
+  if (replace->has_references || replace->expanded == NULL)
+    {
+      g_free (replace->expanded);
+      replace->expanded = g_match_info_expand_references (info, replace->replacement, NULL);
+    }
+
+  mousepad_search_replace_add (replace, match, match_end, replace->expanded, -1);
+}
+
+
+
+static void
+mousepad_search_replace_thread (GTask *task,
+                                gpointer source_object,
+                                gpointer task_data,
+                                GCancellable *cancellable)
+{
+  MousepadSearch *search = task_data;
+  MousepadSearchReplace replace = { 0 };
+  const gchar *p, *match, *match_end, *end = search->text + search->end;
+  guint n = 0;
+
+  replace.edits = g_new0 (MousepadSearchEdits, 1);
+  replace.edits->edits = g_array_new (FALSE, FALSE, sizeof (MousepadSearchEdit));
+  replace.edits->text = g_string_new (NULL);
+  replace.copied = replace.counted = search->text + search->start;
+
+  /* a single sequential pass, as for gtk_source_search_context_replace_all() */
+  if (search->pattern->regex != NULL)
+    {
+      replace.replacement = search->replacement;
+      g_regex_check_replacement (search->replacement, &replace.has_references, NULL);
+
+      search->deadline = g_get_monotonic_time () + MOUSEPAD_SEARCH_REGEX_TIME_BUDGET;
+      mousepad_search_regex_foreach (search, search->start, search->end,
+                                     mousepad_search_replace_regex, &replace);
+      g_free (replace.expanded);
+    }
+  else
+    {
+      for (p = search->text + search->start;
+           (match = mousepad_search_next (search, p, end, &match_end)) != NULL;
+           p = match_end)
+        {
+          if (++n % 1024 == 0 && g_cancellable_is_cancelled (cancellable))
+            break;
+
+          mousepad_search_replace_add (&replace, match, match_end, search->replacement, -1);
+        }
+    }
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      mousepad_search_edits_free (replace.edits);
+      return;
+    }
+
+  /* don't replace only some of the matches */
+  if (search->too_expensive)
+    {
+      mousepad_search_edits_free (replace.edits);
+      mousepad_search_return_too_expensive (task);
+      return;
+    }
+
+  g_task_return_pointer (task, replace.edits, (GDestroyNotify) mousepad_search_edits_free);
+}
+
+
+
+/**
+ * mousepad_search_replace_async:
+ * @text: the valid UTF-8 text to search in, which must not be modified during the operation.
+ * @start: the byte offset in @text where to start replacing, on a character boundary.
+ * @end: the byte offset in @text where to stop replacing, on a character boundary, or -1
+ *       for the end of @text.
+ * @pattern: the text or regex to search for, see mousepad_search_supports().
+ * @options: the search options.
+ * @replacement: the replacement text, with references for regex searches.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: a #GAsyncReadyCallback to call when the operation is complete.
+ * @user_data: the data to pass to @callback.
+ *
+ * Computes the replacement of all the matches of @pattern in @text between @start and @end
+ * by @replacement, as gtk_source_search_context_replace_all() would do it, in a single pass
+ * on a worker thread. The result is a set of edits, one per match except for adjacent
+ * matches which are coalesced, to be applied in reverse order, and whose character offsets
+ * are relative to @start. Regexes which are too expensive are given up as for
+ * mousepad_search_async(), without any edit.
+ **/
+void
+mousepad_search_replace_async (GBytes *text,
+                               gsize start,
+                               gssize end,
+                               const gchar *pattern,
+                               MousepadSearchOptions options,
+                               const gchar *replacement,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+  MousepadSearch *search;
+  GTask *task;
+  GError *error = NULL;
+
+  g_return_if_fail (text != NULL);
+  g_return_if_fail (mousepad_search_supports (pattern, options));
+  g_return_if_fail (replacement != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  search = mousepad_search_new (text, start, end, cancellable);
+  search->replacement = g_strdup (replacement);
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mousepad_search_replace_async);
+  g_task_set_task_data (task, search, mousepad_search_free);
+
+  /* invalid regexes and replacements are reported right away */
+  search->pattern = mousepad_search_pattern_new (pattern, options, &error);
+  if (search->pattern == NULL
+      || (search->pattern->regex != NULL && !g_regex_check_replacement (replacement, NULL, &error)))
+    g_task_return_error (task, error);
+  else
+    g_task_run_in_thread (task, mousepad_search_replace_thread);
+
+  g_object_unref (task);
+}
+
+
+
+/**
+ * mousepad_search_replace_finish:
+ * @result: a #GAsyncResult.
+ * @error: return location for a #GError, or %NULL.
+ *
+ * Finishes an operation started with mousepad_search_replace_async().
+ *
+ * Return value: (transfer full): the edits to apply, to be freed with
+ *               mousepad_search_edits_free(), or %NULL if the operation was cancelled,
+ *               the regex is too expensive or the regex or the replacement is invalid.
+ **/
+MousepadSearchEdits *
+mousepad_search_replace_finish (GAsyncResult *result,
+                                GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+
+
+void
+mousepad_search_edits_free (MousepadSearchEdits *edits)
+{
+  g_array_unref (edits->edits);
+  g_string_free (edits->text, TRUE);
+  g_free (edits);
+}
+
+
+
+/**
+ * mousepad_search_edits_apply:
+ * @edits: a #MousepadSearchEdits.
+ * @buffer: a #GtkTextBuffer.
+ * @offset: the character offset in @buffer of the text the edits were computed on.
+ *
+ * Applies @edits to @buffer in reverse order, so that their offsets remain valid. Grouping
+ * them into a single undoable action is left to the caller.
+ *
+ * Return value: the number of characters added to the text, negative if it was shortened.
+ **/
+gint
+mousepad_search_edits_apply (MousepadSearchEdits *edits,
+                             GtkTextBuffer *buffer,
+                             gint offset)
+{
+  MousepadSearchEdit *edit;
+  GtkTextIter start, end;
+  gint delta = 0;
+  guint n;
+
+  for (n = edits->edits->len; n > 0; n--)
+    {
+      edit = &g_array_index (edits->edits, MousepadSearchEdit, n - 1);
+      gtk_text_buffer_get_iter_at_offset (buffer, &start, offset + edit->start);
+      end = start;
+      gtk_text_iter_forward_chars (&end, edit->end - edit->start);
+      gtk_text_buffer_delete (buffer, &start, &end);
+      gtk_text_buffer_insert (buffer, &start, edits->text->str + edit->offset, edit->length);
+      delta += gtk_text_iter_get_offset (&start) - offset - edit->end;
+    }
+
+  return delta;
+}
+
+
+
+/**
+ * mousepad_search_get_regex_cache_stats:
+ * @hits: (out) (optional): return location for the number of regexes taken from the cache.
+ * @misses: (out) (optional): return location for the number of regexes compiled.
+ *
+ * Gets the statistics of the cache of compiled regexes since the program started, e.g. to
+ * check that the regexes of a search in several documents are compiled once.
+ **/
+void
+mousepad_search_get_regex_cache_stats (guint *hits,
+                                       guint *misses)
+{
+  g_mutex_lock (&regex_cache_lock);
+
+  if (hits != NULL)
+    *hits = regex_cache_hits;
+  if (misses != NULL)
+    *misses = regex_cache_misses;
+
+  g_mutex_unlock (&regex_cache_lock);
+}
+
+
+
+void
+mousepad_search_clear_regex_cache (void)
+{
+  g_mutex_lock (&regex_cache_lock);
+
+  g_debug ("Search regexes: %u reused, %u compiled", regex_cache_hits, regex_cache_misses);
+
+  g_queue_clear_full (&regex_cache_queue, (GDestroyNotify) mousepad_search_cached_regex_free);
+  g_clear_pointer (&regex_cache, g_hash_table_destroy);
+
+  g_mutex_unlock (&regex_cache_lock);
+}
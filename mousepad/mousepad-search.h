@@ -0,0 +1,180 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __MOUSEPAD_SEARCH_H__
+#define __MOUSEPAD_SEARCH_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* beyond this time, a regex search is given up as too expensive */
+#define MOUSEPAD_SEARCH_REGEX_TIME_BUDGET (5 * G_TIME_SPAN_SECOND)
+
+/* options of a search engine run, mirroring those of GtkSourceSearchSettings */
+typedef enum
+{
+  MOUSEPAD_SEARCH_CASE_SENSITIVE = 1 << 0,
+  MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES = 1 << 1,
+  MOUSEPAD_SEARCH_REGEX = 1 << 2,
+} MousepadSearchOptions;
+
+/* a match, as character offsets in the searched text */
+typedef struct _MousepadSearchMatch
+{
+  gint start, end;
+} MousepadSearchMatch;
+
+/* the replacement of the characters in [start, end) by 'length' bytes at 'offset' in the
+ * text of a #MousepadSearchEdits */
+typedef struct _MousepadSearchEdit
+{
+  gint start, end;
+  gsize offset, length;
+} MousepadSearchEdit;
+
+/* the result of a replace operation */
+typedef struct _MousepadSearchEdits
+{
+  GArray *edits;
+  GString *text;
+  guint n_replaced;
+} MousepadSearchEdits;
+
+/* the matches of a search, kept up to date as the text is modified */
+typedef struct _MousepadSearchIndex MousepadSearchIndex;
+
+/* a compiled search pattern */
+typedef struct _MousepadSearchPattern MousepadSearchPattern;
+
+MousepadSearchPattern *
+mousepad_search_pattern_new (const gchar *string,
+                             MousepadSearchOptions options,
+                             GError **error);
+
+void
+mousepad_search_pattern_free (MousepadSearchPattern *pattern);
+
+const gchar *
+mousepad_search_pattern_find (MousepadSearchPattern *pattern,
+                              const gchar *text,
+                              gsize length,
+                              const gchar *from,
+                              gint64 deadline,
+                              GCancellable *cancellable,
+                              const gchar **match_end,
+                              GError **error);
+
+gboolean
+mousepad_search_supports (const gchar *pattern,
+                          MousepadSearchOptions options);
+
+gboolean
+mousepad_search_is_pathological (const gchar *pattern,
+                                 MousepadSearchOptions options);
+
+void
+mousepad_search_async (GBytes *text,
+                       gsize start,
+                       gssize end,
+                       const gchar *pattern,
+                       MousepadSearchOptions options,
+                       GCancellable *cancellable,
+                       GAsyncReadyCallback callback,
+                       gpointer user_data);
+
+MousepadSearchIndex *
+mousepad_search_finish (GAsyncResult *result,
+                        GError **error);
+
+void
+mousepad_search_index_free (MousepadSearchIndex *index);
+
+gint
+mousepad_search_index_get_n_chars (MousepadSearchIndex *index);
+
+guint
+mousepad_search_index_get_n_matches (MousepadSearchIndex *index);
+
+void
+mousepad_search_index_get_match (MousepadSearchIndex *index,
+                                 guint n,
+                                 MousepadSearchMatch *match);
+
+gint
+mousepad_search_index_find (MousepadSearchIndex *index,
+                            gint offset,
+                            gboolean backward);
+
+GArray *
+mousepad_search_index_get_range (MousepadSearchIndex *index,
+                                 gint start,
+                                 gint end);
+
+gboolean
+mousepad_search_index_update (MousepadSearchIndex *index,
+                              GtkTextBuffer *buffer,
+                              gint offset,
+                              gint n_removed,
+                              gint n_inserted);
+
+gboolean
+mousepad_search_index_can_refine (MousepadSearchIndex *index,
+                                  const gchar *pattern,
+                                  MousepadSearchOptions options);
+
+void
+mousepad_search_refine_async (MousepadSearchIndex *index,
+                              const gchar *pattern,
+                              MousepadSearchOptions options,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data);
+
+void
+mousepad_search_replace_async (GBytes *text,
+                               gsize start,
+                               gssize end,
+                               const gchar *pattern,
+                               MousepadSearchOptions options,
+                               const gchar *replacement,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data);
+
+MousepadSearchEdits *
+mousepad_search_replace_finish (GAsyncResult *result,
+                                GError **error);
+
+void
+mousepad_search_edits_free (MousepadSearchEdits *edits);
+
+gint
+mousepad_search_edits_apply (MousepadSearchEdits *edits,
+                             GtkTextBuffer *buffer,
+                             gint offset);
+
+void
+mousepad_search_get_regex_cache_stats (guint *hits,
+                                       guint *misses);
+
+void
+mousepad_search_clear_regex_cache (void);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_SEARCH_H__ */
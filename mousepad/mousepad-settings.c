@@ -393,6 +393,25 @@ mousepad_setting_set_enum (const gchar *setting,
 
 
 
+guint
+mousepad_setting_get_flags (const gchar *setting)
+{
+  guint result = 0;
+  const gchar *key_name = NULL;
+  GSettings *settings = NULL;
+
+  g_return_val_if_fail (setting != NULL, 0);
+
+  if (mousepad_settings_store_lookup (settings_store, setting, &key_name, &settings))
+    result = g_settings_get_flags (settings, key_name);
+  else
+    g_warn_if_reached ();
+
+  return result;
+}
+
+
+
 GVariant *
 mousepad_setting_get_variant (const gchar *setting)
 {
@@ -23,6 +23,7 @@ G_BEGIN_DECLS
 
 /* Setting names */
 #define MOUSEPAD_SETTING_DEFAULT_ENCODING "preferences.file.default-encoding"
+#define MOUSEPAD_SETTING_DETECT_ENCODING "preferences.file.detect-encoding"
 #define MOUSEPAD_SETTING_ADD_LAST_EOL "preferences.file.add-last-end-of-line"
 #define MOUSEPAD_SETTING_MAKE_BACKUP "preferences.file.make-backup"
 #define MOUSEPAD_SETTING_MONITOR_CHANGES "preferences.file.monitor-changes"
@@ -30,6 +31,10 @@ G_BEGIN_DECLS
 #define MOUSEPAD_SETTING_AUTO_RELOAD "preferences.file.auto-reload"
 #define MOUSEPAD_SETTING_SESSION_RESTORE "preferences.file.session-restore"
 #define MOUSEPAD_SETTING_AUTOSAVE_TIMER "preferences.file.autosave-timer"
+#define MOUSEPAD_SETTING_LARGE_FILE_SIZE "preferences.file.large-file-size"
+#define MOUSEPAD_SETTING_LARGE_FILE_LINE_LENGTH "preferences.file.large-file-line-length"
+#define MOUSEPAD_SETTING_LARGE_FILE_DISABLED_FEATURES "preferences.file.large-file-disabled-features"
+#define MOUSEPAD_SETTING_ENCODING_TEST_SAMPLE_SIZE "preferences.file.encoding-test-sample-size"
 
 #define MOUSEPAD_SETTING_AUTO_INDENT "preferences.view.auto-indent"
 #define MOUSEPAD_SETTING_FONT "preferences.view.font-name"
@@ -189,6 +194,9 @@ void
 mousepad_setting_set_enum (const gchar *setting,
                            gint value);
 
+guint
+mousepad_setting_get_flags (const gchar *setting);
+
 GVariant *
 mousepad_setting_get_variant (const gchar *setting);
 
@@ -219,6 +227,7 @@ mousepad_setting_set_variant (const gchar *setting,
 #define MOUSEPAD_SETTING_GET_STRING(setting) mousepad_setting_get_string (MOUSEPAD_SETTING_##setting)
 #define MOUSEPAD_SETTING_GET_STRV(setting) mousepad_setting_get_strv (MOUSEPAD_SETTING_##setting)
 #define MOUSEPAD_SETTING_GET_ENUM(setting) mousepad_setting_get_enum (MOUSEPAD_SETTING_##setting)
+#define MOUSEPAD_SETTING_GET_FLAGS(setting) mousepad_setting_get_flags (MOUSEPAD_SETTING_##setting)
 
 #define MOUSEPAD_SETTING_SET(setting, ...) mousepad_setting_set (MOUSEPAD_SETTING_##setting, __VA_ARGS__)
 #define MOUSEPAD_SETTING_SET_BOOLEAN(setting, value) mousepad_setting_set_boolean (MOUSEPAD_SETTING_##setting, value)
@@ -29,12 +29,20 @@ static gboolean
 mousepad_statusbar_filetype_clicked (GtkWidget *widget,
                                      GdkEventButton *event,
                                      MousepadStatusbar *statusbar);
+static gboolean
+mousepad_statusbar_invalid_clicked (GtkWidget *widget,
+                                    GdkEventButton *event,
+                                    MousepadStatusbar *statusbar);
+static void
+mousepad_statusbar_cancel_clicked (MousepadStatusbar *statusbar);
 
 
 
 enum
 {
+  CANCEL_PROGRESS,
   ENABLE_OVERWRITE,
+  NEXT_INVALID_SEQUENCE,
   LAST_SIGNAL,
 };
 
@@ -45,7 +53,14 @@ struct _MousepadStatusbar
   /* whether overwrite is enabled */
   guint overwrite_enabled : 1;
 
+  /* progress of long operations */
+  GtkWidget *progress;
+  GtkWidget *progress_bar;
+
   /* extra labels in the statusbar */
+  GtkWidget *large_file;
+  GtkWidget *invalid;
+  GtkWidget *invalid_label;
   GtkWidget *language;
   GtkWidget *encoding;
   GtkWidget *position;
@@ -77,12 +92,26 @@ mousepad_statusbar_class_init (MousepadStatusbarClass *klass)
 
   gobject_class = G_OBJECT_CLASS (klass);
 
+  statusbar_signals[CANCEL_PROGRESS] = g_signal_new (I_ ("cancel-progress"),
+                                                     G_TYPE_FROM_CLASS (gobject_class),
+                                                     G_SIGNAL_RUN_LAST,
+                                                     0, NULL, NULL,
+                                                     g_cclosure_marshal_VOID__VOID,
+                                                     G_TYPE_NONE, 0);
+
   statusbar_signals[ENABLE_OVERWRITE] = g_signal_new (I_ ("enable-overwrite"),
                                                       G_TYPE_FROM_CLASS (gobject_class),
                                                       G_SIGNAL_RUN_LAST,
                                                       0, NULL, NULL,
                                                       g_cclosure_marshal_VOID__BOOLEAN,
                                                       G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+
+  statusbar_signals[NEXT_INVALID_SEQUENCE] = g_signal_new (I_ ("next-invalid-sequence"),
+                                                           G_TYPE_FROM_CLASS (gobject_class),
+                                                           G_SIGNAL_RUN_LAST,
+                                                           0, NULL, NULL,
+                                                           g_cclosure_marshal_VOID__VOID,
+                                                           G_TYPE_NONE, 0);
 }
 
 
@@ -90,7 +119,7 @@ mousepad_statusbar_class_init (MousepadStatusbarClass *klass)
 static void
 mousepad_statusbar_init (MousepadStatusbar *statusbar)
 {
-  GtkWidget *ebox, *box, *separator, *label;
+  GtkWidget *ebox, *box, *separator, *label, *button;
   GtkStatusbar *bar = GTK_STATUSBAR (statusbar);
   GList *frame;
 
@@ -109,11 +138,67 @@ mousepad_statusbar_init (MousepadStatusbar *statusbar)
   g_object_unref (label);
   g_list_free (frame);
 
+  /* progress box, shown only during long operations */
+  statusbar->progress = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 4);
+  gtk_box_pack_start (GTK_BOX (box), statusbar->progress, FALSE, TRUE, 0);
+
+  /* progress bar */
+  statusbar->progress_bar = gtk_progress_bar_new ();
+  gtk_widget_set_valign (statusbar->progress_bar, GTK_ALIGN_CENTER);
+  gtk_box_pack_start (GTK_BOX (statusbar->progress), statusbar->progress_bar, FALSE, TRUE, 0);
+  gtk_widget_show (statusbar->progress_bar);
+
+  /* cancel button */
+  button = gtk_button_new_from_icon_name ("process-stop-symbolic", GTK_ICON_SIZE_MENU);
+  gtk_button_set_relief (GTK_BUTTON (button), GTK_RELIEF_NONE);
+  gtk_widget_set_tooltip_text (button, _("Cancel"));
+  g_signal_connect_swapped (button, "clicked",
+                            G_CALLBACK (mousepad_statusbar_cancel_clicked), statusbar);
+  gtk_box_pack_start (GTK_BOX (statusbar->progress), button, FALSE, FALSE, 0);
+  gtk_widget_show (button);
+
   /* separator */
   separator = gtk_separator_new (GTK_ORIENTATION_VERTICAL);
   gtk_box_pack_start (GTK_BOX (box), separator, FALSE, FALSE, 0);
   gtk_widget_show (separator);
 
+  /* large file mode box, shown only for large files */
+  statusbar->large_file = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 8);
+  gtk_box_pack_start (GTK_BOX (box), statusbar->large_file, FALSE, TRUE, 0);
+
+  /* large file mode label */
+  label = gtk_label_new (_("Large file"));
+  gtk_box_pack_start (GTK_BOX (statusbar->large_file), label, FALSE, TRUE, 0);
+  gtk_widget_show (label);
+
+  /* separator */
+  separator = gtk_separator_new (GTK_ORIENTATION_VERTICAL);
+  gtk_box_pack_start (GTK_BOX (statusbar->large_file), separator, FALSE, FALSE, 0);
+  gtk_widget_show (separator);
+
+  /* invalid sequences box, shown only when some were replaced at loading */
+  statusbar->invalid = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 8);
+  gtk_box_pack_start (GTK_BOX (box), statusbar->invalid, FALSE, TRUE, 0);
+
+  /* invalid sequences event box */
+  ebox = gtk_event_box_new ();
+  gtk_box_pack_start (GTK_BOX (statusbar->invalid), ebox, FALSE, TRUE, 0);
+  gtk_event_box_set_visible_window (GTK_EVENT_BOX (ebox), FALSE);
+  gtk_widget_set_tooltip_text (ebox, _("Go to the next invalid byte sequence"));
+  g_signal_connect (ebox, "button-press-event",
+                    G_CALLBACK (mousepad_statusbar_invalid_clicked), statusbar);
+  gtk_widget_show (ebox);
+
+  /* invalid sequences label */
+  statusbar->invalid_label = gtk_label_new (NULL);
+  gtk_container_add (GTK_CONTAINER (ebox), statusbar->invalid_label);
+  gtk_widget_show (statusbar->invalid_label);
+
+  /* separator */
+  separator = gtk_separator_new (GTK_ORIENTATION_VERTICAL);
+  gtk_box_pack_start (GTK_BOX (statusbar->invalid), separator, FALSE, FALSE, 0);
+  gtk_widget_show (separator);
+
   /* language/filetype event box */
   ebox = gtk_event_box_new ();
   gtk_box_pack_start (GTK_BOX (box), ebox, FALSE, TRUE, 0);
@@ -192,6 +277,34 @@ mousepad_statusbar_overwrite_clicked (GtkWidget *widget,
 
 
 
+static gboolean
+mousepad_statusbar_invalid_clicked (GtkWidget *widget,
+                                    GdkEventButton *event,
+                                    MousepadStatusbar *statusbar)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar), FALSE);
+
+  /* only respond on the left button click */
+  if (event->type != GDK_BUTTON_PRESS || event->button != 1)
+    return FALSE;
+
+  g_signal_emit (statusbar, statusbar_signals[NEXT_INVALID_SEQUENCE], 0);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_statusbar_cancel_clicked (MousepadStatusbar *statusbar)
+{
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+
+  g_signal_emit (statusbar, statusbar_signals[CANCEL_PROGRESS], 0);
+}
+
+
+
 static gboolean
 mousepad_statusbar_filetype_clicked (GtkWidget *widget,
                                      GdkEventButton *event,
@@ -251,14 +364,34 @@ mousepad_statusbar_set_cursor_position (MousepadStatusbar *statusbar,
 
 void
 mousepad_statusbar_set_encoding (MousepadStatusbar *statusbar,
-                                 MousepadEncoding encoding)
+                                 MousepadEncoding encoding,
+                                 MousepadEncoding rejected_encoding)
 {
+  gchar *text;
+
   g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
 
   if (encoding == MOUSEPAD_ENCODING_NONE)
     encoding = mousepad_encoding_get_default ();
 
-  gtk_label_set_text (GTK_LABEL (statusbar->encoding), mousepad_encoding_get_charset (encoding));
+  /* not a detected encoding */
+  if (rejected_encoding == MOUSEPAD_ENCODING_NONE)
+    {
+      gtk_label_set_text (GTK_LABEL (statusbar->encoding), mousepad_encoding_get_charset (encoding));
+      gtk_widget_set_tooltip_text (statusbar->encoding, NULL);
+
+      return;
+    }
+
+  /* tell the user the file was not loaded in the encoding it was expected to be in */
+  text = g_strdup_printf (_("%s (detected)"), mousepad_encoding_get_charset (encoding));
+  gtk_label_set_text (GTK_LABEL (statusbar->encoding), text);
+  g_free (text);
+
+  text = g_strdup_printf (_("The file is not valid in %s, its encoding was detected"),
+                          mousepad_encoding_get_charset (rejected_encoding));
+  gtk_widget_set_tooltip_text (statusbar->encoding, text);
+  g_free (text);
 }
 
 
@@ -295,6 +428,36 @@ mousepad_statusbar_set_overwrite (MousepadStatusbar *statusbar,
 }
 
 
+
+void
+mousepad_statusbar_set_progress (MousepadStatusbar *statusbar,
+                                 const gchar *text,
+                                 gdouble fraction)
+{
+  gint id;
+
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+
+  /* drop the previous progress message */
+  id = gtk_statusbar_get_context_id (GTK_STATUSBAR (statusbar), "progress");
+  gtk_statusbar_remove_all (GTK_STATUSBAR (statusbar), id);
+
+  /* the operation is over */
+  if (fraction < 0.0)
+    {
+      gtk_widget_hide (statusbar->progress);
+      return;
+    }
+
+  /* show the progress */
+  if (text != NULL)
+    gtk_statusbar_push (GTK_STATUSBAR (statusbar), id, text);
+
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (statusbar->progress_bar), MIN (fraction, 1.0));
+  gtk_widget_show (statusbar->progress);
+}
+
+
 void
 mousepad_statusbar_push_tooltip (MousepadStatusbar *statusbar,
                                  const gchar *tooltip)
@@ -320,3 +483,66 @@ mousepad_statusbar_pop_tooltip (MousepadStatusbar *statusbar)
   id = gtk_statusbar_get_context_id (GTK_STATUSBAR (statusbar), "tooltip");
   gtk_statusbar_pop (GTK_STATUSBAR (statusbar), id);
 }
+
+
+
+void
+mousepad_statusbar_set_large_file (MousepadStatusbar *statusbar,
+                                   MousepadLargeFileFeatures features)
+{
+  GString *tooltip;
+
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+
+  /* not in large file mode */
+  if (features == 0)
+    {
+      gtk_widget_hide (statusbar->large_file);
+      return;
+    }
+
+  /* list the features turned off in the tooltip */
+  tooltip = g_string_new (_("Large file mode, the following features are turned off:"));
+  if (features & MOUSEPAD_LARGE_FILE_SYNTAX_HIGHLIGHTING)
+    g_string_append_printf (tooltip, "\n- %s", _("Syntax highlighting"));
+  if (features & MOUSEPAD_LARGE_FILE_MATCH_BRACES)
+    g_string_append_printf (tooltip, "\n- %s", _("Matching braces"));
+  if (features & MOUSEPAD_LARGE_FILE_HIGHLIGHT_ALL)
+    g_string_append_printf (tooltip, "\n- %s", _("Search highlight"));
+  if (features & MOUSEPAD_LARGE_FILE_SPELL_CHECKING)
+    g_string_append_printf (tooltip, "\n- %s", _("Spell checking"));
+  if (features & MOUSEPAD_LARGE_FILE_WORD_WRAP)
+    g_string_append_printf (tooltip, "\n- %s", _("Word wrap"));
+  if (features & MOUSEPAD_LARGE_FILE_LANGUAGE_GUESSING)
+    g_string_append_printf (tooltip, "\n- %s", _("Filetype detection"));
+
+  gtk_widget_set_tooltip_text (statusbar->large_file, tooltip->str);
+  gtk_widget_show (statusbar->large_file);
+
+  g_string_free (tooltip, TRUE);
+}
+
+
+
+void
+mousepad_statusbar_set_invalid_sequences (MousepadStatusbar *statusbar,
+                                          guint n_sequences)
+{
+  gchar *label;
+
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+
+  /* no invalid sequence was replaced */
+  if (n_sequences == 0)
+    {
+      gtk_widget_hide (statusbar->invalid);
+      return;
+    }
+
+  label = g_strdup_printf (ngettext ("%u invalid sequence", "%u invalid sequences", n_sequences),
+                           n_sequences);
+  gtk_label_set_text (GTK_LABEL (statusbar->invalid_label), label);
+  gtk_widget_show (statusbar->invalid);
+
+  g_free (label);
+}
@@ -18,6 +18,7 @@
 #define __MOUSEPAD_STATUSBAR_H__
 
 #include "mousepad-encoding.h"
+#include "mousepad-file.h"
 
 #include <gtk/gtk.h>
 #include <gtksourceview/gtksource.h>
@@ -38,7 +39,8 @@ mousepad_statusbar_set_cursor_position (MousepadStatusbar *statusbar,
 
 void
 mousepad_statusbar_set_encoding (MousepadStatusbar *statusbar,
-                                 MousepadEncoding encoding);
+                                 MousepadEncoding encoding,
+                                 MousepadEncoding rejected_encoding);
 
 void
 mousepad_statusbar_set_language (MousepadStatusbar *statusbar,
@@ -48,6 +50,19 @@ void
 mousepad_statusbar_set_overwrite (MousepadStatusbar *statusbar,
                                   gboolean overwrite);
 
+void
+mousepad_statusbar_set_large_file (MousepadStatusbar *statusbar,
+                                   MousepadLargeFileFeatures features);
+
+void
+mousepad_statusbar_set_invalid_sequences (MousepadStatusbar *statusbar,
+                                          guint n_sequences);
+
+void
+mousepad_statusbar_set_progress (MousepadStatusbar *statusbar,
+                                 const gchar *text,
+                                 gdouble fraction);
+
 void
 mousepad_statusbar_push_tooltip (MousepadStatusbar *statusbar,
                                  const gchar *tooltip);
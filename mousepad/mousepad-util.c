@@ -15,6 +15,7 @@
  */
 
 #include "mousepad-private.h"
+#include "mousepad-search.h"
 #include "mousepad-settings.h"
 #include "mousepad-util.h"
 
@@ -318,6 +319,50 @@ mousepad_util_entry_error (GtkWidget *widget,
 
 
 
+void
+mousepad_util_entry_check_pattern (GtkWidget *widget)
+{
+  MousepadSearchOptions options = 0;
+  GtkEntryIconPosition position;
+  const gchar *icon_name;
+
+  g_return_if_fail (GTK_IS_ENTRY (widget));
+
+  /* a search entry has its own secondary icon, to clear it */
+  if (GTK_IS_SEARCH_ENTRY (widget))
+    {
+      position = GTK_ENTRY_ICON_PRIMARY;
+      icon_name = "edit-find-symbolic";
+    }
+  else
+    {
+      position = GTK_ENTRY_ICON_SECONDARY;
+      icon_name = NULL;
+    }
+
+  if (MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_MATCH_CASE))
+    options |= MOUSEPAD_SEARCH_CASE_SENSITIVE;
+  if (MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_ENABLE_REGEX))
+    options |= MOUSEPAD_SEARCH_REGEX;
+
+  /* warn about a regex which is likely to be too expensive to search for */
+  if (mousepad_search_is_pathological (gtk_entry_get_text (GTK_ENTRY (widget)), options))
+    {
+      gtk_entry_set_icon_from_icon_name (GTK_ENTRY (widget), position, "dialog-warning-symbolic");
+      gtk_entry_set_icon_tooltip_text (GTK_ENTRY (widget), position,
+                                       _("Nested or overlapping repetitions, e.g. \"(a+)+\", "
+                                         "may make this regular expression too expensive "
+                                         "to search for"));
+    }
+  else
+    {
+      gtk_entry_set_icon_from_icon_name (GTK_ENTRY (widget), position, icon_name);
+      gtk_entry_set_icon_tooltip_text (GTK_ENTRY (widget), position, NULL);
+    }
+}
+
+
+
 gchar *
 mousepad_util_get_selection (GtkTextBuffer *buffer)
 {
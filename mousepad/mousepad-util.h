@@ -58,6 +58,9 @@ void
 mousepad_util_entry_error (GtkWidget *widget,
                            gboolean error);
 
+void
+mousepad_util_entry_check_pattern (GtkWidget *widget);
+
 gchar *
 mousepad_util_get_selection (GtkTextBuffer *buffer);
 
@@ -119,7 +119,11 @@ struct _MousepadView
   GtkSourceSpaceLocationFlags space_location_flags;
   gboolean show_line_endings;
   gchar *color_scheme;
+  gboolean word_wrap;
   gboolean match_braces;
+
+  /* features turned off in large file mode, overriding the above settings */
+  MousepadLargeFileFeatures disabled_features;
 };
 
 
@@ -244,8 +248,11 @@ mousepad_view_buffer_changed (MousepadView *view,
         }
 
       gtk_source_buffer_set_style_scheme (buffer, scheme);
-      gtk_source_buffer_set_highlight_syntax (buffer, enable_highlight);
-      gtk_source_buffer_set_highlight_matching_brackets (buffer, view->match_braces);
+      gtk_source_buffer_set_highlight_syntax (
+        buffer, enable_highlight
+                  && !(view->disabled_features & MOUSEPAD_LARGE_FILE_SYNTAX_HIGHLIGHTING));
+      gtk_source_buffer_set_highlight_matching_brackets (
+        buffer, view->match_braces && !(view->disabled_features & MOUSEPAD_LARGE_FILE_MATCH_BRACES));
     }
 }
 
@@ -287,7 +294,9 @@ mousepad_view_init (MousepadView *view)
   view->space_location_flags = GTK_SOURCE_SPACE_LOCATION_ALL;
   view->show_line_endings = FALSE;
   view->color_scheme = g_strdup ("none");
+  view->word_wrap = FALSE;
   view->match_braces = FALSE;
+  view->disabled_features = 0;
 
   /* make sure any buffers set on the view get the color scheme applied to them */
   g_signal_connect (view, "notify::buffer",
@@ -1561,8 +1570,11 @@ mousepad_view_set_word_wrap (MousepadView *view,
 {
   g_return_if_fail (MOUSEPAD_IS_VIEW (view));
 
+  view->word_wrap = enabled;
+
   gtk_text_view_set_wrap_mode (GTK_TEXT_VIEW (view),
-                               enabled ? GTK_WRAP_WORD_CHAR : GTK_WRAP_NONE);
+                               enabled && !(view->disabled_features & MOUSEPAD_LARGE_FILE_WORD_WRAP)
+                                 ? GTK_WRAP_WORD_CHAR : GTK_WRAP_NONE);
 }
 
 
@@ -1577,3 +1589,18 @@ mousepad_view_set_match_braces (MousepadView *view,
 
   mousepad_view_buffer_changed (view, NULL, NULL);
 }
+
+
+
+void
+mousepad_view_set_disabled_features (MousepadView *view,
+                                     MousepadLargeFileFeatures features)
+{
+  g_return_if_fail (MOUSEPAD_IS_VIEW (view));
+
+  view->disabled_features = features;
+
+  /* apply the settings again, now overridden or not */
+  mousepad_view_set_word_wrap (view, view->word_wrap);
+  mousepad_view_buffer_changed (view, NULL, NULL);
+}
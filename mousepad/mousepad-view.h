@@ -17,6 +17,8 @@
 #ifndef __MOUSEPAD_VIEW_H__
 #define __MOUSEPAD_VIEW_H__
 
+#include "mousepad-file.h"
+
 #include <gtksourceview/gtksource.h>
 
 G_BEGIN_DECLS
@@ -53,6 +55,10 @@ mousepad_view_duplicate (MousepadView *view);
 gint
 mousepad_view_get_selection_length (MousepadView *view);
 
+void
+mousepad_view_set_disabled_features (MousepadView *view,
+                                     MousepadLargeFileFeatures features);
+
 G_END_DECLS
 
 #endif /* !__MOUSEPAD_VIEW_H__ */
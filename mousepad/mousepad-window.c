@@ -19,6 +19,7 @@
 #include "mousepad-dialogs.h"
 #include "mousepad-document.h"
 #include "mousepad-encoding-dialog.h"
+#include "mousepad-find-in-files.h"
 #include "mousepad-history.h"
 #include "mousepad-marshal.h"
 #include "mousepad-print.h"
@@ -116,6 +117,44 @@ mousepad_window_tool_item_leave_event (GtkWidget *tool_item,
                                        MousepadWindow *window);
 
 /* window functions */
+static void
+mousepad_window_update_actions (MousepadWindow *window);
+static void
+mousepad_window_set_busy (MousepadWindow *window,
+                          gboolean busy);
+static void
+mousepad_window_cancel_progress (MousepadWindow *window);
+static void
+mousepad_window_set_progress (MousepadWindow *window,
+                              MousepadFile *file,
+                              gboolean saving,
+                              gdouble fraction);
+static void
+mousepad_window_load_progress (MousepadFile *file,
+                               gdouble fraction,
+                               MousepadWindow *window);
+static gint
+mousepad_window_load_file (MousepadWindow *window,
+                           MousepadDocument *document,
+                           gint line,
+                           gint column,
+                           gboolean must_exist,
+                           gboolean ignore_bom,
+                           gboolean make_valid,
+                           GError **error);
+static void
+mousepad_window_save_progress (MousepadFile *file,
+                               gdouble fraction,
+                               MousepadWindow *window);
+static void
+mousepad_window_save_ready (GObject *object,
+                            GAsyncResult *result,
+                            gpointer data);
+static gboolean
+mousepad_window_save_file (MousepadWindow *window,
+                           MousepadFile *file,
+                           gboolean forced,
+                           GError **error);
 static gboolean
 mousepad_window_open_file (MousepadWindow *window,
                            GFile *file,
@@ -185,6 +224,14 @@ mousepad_window_readonly_changed (MousepadFile *file,
                                   gboolean readonly,
                                   MousepadWindow *window);
 static void
+mousepad_window_large_file_changed (MousepadFile *file,
+                                    gboolean large,
+                                    MousepadWindow *window);
+static void
+mousepad_window_invalid_sequences_changed (MousepadFile *file,
+                                           guint n_sequences,
+                                           MousepadWindow *window);
+static void
 mousepad_window_modified_changed (GtkTextBuffer *buffer,
                                   MousepadWindow *window);
 static void
@@ -268,6 +315,14 @@ mousepad_window_search_completed (MousepadDocument *document,
                                   MousepadSearchFlags flags,
                                   MousepadWindow *window);
 static void
+mousepad_window_multi_search_reset (MousepadWindow *window,
+                                    const gchar *string,
+                                    const gchar *replacement,
+                                    MousepadSearchFlags flags);
+static void
+mousepad_window_multi_search_remove (MousepadWindow *window,
+                                     MousepadDocument *document);
+static void
 mousepad_window_hide_search_bar (MousepadWindow *window);
 
 /* actions */
@@ -444,6 +499,10 @@ mousepad_window_action_replace (GSimpleAction *action,
                                 GVariant *value,
                                 gpointer data);
 static void
+mousepad_window_action_find_in_files (GSimpleAction *action,
+                                      GVariant *value,
+                                      gpointer data);
+static void
 mousepad_window_action_go_to_position (GSimpleAction *action,
                                        GVariant *value,
                                        gpointer data);
@@ -522,6 +581,21 @@ mousepad_window_action_about (GSimpleAction *action,
 
 
 
+/* a search in all documents: the number of matches per document, -1 while its search is
+ * running, aggregated into a single result once no search is pending; the documents are
+ * searched one at a time when idle, so as not to take all their snapshots at once */
+typedef struct _MousepadWindowSearch
+{
+  gchar *string, *replacement;
+  MousepadSearchFlags flags;
+  GHashTable *n_matches;
+  gint total;
+  guint n_pending;
+  GQueue queued;
+  guint queue_id;
+  GCancellable *cancellable;
+} MousepadWindowSearch;
+
 struct _MousepadWindow
 {
   GtkApplicationWindow __parent__;
@@ -540,6 +614,7 @@ struct _MousepadWindow
   GtkWidget *search_bar;
   GtkWidget *statusbar;
   GtkWidget *replace_dialog;
+  GtkWidget *find_in_files;
 
   /* contextual gtkmenus created from the application resources */
   GtkWidget *textview_menu;
@@ -552,6 +627,16 @@ struct _MousepadWindow
 
   /* search widgets related */
   gboolean search_widget_visible;
+  MousepadWindowSearch multi_search;
+
+  /* number of files being loaded interactively, and of nested main loops iterated to load
+   * or save a file */
+  gint n_loading;
+  gint n_busy;
+
+  /* file whose loading or saving progress is shown in the statusbar */
+  MousepadFile *progress_file;
+  gboolean progress_saving;
 };
 
 
@@ -633,6 +718,7 @@ static const GActionEntry action_entries[] = {
   { "search.find-next", mousepad_window_action_find_next, NULL, NULL, NULL },
   { "search.find-previous", mousepad_window_action_find_previous, NULL, NULL, NULL },
   { "search.find-and-replace", mousepad_window_action_replace, NULL, NULL, NULL },
+  { "search.find-in-files", mousepad_window_action_find_in_files, NULL, NULL, NULL },
 
   { "search.go-to", mousepad_window_action_go_to_position, NULL, NULL, NULL },
 
@@ -784,6 +870,16 @@ mousepad_window_get_property (GObject *object,
 static void
 mousepad_window_finalize (GObject *object)
 {
+  MousepadWindow *window = MOUSEPAD_WINDOW (object);
+
+  /* cleanup, the idle source having been removed with the window */
+  g_free (window->multi_search.string);
+  g_free (window->multi_search.replacement);
+  g_hash_table_destroy (window->multi_search.n_matches);
+  g_queue_clear (&window->multi_search.queued);
+  if (window->multi_search.cancellable != NULL)
+    g_object_unref (window->multi_search.cancellable);
+
   /* decrease last save location ref count */
   last_save_location_ref_count--;
 
@@ -1229,6 +1325,36 @@ mousepad_window_action_statusbar_overwrite (MousepadWindow *window,
 
 
 
+static void
+mousepad_window_action_statusbar_invalid_sequence (MousepadWindow *window)
+{
+  GtkTextBuffer *buffer;
+  GtkTextIter cursor, iter, end;
+  guint n;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
+
+  /* go to the first invalid sequence after the cursor, or back to the first one */
+  buffer = window->active->buffer;
+  gtk_text_buffer_get_iter_at_mark (buffer, &cursor, gtk_text_buffer_get_insert (buffer));
+  for (n = 0; mousepad_file_get_invalid_sequence (window->active->file, n, NULL, &iter); n++)
+    if (gtk_text_iter_compare (&iter, &cursor) > 0)
+      break;
+
+  if (!mousepad_file_get_invalid_sequence (window->active->file, n, NULL, &iter)
+      && !mousepad_file_get_invalid_sequence (window->active->file, 0, NULL, &iter))
+    return;
+
+  /* select the replacement character and put it on screen */
+  end = iter;
+  gtk_text_iter_forward_char (&end);
+  gtk_text_buffer_select_range (buffer, &end, &iter);
+  mousepad_view_scroll_to_cursor (window->active->textview);
+}
+
+
+
 static void
 mousepad_window_create_statusbar (MousepadWindow *window)
 {
@@ -1257,6 +1383,14 @@ mousepad_window_create_statusbar (MousepadWindow *window)
   g_signal_connect_swapped (window->statusbar, "enable-overwrite",
                             G_CALLBACK (mousepad_window_action_statusbar_overwrite), window);
 
+  /* jump to invalid sequences */
+  g_signal_connect_swapped (window->statusbar, "next-invalid-sequence",
+                            G_CALLBACK (mousepad_window_action_statusbar_invalid_sequence), window);
+
+  /* cancel the loading or saving in progress */
+  g_signal_connect_swapped (window->statusbar, "cancel-progress",
+                            G_CALLBACK (mousepad_window_cancel_progress), window);
+
   /* connect to some signals to keep in sync */
   MOUSEPAD_SETTING_CONNECT_OBJECT (STATUSBAR_VISIBLE, mousepad_window_update_bar_visibility,
                                    window, G_CONNECT_SWAPPED);
@@ -1282,12 +1416,21 @@ mousepad_window_init (MousepadWindow *window)
   window->search_bar = NULL;
   window->statusbar = NULL;
   window->replace_dialog = NULL;
+  window->find_in_files = NULL;
   window->textview_menu = NULL;
   window->tab_menu = NULL;
   window->languages_menu = NULL;
   window->gtkmenu_key = NULL;
   window->offset_key = NULL;
   window->old_style_menu = MOUSEPAD_SETTING_GET_BOOLEAN (OLD_STYLE_MENU);
+  window->n_loading = 0;
+  window->n_busy = 0;
+  window->progress_file = NULL;
+  window->progress_saving = FALSE;
+  window->multi_search.n_matches = g_hash_table_new (NULL, NULL);
+  g_queue_init (&window->multi_search.queued);
+  window->multi_search.queue_id = 0;
+  window->multi_search.cancellable = NULL;
 
   /* increase last save location ref count */
   last_save_location_ref_count++;
@@ -2089,6 +2232,221 @@ admin_mount_finish (GObject *file,
 
 
 
+static void
+mousepad_window_set_busy (MousepadWindow *window,
+                          gboolean busy)
+{
+  GAction *action;
+  guint n;
+
+  /* actions which would free or modify the documents under the feet of a nested main loop
+   * loading or saving a file */
+  static const gchar *action_names[] = {
+    "file.save", "file.save-as", "file.save-all", "file.reload", "file.detach-tab", "file.close-tab",
+  };
+
+  if (busy ? window->n_busy++ > 0 : --window->n_busy > 0)
+    return;
+
+  /* the window may have been destroyed meanwhile */
+  if (!mousepad_is_application_window (window))
+    return;
+
+  for (n = 0; n < G_N_ELEMENTS (action_names); n++)
+    {
+      action = g_action_map_lookup_action (G_ACTION_MAP (window), action_names[n]);
+      g_simple_action_set_enabled (G_SIMPLE_ACTION (action), !busy);
+    }
+
+  /* restore the sensitivity of the actions which depend on the active document */
+  if (!busy)
+    mousepad_window_update_actions (window);
+}
+
+
+
+static void
+mousepad_window_cancel_progress (MousepadWindow *window)
+{
+  /* cancel only the operation whose progress is shown, a file may be loaded while
+   * another one is being saved */
+  if (window->progress_file == NULL)
+    return;
+
+  if (window->progress_saving)
+    g_cancellable_cancel (mousepad_object_get_data (window->progress_file, "save-cancellable"));
+  else
+    mousepad_file_cancel_loading (window->progress_file);
+}
+
+
+
+static void
+mousepad_window_set_progress (MousepadWindow *window,
+                              MousepadFile *file,
+                              gboolean saving,
+                              gdouble fraction)
+{
+  gchar *path, *text;
+
+  /* end of an operation: hide its progress, unless another one has taken over */
+  if (fraction < 0.0)
+    {
+      if (window->progress_file != file || window->progress_saving != saving)
+        return;
+
+      window->progress_file = NULL;
+      mousepad_statusbar_set_progress (MOUSEPAD_STATUSBAR (window->statusbar), NULL, -1.0);
+
+      return;
+    }
+
+  window->progress_file = file;
+  window->progress_saving = saving;
+
+  path = mousepad_util_get_display_path (mousepad_file_get_location (file));
+  text = g_strdup_printf (saving ? _("Saving \"%s\"...") : _("Loading \"%s\"..."), path);
+  mousepad_statusbar_set_progress (MOUSEPAD_STATUSBAR (window->statusbar), text, fraction);
+  g_free (path);
+  g_free (text);
+}
+
+
+
+static void
+mousepad_window_load_progress (MousepadFile *file,
+                               gdouble fraction,
+                               MousepadWindow *window)
+{
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+
+  /* first progress report for this file */
+  if (!mousepad_object_get_data (file, "loading"))
+    {
+      mousepad_object_set_data (file, "loading", GINT_TO_POINTER (TRUE));
+
+      /* prevent any interaction with the documents while the main loop is iterated */
+      if (window->n_loading++ == 0)
+        gtk_widget_set_sensitive (window->notebook, FALSE);
+    }
+
+  mousepad_window_set_progress (window, file, FALSE, fraction);
+}
+
+
+
+static gint
+mousepad_window_load_file (MousepadWindow *window,
+                           MousepadDocument *document,
+                           gint line,
+                           gint column,
+                           gboolean must_exist,
+                           gboolean ignore_bom,
+                           gboolean make_valid,
+                           GError **error)
+{
+  MousepadFile *file = document->file;
+  gint result;
+
+  /* keep the window and the document alive while the main loop is iterated, and prevent
+   * the latter from being saved, reloaded or closed meanwhile */
+  g_object_ref (window);
+  g_object_ref (document);
+  mousepad_window_set_busy (window, TRUE);
+
+  /* show the loading progress in the statusbar, for large files */
+  g_signal_connect (file, "load-progress", G_CALLBACK (mousepad_window_load_progress), window);
+  result = mousepad_file_open (file, line, column, must_exist, ignore_bom, make_valid, error);
+  mousepad_disconnect_by_func (file, mousepad_window_load_progress, window);
+
+  /* the window may have been destroyed during the loading */
+  if (mousepad_object_get_data (file, "loading") && mousepad_is_application_window (window))
+    {
+      mousepad_window_set_progress (window, file, FALSE, -1.0);
+      if (--window->n_loading == 0)
+        gtk_widget_set_sensitive (window->notebook, TRUE);
+    }
+
+  mousepad_object_set_data (file, "loading", NULL);
+  mousepad_window_set_busy (window, FALSE);
+  g_object_unref (document);
+  g_object_unref (window);
+
+  return result;
+}
+
+
+
+static void
+mousepad_window_save_progress (MousepadFile *file,
+                               gdouble fraction,
+                               MousepadWindow *window)
+{
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+
+  mousepad_window_set_progress (window, file, TRUE, fraction);
+}
+
+
+
+static void
+mousepad_window_save_ready (GObject *object,
+                            GAsyncResult *result,
+                            gpointer data)
+{
+  GAsyncResult **save_result = data;
+
+  *save_result = g_object_ref (result);
+}
+
+
+
+static gboolean
+mousepad_window_save_file (MousepadWindow *window,
+                           MousepadFile *file,
+                           gboolean forced,
+                           GError **error)
+{
+  GAsyncResult *result = NULL;
+  GCancellable *cancellable;
+  gboolean succeed;
+
+  /* keep the window and the file alive while the main loop is iterated, and prevent the
+   * document from being saved again, reloaded or closed meanwhile */
+  g_object_ref (window);
+  g_object_ref (file);
+  mousepad_window_set_busy (window, TRUE);
+
+  /* the file is written from a worker thread while the main loop is iterated, so that
+   * the application remains responsive and the document can still be edited */
+  cancellable = g_cancellable_new ();
+  mousepad_object_set_data (file, "save-cancellable", cancellable);
+  g_signal_connect (file, "save-progress", G_CALLBACK (mousepad_window_save_progress), window);
+  mousepad_file_save_async (file, forced, cancellable, mousepad_window_save_ready, &result);
+  while (result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  mousepad_disconnect_by_func (file, mousepad_window_save_progress, window);
+  succeed = mousepad_file_save_finish (file, result, error);
+
+  /* the window may have been destroyed during the saving */
+  if (mousepad_is_application_window (window))
+    mousepad_window_set_progress (window, file, TRUE, -1.0);
+
+  mousepad_object_set_data (file, "save-cancellable", NULL);
+  mousepad_window_set_busy (window, FALSE);
+
+  /* cleanup */
+  g_object_unref (result);
+  g_object_unref (cancellable);
+  g_object_unref (file);
+  g_object_unref (window);
+
+  return succeed;
+}
+
+
+
 static gboolean
 mousepad_window_open_file (MousepadWindow *window,
                            GFile *file,
@@ -2179,8 +2537,8 @@ retry:
   gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
 
   /* read the content into the buffer */
-  result = mousepad_file_open (document->file, line, column, must_exist,
-                               FALSE, user_set_encoding, &error);
+  result = mousepad_window_load_file (window, document, line, column, must_exist,
+                                      FALSE, user_set_encoding, &error);
 
   /* release the lock */
   gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
@@ -2224,9 +2582,10 @@ retry:
       /* something went wrong */
       if (G_LIKELY (error != NULL))
         {
-          /* show the warning */
-          mousepad_dialogs_show_error (GTK_WINDOW (window), error,
-                                       MOUSEPAD_MESSAGE_IO_ERROR_OPEN);
+          /* show the warning, unless the user cancelled the loading */
+          if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            mousepad_dialogs_show_error (GTK_WINDOW (window), error,
+                                         MOUSEPAD_MESSAGE_IO_ERROR_OPEN);
 
           /* cleanup */
           g_error_free (error);
@@ -2363,6 +2722,10 @@ mousepad_window_close_document (MousepadWindow *window,
   g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), FALSE);
   g_return_val_if_fail (MOUSEPAD_IS_DOCUMENT (document), FALSE);
 
+  /* a file is being loaded or saved by a nested main loop */
+  if (window->n_busy > 0)
+    return FALSE;
+
   /* check if the document has been modified or the file deleted */
   modified = gtk_text_buffer_get_modified (document->buffer);
   if (modified
@@ -2844,6 +3207,10 @@ mousepad_window_notebook_switch_page (GtkNotebook *notebook,
 
       /* update the statusbar */
       mousepad_document_send_signals (window->active);
+      mousepad_window_large_file_changed (document->file, mousepad_file_is_large (document->file),
+                                          window);
+      mousepad_window_invalid_sequences_changed (
+        document->file, mousepad_file_get_n_invalid_sequences (document->file), window);
     }
 }
 
@@ -2887,6 +3254,10 @@ mousepad_window_notebook_added (GtkNotebook *notebook,
                     G_CALLBACK (mousepad_window_location_changed), window);
   g_signal_connect (document->file, "readonly-changed",
                     G_CALLBACK (mousepad_window_readonly_changed), window);
+  g_signal_connect (document->file, "large-file-changed",
+                    G_CALLBACK (mousepad_window_large_file_changed), window);
+  g_signal_connect (document->file, "invalid-sequences-changed",
+                    G_CALLBACK (mousepad_window_invalid_sequences_changed), window);
   g_signal_connect (document->textview, "drag-data-received",
                     G_CALLBACK (mousepad_window_drag_data_received), window);
   g_signal_connect (document->textview, "populate-popup",
@@ -2926,10 +3297,15 @@ mousepad_window_notebook_removed (GtkNotebook *notebook,
   mousepad_disconnect_by_func (document->file, mousepad_window_externally_modified, window);
   mousepad_disconnect_by_func (document->file, mousepad_window_location_changed, window);
   mousepad_disconnect_by_func (document->file, mousepad_window_readonly_changed, window);
+  mousepad_disconnect_by_func (document->file, mousepad_window_large_file_changed, window);
+  mousepad_disconnect_by_func (document->file, mousepad_window_invalid_sequences_changed, window);
   mousepad_disconnect_by_func (document->textview, mousepad_window_drag_data_received, window);
   mousepad_disconnect_by_func (document->textview, mousepad_window_menu_textview_popup, window);
   mousepad_disconnect_by_func (document->textview, mousepad_window_enable_edit_actions, window);
 
+  /* forget its result in a search in all documents */
+  mousepad_window_multi_search_remove (window, document);
+
   /* reset the reference to NULL to avoid illegal memory access */
   if (window->previous == document)
     window->previous = NULL;
@@ -3285,6 +3661,36 @@ mousepad_window_readonly_changed (MousepadFile *file,
 
 
 
+static void
+mousepad_window_large_file_changed (MousepadFile *file,
+                                    gboolean large,
+                                    MousepadWindow *window)
+{
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+
+  /* tell the user which features are turned off in large file mode */
+  if (window->statusbar && window->active != NULL && window->active->file == file)
+    mousepad_statusbar_set_large_file (MOUSEPAD_STATUSBAR (window->statusbar),
+                                       mousepad_file_get_disabled_features (file));
+}
+
+
+
+static void
+mousepad_window_invalid_sequences_changed (MousepadFile *file,
+                                           guint n_sequences,
+                                           MousepadWindow *window)
+{
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+
+  /* let the user jump to the invalid sequences replaced at loading */
+  if (window->statusbar && window->active != NULL && window->active->file == file)
+    mousepad_statusbar_set_invalid_sequences (MOUSEPAD_STATUSBAR (window->statusbar),
+                                              n_sequences);
+}
+
+
+
 static void
 mousepad_window_modified_changed (GtkTextBuffer *buffer,
                                   MousepadWindow *window)
@@ -3376,7 +3782,8 @@ mousepad_window_encoding_changed (MousepadDocument *document,
 
   /* update the encoding shown in the statusbar */
   if (window->statusbar && window->active == document)
-    mousepad_statusbar_set_encoding (MOUSEPAD_STATUSBAR (window->statusbar), encoding);
+    mousepad_statusbar_set_encoding (MOUSEPAD_STATUSBAR (window->statusbar), encoding,
+                                     mousepad_file_get_rejected_encoding (document->file));
 }
 
 
@@ -4224,6 +4631,125 @@ mousepad_window_drag_data_received (GtkWidget *widget,
 /**
  * Find and replace
  **/
+static void
+mousepad_window_multi_search_cancelled (GCancellable *cancellable,
+                                        MousepadWindow *window)
+{
+  MousepadWindowSearch *search = &window->multi_search;
+  GHashTableIter iter;
+  gpointer document, n_matches;
+
+  /* don't search the remaining documents */
+  if (search->queue_id != 0)
+    {
+      g_source_remove (search->queue_id);
+      search->queue_id = 0;
+    }
+
+  /* stop the running searches, except in the active document, which is also that of the
+   * search bar */
+  g_hash_table_iter_init (&iter, search->n_matches);
+  while (g_hash_table_iter_next (&iter, &document, &n_matches))
+    if (GPOINTER_TO_INT (n_matches) == -1 && document != window->active
+        && g_queue_find (&search->queued, document) == NULL)
+      mousepad_document_cancel_search (document);
+
+  g_queue_clear (&search->queued);
+}
+
+
+
+static void
+mousepad_window_multi_search_reset (MousepadWindow *window,
+                                    const gchar *string,
+                                    const gchar *replacement,
+                                    MousepadSearchFlags flags)
+{
+  MousepadWindowSearch *search = &window->multi_search;
+
+  /* supersede the previous search, if any */
+  if (search->cancellable != NULL)
+    {
+      g_cancellable_cancel (search->cancellable);
+      g_clear_object (&search->cancellable);
+    }
+
+  if (string != NULL)
+    {
+      search->cancellable = g_cancellable_new ();
+      g_cancellable_connect (search->cancellable, G_CALLBACK (mousepad_window_multi_search_cancelled),
+                             window, NULL);
+    }
+
+  g_free (search->string);
+  g_free (search->replacement);
+  search->string = g_strdup (string);
+  search->replacement = g_strdup (replacement);
+  search->flags = flags;
+  g_hash_table_remove_all (search->n_matches);
+  search->total = 0;
+  search->n_pending = 0;
+}
+
+
+
+static gboolean
+mousepad_window_multi_search_idle (gpointer data)
+{
+  MousepadWindow *window = data;
+  MousepadWindowSearch *search = &window->multi_search;
+  MousepadDocument *document;
+
+  /* search the next document, on a snapshot of its buffer taken now */
+  document = g_queue_pop_head (&search->queued);
+  if (!g_queue_is_empty (&search->queued))
+    {
+      mousepad_document_search (document, search->string, search->replacement, search->flags);
+      return TRUE;
+    }
+
+  search->queue_id = 0;
+  mousepad_document_search (document, search->string, search->replacement, search->flags);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_window_multi_search_emit (MousepadWindow *window,
+                                   MousepadSearchFlags flags)
+{
+  MousepadWindowSearch *search = &window->multi_search;
+
+  /* send the final result, only relevant for the replace dialog */
+  g_signal_emit (window, window_signals[SEARCH_COMPLETED], 0, 0, search->total, search->string,
+                 flags | MOUSEPAD_SEARCH_FLAGS_AREA_ALL_DOCUMENTS);
+}
+
+
+
+static void
+mousepad_window_multi_search_remove (MousepadWindow *window,
+                                     MousepadDocument *document)
+{
+  MousepadWindowSearch *search = &window->multi_search;
+  gpointer n_matches;
+
+  if (!g_hash_table_lookup_extended (search->n_matches, document, NULL, &n_matches))
+    return;
+
+  g_hash_table_remove (search->n_matches, document);
+  g_queue_remove (&search->queued, document);
+  if (GPOINTER_TO_INT (n_matches) != -1)
+    search->total -= GPOINTER_TO_INT (n_matches);
+  /* the search is complete if this document was the last one to wait for */
+  else if (--search->n_pending == 0 && gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)) > 0)
+    mousepad_window_multi_search_emit (window, search->flags);
+}
+
+
+
 static void
 mousepad_window_search (MousepadWindow *window,
                         MousepadSearchFlags flags,
@@ -4238,13 +4764,29 @@ mousepad_window_search (MousepadWindow *window,
   /* multi-document mode */
   if (flags & MOUSEPAD_SEARCH_FLAGS_AREA_ALL_DOCUMENTS)
     {
+      /* supersede the previous search in all documents, whose late results will be ignored */
+      mousepad_window_multi_search_reset (window, string, replacement, flags);
+
+      /* all the documents are waited for before any of them is searched, since they may
+       * report their result right away */
       n_docs = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook));
       for (n = 0; n < n_docs; n++)
         {
-          /* search in the nth document */
           document = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), n);
-          mousepad_document_search (MOUSEPAD_DOCUMENT (document), string, replacement, flags);
+          g_hash_table_insert (window->multi_search.n_matches, document, GINT_TO_POINTER (-1));
+          if (document != GTK_WIDGET (window->active))
+            g_queue_push_tail (&window->multi_search.queued, document);
         }
+
+      window->multi_search.n_pending = n_docs;
+
+      /* the searches run in parallel, each document being searched on a snapshot of its
+       * buffer by the search engine: the active document first, the others when idle */
+      if (!g_queue_is_empty (&window->multi_search.queued))
+        window->multi_search.queue_id = g_idle_add (mousepad_window_multi_search_idle,
+                                                    mousepad_util_source_autoremove (window));
+
+      mousepad_document_search (window->active, string, replacement, flags);
     }
   /* search in the active document */
   else
@@ -4261,11 +4803,8 @@ mousepad_window_search_completed (MousepadDocument *document,
                                   MousepadSearchFlags flags,
                                   MousepadWindow *window)
 {
-  static GList *documents = NULL, *n_matches_docs = NULL;
-  static gchar *multi_string = NULL;
-  static gint n_matches = 0, n_documents = 0;
-  GList *up_doc, *up_match;
-  gint index;
+  MousepadWindowSearch *search = &window->multi_search;
+  gpointer n_matches;
 
   /* always send the active document result, although it will only be relevant for the
    * search bar if the multi-document mode is active */
@@ -4279,81 +4818,28 @@ mousepad_window_search_completed (MousepadDocument *document,
       && MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_REPLACE_ALL)
       && MOUSEPAD_SETTING_GET_UINT (SEARCH_REPLACE_ALL_LOCATION) == 2)
     {
-      /* update the current search string and reset other static variables, or exit if
-       * the search is irrelevant */
-      if (g_strcmp0 (multi_string, string) != 0)
-        {
-          if (flags & MOUSEPAD_SEARCH_FLAGS_AREA_ALL_DOCUMENTS)
-            {
-              g_free (multi_string);
-              multi_string = g_strdup (string);
-              g_list_free (documents);
-              g_list_free (n_matches_docs);
-              documents = NULL;
-              n_matches_docs = NULL;
-              n_documents = 0;
-              n_matches = 0;
-            }
-          else
-            return;
-        }
+      /* exit if the search is irrelevant */
+      if (search->string == NULL || strcmp (search->string, string) != 0)
+        return;
 
-      /* remove obsolete document results */
-      if (documents != NULL)
+      /* update the document result, which may also be a new one, for a document added
+       * after the search started */
+      if (g_hash_table_lookup_extended (search->n_matches, document, NULL, &n_matches))
         {
-          for (up_doc = documents, up_match = n_matches_docs; up_doc != NULL;)
-            if (gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), up_doc->data) == -1)
-              {
-                /* update data */
-                n_documents--;
-                n_matches -= GPOINTER_TO_INT (up_match->data);
-
-                /* remove the result from the list */
-                up_match->data = GINT_TO_POINTER (-1);
-                n_matches_docs = g_list_remove (n_matches_docs, up_match->data);
-                up_match = n_matches_docs;
-
-                /* remove the document from the list */
-                documents = g_list_remove (documents, up_doc->data);
-                up_doc = documents;
-
-                /* complementary exit condition */
-                if (documents == NULL)
-                  break;
-              }
-            /* walk the list */
-            else
-              {
-                up_doc = up_doc->next;
-                up_match = up_match->next;
-              }
+          if (GPOINTER_TO_INT (n_matches) == -1)
+            search->n_pending--;
+          else
+            search->total -= GPOINTER_TO_INT (n_matches);
         }
 
-      /* update an old document result */
-      if (documents != NULL && (index = g_list_index (documents, document)) != -1)
-        {
-          up_match = g_list_nth (n_matches_docs, index);
-          n_matches += n_matches_doc - GPOINTER_TO_INT (up_match->data);
-          up_match->data = GINT_TO_POINTER (n_matches_doc);
-        }
-      /* add a new document result, and wait until all documents have completed their search
-       * to send the final result to the replace dialog */
-      else
-        {
-          /* update lists */
-          documents = g_list_prepend (documents, document);
-          n_matches_docs = g_list_prepend (n_matches_docs, GINT_TO_POINTER (n_matches_doc));
-          n_matches += n_matches_doc;
-          n_documents++;
-        }
+      g_hash_table_insert (search->n_matches, document, GINT_TO_POINTER (n_matches_doc));
+      search->total += n_matches_doc;
 
-      /* exit if all documents have not yet send their result */
-      if (n_documents < gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)))
+      /* wait until all documents have completed their search to send the final result */
+      if (search->n_pending > 0)
         return;
 
-      /* send the final result, only relevant for the replace dialog */
-      g_signal_emit (window, window_signals[SEARCH_COMPLETED], 0, 0, n_matches, string,
-                     flags | MOUSEPAD_SEARCH_FLAGS_AREA_ALL_DOCUMENTS);
+      mousepad_window_multi_search_emit (window, flags);
     }
 
   /* make sure the selection is visible whenever idle */
@@ -4596,6 +5082,14 @@ mousepad_window_action_save (GSimpleAction *action,
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
 
+  /* the action may be activated while a file is being loaded or saved, see
+   * mousepad_window_set_busy() */
+  if (G_UNLIKELY (window->n_busy > 0))
+    {
+      g_action_change_state (G_ACTION (action), g_variant_new_int32 (FALSE));
+      return;
+    }
+
   /* can be a temporary location: don't use mousepad_file_location_is_set() here */
   if (mousepad_file_get_location (document->file) == NULL)
     {
@@ -4607,7 +5101,7 @@ mousepad_window_action_save (GSimpleAction *action,
   else
     {
       /* try to save the file */
-      succeed = mousepad_file_save (document->file, FALSE, &error);
+      succeed = mousepad_window_save_file (window, document->file, FALSE, &error);
 
       /* file has been externally modified */
       if (G_UNLIKELY (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG)))
@@ -4627,7 +5121,7 @@ mousepad_window_action_save (GSimpleAction *action,
 
             case MOUSEPAD_RESPONSE_SAVE:
               /* force to save the document */
-              succeed = mousepad_file_save (document->file, TRUE, &error);
+              succeed = mousepad_window_save_file (window, document->file, TRUE, &error);
               break;
 
             default:
@@ -4664,7 +5158,10 @@ mousepad_window_action_save (GSimpleAction *action,
       /* other kind of error, which may result from the previous exceptions */
       if (G_UNLIKELY (error != NULL))
         {
-          mousepad_dialogs_show_error (GTK_WINDOW (window), error, MOUSEPAD_MESSAGE_IO_ERROR_SAVE);
+          /* the saving was cancelled by the user */
+          if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            mousepad_dialogs_show_error (GTK_WINDOW (window), error, MOUSEPAD_MESSAGE_IO_ERROR_SAVE);
+
           g_error_free (error);
         }
     }
@@ -4694,6 +5191,12 @@ mousepad_window_action_save_as (GSimpleAction *action,
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
 
+  if (G_UNLIKELY (window->n_busy > 0))
+    {
+      g_action_change_state (G_ACTION (action), g_variant_new_int32 (FALSE));
+      return;
+    }
+
   /* increase recursion count */
   max_depth = ++depth;
 
@@ -4768,17 +5271,20 @@ mousepad_window_action_save_all (GSimpleAction *action,
   GError *error = NULL;
   const gchar *action_name;
   gboolean succeed = TRUE;
-  gint current, i, n_docs, page_num;
+  gint current, i, page_num;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
 
+  if (G_UNLIKELY (window->n_busy > 0))
+    return;
+
   /* get the current active tab */
   current = gtk_notebook_get_current_page (GTK_NOTEBOOK (window->notebook));
 
-  /* walk though all the document in the window */
-  n_docs = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook));
-  for (i = 0; i < n_docs; i++)
+  /* walk though all the document in the window: documents may be closed while a file
+   * is being saved */
+  for (i = 0; i < gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)); i++)
     {
       /* get the document */
       document = MOUSEPAD_DOCUMENT (gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), i));
@@ -4792,7 +5298,7 @@ mousepad_window_action_save_all (GSimpleAction *action,
           && !mousepad_file_get_read_only (document->file))
         {
           /* try to save the file */
-          succeed = mousepad_file_save (document->file, FALSE, &error);
+          succeed = mousepad_window_save_file (window, document->file, FALSE, &error);
 
           /* file has been externally modified: add it to a queue */
           if (G_UNLIKELY (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG)))
@@ -4814,8 +5320,9 @@ mousepad_window_action_save_all (GSimpleAction *action,
       /* focus the tab that triggered the problem */
       gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), i);
 
-      /* show the error */
-      mousepad_dialogs_show_error (GTK_WINDOW (window), error, MOUSEPAD_MESSAGE_IO_ERROR_SAVE);
+      /* show the error, unless the saving was cancelled by the user */
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        mousepad_dialogs_show_error (GTK_WINDOW (window), error, MOUSEPAD_MESSAGE_IO_ERROR_SAVE);
 
       /* free error */
       g_error_free (error);
@@ -4876,6 +5383,9 @@ mousepad_window_action_reload (GSimpleAction *action,
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
 
+  if (G_UNLIKELY (window->n_busy > 0))
+    return;
+
   /* ask the user what to do if file is modified and action is not forced */
   if (gtk_text_buffer_get_modified (document->buffer) && !g_variant_get_boolean (value))
     {
@@ -4912,16 +5422,19 @@ mousepad_window_action_reload (GSimpleAction *action,
   gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
 
   /* reload the file */
-  retval = mousepad_file_open (document->file, line, column, TRUE, FALSE, TRUE, &error);
+  retval = mousepad_window_load_file (window, document, line, column,
+                                      TRUE, FALSE, TRUE, &error);
 
   /* release the lock */
   gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
 
   if (G_UNLIKELY (retval != 0))
     {
-      /* show the error */
-      mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to reload the document"));
-      g_error_free (error);
+      /* show the error, unless the user cancelled the reloading */
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to reload the document"));
+
+      g_clear_error (&error);
     }
   else
     {
@@ -4975,6 +5488,9 @@ mousepad_window_action_detach (GSimpleAction *action,
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
 
+  if (G_UNLIKELY (window->n_busy > 0))
+    return;
+
   /* invoke function without cooridinates */
   mousepad_window_notebook_create_window (GTK_NOTEBOOK (window->notebook),
                                           GTK_WIDGET (window->active),
@@ -5010,6 +5526,13 @@ mousepad_window_action_close_window (GSimpleAction *action,
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
 
+  /* the window cannot be closed while a file is being loaded or saved */
+  if (G_UNLIKELY (window->n_busy > 0))
+    {
+      g_action_change_state (G_ACTION (action), g_variant_new_int32 (FALSE));
+      return;
+    }
+
   /* reset action state */
   g_action_change_state (G_ACTION (action), g_variant_new_int32 (TRUE));
 
@@ -5674,6 +6197,9 @@ mousepad_window_replace_dialog_destroy (MousepadWindow *window)
   /* reset the dialog variable */
   window->replace_dialog = NULL;
 
+  /* cancel the pending search in all documents, only relevant for the dialog */
+  mousepad_window_multi_search_reset (window, NULL, NULL, 0);
+
   /* set the window property if no search widget is visible */
   if (window->search_bar == NULL || !gtk_widget_get_visible (window->search_bar))
     g_object_set (window, "search-widget-visible", FALSE, NULL);
@@ -5735,6 +6261,117 @@ mousepad_window_action_replace (GSimpleAction *action,
 
 
 
+static void
+mousepad_window_find_in_files_hide (MousepadWindow *window)
+{
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_FIND_IN_FILES (window->find_in_files));
+
+  /* hide the pane, the results stay listed for the next time */
+  gtk_widget_hide (window->find_in_files);
+
+  /* focus the active document's text view */
+  if (G_LIKELY (window->active != NULL))
+    gtk_widget_grab_focus (window->active->textview);
+}
+
+
+
+static void
+mousepad_window_find_in_files_open_match (MousepadWindow *window,
+                                          GFile *file,
+                                          gint line,
+                                          gint column,
+                                          gint length)
+{
+  GtkTextIter start, end;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+
+  /* open the file or focus its tab, the listed files being valid UTF-8 */
+  if (!mousepad_window_open_file (window, file, MOUSEPAD_ENCODING_UTF_8, line, 0, TRUE)
+      || window->active == NULL)
+    return;
+
+  /* select the match, as far as the file was not changed since the search */
+  gtk_text_buffer_get_iter_at_line (window->active->buffer, &start, line);
+  if (gtk_text_iter_get_chars_in_line (&start) > column)
+    gtk_text_iter_set_line_offset (&start, column);
+  else if (!gtk_text_iter_ends_line (&start))
+    gtk_text_iter_forward_to_line_end (&start);
+
+  end = start;
+  gtk_text_iter_forward_chars (&end, length);
+  gtk_text_buffer_select_range (window->active->buffer, &end, &start);
+
+  /* put the match on screen once the view is realized */
+  g_idle_add (mousepad_view_scroll_to_cursor,
+              mousepad_util_source_autoremove (window->active->textview));
+  gtk_widget_grab_focus (window->active->textview);
+}
+
+
+
+static void
+mousepad_window_action_find_in_files (GSimpleAction *action,
+                                      GVariant *value,
+                                      gpointer data)
+{
+  MousepadWindow *window = data;
+  GFile *location, *folder;
+  gchar *selection, *dirname;
+  gint position;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
+
+  /* create the pane if needed, and pack it under the notebook */
+  if (window->find_in_files == NULL)
+    {
+      window->find_in_files = mousepad_find_in_files_new ();
+      gtk_container_child_get (GTK_CONTAINER (window->box), window->notebook,
+                               "position", &position, NULL);
+      gtk_box_pack_start (GTK_BOX (window->box), window->find_in_files, FALSE, FALSE, PADDING);
+      gtk_box_reorder_child (GTK_BOX (window->box), window->find_in_files, position + 1);
+
+      /* connect signals */
+      g_signal_connect_swapped (window->find_in_files, "hide-pane",
+                                G_CALLBACK (mousepad_window_find_in_files_hide), window);
+      g_signal_connect_swapped (window->find_in_files, "open-match",
+                                G_CALLBACK (mousepad_window_find_in_files_open_match), window);
+    }
+
+  /* search in the folder of the active document by default */
+  location = mousepad_file_get_location (window->active->file);
+  if (location != NULL && (folder = g_file_get_parent (location)) != NULL)
+    {
+      mousepad_find_in_files_set_folder (MOUSEPAD_FIND_IN_FILES (window->find_in_files), folder);
+      g_object_unref (folder);
+    }
+  else
+    {
+      dirname = g_get_current_dir ();
+      folder = g_file_new_for_path (dirname);
+      mousepad_find_in_files_set_folder (MOUSEPAD_FIND_IN_FILES (window->find_in_files), folder);
+      g_object_unref (folder);
+      g_free (dirname);
+    }
+
+  /* set the search entry text */
+  selection = mousepad_util_get_selection (window->active->buffer);
+  if (selection != NULL)
+    {
+      mousepad_find_in_files_set_text (MOUSEPAD_FIND_IN_FILES (window->find_in_files), selection);
+      g_free (selection);
+    }
+
+  /* show the pane and focus the search entry */
+  gtk_widget_show (window->find_in_files);
+  mousepad_find_in_files_focus (MOUSEPAD_FIND_IN_FILES (window->find_in_files));
+}
+
+
+
 static void
 mousepad_window_action_go_to_position (GSimpleAction *action,
                                        GVariant *value,
@@ -53,6 +53,10 @@ gspell_plugin_set_state (GspellPlugin *plugin,
                          gboolean external,
                          GspellPluginView *view);
 static void
+gspell_plugin_large_file_changed (GspellPlugin *plugin,
+                                  gboolean large,
+                                  MousepadFile *file);
+static void
 gspell_plugin_view_menu_populate (GspellPlugin *plugin,
                                   GtkWidget *menu,
                                   GtkTextView *mousepad_view);
@@ -81,8 +85,14 @@ struct _GspellPlugin
 
 struct _GspellPluginView
 {
-  /* the mousepad view the gspell objects are attached to */
+  /* the mousepad view the gspell objects are attached to, and the file of its document */
   MousepadView *mousepad_view;
+  MousepadFile *file;
+
+  /* whether spell checking is turned off in large file mode, and whether inline spell
+   * checking was on before, to be restored when leaving it */
+  gboolean large_file;
+  gboolean inline_checking;
 
   /* gspell objects */
   GspellTextView *gspell_view;
@@ -278,6 +288,9 @@ gspell_plugin_document_added (GspellPlugin *plugin,
       /* allocate and fill in a new plugin view */
       view = g_new (GspellPluginView, 1);
       view->mousepad_view = document->textview;
+      view->file = document->file;
+      view->large_file = FALSE;
+      view->inline_checking = TRUE;
       text_view = GTK_TEXT_VIEW (document->textview);
       view->gspell_view = gspell_text_view_get_from_gtk_text_view (text_view);
       buffer = gtk_text_view_get_buffer (text_view);
@@ -300,6 +313,14 @@ gspell_plugin_document_added (GspellPlugin *plugin,
   else
     view = item->data;
 
+  /* (re)connect to the file "large-file-changed" signal to turn spell checking off if needed */
+  mousepad_disconnect_by_func (document->file, gspell_plugin_large_file_changed, plugin);
+  g_signal_connect_object (document->file, "large-file-changed",
+                           G_CALLBACK (gspell_plugin_large_file_changed),
+                           plugin, G_CONNECT_SWAPPED);
+  view->large_file = mousepad_file_get_disabled_features (document->file)
+                     & MOUSEPAD_LARGE_FILE_SPELL_CHECKING;
+
   /* set spell checking on this view */
   gspell_plugin_set_state (plugin, TRUE, TRUE, view);
 }
@@ -375,6 +396,7 @@ gspell_plugin_disable (MousepadPlugin *mplugin)
       view = item->data;
       mousepad_disconnect_by_func (view->mousepad_view,
                                    gspell_plugin_view_menu_populate, plugin);
+      mousepad_disconnect_by_func (view->file, gspell_plugin_large_file_changed, plugin);
 
       /* unset spell checking on this view */
       gspell_plugin_set_state (plugin, FALSE, TRUE, view);
@@ -389,6 +411,9 @@ gspell_plugin_set_state (GspellPlugin *plugin,
                          gboolean external,
                          GspellPluginView *view)
 {
+  /* spell checking stays off in large file mode */
+  enabled = enabled && !view->large_file;
+
   /* the function call comes from a change in mousepad settings, not from
    * gspell_plugin_view_menu_show() to retrieve the gspell menu */
   if (external)
@@ -400,6 +425,40 @@ gspell_plugin_set_state (GspellPlugin *plugin,
 
 
 
+static void
+gspell_plugin_large_file_changed (GspellPlugin *plugin,
+                                  gboolean large,
+                                  MousepadFile *file)
+{
+  GspellPluginView *view;
+  GList *item;
+  gboolean large_file;
+
+  for (item = plugin->views; item != NULL; item = item->next)
+    {
+      view = item->data;
+      if (view->file != file)
+        continue;
+
+      large_file = mousepad_file_get_disabled_features (file) & MOUSEPAD_LARGE_FILE_SPELL_CHECKING;
+      if (large_file == view->large_file)
+        continue;
+
+      /* the user may have turned inline spell checking off from the context menu */
+      if (large_file)
+        view->inline_checking = gspell_text_view_get_inline_spell_checking (view->gspell_view);
+
+      view->large_file = large_file;
+      gspell_plugin_set_state (plugin, TRUE, TRUE, view);
+
+      /* leaving large file mode: restore the previous state */
+      if (!large_file && !view->inline_checking)
+        gspell_text_view_set_inline_spell_checking (view->gspell_view, FALSE);
+    }
+}
+
+
+
 static void
 gspell_plugin_view_menu_populate (GspellPlugin *plugin,
                                   GtkWidget *menu,
@@ -0,0 +1,255 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mousepad/mousepad-private.h"
+#include "mousepad/mousepad-encoding.h"
+
+
+
+/* minimal confidence for a detected encoding to be used at loading */
+#define DETECTION_CONFIDENCE 0.5
+
+static const gchar *text_french =
+  "Le cœur a ses raisons que la raison ne connaît point ; on le sait en mille choses. "
+  "Je dis que le cœur aime l'être universel naturellement, et soi-même naturellement, "
+  "selon qu'il s'y adonne ; et il se durcit contre l'un ou l'autre à son choix. Vous "
+  "avez rejeté l'un et conservé l'autre : est-ce par raison que vous vous aimez ?\n";
+
+static const gchar *text_german =
+  "Über allen Gipfeln ist Ruh, in allen Wipfeln spürest du kaum einen Hauch; die "
+  "Vögelein schweigen im Walde. Warte nur, balde ruhest du auch. Größere Städte "
+  "wählen häufig eine andere Straße für ihre Märkte.\n";
+
+static const gchar *text_polish =
+  "Litwo! Ojczyzno moja! ty jesteś jak zdrowie. Ile cię trzeba cenić, ten tylko się "
+  "dowie, kto cię stracił. Dziś piękność twą w całej ozdobie widzę i opisuję, bo "
+  "tęsknię po tobie. Panno Święta, co jasnej bronisz Częstochowy.\n";
+
+static const gchar *text_russian =
+  "Все счастливые семьи похожи друг на друга, каждая несчастливая семья несчастлива "
+  "по-своему. Всё смешалось в доме Облонских. Жена узнала, что муж был в связи с "
+  "бывшею в их доме француженкою-гувернанткой, и объявила мужу, что не может жить с "
+  "ним в одном доме.\n";
+
+static const gchar *text_greek =
+  "Άνδρα μοι έννεπε, Μούσα, πολύτροπον, ος μάλα πολλά πλάγχθη, επεί Τροίης ιερόν "
+  "πτολίεθρον έπερσε· πολλών δ' ανθρώπων ίδεν άστεα και νόον έγνω, πολλά δ' ο γ' εν "
+  "πόντω πάθεν άλγεα ον κατά θυμόν.\n";
+
+static const gchar *text_japanese =
+  "吾輩は猫である。名前はまだ無い。どこで生れたかとんと見当がつかぬ。何でも薄暗いじめじめした"
+  "所でニャーニャー泣いていた事だけは記憶している。吾輩はここで始めて人間というものを見た。"
+  "しかもあとで聞くとそれは書生という人間中で一番獰悪な種族であったそうだ。\n";
+
+static const gchar *text_chinese =
+  "我们的生活是在不断的变化中发展的，每个人都有自己的理想和目标。在这个时代，"
+  "我们要为国家的发展作出自己的贡献，也要对社会和家庭负责。他说这是一个大问题，"
+  "我们不能不认真地对待。\n";
+
+static const gchar *text_traditional_chinese =
+  "我們的生活是在不斷的變化中發展的，每個人都有自己的理想和目標。在這個時代，"
+  "我們要為國家的發展作出自己的貢獻，也要對社會和家庭負責。他說這是一個大問題，"
+  "我們不能不認真地對待。\n";
+
+static const gchar *text_korean =
+  "모든 인간은 태어날 때부터 자유로우며 그 존엄과 권리에 있어 동등하다. 인간은 천부적으로 "
+  "이성과 양심을 부여받았으며 서로 형제애의 정신으로 행동하여야 한다. 이 선언에 "
+  "규정된 권리와 자유를 누릴 자격이 있다.\n";
+
+
+
+static gchar *
+encode (const gchar *text,
+        MousepadEncoding encoding,
+        gsize *length)
+{
+  GError *error = NULL;
+  gchar *contents;
+
+  contents = g_convert (text, -1, mousepad_encoding_get_charset (encoding), "UTF-8",
+                        NULL, length, &error);
+  g_assert_no_error (error);
+
+  return contents;
+}
+
+
+
+/* the contents are decoded as they were encoded by the most likely encoding, which may
+ * be another one than that used to encode them, if they are the same for these contents */
+static void
+check_detect (const gchar *text,
+              MousepadEncoding encoding)
+{
+  MousepadEncodingCandidate candidates[3];
+  gchar *contents, *decoded;
+  gsize length;
+  guint n_candidates;
+
+  contents = encode (text, encoding, &length);
+  n_candidates = mousepad_encoding_detect (contents, length, candidates, G_N_ELEMENTS (candidates));
+  g_assert_cmpuint (n_candidates, >, 0);
+
+  g_test_message ("%s: %s detected with confidence %.2f", mousepad_encoding_get_charset (encoding),
+                  mousepad_encoding_get_charset (candidates[0].encoding), candidates[0].confidence);
+
+  decoded = g_convert (contents, length, "UTF-8",
+                       mousepad_encoding_get_charset (candidates[0].encoding), NULL, NULL, NULL);
+  g_assert_cmpstr (decoded, ==, text);
+  g_assert_cmpfloat (candidates[0].confidence, >=, DETECTION_CONFIDENCE);
+
+  g_free (decoded);
+  g_free (contents);
+}
+
+
+
+static void
+test_detect_empty (void)
+{
+  MousepadEncodingCandidate candidates[3];
+
+  g_assert_cmpuint (mousepad_encoding_detect ("", 0, candidates, G_N_ELEMENTS (candidates)), ==, 0);
+  g_assert_cmpuint (mousepad_encoding_detect ("abc", 3, candidates, 0), ==, 0);
+}
+
+
+
+static void
+test_detect_ascii (void)
+{
+  MousepadEncodingCandidate candidates[3];
+  const gchar *text = "Hello world\n";
+
+  /* valid in any ASCII superset, UTF-8 being preferred */
+  g_assert_cmpuint (mousepad_encoding_detect (text, strlen (text), candidates,
+                                              G_N_ELEMENTS (candidates)), ==, 2);
+  g_assert_cmpint (candidates[0].encoding, ==, MOUSEPAD_ENCODING_UTF_8);
+  g_assert_cmpfloat (candidates[0].confidence, ==, 1.0);
+  g_assert_cmpint (candidates[1].encoding, ==, MOUSEPAD_ENCODING_ASCII);
+}
+
+
+
+static void
+test_detect_single_byte (void)
+{
+  check_detect (text_french, MOUSEPAD_ENCODING_ISO_8859_15);
+  check_detect (text_french, MOUSEPAD_ENCODING_WINDOWS_1252);
+  check_detect (text_german, MOUSEPAD_ENCODING_ISO_8859_1);
+  check_detect (text_polish, MOUSEPAD_ENCODING_ISO_8859_2);
+  check_detect (text_polish, MOUSEPAD_ENCODING_WINDOWS_1250);
+  check_detect (text_russian, MOUSEPAD_ENCODING_WINDOWS_1251);
+  check_detect (text_russian, MOUSEPAD_ENCODING_KOI8_R);
+  check_detect (text_greek, MOUSEPAD_ENCODING_ISO_8859_7);
+}
+
+
+
+static void
+test_detect_multibyte (void)
+{
+  check_detect (text_french, MOUSEPAD_ENCODING_UTF_8);
+  check_detect (text_japanese, MOUSEPAD_ENCODING_UTF_8);
+  check_detect (text_japanese, MOUSEPAD_ENCODING_SHIFT_JIS);
+  check_detect (text_japanese, MOUSEPAD_ENCODING_EUC_JP);
+  check_detect (text_chinese, MOUSEPAD_ENCODING_GB18030);
+  check_detect (text_traditional_chinese, MOUSEPAD_ENCODING_BIG5);
+  check_detect (text_korean, MOUSEPAD_ENCODING_EUC_KR);
+  check_detect (text_japanese, MOUSEPAD_ENCODING_ISO_2022_JP);
+  check_detect (text_korean, MOUSEPAD_ENCODING_ISO_2022_KR);
+}
+
+
+
+static void
+test_detect_unicode (void)
+{
+  check_detect (text_german, MOUSEPAD_ENCODING_UTF_16LE);
+  check_detect (text_german, MOUSEPAD_ENCODING_UTF_16BE);
+  check_detect (text_russian, MOUSEPAD_ENCODING_UTF_16LE);
+  check_detect (text_japanese, MOUSEPAD_ENCODING_UTF_16BE);
+  check_detect (text_greek, MOUSEPAD_ENCODING_UTF_32LE);
+  check_detect (text_korean, MOUSEPAD_ENCODING_UTF_32BE);
+}
+
+
+
+static void
+test_detect_ranking (void)
+{
+  MousepadEncodingCandidate candidates[MOUSEPAD_N_ENCODINGS];
+  gchar *contents;
+  gsize length;
+  guint n, n_candidates;
+
+  /* the candidates are sorted by decreasing confidence, and their number is bounded */
+  contents = encode (text_french, MOUSEPAD_ENCODING_ISO_8859_15, &length);
+  n_candidates = mousepad_encoding_detect (contents, length, candidates, G_N_ELEMENTS (candidates));
+  g_assert_cmpuint (n_candidates, >, 1);
+  for (n = 1; n < n_candidates; n++)
+    {
+      g_assert_cmpfloat (candidates[n].confidence, <=, candidates[n - 1].confidence);
+      g_assert_cmpfloat (candidates[n].confidence, >, 0.0);
+    }
+
+  g_assert_cmpuint (mousepad_encoding_detect (contents, length, candidates, 1), ==, 1);
+
+  /* UTF-8 is not a candidate for contents which are not valid in it */
+  for (n = 0; n < n_candidates; n++)
+    g_assert_cmpint (candidates[n].encoding, !=, MOUSEPAD_ENCODING_UTF_8);
+
+  g_free (contents);
+}
+
+
+
+static void
+test_detect_nul (void)
+{
+  MousepadEncodingCandidate candidates[MOUSEPAD_N_ENCODINGS];
+  gchar *contents;
+  gsize length;
+  guint n, n_candidates;
+
+  /* null bytes don't appear in text encoded in 8-bit or 7-bit encodings */
+  contents = encode (text_german, MOUSEPAD_ENCODING_ISO_8859_1, &length);
+  contents[length / 2] = '\0';
+  n_candidates = mousepad_encoding_detect (contents, length, candidates, G_N_ELEMENTS (candidates));
+  for (n = 0; n < n_candidates; n++)
+    g_assert_true (mousepad_encoding_is_unicode (candidates[n].encoding));
+
+  g_free (contents);
+}
+
+
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/encoding/detect/empty", test_detect_empty);
+  g_test_add_func ("/encoding/detect/ascii", test_detect_ascii);
+  g_test_add_func ("/encoding/detect/single-byte", test_detect_single_byte);
+  g_test_add_func ("/encoding/detect/multibyte", test_detect_multibyte);
+  g_test_add_func ("/encoding/detect/unicode", test_detect_unicode);
+  g_test_add_func ("/encoding/detect/ranking", test_detect_ranking);
+  g_test_add_func ("/encoding/detect/nul", test_detect_nul);
+
+  return g_test_run ();
+}
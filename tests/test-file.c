@@ -0,0 +1,431 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mousepad/mousepad-private.h"
+#include "mousepad/mousepad-file.h"
+#include "mousepad/mousepad-settings.h"
+
+#include <glib/gstdio.h>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+
+
+/* large enough to be read by a worker thread and inserted in time slices, and for its
+ * working buffer to be allocated outside of the malloc heap, so that it is given back to
+ * the system once freed */
+#define TEST_FILE_SIZE (48 * 1024 * 1024)
+#define TEST_FILE_LINE "The quick brown fox jumps over the lazy dog 0123456789\r\n"
+#define TEST_FILE_LINE_LF "The quick brown fox jumps over the lazy dog 0123456789\n"
+
+/* size of the chunks in which non-UTF-8 contents are converted */
+#define CONVERSION_CHUNK_SIZE (1024 * 1024)
+
+/* size of the start of the contents the encoding is detected from */
+#define ENCODING_DETECTION_SAMPLE_SIZE (64 * 1024)
+
+
+
+typedef struct
+{
+  gchar *dir;
+  GFile *location;
+  GtkTextBuffer *buffer;
+  MousepadFile *file;
+} Fixture;
+
+
+
+static gsize
+get_resident_size (void)
+{
+  gchar *contents;
+  gsize size = 0, resident = 0;
+
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    {
+      sscanf (contents, "%" G_GSIZE_FORMAT " %" G_GSIZE_FORMAT, &size, &resident);
+      g_free (contents);
+    }
+
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
+
+
+static gsize
+get_peak_resident_size (void)
+{
+  struct rusage usage;
+
+  /* in kilobytes on Linux */
+  getrusage (RUSAGE_SELF, &usage);
+
+  return (gsize) usage.ru_maxrss * 1024;
+}
+
+
+
+static void
+load_progress (MousepadFile *file,
+               gdouble fraction,
+               gpointer data)
+{
+  gint *n_reports = data;
+
+  (*n_reports)++;
+}
+
+
+
+static void
+fixture_set_up (Fixture *fixture,
+                gconstpointer data)
+{
+  gchar *path;
+
+  fixture->dir = g_dir_make_tmp ("mousepad-test-file-XXXXXX", NULL);
+  g_assert_nonnull (fixture->dir);
+
+  path = g_build_filename (fixture->dir, "contents.txt", NULL);
+  fixture->location = g_file_new_for_path (path);
+  g_free (path);
+
+  fixture->buffer = GTK_TEXT_BUFFER (gtk_source_buffer_new (NULL));
+  fixture->file = mousepad_file_new (fixture->buffer);
+}
+
+
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   gconstpointer data)
+{
+  g_file_delete (fixture->location, NULL, NULL);
+  g_rmdir (fixture->dir);
+
+  g_object_unref (fixture->file);
+  g_object_unref (fixture->buffer);
+  g_object_unref (fixture->location);
+  g_free (fixture->dir);
+}
+
+
+
+/* write the file by small blocks, not to raise the peak memory usage before the loading */
+static gsize
+write_large_file (GFile *location,
+                  const gchar *line)
+{
+  GFileOutputStream *stream;
+  GString *block;
+  gsize n_lines = 0, size;
+
+  block = g_string_new (NULL);
+  while (block->len + strlen (line) <= 64 * 1024)
+    g_string_append (block, line);
+
+  stream = g_file_replace (location, NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL);
+  g_assert_nonnull (stream);
+
+  for (size = 0; size + block->len <= TEST_FILE_SIZE; size += block->len)
+    {
+      g_assert_true (g_output_stream_write_all (G_OUTPUT_STREAM (stream), block->str, block->len,
+                                                NULL, NULL, NULL));
+      n_lines += block->len / strlen (line);
+    }
+
+  g_assert_true (g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, NULL));
+  g_object_unref (stream);
+  g_string_free (block, TRUE);
+
+  return n_lines;
+}
+
+
+
+static void
+test_load_small (Fixture *fixture,
+                 gconstpointer data)
+{
+  GError *error = NULL;
+  gchar *text;
+  gint n_reports = 0;
+
+  g_assert_true (g_file_replace_contents (fixture->location, "one\r\ntwo\r\nthree", 15, NULL, FALSE,
+                                          G_FILE_CREATE_NONE, NULL, NULL, NULL));
+  mousepad_file_set_location (fixture->file, fixture->location, MOUSEPAD_LOCATION_REAL);
+
+  g_signal_connect (fixture->file, "load-progress", G_CALLBACK (load_progress), &n_reports);
+  g_assert_cmpint (mousepad_file_open (fixture->file, 0, 0, TRUE, FALSE, FALSE, &error), ==, 0);
+  g_assert_no_error (error);
+
+  /* small files are loaded at once, line endings being normalized */
+  g_assert_cmpint (n_reports, ==, 0);
+  g_object_get (fixture->buffer, "text", &text, NULL);
+  g_assert_cmpstr (text, ==, "one\ntwo\nthree");
+  g_assert_cmpint (mousepad_file_get_line_ending (fixture->file), ==, MOUSEPAD_EOL_DOS);
+  g_assert_false (gtk_text_buffer_get_modified (fixture->buffer));
+  g_free (text);
+}
+
+
+
+static gchar *
+load_contents (Fixture *fixture,
+               MousepadEncoding encoding,
+               const gchar *contents,
+               gsize length)
+{
+  GError *error = NULL;
+  gchar *text;
+
+  g_assert_true (g_file_replace_contents (fixture->location, contents, length, NULL, FALSE,
+                                          G_FILE_CREATE_NONE, NULL, NULL, NULL));
+  mousepad_file_set_location (fixture->file, fixture->location, MOUSEPAD_LOCATION_REAL);
+  mousepad_file_set_encoding (fixture->file, encoding);
+
+  g_assert_cmpint (mousepad_file_open (fixture->file, 0, 0, TRUE, FALSE, TRUE, &error), ==, 0);
+  g_assert_no_error (error);
+  g_object_get (fixture->buffer, "text", &text, NULL);
+
+  return text;
+}
+
+
+
+static void
+test_load_line_endings (Fixture *fixture,
+                        gconstpointer data)
+{
+  struct
+  {
+    const gchar *contents, *text;
+    MousepadLineEnding line_ending;
+  } tests[] = {
+    { "a\r\nb\r\n", "a\nb\n", MOUSEPAD_EOL_DOS },
+    { "a\rb\r", "a\nb\n", MOUSEPAD_EOL_MAC },
+    { "\r\n\r\n\r\n", "\n\n\n", MOUSEPAD_EOL_DOS },
+    { "a\r\r\nb\n\rc", "a\n\nb\n\nc", MOUSEPAD_EOL_MAC },
+    { "a\r\nb\rc\nd", "a\nb\nc\nd", MOUSEPAD_EOL_DOS },
+    /* the line endings are normalized only if the first one is not a LF */
+    { "a\nb\r\nc", "a\nb\r\nc", MOUSEPAD_EOL_UNIX },
+  };
+  MousepadEncoding encodings[] = { MOUSEPAD_ENCODING_UTF_8, MOUSEPAD_ENCODING_ISO_8859_1 };
+  gchar *text;
+  guint n, m;
+
+  /* the contents are normalized in place at once if valid UTF-8, or while converted */
+  for (m = 0; m < G_N_ELEMENTS (encodings); m++)
+    for (n = 0; n < G_N_ELEMENTS (tests); n++)
+      {
+        text = load_contents (fixture, encodings[m], tests[n].contents, strlen (tests[n].contents));
+        g_assert_cmpstr (text, ==, tests[n].text);
+        g_assert_cmpint (mousepad_file_get_line_ending (fixture->file), ==, tests[n].line_ending);
+        g_free (text);
+      }
+}
+
+
+
+static void
+test_load_line_endings_chunks (Fixture *fixture,
+                               gconstpointer data)
+{
+  gchar *contents, *text;
+  gsize length = 2 * CONVERSION_CHUNK_SIZE;
+  gsize offsets[] = { CONVERSION_CHUNK_SIZE - 2, CONVERSION_CHUNK_SIZE - 1, CONVERSION_CHUNK_SIZE };
+  guint n;
+
+  /* a CRLF split between two converted chunks is still a single line ending */
+  for (n = 0; n < G_N_ELEMENTS (offsets); n++)
+    {
+      contents = g_malloc (length);
+      memset (contents, 'x', length);
+      contents[0] = '\r';
+      contents[1] = '\n';
+      contents[offsets[n]] = '\r';
+      contents[offsets[n] + 1] = '\n';
+
+      text = load_contents (fixture, MOUSEPAD_ENCODING_ISO_8859_1, contents, length);
+      g_assert_cmpuint (strlen (text), ==, length - 2);
+      g_assert_cmpint (text[0], ==, '\n');
+      g_assert_cmpint (text[offsets[n] - 1], ==, '\n');
+      g_assert_cmpint (text[offsets[n]], ==, 'x');
+      g_assert_cmpint (gtk_text_buffer_get_line_count (fixture->buffer), ==, 3);
+
+      g_free (text);
+      g_free (contents);
+    }
+}
+
+
+
+static void
+test_load_detect_encoding (Fixture *fixture,
+                           gconstpointer data)
+{
+  GError *error = NULL;
+  const gchar *line = "Größere Städte wählen häufig eine andere Straße für ihre Märkte.\n";
+  GString *contents;
+  gchar *encoded, *text;
+  gsize length;
+
+  encoded = g_convert (line, -1, "ISO-8859-1", "UTF-8", NULL, &length, NULL);
+  contents = g_string_new (NULL);
+  while (contents->len < 2 * ENCODING_DETECTION_SAMPLE_SIZE)
+    g_string_append_len (contents, encoded, length);
+
+  /* contents not valid in the default encoding are loaded in the detected one, which is
+   * told to the user */
+  g_assert_true (g_file_replace_contents (fixture->location, contents->str, contents->len, NULL,
+                                          FALSE, G_FILE_CREATE_NONE, NULL, NULL, NULL));
+  mousepad_file_set_location (fixture->file, fixture->location, MOUSEPAD_LOCATION_REAL);
+  mousepad_file_set_encoding (fixture->file, MOUSEPAD_ENCODING_UTF_8);
+  g_assert_cmpint (mousepad_file_open (fixture->file, 0, 0, TRUE, FALSE, FALSE, &error), ==, 0);
+  g_assert_no_error (error);
+
+  g_object_get (fixture->buffer, "text", &text, NULL);
+  g_assert_true (g_str_has_prefix (text, line));
+  g_assert_cmpuint (strlen (text), ==, contents->len / length * strlen (line));
+  g_assert_cmpint (mousepad_file_get_encoding (fixture->file), !=, MOUSEPAD_ENCODING_UTF_8);
+  g_assert_cmpint (mousepad_file_get_rejected_encoding (fixture->file), ==, MOUSEPAD_ENCODING_UTF_8);
+  g_free (text);
+
+  /* the detection is based on the start of the contents, but the detected encoding is not
+   * used if the rest is not valid in it */
+  g_string_append_c (contents, '\0');
+  g_assert_true (g_file_replace_contents (fixture->location, contents->str, contents->len, NULL,
+                                          FALSE, G_FILE_CREATE_NONE, NULL, NULL, NULL));
+  mousepad_file_set_encoding (fixture->file, MOUSEPAD_ENCODING_UTF_8);
+  g_assert_cmpint (mousepad_file_open (fixture->file, 0, 0, TRUE, FALSE, FALSE, &error),
+                   ==, ERROR_ENCODING_NOT_VALID);
+  g_clear_error (&error);
+  g_assert_cmpint (mousepad_file_get_encoding (fixture->file), ==, MOUSEPAD_ENCODING_UTF_8);
+  g_assert_cmpint (mousepad_file_get_rejected_encoding (fixture->file), ==, MOUSEPAD_ENCODING_NONE);
+
+  g_string_free (contents, TRUE);
+  g_free (encoded);
+}
+
+
+
+static void
+test_load_peak_memory (Fixture *fixture,
+                       gconstpointer data)
+{
+  GError *error = NULL;
+  gsize n_lines, transient;
+  gint n_reports = 0;
+
+  n_lines = write_large_file (fixture->location, TEST_FILE_LINE);
+  mousepad_file_set_location (fixture->file, fixture->location, MOUSEPAD_LOCATION_REAL);
+
+  g_signal_connect (fixture->file, "load-progress", G_CALLBACK (load_progress), &n_reports);
+  g_assert_cmpint (mousepad_file_open (fixture->file, 0, 0, TRUE, FALSE, FALSE, &error), ==, 0);
+  g_assert_no_error (error);
+
+  /* the file was read and inserted interactively, line endings being normalized */
+  g_assert_cmpint (n_reports, >, 0);
+  g_assert_cmpuint (gtk_text_buffer_get_char_count (fixture->buffer),
+                    ==, n_lines * (strlen (TEST_FILE_LINE) - 1));
+  g_assert_cmpuint (gtk_text_buffer_get_line_count (fixture->buffer), ==, n_lines + 1);
+
+  /* the memory used during the loading on top of the buffer contents: a single working
+   * buffer is needed, in which the contents are read and normalized in place */
+  transient = get_peak_resident_size () - get_resident_size ();
+  g_test_message ("transient memory usage: %" G_GSIZE_FORMAT " kB for a %d kB file",
+                  transient / 1024, TEST_FILE_SIZE / 1024);
+  g_assert_cmpuint (transient, <, TEST_FILE_SIZE + TEST_FILE_SIZE / 4);
+}
+
+
+
+static void
+test_benchmark_line_endings (Fixture *fixture,
+                             gconstpointer data)
+{
+  GError *error = NULL;
+  const gchar *lines[] = { TEST_FILE_LINE_LF, TEST_FILE_LINE };
+  gdouble times[G_N_ELEMENTS (lines)], elapsed;
+  gsize n_lines;
+  gint result;
+  guint n, run;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("only run in perf mode");
+      return;
+    }
+
+  /* the same large file with LF and CRLF line endings, the latter being normalized in
+   * place in the working buffer */
+  for (n = 0; n < G_N_ELEMENTS (lines); n++)
+    {
+      n_lines = write_large_file (fixture->location, lines[n]);
+      mousepad_file_set_location (fixture->file, fixture->location, MOUSEPAD_LOCATION_REAL);
+
+      /* best of a few runs, the first one also reading the file from the disk */
+      times[n] = G_MAXDOUBLE;
+      for (run = 0; run < 3; run++)
+        {
+          gtk_text_buffer_set_text (fixture->buffer, "", 0);
+
+          g_test_timer_start ();
+          result = mousepad_file_open (fixture->file, 0, 0, TRUE, FALSE, FALSE, &error);
+          elapsed = g_test_timer_elapsed ();
+          times[n] = MIN (times[n], elapsed);
+
+          g_assert_cmpint (result, ==, 0);
+          g_assert_no_error (error);
+          g_assert_cmpuint (gtk_text_buffer_get_line_count (fixture->buffer), ==, n_lines + 1);
+        }
+
+      g_test_minimized_result (times[n], "%s load time: %.0f ms for a %d kB file",
+                               n == 0 ? "LF" : "CRLF", times[n] * 1000, TEST_FILE_SIZE / 1024);
+    }
+
+  g_test_message ("CRLF/LF load time ratio: %.2f", times[1] / times[0]);
+}
+
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  mousepad_settings_init ();
+
+  /* must be run first, the peak memory usage being that of the whole process */
+  if (g_file_test ("/proc/self/statm", G_FILE_TEST_EXISTS))
+    g_test_add ("/file/load/peak-memory", Fixture, NULL,
+                fixture_set_up, test_load_peak_memory, fixture_tear_down);
+
+  g_test_add ("/file/load/small", Fixture, NULL,
+              fixture_set_up, test_load_small, fixture_tear_down);
+  g_test_add ("/file/load/line-endings", Fixture, NULL,
+              fixture_set_up, test_load_line_endings, fixture_tear_down);
+  g_test_add ("/file/load/line-endings-chunks", Fixture, NULL,
+              fixture_set_up, test_load_line_endings_chunks, fixture_tear_down);
+  g_test_add ("/file/load/detect-encoding", Fixture, NULL,
+              fixture_set_up, test_load_detect_encoding, fixture_tear_down);
+  g_test_add ("/file/benchmark/line-endings", Fixture, NULL,
+              fixture_set_up, test_benchmark_line_endings, fixture_tear_down);
+
+  return g_test_run ();
+}
@@ -0,0 +1,399 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mousepad/mousepad-private.h"
+#include "mousepad/mousepad-file.h"
+#include "mousepad/mousepad-journal.h"
+#include "mousepad/mousepad-settings.h"
+
+#include <glib/gstdio.h>
+
+
+
+#define TEST_BASE "Hello world\n"
+
+typedef struct
+{
+  gchar *dir;
+  GFile *location, *journal;
+  GtkTextBuffer *buffer;
+
+  /* journal records, the offsets at which each of them ends, and the buffer contents
+   * after each of them was replayed */
+  GString *records;
+  GArray *ends;
+  GPtrArray *states;
+} Fixture;
+
+
+
+static void
+fixture_add_record (Fixture *fixture,
+                    MousepadJournal *journal)
+{
+  GBytes *bytes;
+  gchar *text;
+  gsize end;
+
+  bytes = mousepad_journal_steal_records (journal);
+  g_string_append_len (fixture->records, g_bytes_get_data (bytes, NULL), g_bytes_get_size (bytes));
+  g_bytes_unref (bytes);
+
+  end = fixture->records->len;
+  g_array_append_val (fixture->ends, end);
+  g_object_get (fixture->buffer, "text", &text, NULL);
+  g_ptr_array_add (fixture->states, text);
+}
+
+
+
+static void
+fixture_set_up (Fixture *fixture,
+                gconstpointer data)
+{
+  MousepadJournal *journal;
+  GtkTextIter start, end;
+  gchar *path;
+
+  fixture->dir = g_dir_make_tmp ("mousepad-test-journal-XXXXXX", NULL);
+  g_assert_nonnull (fixture->dir);
+
+  path = g_build_filename (fixture->dir, "autosave", NULL);
+  fixture->location = g_file_new_for_path (path);
+  fixture->journal = mousepad_journal_get_location (fixture->location);
+  g_free (path);
+
+  fixture->buffer = GTK_TEXT_BUFFER (gtk_source_buffer_new (NULL));
+  fixture->records = g_string_new (NULL);
+  fixture->ends = g_array_new (FALSE, FALSE, sizeof (gsize));
+  fixture->states = g_ptr_array_new_with_free_func (g_free);
+
+  /* journal some edits of the base, one record each */
+  gtk_text_buffer_set_text (fixture->buffer, TEST_BASE, -1);
+  g_ptr_array_add (fixture->states, g_strdup (TEST_BASE));
+  journal = mousepad_journal_new ();
+
+  gtk_text_buffer_get_iter_at_offset (fixture->buffer, &start, 5);
+  gtk_text_buffer_insert (fixture->buffer, &start, ", dear", -1);
+  mousepad_journal_insert (journal, 5, ", dear", -1);
+  fixture_add_record (fixture, journal);
+
+  gtk_text_buffer_get_iter_at_offset (fixture->buffer, &start, 0);
+  gtk_text_buffer_get_iter_at_offset (fixture->buffer, &end, 1);
+  gtk_text_buffer_delete (fixture->buffer, &start, &end);
+  mousepad_journal_delete (journal, 0, 1);
+  fixture_add_record (fixture, journal);
+
+  gtk_text_buffer_get_end_iter (fixture->buffer, &start);
+  gtk_text_buffer_insert (fixture->buffer, &start, "\303\251\342\202\254 x\ny", -1);
+  mousepad_journal_insert (journal, gtk_text_buffer_get_char_count (fixture->buffer) - 6,
+                           "\303\251\342\202\254 x\ny", -1);
+  fixture_add_record (fixture, journal);
+
+  gtk_text_buffer_get_iter_at_offset (fixture->buffer, &start, 3);
+  gtk_text_buffer_get_iter_at_offset (fixture->buffer, &end, 8);
+  gtk_text_buffer_delete (fixture->buffer, &start, &end);
+  mousepad_journal_delete (journal, 3, 8);
+  fixture_add_record (fixture, journal);
+
+  mousepad_journal_free (journal);
+}
+
+
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   gconstpointer data)
+{
+  g_file_delete (fixture->journal, NULL, NULL);
+  g_file_delete (fixture->location, NULL, NULL);
+  g_rmdir (fixture->dir);
+
+  g_ptr_array_unref (fixture->states);
+  g_array_unref (fixture->ends);
+  g_string_free (fixture->records, TRUE);
+  g_object_unref (fixture->buffer);
+  g_object_unref (fixture->journal);
+  g_object_unref (fixture->location);
+  g_free (fixture->dir);
+}
+
+
+
+static void
+write_journal (GFile *location,
+               const gchar *header,
+               const gchar *records,
+               gsize length)
+{
+  GString *contents;
+
+  contents = g_string_new (header);
+  g_string_append_len (contents, records, length);
+  g_assert_true (g_file_replace_contents (location, contents->str, contents->len, NULL, FALSE,
+                                          G_FILE_CREATE_NONE, NULL, NULL, NULL));
+  g_string_free (contents, TRUE);
+}
+
+
+
+/* replay the journal on the base and check that the buffer is restored to the state it
+ * had after the given number of records */
+static void
+check_replay (Fixture *fixture,
+              const gchar *digest,
+              guint n_records)
+{
+  GError *error = NULL;
+  gchar *text;
+
+  gtk_text_buffer_set_text (fixture->buffer, TEST_BASE, -1);
+  g_assert_cmpint (mousepad_journal_replay (fixture->buffer, fixture->journal, digest, &error),
+                   ==, n_records);
+  g_assert_no_error (error);
+
+  g_object_get (fixture->buffer, "text", &text, NULL);
+  g_assert_cmpstr (text, ==, g_ptr_array_index (fixture->states, n_records));
+  g_free (text);
+}
+
+
+
+static void
+test_journal_replay (Fixture *fixture,
+                     gconstpointer data)
+{
+  GBytes *header;
+  gchar *digest;
+
+  digest = mousepad_journal_get_digest (TEST_BASE, strlen (TEST_BASE));
+  header = mousepad_journal_new_header (digest, FALSE, MOUSEPAD_EOL_UNIX);
+  write_journal (fixture->journal, g_bytes_get_data (header, NULL),
+                 fixture->records->str, fixture->records->len);
+
+  check_replay (fixture, digest, fixture->ends->len);
+
+  /* no journal */
+  g_file_delete (fixture->journal, NULL, NULL);
+  check_replay (fixture, digest, 0);
+
+  g_bytes_unref (header);
+  g_free (digest);
+}
+
+
+
+static void
+test_journal_obsolete (Fixture *fixture,
+                       gconstpointer data)
+{
+  GBytes *header;
+  gchar *digest, *other;
+
+  /* a journal based on another base is ignored */
+  digest = mousepad_journal_get_digest (TEST_BASE, strlen (TEST_BASE));
+  other = mousepad_journal_get_digest (TEST_BASE, strlen (TEST_BASE) - 1);
+  header = mousepad_journal_new_header (other, FALSE, MOUSEPAD_EOL_UNIX);
+  write_journal (fixture->journal, g_bytes_get_data (header, NULL),
+                 fixture->records->str, fixture->records->len);
+
+  check_replay (fixture, digest, 0);
+
+  g_bytes_unref (header);
+  g_free (digest);
+  g_free (other);
+}
+
+
+
+static void
+test_journal_torn_tail (Fixture *fixture,
+                        gconstpointer data)
+{
+  GBytes *header;
+  gchar *digest;
+  gsize length;
+  guint n_records = 0;
+
+  digest = mousepad_journal_get_digest (TEST_BASE, strlen (TEST_BASE));
+  header = mousepad_journal_new_header (digest, FALSE, MOUSEPAD_EOL_UNIX);
+
+  /* the application stopped at any point while appending records: only the complete ones
+   * are replayed */
+  for (length = 0; length <= fixture->records->len; length++)
+    {
+      if (n_records < fixture->ends->len && g_array_index (fixture->ends, gsize, n_records) == length)
+        n_records++;
+
+      write_journal (fixture->journal, g_bytes_get_data (header, NULL),
+                     fixture->records->str, length);
+      check_replay (fixture, digest, n_records);
+    }
+
+  g_bytes_unref (header);
+  g_free (digest);
+}
+
+
+
+static void
+test_journal_checksum_mismatch (Fixture *fixture,
+                                gconstpointer data)
+{
+  GBytes *header;
+  gchar *digest, *records;
+  gsize offset;
+  guint n_records = 0;
+
+  digest = mousepad_journal_get_digest (TEST_BASE, strlen (TEST_BASE));
+  header = mousepad_journal_new_header (digest, FALSE, MOUSEPAD_EOL_UNIX);
+
+  /* any corrupted byte of a record stops the replay before it */
+  for (offset = 0; offset < fixture->records->len; offset++)
+    {
+      if (g_array_index (fixture->ends, gsize, n_records) == offset)
+        n_records++;
+
+      records = g_strndup (fixture->records->str, fixture->records->len);
+      records[offset] ^= 0x01;
+      write_journal (fixture->journal, g_bytes_get_data (header, NULL),
+                     records, fixture->records->len);
+      check_replay (fixture, digest, n_records);
+      g_free (records);
+    }
+
+  g_bytes_unref (header);
+  g_free (digest);
+}
+
+
+
+static void
+test_journal_version_1 (Fixture *fixture,
+                        gconstpointer data)
+{
+  MousepadLineEnding line_ending;
+  GBytes *header;
+  gchar *digest, *text;
+
+  digest = mousepad_journal_get_digest (TEST_BASE, strlen (TEST_BASE));
+
+  /* version 2 records the line ending mode of the base */
+  header = mousepad_journal_new_header (digest, FALSE, MOUSEPAD_EOL_MAC);
+  write_journal (fixture->journal, g_bytes_get_data (header, NULL), NULL, 0);
+  g_assert_true (mousepad_journal_get_line_ending (fixture->journal, digest, &line_ending));
+  g_assert_cmpint (line_ending, ==, MOUSEPAD_EOL_MAC);
+  g_bytes_unref (header);
+
+  /* version 1 doesn't, but its records are still replayed */
+  text = g_strdup_printf ("MOUSEPAD-JOURNAL 1 %s 0\n", digest);
+  write_journal (fixture->journal, text, fixture->records->str, fixture->records->len);
+  g_assert_false (mousepad_journal_get_line_ending (fixture->journal, digest, &line_ending));
+  check_replay (fixture, digest, fixture->ends->len);
+  g_free (text);
+
+  g_free (digest);
+}
+
+
+
+static void
+test_journal_line_ending (Fixture *fixture,
+                          gconstpointer data)
+{
+  struct
+  {
+    const gchar *base;
+    MousepadLineEnding line_ending;
+    gint offset;
+    const gchar *text;
+  } tests[] = {
+    /* a file in Unix mode containing CRLF sequences, which are not line endings */
+    { "a\r\nb\n", MOUSEPAD_EOL_UNIX, 3, "a\r\nXb\n" },
+    { "a\nb\r\n", MOUSEPAD_EOL_UNIX, 2, "a\nXb\r\n" },
+    { "a\r\nb\r\n", MOUSEPAD_EOL_DOS, 2, "a\nXb\n" },
+    { "a\rb\r", MOUSEPAD_EOL_MAC, 2, "a\nXb\n" },
+  };
+  MousepadJournal *journal;
+  MousepadFile *file;
+  GBytes *header, *records;
+  GError *error = NULL;
+  gchar *digest, *uri, *text;
+  guint n;
+
+  uri = g_file_get_uri (fixture->location);
+  for (n = 0; n < G_N_ELEMENTS (tests); n++)
+    {
+      /* an autosaved base and a journal inserting a character in it */
+      g_assert_true (g_file_replace_contents (fixture->location, tests[n].base,
+                                              strlen (tests[n].base), NULL, FALSE,
+                                              G_FILE_CREATE_NONE, NULL, NULL, NULL));
+      digest = mousepad_journal_get_digest (tests[n].base, strlen (tests[n].base));
+      header = mousepad_journal_new_header (digest, FALSE, tests[n].line_ending);
+      journal = mousepad_journal_new ();
+      mousepad_journal_insert (journal, tests[n].offset, "X", 1);
+      records = mousepad_journal_steal_records (journal);
+      write_journal (fixture->journal, g_bytes_get_data (header, NULL),
+                     g_bytes_get_data (records, NULL), g_bytes_get_size (records));
+
+      /* restore it, the base being loaded in the mode it was written in */
+      gtk_text_buffer_set_text (fixture->buffer, "", -1);
+      file = mousepad_file_new (fixture->buffer);
+      mousepad_file_set_location (file, fixture->location, MOUSEPAD_LOCATION_REAL);
+      mousepad_object_set_data (mousepad_file_get_location (file), "autosave-uri", uri);
+      g_assert_cmpint (mousepad_file_open (file, 0, 0, TRUE, FALSE, FALSE, &error), ==, 0);
+      g_assert_no_error (error);
+
+      g_object_get (fixture->buffer, "text", &text, NULL);
+      g_assert_cmpstr (text, ==, tests[n].text);
+      g_assert_cmpint (mousepad_file_get_line_ending (file), ==, tests[n].line_ending);
+
+      g_free (text);
+      g_object_unref (file);
+      g_bytes_unref (records);
+      mousepad_journal_free (journal);
+      g_bytes_unref (header);
+      g_free (digest);
+    }
+
+  g_free (uri);
+}
+
+
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  mousepad_settings_init ();
+
+  g_test_add ("/journal/replay", Fixture, NULL,
+              fixture_set_up, test_journal_replay, fixture_tear_down);
+  g_test_add ("/journal/obsolete", Fixture, NULL,
+              fixture_set_up, test_journal_obsolete, fixture_tear_down);
+  g_test_add ("/journal/torn-tail", Fixture, NULL,
+              fixture_set_up, test_journal_torn_tail, fixture_tear_down);
+  g_test_add ("/journal/checksum-mismatch", Fixture, NULL,
+              fixture_set_up, test_journal_checksum_mismatch, fixture_tear_down);
+  g_test_add ("/journal/version-1", Fixture, NULL,
+              fixture_set_up, test_journal_version_1, fixture_tear_down);
+  g_test_add ("/journal/line-ending", Fixture, NULL,
+              fixture_set_up, test_journal_line_ending, fixture_tear_down);
+
+  return g_test_run ();
+}
@@ -0,0 +1,342 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mousepad/mousepad-private.h"
+#include "mousepad/mousepad-scan.h"
+
+
+
+/* the contents are scanned by blocks of 16 or 32 bytes with SIMD instructions, and the
+ * remaining bytes one by one: tests are run at different alignments and with lengths
+ * around these sizes */
+#define MAX_ALIGNMENT 32
+#define MAX_LENGTH 200
+
+
+
+/* straightforward implementation of the scan, byte by byte */
+static void
+scan_reference (const gchar *contents,
+                gsize length,
+                MousepadScanResult *result)
+{
+  const gchar *end;
+  gsize n, line_start = 0;
+
+  memset (result, 0, sizeof (MousepadScanResult));
+
+  g_utf8_validate (contents, length, &end);
+  result->valid_length = end - contents;
+
+  for (n = 0; n < length; n++)
+    {
+      if (contents[n] != '\r' && contents[n] != '\n')
+        continue;
+
+      if (!result->has_eol)
+        {
+          result->has_eol = TRUE;
+          if (contents[n] == '\n')
+            result->first_eol = MOUSEPAD_EOL_UNIX;
+          else if (n + 1 < length && contents[n + 1] == '\n')
+            result->first_eol = MOUSEPAD_EOL_DOS;
+          else
+            result->first_eol = MOUSEPAD_EOL_MAC;
+        }
+
+      if (contents[n] == '\r' && n + 1 < length && contents[n + 1] == '\n')
+        result->n_crlf++;
+      else if (contents[n] == '\r')
+        result->n_cr++;
+      else if (n == 0 || contents[n - 1] != '\r')
+        result->n_lf++;
+
+      result->max_line_length = MAX (result->max_line_length, n - line_start);
+      line_start = n + 1;
+    }
+
+  result->max_line_length = MAX (result->max_line_length, length - line_start);
+  result->n_lines = result->n_cr + result->n_lf + result->n_crlf + 1;
+}
+
+
+
+static void
+check_scan (const gchar *contents,
+            gsize length)
+{
+  MousepadScanResult result, expected;
+  gchar *buffer;
+  gsize alignment;
+
+  scan_reference (contents, length, &expected);
+
+  buffer = g_malloc (length + MAX_ALIGNMENT);
+  for (alignment = 0; alignment < MAX_ALIGNMENT; alignment++)
+    {
+      memcpy (buffer + alignment, contents, length);
+      mousepad_scan_contents (buffer + alignment, length, &result);
+
+      g_assert_cmpuint (result.valid_length, ==, expected.valid_length);
+      g_assert_cmpint (result.has_eol, ==, expected.has_eol);
+      if (expected.has_eol)
+        g_assert_cmpint (result.first_eol, ==, expected.first_eol);
+
+      g_assert_cmpuint (result.n_cr, ==, expected.n_cr);
+      g_assert_cmpuint (result.n_lf, ==, expected.n_lf);
+      g_assert_cmpuint (result.n_crlf, ==, expected.n_crlf);
+      g_assert_cmpuint (result.n_lines, ==, expected.n_lines);
+      g_assert_cmpuint (result.max_line_length, ==, expected.max_line_length);
+    }
+
+  g_free (buffer);
+}
+
+
+
+static void
+test_scan_empty (void)
+{
+  MousepadScanResult result;
+
+  mousepad_scan_contents (NULL, 0, &result);
+
+  g_assert_cmpuint (result.valid_length, ==, 0);
+  g_assert_false (result.has_eol);
+  g_assert_cmpuint (result.n_lines, ==, 1);
+  g_assert_cmpuint (result.max_line_length, ==, 0);
+}
+
+
+
+static void
+test_scan_line_endings (void)
+{
+  MousepadScanResult result;
+  gchar contents[MAX_LENGTH];
+  gsize n;
+
+  mousepad_scan_contents ("a\nb\r\nc\rd", 8, &result);
+  g_assert_true (result.has_eol);
+  g_assert_cmpint (result.first_eol, ==, MOUSEPAD_EOL_UNIX);
+  g_assert_cmpuint (result.n_lf, ==, 1);
+  g_assert_cmpuint (result.n_crlf, ==, 1);
+  g_assert_cmpuint (result.n_cr, ==, 1);
+  g_assert_cmpuint (result.n_lines, ==, 4);
+
+  /* a final CR cannot be the start of a CRLF */
+  mousepad_scan_contents ("abc\r", 4, &result);
+  g_assert_cmpint (result.first_eol, ==, MOUSEPAD_EOL_MAC);
+  g_assert_cmpuint (result.n_cr, ==, 1);
+
+  /* CRLF pairs split at every possible block boundary */
+  for (n = 0; n + 1 < MAX_LENGTH; n++)
+    {
+      memset (contents, 'x', sizeof (contents));
+      contents[n] = '\r';
+      contents[n + 1] = '\n';
+      check_scan (contents, sizeof (contents));
+    }
+
+  /* lines of all lengths */
+  for (n = 1; n < MAX_LENGTH; n++)
+    {
+      memset (contents, 'x', sizeof (contents));
+      contents[n - 1] = '\n';
+      contents[MAX_LENGTH - n] = '\r';
+      check_scan (contents, sizeof (contents));
+    }
+}
+
+
+
+static void
+test_scan_utf8 (void)
+{
+  /* valid characters of all lengths, and invalid sequences g_utf8_validate() rejects */
+  const gchar *sequences[] = {
+    "\303\251", "\342\202\254", "\360\237\230\200", "\357\277\277", "\364\217\277\277",
+    "\300\200", "\301\277", "\340\200\200", "\355\240\200", "\360\200\200\200",
+    "\364\220\200\200", "\370\210\200\200\200", "\200", "\277", "\303", "\342\202",
+  };
+  gchar contents[MAX_LENGTH];
+  gsize n, offset, length;
+
+  /* each sequence at every offset, possibly truncated by the end of the contents */
+  for (n = 0; n < G_N_ELEMENTS (sequences); n++)
+    for (offset = 0; offset < 70; offset++)
+      {
+        length = strlen (sequences[n]);
+        memset (contents, 'x', sizeof (contents));
+        memcpy (contents + offset, sequences[n], length);
+        check_scan (contents, offset + length + 3);
+        check_scan (contents, offset + length);
+        check_scan (contents, offset + 1);
+      }
+
+  /* a nul character is not valid text */
+  memset (contents, 'x', sizeof (contents));
+  for (offset = 0; offset < 70; offset++)
+    {
+      contents[offset] = '\0';
+      check_scan (contents, sizeof (contents));
+      contents[offset] = 'x';
+    }
+}
+
+
+
+static void
+test_scan_random (void)
+{
+  /* mostly ASCII text, with line endings and a few multibyte or invalid sequences */
+  const gchar alphabet[] = "abc \t\r\n\r\n\303\251\342\202\254\360\237\230\200\377";
+  gchar contents[4 * MAX_LENGTH];
+  gsize length, n;
+  guint iteration;
+
+  for (iteration = 0; iteration < 2000; iteration++)
+    {
+      length = g_test_rand_int_range (0, sizeof (contents));
+      for (n = 0; n < length; n++)
+        contents[n] = alphabet[g_test_rand_int_range (0, sizeof (alphabet) - 1)];
+
+      /* valid contents most of the time, so that the whole scan is exercised */
+      if (g_test_rand_bit ())
+        for (n = 0; n < length; n++)
+          if (contents[n] & 0x80)
+            contents[n] = 'y';
+
+      check_scan (contents, length);
+    }
+}
+
+
+
+/* the loops the pre-scan replaced: g_utf8_validate(), then a search for the first line
+ * ending and, for files which are not Unix ones, a walk over every character to find the
+ * CRs, all of them in g_utf8_next_char() steps */
+static gsize
+scan_previous_loops (const gchar *contents,
+                     gsize length,
+                     MousepadLineEnding *line_ending)
+{
+  const gchar *n, *endc;
+  gsize n_cr = 0;
+
+  *line_ending = MOUSEPAD_EOL_UNIX;
+
+  g_utf8_validate (contents, length, &endc);
+
+  for (n = contents; n < endc; n = g_utf8_next_char (n))
+    {
+      if (G_LIKELY (*n == '\n'))
+        {
+          *line_ending = MOUSEPAD_EOL_UNIX;
+          break;
+        }
+      else if (*n == '\r')
+        {
+          n = g_utf8_next_char (n);
+          *line_ending = (*n == '\n') ? MOUSEPAD_EOL_DOS : MOUSEPAD_EOL_MAC;
+          break;
+        }
+    }
+
+  if (*line_ending != MOUSEPAD_EOL_UNIX)
+    for (n = contents; n < endc; n = g_utf8_next_char (n))
+      if (G_UNLIKELY (*n == '\r'))
+        n_cr++;
+
+  return n_cr;
+}
+
+
+
+static void
+test_scan_benchmark (void)
+{
+  const gchar *eols[] = { "\n", "\r\n" };
+  const gchar *line = "\tgtk_text_buffer_insert (buffer, &iter, \"caf\303\251\", -1); /* \342\202\254 */";
+  MousepadScanResult result;
+  MousepadLineEnding line_ending;
+  GString *contents;
+  gdouble scan_time, loops_time, elapsed;
+  gsize n_cr;
+  guint n, run;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("only run in perf mode");
+      return;
+    }
+
+  for (n = 0; n < G_N_ELEMENTS (eols); n++)
+    {
+      /* 64 MiB of mostly ASCII source code */
+      contents = g_string_new (NULL);
+      while (contents->len < 64 * 1024 * 1024)
+        {
+          g_string_append (contents, line);
+          g_string_append (contents, eols[n]);
+        }
+
+      /* best of a few runs, to leave the page faults of the first one out */
+      scan_time = loops_time = G_MAXDOUBLE;
+      for (run = 0; run < 5; run++)
+        {
+          g_test_timer_start ();
+          mousepad_scan_contents (contents->str, contents->len, &result);
+          elapsed = g_test_timer_elapsed ();
+          scan_time = MIN (scan_time, elapsed);
+
+          g_test_timer_start ();
+          n_cr = scan_previous_loops (contents->str, contents->len, &line_ending);
+          elapsed = g_test_timer_elapsed ();
+          loops_time = MIN (loops_time, elapsed);
+
+          /* both must agree, which also keeps their results alive */
+          g_assert_cmpuint (result.valid_length, ==, contents->len);
+          g_assert_cmpint (result.first_eol, ==, line_ending);
+          g_assert_cmpuint (result.n_cr + result.n_crlf, ==, n_cr);
+        }
+
+      g_test_minimized_result (scan_time, "%s pre-scan: %.1f ms, %.0f MiB/s",
+                               n == 0 ? "LF" : "CRLF", scan_time * 1000,
+                               contents->len / scan_time / (1024 * 1024));
+      g_test_message ("%s previous loops: %.1f ms, %.0f MiB/s",
+                      n == 0 ? "LF" : "CRLF", loops_time * 1000,
+                      contents->len / loops_time / (1024 * 1024));
+
+      g_string_free (contents, TRUE);
+    }
+}
+
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/scan/empty", test_scan_empty);
+  g_test_add_func ("/scan/line-endings", test_scan_line_endings);
+  g_test_add_func ("/scan/utf8", test_scan_utf8);
+  g_test_add_func ("/scan/random", test_scan_random);
+  g_test_add_func ("/scan/benchmark", test_scan_benchmark);
+
+  return g_test_run ();
+}
@@ -0,0 +1,1152 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mousepad/mousepad-private.h"
+#include "mousepad/mousepad-search.h"
+
+#include <gtksourceview/gtksource.h>
+
+
+
+/* literal searches test 16 or 32 positions at once with SIMD instructions, and the
+ * remaining positions one by one: patterns are searched at every position of texts with
+ * lengths around these sizes */
+#define MAX_ALIGNMENT 32
+#define MAX_PATTERN_LENGTH 70
+
+/* size of the chunks searched on their own thread */
+#define CHUNK_SIZE_MIN (1024 * 1024)
+
+/* number of compiled regexes kept for later searches */
+#define REGEX_CACHE_SIZE 16
+
+
+
+/* straightforward implementation of a literal search, position by position */
+static const gchar *
+find_reference (const gchar *text,
+                gsize length,
+                const gchar *from,
+                const gchar *pattern,
+                MousepadSearchOptions options)
+{
+  gsize pattern_length = strlen (pattern);
+  const gchar *p;
+
+  for (p = from; p + pattern_length <= text + length; p++)
+    if ((options & MOUSEPAD_SEARCH_CASE_SENSITIVE) ? strncmp (p, pattern, pattern_length) == 0
+                                                   : g_ascii_strncasecmp (p, pattern, pattern_length) == 0)
+      return p;
+
+  return NULL;
+}
+
+
+
+/* scalar loop of the literal search, as used before the SIMD kernels and still used for
+ * the last positions of a text, against which the kernels are measured */
+static const gchar *
+find_scalar (const gchar *text,
+             gsize length,
+             const gchar *pattern,
+             MousepadSearchOptions options)
+{
+  gsize pattern_length = strlen (pattern);
+  const gchar *p = text, *last = text + length - pattern_length, *match;
+  gchar first_fold = g_ascii_isalpha (pattern[0]) ? 0x20 : 0;
+
+  if (options & MOUSEPAD_SEARCH_CASE_SENSITIVE)
+    {
+      while (p <= last && (match = memchr (p, pattern[0], last - p + 1)) != NULL)
+        {
+          if (memcmp (match + 1, pattern + 1, pattern_length - 1) == 0)
+            return match;
+
+          p = match + 1;
+        }
+    }
+  else
+    {
+      for (; p <= last; p++)
+        if ((*p | first_fold) == pattern[0]
+            && g_ascii_strncasecmp (p + 1, pattern + 1, pattern_length - 1) == 0)
+          return p;
+    }
+
+  return NULL;
+}
+
+
+
+/* checks that all the matches are found as with find_reference(), and returns their number */
+static guint
+check_find (const gchar *text,
+            gsize length,
+            const gchar *pattern,
+            MousepadSearchOptions options)
+{
+  MousepadSearchPattern *compiled;
+  GError *error = NULL;
+  const gchar *p, *match, *match_end, *expected;
+  guint n_matches = 0;
+
+  compiled = mousepad_search_pattern_new (pattern, options, &error);
+  g_assert_no_error (error);
+
+  for (p = text;; p = match_end)
+    {
+      match = mousepad_search_pattern_find (compiled, text, length, p, 0, NULL, &match_end, &error);
+      g_assert_no_error (error);
+      expected = find_reference (text, length, p, pattern, options);
+      g_assert_true (match == expected);
+      if (match == NULL)
+        break;
+
+      g_assert_true (match_end == match + strlen (pattern));
+      n_matches++;
+    }
+
+  mousepad_search_pattern_free (compiled);
+
+  return n_matches;
+}
+
+
+
+static void
+async_ready (GObject *object,
+             GAsyncResult *result,
+             gpointer data)
+{
+  GAsyncResult **ret = data;
+
+  *ret = g_object_ref (result);
+}
+
+
+
+static MousepadSearchIndex *
+search (GBytes *text,
+        const gchar *pattern,
+        MousepadSearchOptions options,
+        GError **error)
+{
+  MousepadSearchIndex *index;
+  GAsyncResult *result = NULL;
+
+  mousepad_search_async (text, 0, -1, pattern, options, NULL, async_ready, &result);
+  while (result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  index = mousepad_search_finish (result, error);
+  g_object_unref (result);
+
+  return index;
+}
+
+
+
+/* checks that the index holds the character offsets of the matches of find_reference() */
+static void
+check_index (MousepadSearchIndex *index,
+             const gchar *text,
+             gsize length,
+             const gchar *pattern,
+             MousepadSearchOptions options)
+{
+  MousepadSearchMatch match;
+  const gchar *p, *expected;
+  gint offset = 0;
+  guint n = 0;
+
+  g_assert_cmpint (mousepad_search_index_get_n_chars (index), ==, g_utf8_strlen (text, length));
+
+  for (p = text; (expected = find_reference (text, length, p, pattern, options)) != NULL;
+       p = expected + strlen (pattern))
+    {
+      offset += g_utf8_strlen (p, expected - p);
+      g_assert_cmpuint (n, <, mousepad_search_index_get_n_matches (index));
+      mousepad_search_index_get_match (index, n++, &match);
+      g_assert_cmpint (match.start, ==, offset);
+      g_assert_cmpint (match.end, ==, offset + g_utf8_strlen (pattern, -1));
+      offset = match.end;
+    }
+
+  g_assert_cmpuint (n, ==, mousepad_search_index_get_n_matches (index));
+}
+
+
+
+static MousepadSearchIndex *
+refine (MousepadSearchIndex *index,
+        const gchar *pattern,
+        MousepadSearchOptions options,
+        GCancellable *cancellable,
+        GError **error)
+{
+  GAsyncResult *result = NULL;
+
+  mousepad_search_refine_async (index, pattern, options, cancellable, async_ready, &result);
+  while (result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  index = mousepad_search_finish (result, error);
+  g_object_unref (result);
+
+  return index;
+}
+
+
+
+/* checks that the index holds the character offsets of the non-empty matches of a
+ * sequential GRegex search, on bytes so that the whole text is not validated for each
+ * match: the patterns must match the same way in UTF-8 */
+static void
+check_regex_index (MousepadSearchIndex *index,
+                   const gchar *text,
+                   gsize length,
+                   const gchar *pattern)
+{
+  MousepadSearchMatch match;
+  GMatchInfo *info;
+  GRegex *regex;
+  GError *error = NULL;
+  gint start_pos, end_pos, last_pos = 0, offset = 0;
+  guint n = 0;
+
+  regex = g_regex_new (pattern, G_REGEX_MULTILINE | G_REGEX_RAW, 0, &error);
+  g_assert_no_error (error);
+
+  g_regex_match_full (regex, text, length, 0, 0, &info, &error);
+  for (; g_match_info_matches (info); g_match_info_next (info, &error))
+    {
+      g_match_info_fetch_pos (info, 0, &start_pos, &end_pos);
+      if (end_pos == start_pos)
+        continue;
+
+      offset += g_utf8_strlen (text + last_pos, start_pos - last_pos);
+      g_assert_cmpuint (n, <, mousepad_search_index_get_n_matches (index));
+      mousepad_search_index_get_match (index, n++, &match);
+      g_assert_cmpint (match.start, ==, offset);
+      offset += g_utf8_strlen (text + start_pos, end_pos - start_pos);
+      g_assert_cmpint (match.end, ==, offset);
+      last_pos = end_pos;
+    }
+
+  g_assert_no_error (error);
+  g_assert_cmpuint (n, ==, mousepad_search_index_get_n_matches (index));
+
+  g_match_info_free (info);
+  g_regex_unref (regex);
+}
+
+
+
+static MousepadSearchEdits *
+replace (GBytes *text,
+         gsize start,
+         gssize end,
+         const gchar *pattern,
+         MousepadSearchOptions options,
+         const gchar *replacement,
+         GError **error)
+{
+  MousepadSearchEdits *edits;
+  GAsyncResult *result = NULL;
+
+  mousepad_search_replace_async (text, start, end, pattern, options, replacement, NULL,
+                                 async_ready, &result);
+  while (result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  edits = mousepad_search_replace_finish (result, error);
+  g_object_unref (result);
+
+  return edits;
+}
+
+
+
+/* applies the edits to [start, end) in 'text' in reverse order, as the document does,
+ * checking that they are sorted and don't overlap */
+static gchar *
+apply_edits (const gchar *text,
+             gsize start,
+             gsize end,
+             MousepadSearchEdits *edits)
+{
+  MousepadSearchEdit *edit;
+  GString *result;
+  gsize edit_start, edit_end;
+  guint n;
+
+  result = g_string_new_len (text + start, end - start);
+  for (n = edits->edits->len; n > 0; n--)
+    {
+      edit = &g_array_index (edits->edits, MousepadSearchEdit, n - 1);
+      g_assert_cmpint (edit->start, <=, edit->end);
+      g_assert_cmpuint (edit->offset + edit->length, <=, edits->text->len);
+      if (n > 1)
+        g_assert_cmpint (g_array_index (edits->edits, MousepadSearchEdit, n - 2).end, <=, edit->start);
+
+      edit_start = g_utf8_offset_to_pointer (result->str, edit->start) - result->str;
+      edit_end = g_utf8_offset_to_pointer (result->str, edit->end) - result->str;
+      g_assert_cmpuint (edit_end, <=, result->len);
+      g_string_erase (result, edit_start, edit_end - edit_start);
+      g_string_insert_len (result, edit_start, edits->text->str + edit->offset, edit->length);
+    }
+
+  g_string_prepend_len (result, text, start);
+  g_string_append (result, text + end);
+
+  return g_string_free (result, FALSE);
+}
+
+
+
+/* straightforward implementation of a literal replace-all in [start, end) */
+static gchar *
+replace_reference (const gchar *text,
+                   gsize start,
+                   gsize end,
+                   const gchar *pattern,
+                   MousepadSearchOptions options,
+                   const gchar *replacement,
+                   guint *n_replaced)
+{
+  GString *result;
+  const gchar *p, *match;
+
+  result = g_string_new_len (text, start);
+  *n_replaced = 0;
+  for (p = text + start; (match = find_reference (text + start, end - start, p, pattern, options)) != NULL;
+       p = match + strlen (pattern))
+    {
+      g_string_append_len (result, p, match - p);
+      g_string_append (result, replacement);
+      (*n_replaced)++;
+    }
+
+  g_string_append (result, p);
+
+  return g_string_free (result, FALSE);
+}
+
+
+
+static void
+test_literal_positions (void)
+{
+  MousepadSearchOptions options[] = { MOUSEPAD_SEARCH_CASE_SENSITIVE, 0 };
+  gchar text[2 * MAX_ALIGNMENT + MAX_PATTERN_LENGTH], pattern[MAX_PATTERN_LENGTH + 1];
+  gsize length, pattern_length, n, i;
+  guint m;
+
+  /* every pattern length, around the block sizes, at every position of texts ending after
+   * the last full block or in it, its case being changed for case insensitive searches */
+  for (pattern_length = 1; pattern_length <= MAX_PATTERN_LENGTH; pattern_length++)
+    for (length = pattern_length; length <= pattern_length + 2 * MAX_ALIGNMENT; length++)
+      for (n = 0; n + pattern_length <= length; n++)
+        for (m = 0; m < G_N_ELEMENTS (options); m++)
+          {
+            for (i = 0; i < pattern_length; i++)
+              pattern[i] = 'a' + i % 26;
+
+            pattern[pattern_length] = '\0';
+            memset (text, '.', length);
+            for (i = 0; i < pattern_length; i++)
+              text[n + i] = (options[m] & MOUSEPAD_SEARCH_CASE_SENSITIVE) ? pattern[i] : pattern[i] - 0x20;
+
+            g_assert_cmpuint (check_find (text, length, pattern, options[m]), ==, 1);
+          }
+}
+
+
+
+static void
+test_literal_case_folding (void)
+{
+  struct
+  {
+    const gchar *text, *pattern;
+    guint n_matches;
+  } tests[] = {
+    /* letters are folded */
+    { "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxZABx", "zab", 1 },
+    { "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxzAbx", "ZaB", 1 },
+    /* but not the bytes which differ by the same bit */
+    { "{{{{{{{{{{{{{{{{{{{{{{{{{{{{{{{{[[[[[[[[", "[", 8 },
+    { "@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@````````", "@", 32 },
+    { "z[z[z[z[z[z[z[z[z[z[z[z[z[z[z[z[z[z[z[z[Z{", "z{", 1 },
+    /* nor UTF-8 bytes equal to an ASCII letter once folded, e.g. 0xC3 and 'c' */
+    { "ÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃÃc", "c", 1 },
+  };
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (tests); n++)
+    g_assert_cmpuint (check_find (tests[n].text, strlen (tests[n].text), tests[n].pattern, 0),
+                      ==, tests[n].n_matches);
+}
+
+
+
+static void
+test_literal_random (void)
+{
+  MousepadSearchOptions options;
+  const gchar *alphabet[] = { "a", "b", "A", "B", "\n", "é", "É" };
+  GString *text;
+  gchar *pattern;
+  gsize start, length;
+  guint n, m;
+
+  text = g_string_new (NULL);
+  for (n = 0; n < 2000; n++)
+    {
+      g_string_truncate (text, 0);
+      length = g_test_rand_int_range (1, 300);
+      for (m = 0; m < length; m++)
+        g_string_append (text, alphabet[g_test_rand_int_range (0, G_N_ELEMENTS (alphabet))]);
+
+      /* a pattern taken from the text or not, case folding beyond ASCII being done through
+       * a regex, hence other results than those of the reference */
+      do
+        {
+          start = g_test_rand_int_range (0, text->len + 1);
+          length = g_test_rand_int_range (1, 40);
+          pattern = g_strndup (text->str + start, length);
+          if (*pattern == '\0' || !g_utf8_validate (pattern, -1, NULL))
+            g_clear_pointer (&pattern, g_free);
+        }
+      while (pattern == NULL);
+
+      options = g_test_rand_bit () ? MOUSEPAD_SEARCH_CASE_SENSITIVE : 0;
+      if (!(options & MOUSEPAD_SEARCH_CASE_SENSITIVE) && !g_str_is_ascii (pattern))
+        options = MOUSEPAD_SEARCH_CASE_SENSITIVE;
+
+      check_find (text->str, text->len, pattern, options);
+      g_free (pattern);
+    }
+
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_literal_chunks (void)
+{
+  MousepadSearchIndex *index;
+  GError *error = NULL;
+  GBytes *bytes;
+  GString *text;
+  const gchar *patterns[] = { "aa", "aaa", "éa", "aé" };
+  guint n;
+
+  /* a text searched in several chunks, whose boundaries fall in runs of overlapping
+   * occurrences and in multibyte characters */
+  text = g_string_new (NULL);
+  while (text->len < 4 * CHUNK_SIZE_MIN + 1000)
+    {
+      g_string_append (text, "aaaaaaa");
+      g_string_append (text, (text->len % 3 == 0) ? "é" : "b");
+    }
+
+  bytes = g_bytes_new (text->str, text->len);
+  for (n = 0; n < G_N_ELEMENTS (patterns); n++)
+    {
+      index = search (bytes, patterns[n], MOUSEPAD_SEARCH_CASE_SENSITIVE, &error);
+      g_assert_no_error (error);
+      check_index (index, text->str, text->len, patterns[n], MOUSEPAD_SEARCH_CASE_SENSITIVE);
+      mousepad_search_index_free (index);
+    }
+
+  g_bytes_unref (bytes);
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_regex_chunks (void)
+{
+  MousepadSearchIndex *index;
+  GError *error = NULL;
+  GBytes *bytes;
+  GString *text;
+  const gchar *patterns[] = { "a+b", "^a{2}", "a$", "b\\na", "(?<=é)\\n?a+", "é\\n(?:a+\\n)+b" };
+  guint n;
+
+  /* a text searched in several chunks, aligned on lines, with matches at their start and
+   * end, and spanning lines */
+  text = g_string_new (NULL);
+  for (n = 0; text->len < 4 * CHUNK_SIZE_MIN + 1000; n++)
+    g_string_append (text, (n % 5 == 0) ? "aaaé\n" : (n % 3 == 0) ? "aaaaaaab\n" : "aa\n");
+
+  bytes = g_bytes_new (text->str, text->len);
+  for (n = 0; n < G_N_ELEMENTS (patterns); n++)
+    {
+      index = search (bytes, patterns[n], MOUSEPAD_SEARCH_REGEX | MOUSEPAD_SEARCH_CASE_SENSITIVE, &error);
+      g_assert_no_error (error);
+      check_regex_index (index, text->str, text->len, patterns[n]);
+      mousepad_search_index_free (index);
+    }
+
+  g_bytes_unref (bytes);
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_refine_can_refine (void)
+{
+  MousepadSearchIndex *index;
+  GError *error = NULL;
+  GBytes *bytes;
+
+  bytes = g_bytes_new_static ("abcabd aab AbC", 14);
+
+  /* the pattern must extend the previous one with the same options */
+  index = search (bytes, "ab", MOUSEPAD_SEARCH_CASE_SENSITIVE, &error);
+  g_assert_no_error (error);
+  g_assert_true (mousepad_search_index_can_refine (index, "ab", MOUSEPAD_SEARCH_CASE_SENSITIVE));
+  g_assert_true (mousepad_search_index_can_refine (index, "abc", MOUSEPAD_SEARCH_CASE_SENSITIVE));
+  g_assert_false (mousepad_search_index_can_refine (index, "a", MOUSEPAD_SEARCH_CASE_SENSITIVE));
+  g_assert_false (mousepad_search_index_can_refine (index, "Abc", MOUSEPAD_SEARCH_CASE_SENSITIVE));
+  g_assert_false (mousepad_search_index_can_refine (index, "abc", 0));
+  g_assert_false (mousepad_search_index_can_refine (index, "abc", MOUSEPAD_SEARCH_CASE_SENSITIVE
+                                                                 | MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES));
+  g_assert_false (mousepad_search_index_can_refine (index, "abc", MOUSEPAD_SEARCH_CASE_SENSITIVE
+                                                                 | MOUSEPAD_SEARCH_REGEX));
+  mousepad_search_index_free (index);
+
+  /* case insensitive searches beyond ASCII are regex searches */
+  index = search (bytes, "Ab", 0, &error);
+  g_assert_no_error (error);
+  g_assert_true (mousepad_search_index_can_refine (index, "aBc", 0));
+  g_assert_false (mousepad_search_index_can_refine (index, "abé", 0));
+  mousepad_search_index_free (index);
+
+  /* the occurrences of a pattern may overlap, in which case some of them are not indexed */
+  index = search (bytes, "aa", MOUSEPAD_SEARCH_CASE_SENSITIVE, &error);
+  g_assert_no_error (error);
+  g_assert_true (mousepad_search_index_can_refine (index, "aa", MOUSEPAD_SEARCH_CASE_SENSITIVE));
+  g_assert_false (mousepad_search_index_can_refine (index, "aab", MOUSEPAD_SEARCH_CASE_SENSITIVE));
+  mousepad_search_index_free (index);
+
+  /* regex searches can't be refined */
+  index = search (bytes, "ab", MOUSEPAD_SEARCH_CASE_SENSITIVE | MOUSEPAD_SEARCH_REGEX, &error);
+  g_assert_no_error (error);
+  g_assert_false (mousepad_search_index_can_refine (index, "abc", MOUSEPAD_SEARCH_CASE_SENSITIVE
+                                                                 | MOUSEPAD_SEARCH_REGEX));
+  mousepad_search_index_free (index);
+
+  g_bytes_unref (bytes);
+}
+
+
+
+static void
+test_refine_random (void)
+{
+  MousepadSearchIndex *index;
+  MousepadSearchOptions options;
+  GError *error = NULL;
+  GBytes *bytes;
+  GString *text;
+  const gchar *alphabet[] = { "a", "b", "A", "B", "\n", "é" };
+  gchar *pattern, *new_pattern;
+  gsize start, length;
+  guint n, m, n_refined = 0;
+
+  text = g_string_new (NULL);
+  for (n = 0; n < 2000; n++)
+    {
+      g_string_truncate (text, 0);
+      length = g_test_rand_int_range (1, 300);
+      for (m = 0; m < length; m++)
+        g_string_append (text, alphabet[g_test_rand_int_range (0, G_N_ELEMENTS (alphabet))]);
+
+      /* a pattern taken from the text, extended by what follows it there */
+      do
+        {
+          start = g_test_rand_int_range (0, text->len);
+          length = g_test_rand_int_range (1, 4);
+          pattern = g_strndup (text->str + start, length);
+          new_pattern = g_strndup (text->str + start, length + g_test_rand_int_range (0, 4));
+          if (!g_utf8_validate (new_pattern, -1, NULL) || !g_utf8_validate (pattern, -1, NULL))
+            {
+              g_clear_pointer (&pattern, g_free);
+              g_free (new_pattern);
+            }
+        }
+      while (pattern == NULL);
+
+      options = g_test_rand_bit () ? MOUSEPAD_SEARCH_CASE_SENSITIVE : 0;
+      if (!(options & MOUSEPAD_SEARCH_CASE_SENSITIVE) && !g_str_is_ascii (pattern))
+        options = MOUSEPAD_SEARCH_CASE_SENSITIVE;
+
+      /* the refined index is that of a new search */
+      bytes = g_bytes_new (text->str, text->len);
+      index = search (bytes, pattern, options, &error);
+      g_assert_no_error (error);
+      if (mousepad_search_index_can_refine (index, new_pattern, options))
+        {
+          index = refine (index, new_pattern, options, NULL, &error);
+          g_assert_no_error (error);
+          check_index (index, text->str, text->len, new_pattern, options);
+          n_refined++;
+        }
+
+      mousepad_search_index_free (index);
+      g_bytes_unref (bytes);
+      g_free (pattern);
+      g_free (new_pattern);
+    }
+
+  g_assert_cmpuint (n_refined, >, 0);
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_refine_chunks (void)
+{
+  MousepadSearchIndex *index;
+  GCancellable *cancellable;
+  GError *error = NULL;
+  GBytes *bytes;
+  GString *text;
+  const gchar *patterns[][2] = { { "a", "ab" }, { "a", "aé" }, { "é", "éa" }, { "b", "b" } };
+  guint n;
+
+  /* the matches of a search in several chunks */
+  text = g_string_new (NULL);
+  while (text->len < 4 * CHUNK_SIZE_MIN + 1000)
+    {
+      g_string_append (text, "aaaaaaa");
+      g_string_append (text, (text->len % 3 == 0) ? "é" : "b");
+    }
+
+  bytes = g_bytes_new (text->str, text->len);
+  for (n = 0; n < G_N_ELEMENTS (patterns); n++)
+    {
+      index = search (bytes, patterns[n][0], MOUSEPAD_SEARCH_CASE_SENSITIVE, &error);
+      g_assert_no_error (error);
+      g_assert_true (mousepad_search_index_can_refine (index, patterns[n][1], MOUSEPAD_SEARCH_CASE_SENSITIVE));
+      index = refine (index, patterns[n][1], MOUSEPAD_SEARCH_CASE_SENSITIVE, NULL, &error);
+      g_assert_no_error (error);
+      check_index (index, text->str, text->len, patterns[n][1], MOUSEPAD_SEARCH_CASE_SENSITIVE);
+
+      /* a refined index can be refined again */
+      g_assert_true (mousepad_search_index_can_refine (index, patterns[n][1], MOUSEPAD_SEARCH_CASE_SENSITIVE));
+      mousepad_search_index_free (index);
+    }
+
+  /* the previous index is freed with a cancelled refine operation */
+  index = search (bytes, "a", MOUSEPAD_SEARCH_CASE_SENSITIVE, &error);
+  g_assert_no_error (error);
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  g_assert_null (refine (index, "ab", MOUSEPAD_SEARCH_CASE_SENSITIVE, cancellable, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error (&error);
+
+  g_object_unref (cancellable);
+  g_bytes_unref (bytes);
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_replace_literal (void)
+{
+  MousepadSearchEdits *edits;
+  MousepadSearchOptions options[] = { MOUSEPAD_SEARCH_CASE_SENSITIVE, 0 };
+  GError *error = NULL;
+  GBytes *bytes;
+  GString *text;
+  gchar *result, *expected;
+  gsize start, end;
+  guint n, m, n_replaced;
+
+  text = g_string_new (NULL);
+  for (n = 0; n < 1000; n++)
+    g_string_append (text, (n % 7 == 0) ? "αβ ab\n" : (n % 3 == 0) ? "AbaB aab " : "ab");
+
+  /* in the whole text and in a range, on character boundaries, as if it were the whole text */
+  bytes = g_bytes_new (text->str, text->len);
+  for (n = 0; n < 2; n++)
+    for (m = 0; m < G_N_ELEMENTS (options); m++)
+      {
+        start = (n == 0) ? 0 : (gsize) (g_utf8_offset_to_pointer (text->str, 1001) - text->str);
+        end = (n == 0) ? text->len : (gsize) (g_utf8_offset_to_pointer (text->str, 2001) - text->str);
+
+        edits = replace (bytes, start, (n == 0) ? -1 : (gssize) end, "ab", options[m], "ÿ-", &error);
+        g_assert_no_error (error);
+
+        result = apply_edits (text->str, start, end, edits);
+        expected = replace_reference (text->str, start, end, "ab", options[m], "ÿ-", &n_replaced);
+        g_assert_cmpstr (result, ==, expected);
+        g_assert_cmpuint (edits->n_replaced, ==, n_replaced);
+
+        mousepad_search_edits_free (edits);
+        g_free (result);
+        g_free (expected);
+      }
+
+  g_bytes_unref (bytes);
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_replace_regex (void)
+{
+  MousepadSearchEdits *edits;
+  GError *error = NULL;
+  GRegex *regex;
+  GBytes *bytes;
+  GString *text;
+  gchar *result, *expected;
+  guint n;
+
+  text = g_string_new (NULL);
+  for (n = 0; n < 1000; n++)
+    g_string_append_printf (text, "%s%u@host%u\n", (n % 5 == 0) ? "élan " : "", n, n % 7);
+
+  /* with references, anchors and multibyte characters */
+  bytes = g_bytes_new (text->str, text->len);
+  edits = replace (bytes, 0, -1, "^(\\w*\\s)?(\\d+)@(\\w+)$", MOUSEPAD_SEARCH_REGEX, "\\3:\\2", &error);
+  g_assert_no_error (error);
+
+  regex = g_regex_new ("^(\\w*\\s)?(\\d+)@(\\w+)$", G_REGEX_MULTILINE | G_REGEX_CASELESS, 0, NULL);
+  expected = g_regex_replace (regex, text->str, -1, 0, "\\3:\\2", 0, NULL);
+  result = apply_edits (text->str, 0, text->len, edits);
+  g_assert_cmpstr (result, ==, expected);
+  g_assert_cmpuint (edits->n_replaced, ==, 1000);
+
+  mousepad_search_edits_free (edits);
+  g_regex_unref (regex);
+  g_free (result);
+  g_free (expected);
+
+  /* invalid replacements are reported */
+  g_assert_null (replace (bytes, 0, -1, "(\\d+)", MOUSEPAD_SEARCH_REGEX, "\\", &error));
+  g_assert_error (error, G_REGEX_ERROR, G_REGEX_ERROR_REPLACE);
+  g_clear_error (&error);
+
+  g_bytes_unref (bytes);
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_replace_coalescing (void)
+{
+  struct
+  {
+    gsize distance;
+    guint n_edits;
+  } tests[] = {
+    /* adjacent matches are replaced by a single edit */
+    { 0, 1 },
+    /* but the text between matches is left as is, however close they are */
+    { 1, 3 },
+    { 10, 3 },
+    { 4096, 3 },
+  };
+  MousepadSearchEdits *edits;
+  GError *error = NULL;
+  GBytes *bytes;
+  GString *text;
+  gchar *result, *expected;
+  gsize i;
+  guint n, m, n_replaced;
+
+  for (n = 0; n < G_N_ELEMENTS (tests); n++)
+    {
+      /* three matches at this distance */
+      text = g_string_new ("...");
+      for (m = 0; m < 3; m++)
+        {
+          g_string_append (text, "ab");
+          for (i = 0; m < 2 && i < tests[n].distance; i++)
+            g_string_append_c (text, '.');
+        }
+
+      g_string_append (text, "...");
+      bytes = g_bytes_new (text->str, text->len);
+      edits = replace (bytes, 0, -1, "ab", MOUSEPAD_SEARCH_CASE_SENSITIVE, "x", &error);
+      g_assert_no_error (error);
+      g_assert_cmpuint (edits->edits->len, ==, tests[n].n_edits);
+      g_assert_cmpuint (edits->n_replaced, ==, 3);
+
+      result = apply_edits (text->str, 0, text->len, edits);
+      expected = replace_reference (text->str, 0, text->len, "ab", MOUSEPAD_SEARCH_CASE_SENSITIVE, "x", &n_replaced);
+      g_assert_cmpstr (result, ==, expected);
+
+      mousepad_search_edits_free (edits);
+      g_bytes_unref (bytes);
+      g_string_free (text, TRUE);
+      g_free (result);
+      g_free (expected);
+    }
+
+  /* in large texts, there is one edit per run of adjacent matches */
+  text = g_string_new (NULL);
+  while (text->len < CHUNK_SIZE_MIN)
+    g_string_append (text, "abab............................................................");
+
+  bytes = g_bytes_new (text->str, text->len);
+  edits = replace (bytes, 0, -1, "ab", MOUSEPAD_SEARCH_CASE_SENSITIVE, "x", &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (edits->edits->len, ==, text->len / 64);
+  g_assert_cmpuint (edits->n_replaced, ==, 2 * text->len / 64);
+
+  mousepad_search_edits_free (edits);
+  g_bytes_unref (bytes);
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_literal_benchmark (void)
+{
+  MousepadSearchOptions options[] = { MOUSEPAD_SEARCH_CASE_SENSITIVE, 0 };
+  MousepadSearchPattern *compiled;
+  GError *error = NULL;
+  GString *text;
+  const gchar *pattern = "gtk_text_iter_forward_line", *match, *match_end, *expected;
+  gdouble find_time, scalar_time, elapsed;
+  guint n, run;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("only run in perf mode");
+      return;
+    }
+
+  /* 64 MiB of source code where the first pattern byte is frequent, with a single match
+   * at the end */
+  text = g_string_new (NULL);
+  while (text->len < 64 * 1024 * 1024)
+    g_string_append (text, "\tgtk_text_buffer_get_iter_at_offset (buffer, &iter, gtk_text_iter_get_offset (&start));\n");
+
+  g_string_append (text, pattern);
+
+  for (n = 0; n < G_N_ELEMENTS (options); n++)
+    {
+      compiled = mousepad_search_pattern_new (pattern, options[n], &error);
+      g_assert_no_error (error);
+
+      /* best of a few runs, to leave the page faults of the first one out */
+      find_time = scalar_time = G_MAXDOUBLE;
+      for (run = 0; run < 5; run++)
+        {
+          g_test_timer_start ();
+          match = mousepad_search_pattern_find (compiled, text->str, text->len, text->str, 0, NULL,
+                                                &match_end, &error);
+          elapsed = g_test_timer_elapsed ();
+          find_time = MIN (find_time, elapsed);
+          g_assert_no_error (error);
+
+          g_test_timer_start ();
+          expected = find_scalar (text->str, text->len, pattern, options[n]);
+          elapsed = g_test_timer_elapsed ();
+          scalar_time = MIN (scalar_time, elapsed);
+
+          /* both must agree, which also keeps their results alive */
+          g_assert_true (match == text->str + text->len - strlen (pattern));
+          g_assert_true (match == expected);
+        }
+
+      g_test_minimized_result (find_time, "%s search: %.1f ms, %.0f MiB/s",
+                               n == 0 ? "case sensitive" : "case insensitive", find_time * 1000,
+                               text->len / find_time / (1024 * 1024));
+      g_test_message ("%s scalar loop: %.1f ms, %.0f MiB/s",
+                      n == 0 ? "case sensitive" : "case insensitive", scalar_time * 1000,
+                      text->len / scalar_time / (1024 * 1024));
+
+      mousepad_search_pattern_free (compiled);
+    }
+
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_replace_benchmark (void)
+{
+  MousepadSearchEdits *edits;
+  GtkTextBuffer *buffer;
+  GtkTextIter start, end;
+  GError *error = NULL;
+  GBytes *bytes;
+  GString *text;
+  gchar *result, *expected;
+  gdouble replace_time, apply_time;
+  guint n, n_replaced;
+  gint delta;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("only run in perf mode");
+      return;
+    }
+
+  /* a million matches, one per line, in a buffer loaded as from a file */
+  text = g_string_new (NULL);
+  for (n = 0; n < 1000000; n++)
+    g_string_append (text, "\tn_items = g_list_length (list);\n");
+
+  buffer = GTK_TEXT_BUFFER (gtk_source_buffer_new (NULL));
+  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+  gtk_text_buffer_set_text (buffer, text->str, text->len);
+  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+
+  /* the edits are computed on a snapshot, then applied as a single user action, as the
+   * document does */
+  g_test_timer_start ();
+  bytes = g_bytes_new_static (text->str, text->len);
+  edits = replace (bytes, 0, -1, "g_list_length", MOUSEPAD_SEARCH_CASE_SENSITIVE, "g_slist_length", &error);
+  replace_time = g_test_timer_elapsed ();
+  g_assert_no_error (error);
+  g_assert_cmpuint (edits->n_replaced, ==, 1000000);
+
+  g_test_timer_start ();
+  gtk_text_buffer_begin_user_action (buffer);
+  delta = mousepad_search_edits_apply (edits, buffer, 0);
+  gtk_text_buffer_end_user_action (buffer);
+  apply_time = g_test_timer_elapsed ();
+  g_assert_cmpint (delta, ==, 1000000);
+
+  gtk_text_buffer_get_bounds (buffer, &start, &end);
+  result = gtk_text_buffer_get_text (buffer, &start, &end, TRUE);
+  expected = replace_reference (text->str, 0, text->len, "g_list_length", MOUSEPAD_SEARCH_CASE_SENSITIVE,
+                                "g_slist_length", &n_replaced);
+  g_assert_cmpstr (result, ==, expected);
+
+  g_test_minimized_result (replace_time + apply_time, "a million replacements: %.1f ms",
+                           (replace_time + apply_time) * 1000);
+  g_test_message ("search: %.1f ms, buffer edits: %.1f ms", replace_time * 1000, apply_time * 1000);
+
+  /* the target of the replace engine */
+  g_assert_cmpfloat (replace_time + apply_time, <, 1.0);
+
+  mousepad_search_edits_free (edits);
+  g_bytes_unref (bytes);
+  g_object_unref (buffer);
+  g_string_free (text, TRUE);
+  g_free (result);
+  g_free (expected);
+}
+
+
+
+static void
+test_pattern_interrupted (void)
+{
+  MousepadSearchPattern *pattern;
+  GCancellable *cancellable;
+  GError *error = NULL;
+  GString *text;
+  const gchar *match, *match_end;
+  gsize n;
+
+  /* a match far from the start, beyond several search windows */
+  text = g_string_new (NULL);
+  for (n = 0; n < 3 * 64 * 1024; n++)
+    g_string_append_c (text, (n % 80 == 79) ? '\n' : 'a');
+
+  g_string_append (text, "\nbc\n");
+
+  /* regex searches are given up past their deadline, unlike literal ones */
+  pattern = mousepad_search_pattern_new ("^b", MOUSEPAD_SEARCH_REGEX, &error);
+  g_assert_no_error (error);
+  match = mousepad_search_pattern_find (pattern, text->str, text->len, text->str, 0, NULL,
+                                        &match_end, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == text->str + text->len - 3);
+  g_assert_true (match_end == match + 1);
+
+  match = mousepad_search_pattern_find (pattern, text->str, text->len, text->str, 1, NULL,
+                                        &match_end, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+  g_assert_null (match);
+  g_clear_error (&error);
+  mousepad_search_pattern_free (pattern);
+
+  pattern = mousepad_search_pattern_new ("b", MOUSEPAD_SEARCH_CASE_SENSITIVE, &error);
+  g_assert_no_error (error);
+  match = mousepad_search_pattern_find (pattern, text->str, text->len, text->str, 1, NULL,
+                                        &match_end, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == text->str + text->len - 3);
+
+  /* so are cancelled searches */
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  match = mousepad_search_pattern_find (pattern, text->str, text->len, text->str, 0, cancellable,
+                                        &match_end, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (match);
+  g_clear_error (&error);
+  mousepad_search_pattern_free (pattern);
+
+  g_object_unref (cancellable);
+  g_string_free (text, TRUE);
+}
+
+
+
+static void
+test_pattern_pathological (void)
+{
+  MousepadSearchOptions regex = MOUSEPAD_SEARCH_REGEX,
+                        regex_case = MOUSEPAD_SEARCH_REGEX | MOUSEPAD_SEARCH_CASE_SENSITIVE;
+
+  /* nested repetitions */
+  g_assert_true (mousepad_search_is_pathological ("(a+)+", regex_case));
+  g_assert_true (mousepad_search_is_pathological ("(\\w+\\s?)*", regex_case));
+  g_assert_false (mousepad_search_is_pathological ("(a+)+", MOUSEPAD_SEARCH_CASE_SENSITIVE));
+  g_assert_false (mousepad_search_is_pathological ("(ab)+", regex_case));
+  g_assert_false (mousepad_search_is_pathological ("(?>a+)+", regex_case));
+
+  /* overlapping alternatives, depending on case */
+  g_assert_true (mousepad_search_is_pathological ("(a|ab)*", regex_case));
+  g_assert_false (mousepad_search_is_pathological ("(a|b)*", regex_case));
+  g_assert_false (mousepad_search_is_pathological ("(a|A)*", regex_case));
+  g_assert_true (mousepad_search_is_pathological ("(a|A)*", regex));
+  g_assert_false (mousepad_search_is_pathological ("(a|b)*", regex));
+}
+
+
+
+static void
+check_regex_cache (const gchar *pattern,
+                   MousepadSearchOptions options,
+                   gboolean cached)
+{
+  MousepadSearchPattern *compiled;
+  GError *error = NULL;
+  guint hits, misses, new_hits, new_misses;
+
+  mousepad_search_get_regex_cache_stats (&hits, &misses);
+  compiled = mousepad_search_pattern_new (pattern, options | MOUSEPAD_SEARCH_REGEX, &error);
+  g_assert_no_error (error);
+  mousepad_search_get_regex_cache_stats (&new_hits, &new_misses);
+
+  g_assert_cmpuint (new_hits, ==, hits + (cached ? 1 : 0));
+  g_assert_cmpuint (new_misses, ==, misses + (cached ? 0 : 1));
+
+  mousepad_search_pattern_free (compiled);
+}
+
+
+
+static void
+test_regex_cache (void)
+{
+  MousepadSearchPattern *compiled;
+  GError *error = NULL;
+  const gchar *match, *match_end;
+  gchar *pattern;
+  guint n, misses, new_misses;
+
+  mousepad_search_clear_regex_cache ();
+
+  /* regexes are cached by pattern and compile flags */
+  check_regex_cache ("a+b", 0, FALSE);
+  check_regex_cache ("a+b", 0, TRUE);
+  check_regex_cache ("a+b", MOUSEPAD_SEARCH_CASE_SENSITIVE, FALSE);
+  check_regex_cache ("a+b", MOUSEPAD_SEARCH_AT_WORD_BOUNDARIES, FALSE);
+  check_regex_cache ("a+b", MOUSEPAD_SEARCH_CASE_SENSITIVE, TRUE);
+
+  /* the least recently used regex is dropped when the cache is full */
+  mousepad_search_clear_regex_cache ();
+  for (n = 0; n < REGEX_CACHE_SIZE; n++)
+    {
+      pattern = g_strdup_printf ("x%u", n);
+      check_regex_cache (pattern, 0, FALSE);
+      g_free (pattern);
+    }
+
+  check_regex_cache ("x0", 0, TRUE);
+  check_regex_cache ("y", 0, FALSE);
+  check_regex_cache ("x1", 0, FALSE);
+  check_regex_cache ("x0", 0, TRUE);
+
+  /* invalid regexes are not cached */
+  mousepad_search_get_regex_cache_stats (NULL, &misses);
+  for (n = 0; n < 2; n++)
+    {
+      g_assert_null (mousepad_search_pattern_new ("(", MOUSEPAD_SEARCH_REGEX, &error));
+      g_assert_error (error, G_REGEX_ERROR, G_REGEX_ERROR_UNMATCHED_PARENTHESIS);
+      g_clear_error (&error);
+    }
+
+  mousepad_search_get_regex_cache_stats (NULL, &new_misses);
+  g_assert_cmpuint (new_misses, ==, misses + 2);
+
+  /* the patterns compiled before the cache is cleared remain usable */
+  compiled = mousepad_search_pattern_new ("a+b", MOUSEPAD_SEARCH_REGEX, &error);
+  g_assert_no_error (error);
+  mousepad_search_clear_regex_cache ();
+  match = mousepad_search_pattern_find (compiled, "xaab", 4, "xaab", 0, NULL, &match_end, &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (match, ==, "aab");
+  g_assert_true (match_end == match + 3);
+  mousepad_search_pattern_free (compiled);
+
+  check_regex_cache ("a+b", 0, FALSE);
+  mousepad_search_clear_regex_cache ();
+}
+
+
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/search/literal/positions", test_literal_positions);
+  g_test_add_func ("/search/literal/case-folding", test_literal_case_folding);
+  g_test_add_func ("/search/literal/random", test_literal_random);
+  g_test_add_func ("/search/literal/chunks", test_literal_chunks);
+  g_test_add_func ("/search/benchmark/literal", test_literal_benchmark);
+  g_test_add_func ("/search/pattern/interrupted", test_pattern_interrupted);
+  g_test_add_func ("/search/pattern/pathological", test_pattern_pathological);
+  g_test_add_func ("/search/regex/chunks", test_regex_chunks);
+  g_test_add_func ("/search/regex/cache", test_regex_cache);
+  g_test_add_func ("/search/refine/can-refine", test_refine_can_refine);
+  g_test_add_func ("/search/refine/random", test_refine_random);
+  g_test_add_func ("/search/refine/chunks", test_refine_chunks);
+  g_test_add_func ("/search/replace/literal", test_replace_literal);
+  g_test_add_func ("/search/replace/regex", test_replace_regex);
+  g_test_add_func ("/search/replace/coalescing", test_replace_coalescing);
+  g_test_add_func ("/search/benchmark/replace", test_replace_benchmark);
+
+  return g_test_run ();
+}